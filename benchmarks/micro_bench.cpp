@@ -0,0 +1,221 @@
+// Micro benchmarks of the hot router components, each measured alone.
+//
+// Results are written to micro_bench.json (Google Benchmark JSON format) next
+// to the console output, unless --benchmark_out is given. Comparing two JSON
+// files, e.g. with compare.py of Google Benchmark, shows regressions between
+// releases.
+//
+// Usage:
+//   ISC-MicroBench [--benchmark_filter=<regex>] [--benchmark_out=<file>]
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "message.h"
+#include "outbox.h"
+#include "router_core.h"
+#include "sessions.h"
+#include "signaling_queue.h"
+#include "tcpserver.h"
+
+#define FRAMES_COUNT 1024
+#define QUEUE_ITEMS 100000
+#define SESSIONS_COUNT 256
+/// Socket numbers of benchmark sessions, never open descriptors.
+#define FAKE_SOCKET_BASE 1000000
+/// Lookups between two add/remove of each thread.
+#define CHURN_PERIOD 64
+
+/**
+ * @brief Frames with varying source and destination IDs.
+ */
+static std::vector<std::string> make_frames() {
+  std::vector<std::string> frames;
+  frames.reserve(FRAMES_COUNT);
+  char frame[DATA_MESSAGE_SIZE + 1];
+  for (int i = 0; i < FRAMES_COUNT; i++) {
+    std::snprintf(frame, sizeof(frame), "%03d2200%06d1111111111111111%03d",
+                  i % 999, i, (i * 7) % 999);
+    frames.emplace_back(frame, DATA_MESSAGE_SIZE);
+  }
+  return frames;
+}
+
+static void BM_ExtractDstId(benchmark::State& state) {
+  auto frames = make_frames();
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& frame = frames[i++ % FRAMES_COUNT];
+    benchmark::DoNotOptimize(
+        Message::extract_dst_id(frame.data(), DATA_MESSAGE_SIZE));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ExtractDstId);
+
+/**
+ * @brief Packs and unpacks frames, the router transcodes each frame between nodes of different encodings.
+ */
+static void BM_FrameCodec(benchmark::State& state) {
+  auto frames = make_frames();
+  char packed[COMPACT_MESSAGE_SIZE]{};
+  char ascii[DATA_MESSAGE_SIZE];
+  size_t i = 0;
+  for (auto _ : state) {
+    const std::string& frame = frames[i++ % FRAMES_COUNT];
+    benchmark::DoNotOptimize(FrameCodec::pack(frame.data(), packed));
+    FrameCodec::unpack(packed, ascii);
+    benchmark::DoNotOptimize(ascii);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FrameCodec);
+
+/**
+ * @brief Moves QUEUE_ITEMS items from range(0) producers to range(1) consumers.
+ */
+static void BM_SignalingQueue(benchmark::State& state) {
+  int producers = static_cast<int>(state.range(0));
+  int consumers = static_cast<int>(state.range(1));
+  for (auto _ : state) {
+    SignalingQueue<int> queue;
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+      threads.emplace_back([&queue]() {
+        // -1 ends a consumer
+        while (queue.pop() != -1) {
+        }
+      });
+    }
+    std::vector<std::thread> producer_threads;
+    for (int p = 0; p < producers; p++) {
+      producer_threads.emplace_back([&queue, producers, p]() {
+        for (int i = p; i < QUEUE_ITEMS; i += producers) queue.push(i);
+      });
+    }
+    for (auto& thread : producer_threads) thread.join();
+    for (int c = 0; c < consumers; c++) queue.push(-1);
+    for (auto& thread : threads) thread.join();
+  }
+  state.SetItemsProcessed(state.iterations() * QUEUE_ITEMS);
+}
+BENCHMARK(BM_SignalingQueue)
+    ->ArgNames({"producers", "consumers"})
+    ->ArgsProduct({{1, 2, 4}, {1, 2, 4}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static RouterCore sessions_core;
+static std::once_flag sessions_once;
+
+/**
+ * @brief Session lookups by socket, each thread also adds and removes a node session every CHURN_PERIOD lookups.
+ */
+static void BM_SessionsLookup(benchmark::State& state) {
+  std::call_once(sessions_once, []() {
+    Sessions::init_sessions(
+        MAX_CLIENTS_COUNT, &sessions_core,
+        [](const std::shared_ptr<Session>&, const char*, int) { return true; });
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+      Sessions::accept_client(FAKE_SOCKET_BASE + i);
+      Sessions::add_node(FAKE_SOCKET_BASE + i, i);
+    }
+  });
+  int churn_socket = FAKE_SOCKET_BASE + SESSIONS_COUNT + state.thread_index();
+  int churn_id = SESSIONS_COUNT + state.thread_index();
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        Sessions::find_session_by_socket(FAKE_SOCKET_BASE + i % SESSIONS_COUNT));
+    if (++i % CHURN_PERIOD == 0) {
+      Sessions::accept_client(churn_socket);
+      Sessions::add_node(churn_socket, churn_id);
+      Sessions::removeSession(churn_socket);
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SessionsLookup)->ThreadRange(1, 8)->UseRealTime();
+
+/**
+ * @brief Flushes range(0) frames with one send_some() and reads them with read_async() over a socket pair.
+ *
+ * Frames are contiguous like the ones a write task takes from an outbox, the
+ * largest batch is a full flush of FLUSH_MAX_BYTES.
+ */
+static void BM_TcpServerSendSome(benchmark::State& state) {
+#ifdef _WIN32
+  state.SkipWithError("socketpair is not available");
+#else
+  int batch = static_cast<int>(state.range(0));
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+    state.SkipWithError("socketpair failed");
+    return;
+  }
+  TcpServer::set_client_socket_nonblocking(fds[0]);
+  TcpServer::set_client_socket_nonblocking(fds[1]);
+  auto frames = make_frames();
+  std::string flush;
+  flush.reserve(DATA_MESSAGE_SIZE * batch);
+  for (int b = 0; b < batch; b++) flush += frames[b % FRAMES_COUNT];
+  int len = static_cast<int>(flush.size());
+  std::vector<char> buffer(len);
+  for (auto _ : state) {
+    // a flush larger than the socket buffer goes out as the reader drains it
+    int sent = 0;
+    int received = 0;
+    while (received < len) {
+      if (sent < len) {
+        int count = TcpServer::send_some(fds[0], flush.data() + sent, len - sent);
+        if (count == SOCKET_ERROR) break;
+        sent += count;
+      }
+      int count = TcpServer::read_async(fds[1], buffer.data(), len - received);
+      if (count < 0) break;
+      received += count;
+    }
+    if (received != len) {
+      state.SkipWithError("socket error");
+      break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batch);
+  state.SetBytesProcessed(state.iterations() * len);
+  TcpServer::close_socket(fds[0]);
+  TcpServer::close_socket(fds[1]);
+#endif
+}
+BENCHMARK(BM_TcpServerSendSome)
+    ->ArgName("frames")
+    ->Arg(1)
+    ->Arg(16)
+    ->Arg(64)
+    ->Arg(FLUSH_MAX_BYTES / DATA_MESSAGE_SIZE);
+
+int main(int argc, char** argv) {
+  // JSON results by default, console output stays readable
+  std::vector<char*> args(argv, argv + argc);
+  bool has_out = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--benchmark_out=", 16) == 0) has_out = true;
+  }
+  char out[] = "--benchmark_out=micro_bench.json";
+  char out_format[] = "--benchmark_out_format=json";
+  if (!has_out) {
+    args.push_back(out);
+    args.push_back(out_format);
+  }
+  int args_count = static_cast<int>(args.size());
+  benchmark::Initialize(&args_count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(args_count, args.data())) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,47 @@
+// Micro benchmarks of node message handling.
+//
+// A separate executable from ISC-MicroBench, the node and the router each
+// define their own Message class. Results are written to
+// node_micro_bench.json unless --benchmark_out is given.
+//
+// Usage:
+//   ISC-NodeMicroBench [--benchmark_filter=<regex>] [--benchmark_out=<file>]
+
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "message.h"
+
+static void BM_ProcessMessage(benchmark::State& state) {
+  // reply path of a node: parse, bump MTI, swap IDs
+  std::string frame = Message::buildFirstMessage(5, 3);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(Message::processMessage(3, frame.data(), MSG_LEN));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProcessMessage);
+
+int main(int argc, char** argv) {
+  // JSON results by default, console output stays readable
+  std::vector<char*> args(argv, argv + argc);
+  bool has_out = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strncmp(argv[i], "--benchmark_out=", 16) == 0) has_out = true;
+  }
+  char out[] = "--benchmark_out=node_micro_bench.json";
+  char out_format[] = "--benchmark_out_format=json";
+  if (!has_out) {
+    args.push_back(out);
+    args.push_back(out_format);
+  }
+  int args_count = static_cast<int>(args.size());
+  benchmark::Initialize(&args_count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(args_count, args.data())) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,223 @@
+// Round-trip time benchmark of the router.
+//
+// Two clients connect to the router as nodes, the pinger sends a frame to the
+// ponger and the ponger sends it back, each round trip is timed and p50/p99/
+// p999 are printed. With --spawn the router binary is started twice, once in
+// default mode and once with --low-latency on, and both results are printed.
+//
+// Usage:
+//   ISC-RttBench <router_ip> <router_port> [samples] [--low-latency]
+//   ISC-RttBench --spawn <router_binary> <port> [samples]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+int main() {
+  std::printf("ISC-RttBench is not supported on this platform.\n");
+  return 1;
+}
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FRAME_SIZE 32
+#define PINGER_ID 101
+#define PONGER_ID 102
+#define DEFAULT_SAMPLES 20000
+#define WARMUP_SAMPLES 1000
+#define ROUTER_START_RETRIES 50
+
+/**
+ * @brief Connects to the router and sends the 3 byte node ID.
+ * @return Socket descriptor, -1 on failure.
+ */
+static int connect_node(const std::string& ip, int port, int node_id,
+                        bool low_latency) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) return -1;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  if (low_latency) {
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+#ifdef __linux__
+    setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+#endif
+  }
+  char id[4];
+  std::snprintf(id, sizeof(id), "%03d", node_id);
+  if (send(fd, id, 3, 0) != 3) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Receives exactly len bytes.
+ * @return false if connection is closed or failed.
+ */
+static bool recv_all(int fd, char* buf, int len) {
+  int total = 0;
+  while (total < len) {
+    int n = recv(fd, buf + total, len - total, 0);
+    if (n <= 0) return false;
+    total += n;
+  }
+  return true;
+}
+
+/**
+ * @brief Builds a frame from src to dst, "%03d" src, 26 digits MTI and payload, "%03d" dst.
+ */
+static void build_frame(char* frame, int src, int dst, long sequence) {
+  char text[FRAME_SIZE + 1];
+  std::snprintf(text, sizeof(text), "%03d0200%022ld%03d", src,
+                sequence, dst);
+  std::memcpy(frame, text, FRAME_SIZE);
+}
+
+/**
+ * @brief Runs ping-pong rounds through the router.
+ * @return Round trip times in nanoseconds, empty on failure.
+ */
+static std::vector<long> run_rounds(const std::string& ip, int port,
+                                    int samples, bool low_latency) {
+  std::vector<long> rtts;
+  int ponger = connect_node(ip, port, PONGER_ID, low_latency);
+  int pinger = connect_node(ip, port, PINGER_ID, low_latency);
+  if (ponger == -1 || pinger == -1) {
+    std::printf("Cannot connect to router %s:%d\n", ip.c_str(), port);
+    if (ponger != -1) close(ponger);
+    if (pinger != -1) close(pinger);
+    return rtts;
+  }
+  // let the router register both handshakes before first frame
+  usleep(200 * 1000);
+
+  rtts.reserve(samples);
+  char frame[FRAME_SIZE];
+  bool ok = true;
+  for (long i = 0; i < samples + WARMUP_SAMPLES && ok; i++) {
+    build_frame(frame, PINGER_ID, PONGER_ID, i);
+    auto start = std::chrono::steady_clock::now();
+    ok = send(pinger, frame, FRAME_SIZE, 0) == FRAME_SIZE &&
+         recv_all(ponger, frame, FRAME_SIZE);
+    build_frame(frame, PONGER_ID, PINGER_ID, i);
+    ok = ok && send(ponger, frame, FRAME_SIZE, 0) == FRAME_SIZE &&
+         recv_all(pinger, frame, FRAME_SIZE);
+#ifdef __linux__
+    if (low_latency) {
+      // delayed ACK comes back after some segments, re-arm it
+      int enable = 1;
+      setsockopt(pinger, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+      setsockopt(ponger, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+    }
+#endif
+    auto end = std::chrono::steady_clock::now();
+    if (ok && i >= WARMUP_SAMPLES) {
+      rtts.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+              .count());
+    }
+  }
+  close(pinger);
+  close(ponger);
+  if (!ok) {
+    std::printf("Connection to router lost after %zu samples.\n", rtts.size());
+    rtts.clear();
+  }
+  return rtts;
+}
+
+/**
+ * @brief Prints percentiles of round trip times in microseconds.
+ */
+static void report(const char* mode, std::vector<long> rtts) {
+  if (rtts.empty()) return;
+  std::sort(rtts.begin(), rtts.end());
+  auto percentile = [&rtts](double p) {
+    size_t index = static_cast<size_t>(p * (rtts.size() - 1));
+    return rtts[index] / 1000.0;
+  };
+  std::printf("%-12s samples=%zu p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n",
+              mode, rtts.size(), percentile(0.50), percentile(0.99),
+              percentile(0.999), rtts.back() / 1000.0);
+}
+
+/**
+ * @brief Starts router binary, runs rounds against it and stops it.
+ */
+static std::vector<long> run_spawned(const std::string& router, int port,
+                                     int samples, bool low_latency) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    std::string port_arg = std::to_string(port);
+    const char* mode = low_latency ? "on" : "off";
+    execl(router.c_str(), router.c_str(), port_arg.c_str(), "--low-latency",
+          mode, (char*)nullptr);
+    _exit(127);
+  }
+  std::vector<long> rtts;
+  for (int i = 0; i < ROUTER_START_RETRIES && rtts.empty(); i++) {
+    usleep(100 * 1000);
+    int probe = connect_node("127.0.0.1", port, PONGER_ID, false);
+    if (probe == -1) continue;
+    close(probe);
+    rtts = run_rounds("127.0.0.1", port, samples, low_latency);
+    break;
+  }
+  kill(pid, SIGTERM);
+  waitpid(pid, nullptr, 0);
+  return rtts;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc >= 4 && std::string(argv[1]) == "--spawn") {
+    std::string router = argv[2];
+    int port = std::stoi(argv[3]);
+    int samples = argc > 4 ? std::stoi(argv[4]) : DEFAULT_SAMPLES;
+    report("default", run_spawned(router, port, samples, false));
+    // next port, previous connections may linger in TIME_WAIT
+    report("low-latency", run_spawned(router, port + 1, samples, true));
+    return 0;
+  }
+  if (argc < 3) {
+    std::printf(
+        "Usage: ISC-RttBench <router_ip> <router_port> [samples] "
+        "[--low-latency]\n"
+        "       ISC-RttBench --spawn <router_binary> <port> [samples]\n");
+    return 1;
+  }
+  std::string ip = argv[1];
+  int port = std::stoi(argv[2]);
+  int samples = DEFAULT_SAMPLES;
+  bool low_latency = false;
+  for (int i = 3; i < argc; i++) {
+    if (std::string(argv[i]) == "--low-latency") {
+      low_latency = true;
+    } else {
+      samples = std::stoi(argv[i]);
+    }
+  }
+  auto rtts = run_rounds(ip, port, samples, low_latency);
+  report(low_latency ? "low-latency" : "default", rtts);
+  return rtts.empty() ? 1 : 0;
+}
+#endif  // _WIN32
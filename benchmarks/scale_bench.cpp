@@ -0,0 +1,468 @@
+// End-to-end scaling benchmark of the router.
+//
+// For each combination of node count and router thread count the router
+// binary is started on loopback and half of the nodes ping the other half
+// through it, each pinger keeping a window of frames in flight. After a warmup
+// the router throughput (frames routed per second), round trip time
+// percentiles, router CPU time per frame and router RSS are measured. Results
+// are printed, written as JSON, and checked against a baseline file; the exit
+// code is 1 if a result is below its baseline or a run failed, so ctest can
+// run it.
+//
+// The router multiplexes its sockets with select(), node counts are capped at
+// SCALE_MAX_NODES so every descriptor fits in an fd_set.
+//
+// Usage:
+//   ISC-ScaleBench --spawn <router_binary> <port> [--nodes 10,100,1000]
+//       [--threads 2,4] [--seconds 3] [--window 4] [--baseline <file>]
+//       [--out scale_results.json]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+int main() {
+  std::printf("ISC-ScaleBench is not supported on this platform.\n");
+  return 1;
+}
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FRAME_SIZE 32
+#define ROUTER_START_RETRIES 50
+/// Router and benchmark descriptors besides the nodes, e.g. listener and log file.
+#define RESERVED_FDS 64
+#define SCALE_MAX_NODES (FD_SETSIZE - RESERVED_FDS)
+#define MAX_WINDOW 64
+#define WARMUP_MS 500
+/// A frame without reply for this long is counted lost and sent again.
+#define RESEND_MS 1000
+#define POLL_TIMEOUT_MS 100
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Connection of one simulated node.
+ */
+struct SimNode {
+  int fd = -1;
+  int id = 0;
+  int peer = 0;
+  bool pinger = false;
+  char rx[FRAME_SIZE * MAX_WINDOW];
+  int rx_len = 0;
+  long sends = 0;
+  long slot_sequence[MAX_WINDOW];      ///< sequence in flight per window slot
+  Clock::time_point slot_sent[MAX_WINDOW];
+};
+
+/**
+ * @brief Results of one node count and thread count combination.
+ */
+struct ScaleResult {
+  int nodes = 0;
+  int threads = 0;
+  bool ok = false;
+  double msgs_per_sec = 0;
+  double p50_us = 0, p99_us = 0, p999_us = 0;
+  double cpu_us_per_msg = 0;
+  long rss_kb = 0;
+  long lost = 0;
+};
+
+/**
+ * @brief Connects to the router and sends the 3 byte node ID.
+ * @return Socket descriptor, -1 on failure.
+ */
+static int connect_node(int port, int node_id) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) return -1;
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == -1) {
+    close(fd);
+    return -1;
+  }
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  if (node_id < 0) return fd;  // probe only
+  char id[12];
+  std::snprintf(id, sizeof(id), "%03d", node_id);
+  if (send(fd, id, 3, MSG_NOSIGNAL) != 3) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * @brief Sends the frame of a window slot with a new sequence number.
+ */
+static bool send_ping(SimNode& node, int slot, int window) {
+  char text[FRAME_SIZE + 1];
+  // unique per frame, its reply finds the slot by sequence % window
+  long sequence = node.sends++ * window + slot;
+  std::snprintf(text, sizeof(text), "%03d0200%022ld%03d", node.id, sequence,
+                node.peer);
+  node.slot_sequence[slot] = sequence;
+  node.slot_sent[slot] = Clock::now();
+  return send(node.fd, text, FRAME_SIZE, MSG_NOSIGNAL) == FRAME_SIZE;
+}
+
+/**
+ * @brief Reads router CPU time (user + system) in seconds from /proc.
+ */
+static double process_cpu_seconds(pid_t pid) {
+  std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+  std::string content((std::istreambuf_iterator<char>(stat)),
+                      std::istreambuf_iterator<char>());
+  // fields after the command name, which may contain spaces
+  size_t close_paren = content.rfind(')');
+  if (close_paren == std::string::npos) return 0;
+  std::istringstream fields(content.substr(close_paren + 2));
+  std::string field;
+  unsigned long utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && fields >> field; i++) {
+    if (i == 14) utime = std::stoul(field);
+    if (i == 15) stime = std::stoul(field);
+  }
+  return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * @brief Reads router resident set size in kB from /proc.
+ */
+static long process_rss_kb(pid_t pid) {
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) return std::stol(line.substr(6));
+  }
+  return 0;
+}
+
+/**
+ * @brief Drives a running router with nodes and measures it.
+ */
+static ScaleResult drive(pid_t router, int port, int node_count, int window,
+                         int seconds) {
+  ScaleResult result;
+  int pairs = node_count / 2;
+  std::vector<SimNode> nodes(pairs * 2);
+  for (int i = 0; i < pairs * 2; i++) {
+    // IDs 1..pairs ping, pairs+1..2*pairs answer
+    nodes[i].id = i + 1;
+    nodes[i].pinger = i < pairs;
+    nodes[i].peer = nodes[i].pinger ? i + 1 + pairs : i + 1 - pairs;
+    nodes[i].fd = connect_node(port, nodes[i].id);
+    if (nodes[i].fd == -1) {
+      std::printf("Cannot connect node %d\n", nodes[i].id);
+      for (auto& node : nodes) {
+        if (node.fd != -1) close(node.fd);
+      }
+      return result;
+    }
+  }
+  // let the router register every handshake before first frame
+  usleep((200 + node_count) * 1000);
+
+  std::vector<pollfd> fds(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    fds[i] = {nodes[i].fd, POLLIN, 0};
+    if (!nodes[i].pinger) continue;
+    for (int slot = 0; slot < window; slot++) send_ping(nodes[i], slot, window);
+  }
+
+  std::vector<long> rtts;
+  long round_trips = 0;
+  long lost = 0;
+  bool measuring = false;
+  bool ok = true;
+  double cpu_start = 0;
+  auto start = Clock::now();
+  auto measure_start = start;
+  auto end = start + std::chrono::milliseconds(WARMUP_MS + seconds * 1000);
+  while (ok) {
+    auto now = Clock::now();
+    if (now >= end) break;
+    if (!measuring && now - start >= std::chrono::milliseconds(WARMUP_MS)) {
+      measuring = true;
+      measure_start = now;
+      cpu_start = process_cpu_seconds(router);
+      rtts.clear();
+      round_trips = 0;
+      lost = 0;
+    }
+    if (poll(fds.data(), fds.size(), POLL_TIMEOUT_MS) < 0) break;
+    now = Clock::now();
+    for (size_t i = 0; i < nodes.size() && ok; i++) {
+      SimNode& node = nodes[i];
+      if (fds[i].revents != 0) {
+        int n = recv(node.fd, node.rx + node.rx_len,
+                     sizeof(node.rx) - node.rx_len, 0);
+        if (n <= 0) {
+          std::printf("Node %d lost its connection\n", node.id);
+          ok = false;
+          break;
+        }
+        node.rx_len += n;
+        int offset = 0;
+        for (; node.rx_len - offset >= FRAME_SIZE; offset += FRAME_SIZE) {
+          char* frame = node.rx + offset;
+          if (!node.pinger) {
+            // answer like a node: swap IDs, 0200 -> 0210
+            char reply[FRAME_SIZE];
+            std::memcpy(reply, frame + FRAME_SIZE - 3, 3);
+            std::memcpy(reply + 3, frame + 3, FRAME_SIZE - 6);
+            reply[5] = '1';
+            std::memcpy(reply + FRAME_SIZE - 3, frame, 3);
+            ok = send(node.fd, reply, FRAME_SIZE, MSG_NOSIGNAL) == FRAME_SIZE;
+            continue;
+          }
+          long sequence = std::strtol(std::string(frame + 7, 22).c_str(),
+                                      nullptr, 10);
+          int slot = static_cast<int>(sequence % window);
+          // a late reply of a resent frame is ignored
+          if (node.slot_sequence[slot] != sequence) continue;
+          rtts.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             now - node.slot_sent[slot])
+                             .count());
+          round_trips++;
+          ok = send_ping(node, slot, window);
+        }
+        node.rx_len -= offset;
+        std::memmove(node.rx, node.rx + offset, node.rx_len);
+      }
+      if (!node.pinger) continue;
+      for (int slot = 0; slot < window && ok; slot++) {
+        if (now - node.slot_sent[slot] < std::chrono::milliseconds(RESEND_MS)) {
+          continue;
+        }
+        lost++;
+        ok = send_ping(node, slot, window);
+      }
+    }
+  }
+  double elapsed =
+      std::chrono::duration<double>(Clock::now() - measure_start).count();
+  double cpu = process_cpu_seconds(router) - cpu_start;
+  result.rss_kb = process_rss_kb(router);
+  for (auto& node : nodes) close(node.fd);
+  if (!ok || !measuring) return result;
+  if (rtts.empty()) {
+    std::printf("No round trip completed\n");
+    return result;
+  }
+
+  std::sort(rtts.begin(), rtts.end());
+  auto percentile = [&rtts](double p) {
+    return rtts[static_cast<size_t>(p * (rtts.size() - 1))] / 1000.0;
+  };
+  // each round trip is routed twice
+  long frames = round_trips * 2;
+  result.ok = true;
+  result.msgs_per_sec = frames / elapsed;
+  result.p50_us = percentile(0.50);
+  result.p99_us = percentile(0.99);
+  result.p999_us = percentile(0.999);
+  result.cpu_us_per_msg = cpu * 1e6 / frames;
+  result.lost = lost;
+  return result;
+}
+
+/**
+ * @brief Starts the router binary with a thread count, drives it and stops it.
+ */
+static ScaleResult run_spawned(const std::string& router, int port,
+                               int node_count, int threads, int window,
+                               int seconds) {
+  // buffered output would be written again by the child
+  std::fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    // per frame logging would dominate the measurement on a terminal
+    freopen("/dev/null", "w", stdout);
+    freopen("/dev/null", "w", stderr);
+    std::string port_arg = std::to_string(port);
+    std::string threads_arg = std::to_string(threads);
+    execl(router.c_str(), router.c_str(), port_arg.c_str(), "--threads",
+          threads_arg.c_str(), (char*)nullptr);
+    _exit(127);
+  }
+  ScaleResult result;
+  bool started = false;
+  for (int i = 0; i < ROUTER_START_RETRIES && !started; i++) {
+    usleep(100 * 1000);
+    int probe = connect_node(port, -1);
+    if (probe == -1) continue;
+    close(probe);
+    started = true;
+    result = drive(pid, port, node_count, window, seconds);
+  }
+  if (!started) std::printf("Router did not accept connections\n");
+  if (waitpid(pid, nullptr, WNOHANG) == pid) {
+    std::printf("Router exited during the run\n");
+    result.ok = false;
+    pid = -1;
+  }
+  if (pid != -1) {
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+  }
+  result.nodes = node_count;
+  result.threads = threads;
+  return result;
+}
+
+/**
+ * @brief Parses a comma separated list of integers.
+ */
+static std::vector<int> parse_list(const std::string& text) {
+  std::vector<int> values;
+  std::istringstream items(text);
+  std::string item;
+  while (std::getline(items, item, ',')) values.push_back(std::stoi(item));
+  return values;
+}
+
+/**
+ * @brief Checks results against baseline lines `<nodes> <threads> <min_msgs_per_sec> <max_p99_us>`.
+ * @return Number of results below their baseline.
+ */
+static int check_baseline(const std::string& path,
+                          const std::vector<ScaleResult>& results) {
+  std::ifstream file(path);
+  if (!file) {
+    std::printf("Cannot open baseline file %s\n", path.c_str());
+    return 1;
+  }
+  int failures = 0;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    int nodes, threads;
+    double min_msgs, max_p99;
+    if (line.empty() || line[0] == '#' ||
+        !(fields >> nodes >> threads >> min_msgs >> max_p99)) {
+      continue;
+    }
+    for (auto& result : results) {
+      if (result.nodes != nodes || result.threads != threads || !result.ok) {
+        continue;
+      }
+      if (result.msgs_per_sec < min_msgs || result.p99_us > max_p99) {
+        std::printf(
+            "BELOW BASELINE nodes=%d threads=%d msgs_per_sec=%.0f (min %.0f) "
+            "p99=%.1fus (max %.1f)\n",
+            nodes, threads, result.msgs_per_sec, min_msgs, result.p99_us,
+            max_p99);
+        failures++;
+      }
+    }
+  }
+  return failures;
+}
+
+/**
+ * @brief Writes results as a JSON array.
+ */
+static void write_json(const std::string& path,
+                       const std::vector<ScaleResult>& results) {
+  std::ofstream out(path);
+  out << "[\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const ScaleResult& r = results[i];
+    char line[512];
+    std::snprintf(line, sizeof(line),
+                  "  {\"nodes\": %d, \"threads\": %d, \"ok\": %s, "
+                  "\"msgs_per_sec\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, "
+                  "\"p999_us\": %.1f, \"cpu_us_per_msg\": %.3f, \"rss_kb\": %ld, "
+                  "\"lost\": %ld}%s\n",
+                  r.nodes, r.threads, r.ok ? "true" : "false", r.msgs_per_sec,
+                  r.p50_us, r.p99_us, r.p999_us, r.cpu_us_per_msg, r.rss_kb,
+                  r.lost, i + 1 < results.size() ? "," : "");
+    out << line;
+  }
+  out << "]\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 4 || std::string(argv[1]) != "--spawn") {
+    std::printf(
+        "Usage: ISC-ScaleBench --spawn <router_binary> <port> [--nodes "
+        "10,100,1000] [--threads 2,4] [--seconds 3] [--window 4] "
+        "[--baseline <file>] [--out scale_results.json]\n");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  std::string router = argv[2];
+  int port = std::stoi(argv[3]);
+  std::vector<int> node_counts = {10, 100, 1000};
+  std::vector<int> thread_counts = {2, 4};
+  int seconds = 3;
+  int window = 4;
+  std::string baseline, out = "scale_results.json";
+  for (int i = 4; i + 1 < argc; i += 2) {
+    std::string option = argv[i];
+    std::string value = argv[i + 1];
+    if (option == "--nodes") node_counts = parse_list(value);
+    else if (option == "--threads") thread_counts = parse_list(value);
+    else if (option == "--seconds") seconds = std::stoi(value);
+    else if (option == "--window") window = std::min(std::stoi(value), MAX_WINDOW);
+    else if (option == "--baseline") baseline = value;
+    else if (option == "--out") out = value;
+  }
+  for (int threads : thread_counts) {
+    if (threads < 2) {
+      // shared pool of the router, one read and one write worker at least
+      std::printf("Thread counts start at 2, got %d\n", threads);
+      return 1;
+    }
+  }
+
+  std::vector<ScaleResult> results;
+  int failures = 0;
+  for (int nodes : node_counts) {
+    int capped = std::min(nodes, SCALE_MAX_NODES);
+    if (capped != nodes) {
+      std::printf("%d nodes capped to %d, router sockets must fit in an fd_set\n",
+                  nodes, capped);
+    }
+    for (int threads : thread_counts) {
+      // next port each run, previous connections may linger in TIME_WAIT
+      ScaleResult result =
+          run_spawned(router, port++, capped, threads, window, seconds);
+      if (!result.ok) {
+        std::printf("nodes=%d threads=%d FAILED\n", capped, threads);
+        failures++;
+      } else {
+        std::printf(
+            "nodes=%-5d threads=%-2d msgs_per_sec=%-9.0f p50=%.1fus "
+            "p99=%.1fus p999=%.1fus cpu_per_msg=%.2fus rss=%ldkB lost=%ld\n",
+            capped, threads, result.msgs_per_sec, result.p50_us, result.p99_us,
+            result.p999_us, result.cpu_us_per_msg, result.rss_kb, result.lost);
+      }
+      results.push_back(result);
+    }
+  }
+  write_json(out, results);
+  if (!baseline.empty()) failures += check_baseline(baseline, results);
+  return failures == 0 ? 0 : 1;
+}
+#endif  // _WIN32
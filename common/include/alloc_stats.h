@@ -0,0 +1,95 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// Threads counted apart, later threads share the last slot.
+#define ALLOC_STATS_MAX_THREADS 64
+
+/**
+ * @brief Heap allocations and requested bytes.
+ */
+struct AllocCounts {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+};
+
+/**
+ * @class AllocStats
+ * @brief Per thread heap allocation counters, fed by the global operator new when built with ISC_ALLOC_STATS.
+ *
+ * A thread takes a slot of counters on its first allocation, in order of
+ * appearance, so the main thread is slot 0. Counters are relaxed atomics, the
+ * metrics report reads every slot without a lock. Without ISC_ALLOC_STATS
+ * operator new is not replaced and all counts stay zero.
+ */
+class AllocStats {
+ public:
+  /**
+   * @brief Checks if allocations are counted, i.e. the linked counters replace operator new.
+   *
+   * Defined next to the counters, so every caller sees the library that is
+   * linked, whatever ISC_ALLOC_STATS is in its own translation unit.
+   */
+  static bool enabled();
+
+  /**
+   * @brief Counts an allocation of the calling thread, called by operator new.
+   * @param bytes Requested size.
+   */
+  static void record(size_t bytes) {
+    if (slot_ == -1) {
+      int slot = slots_.fetch_add(1, std::memory_order_relaxed);
+      slot_ = slot < ALLOC_STATS_MAX_THREADS ? slot : ALLOC_STATS_MAX_THREADS - 1;
+    }
+    allocations_[slot_].fetch_add(1, std::memory_order_relaxed);
+    bytes_[slot_].fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Gets counts of the calling thread.
+   */
+  static AllocCounts thread_counts() {
+    return slot_ == -1 ? AllocCounts{} : slot_counts(slot_);
+  }
+
+  /**
+   * @brief Gets counts of a slot.
+   * @param slot Slot index, below slots().
+   */
+  static AllocCounts slot_counts(int slot) {
+    return AllocCounts{allocations_[slot].load(std::memory_order_relaxed),
+                       bytes_[slot].load(std::memory_order_relaxed)};
+  }
+
+  /**
+   * @brief Gets number of slots taken so far.
+   */
+  static int slots() {
+    int slots = slots_.load(std::memory_order_relaxed);
+    return slots < ALLOC_STATS_MAX_THREADS ? slots : ALLOC_STATS_MAX_THREADS;
+  }
+
+  /**
+   * @brief Gets counts of all threads, exited ones included.
+   */
+  static AllocCounts total() {
+    AllocCounts total;
+    for (int slot = 0; slot < slots(); slot++) {
+      AllocCounts counts = slot_counts(slot);
+      total.allocations += counts.allocations;
+      total.bytes += counts.bytes;
+    }
+    return total;
+  }
+
+ private:
+  static std::atomic<uint64_t> allocations_[ALLOC_STATS_MAX_THREADS];
+  static std::atomic<uint64_t> bytes_[ALLOC_STATS_MAX_THREADS];
+  static std::atomic<int> slots_;
+  static thread_local int slot_;  ///< Slot of the thread, -1 before its first allocation.
+};
+
+#endif
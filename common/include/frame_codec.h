@@ -0,0 +1,117 @@
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_CODEC_SSE2 1
+#endif
+
+/// Digits of a frame, ASCII frames carry one per byte.
+#define FRAME_DIGITS 32
+/// Bytes of a packed BCD frame, two digits per byte.
+#define COMPACT_MESSAGE_SIZE (FRAME_DIGITS / 2)
+
+/**
+ * @brief Wire encoding of frames on a connection, negotiated per direction.
+ * values are carried in the TRACE field of encoding frames.
+ */
+enum class FrameEncoding : uint8_t {
+  ASCII = 0,      ///< 32 ASCII digits, the default
+  PACKED_BCD = 1  ///< 16 bytes, digit 2i in the high nibble of byte i
+};
+
+/**
+ * @class FrameCodec
+ * @brief Converts frames between ASCII digits and packed BCD.
+ *
+ * Every field of a frame is a decimal number, so a frame is 32 digits and
+ * packs into 16 bytes. Each conversion is a few SSE2 instructions on x86-64,
+ * other targets use the scalar loop.
+ */
+class FrameCodec {
+ public:
+  /**
+   * @brief Gets the size of a frame in an encoding.
+   */
+  static int frame_size(FrameEncoding encoding) {
+    return encoding == FrameEncoding::PACKED_BCD ? COMPACT_MESSAGE_SIZE
+                                                 : FRAME_DIGITS;
+  }
+
+  /**
+   * @brief Gets the name of an encoding in logs.
+   */
+  static const char* name(FrameEncoding encoding) {
+    return encoding == FrameEncoding::PACKED_BCD ? "packed BCD" : "ASCII";
+  }
+
+  /**
+   * @brief Packs an ASCII frame into packed BCD.
+   * @param ascii FRAME_DIGITS ASCII digits.
+   * @param packed Output, COMPACT_MESSAGE_SIZE bytes.
+   * @return false if the frame has a byte other than a digit, packed is undefined then.
+   */
+  static bool pack(const char* ascii, char* packed) {
+#ifdef FRAME_CODEC_SSE2
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+    __m128i first = _mm_sub_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ascii)), zero);
+    __m128i second = _mm_sub_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(ascii + 16)), zero);
+    // bytes below '0' wrap around, so one unsigned compare rejects both sides
+    __m128i valid = _mm_and_si128(
+        _mm_cmpeq_epi8(_mm_max_epu8(first, nine), nine),
+        _mm_cmpeq_epi8(_mm_max_epu8(second, nine), nine));
+    if (_mm_movemask_epi8(valid) != 0xFFFF) return false;
+    // a 16 bit lane holds digits 2i and 2i+1, merge them in its low byte
+    first = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(first, low_byte), 4),
+                         _mm_srli_epi16(first, 8));
+    second = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(second, low_byte), 4),
+                          _mm_srli_epi16(second, 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(packed),
+                     _mm_packus_epi16(first, second));
+    return true;
+#else
+    for (int i = 0; i < COMPACT_MESSAGE_SIZE; i++) {
+      unsigned high = static_cast<unsigned char>(ascii[2 * i]) - '0';
+      unsigned low = static_cast<unsigned char>(ascii[2 * i + 1]) - '0';
+      if (high > 9 || low > 9) return false;
+      packed[i] = static_cast<char>(high << 4 | low);
+    }
+    return true;
+#endif
+  }
+
+  /**
+   * @brief Unpacks a packed BCD frame into ASCII digits.
+   * nibbles above 9 come out as the characters after '9', routing rejects them like any non-digit.
+   * @param packed COMPACT_MESSAGE_SIZE bytes.
+   * @param ascii Output, FRAME_DIGITS bytes, it must not overlap packed.
+   */
+  static void unpack(const char* packed, char* ascii) {
+#ifdef FRAME_CODEC_SSE2
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(packed));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+    __m128i low = _mm_and_si128(bytes, nibble);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ascii),
+                     _mm_add_epi8(_mm_unpacklo_epi8(high, low), zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(ascii + 16),
+                     _mm_add_epi8(_mm_unpackhi_epi8(high, low), zero));
+#else
+    for (int i = 0; i < COMPACT_MESSAGE_SIZE; i++) {
+      unsigned char byte = static_cast<unsigned char>(packed[i]);
+      ascii[2 * i] = static_cast<char>('0' + (byte >> 4));
+      ascii[2 * i + 1] = static_cast<char>('0' + (byte & 0x0F));
+    }
+#endif
+  }
+};
+
+#endif
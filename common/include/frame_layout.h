@@ -0,0 +1,118 @@
+#ifndef FRAME_LAYOUT_H
+#define FRAME_LAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief A fixed width decimal field of a frame.
+ *
+ * Fields are told apart by type, derive a tag from it for each field:
+ * struct MtiField : Field<4> {};
+ *
+ * @tparam Width Digits of the field, at most 18 so a value fits int64_t.
+ */
+template <int Width>
+struct Field {
+  static_assert(Width > 0 && Width <= 18, "field width must be 1..18 digits");
+  static constexpr int width = Width;
+};
+
+/**
+ * @class FrameLayout
+ * @brief A frame of fixed width decimal fields, laid out in the order given.
+ *
+ * Offsets are computed at compile time, so every accessor compiles to loads
+ * and stores at constant offsets with an unrolled digit loop, no string or
+ * stream is involved. A layout is a type, it is never instantiated.
+ *
+ * @tparam Fields Field tags, each at most once.
+ */
+template <class... Fields>
+class FrameLayout {
+ public:
+  /// Digits of a whole frame.
+  static constexpr int size = (0 + ... + Fields::width);
+
+  /**
+   * @brief Gets the offset of a field in the frame.
+   */
+  template <class F>
+  static constexpr int offset() {
+    constexpr bool match[] = {std::is_same_v<F, Fields>...};
+    constexpr int widths[] = {Fields::width...};
+    int offset = 0;
+    for (size_t i = 0; i < sizeof...(Fields); i++) {
+      if (match[i]) return offset;
+      offset += widths[i];
+    }
+    return -1;
+  }
+
+  /**
+   * @brief Reads a field.
+   * @param frame Frame of at least offset<F>() + F::width bytes.
+   * @return Value of the field, -1 if it has a byte other than a digit.
+   */
+  template <class F>
+  static constexpr int64_t get(const char* frame) {
+    check<F>();
+    int64_t value = 0;
+    for (int i = offset<F>(); i < offset<F>() + F::width; i++) {
+      unsigned digit = static_cast<unsigned char>(frame[i]) - '0';
+      if (digit > 9) return -1;
+      value = value * 10 + digit;
+    }
+    return value;
+  }
+
+  /**
+   * @brief Writes a field in place, zero padded.
+   * digits above the field width are dropped, 12345 in a 4 digit field is 2345.
+   */
+  template <class F>
+  static constexpr void set(char* frame, uint64_t value) {
+    check<F>();
+    for (int i = offset<F>() + F::width - 1; i >= offset<F>(); i--) {
+      frame[i] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    }
+  }
+
+  /**
+   * @brief Writes every field of a frame, values in field order.
+   * @param frame Output, size bytes, it is not null terminated.
+   */
+  template <class... Values>
+  static constexpr void write(char* frame, Values... values) {
+    static_assert(sizeof...(Values) == sizeof...(Fields),
+                  "one value per field");
+    (set<Fields>(frame, static_cast<uint64_t>(values)), ...);
+  }
+
+  /**
+   * @brief Checks that a field is all digits.
+   */
+  template <class F>
+  static constexpr bool valid(const char* frame) {
+    return get<F>(frame) >= 0;
+  }
+
+  /**
+   * @brief Checks that every field of a frame is all digits.
+   */
+  static constexpr bool valid(const char* frame) {
+    return (valid<Fields>(frame) && ...);
+  }
+
+ private:
+  template <class F>
+  static constexpr void check() {
+    static_assert(offset<F>() >= 0, "field is not part of this layout");
+    static_assert(((std::is_same_v<F, Fields> ? 1 : 0) + ...) == 1,
+                  "field appears more than once in this layout");
+  }
+};
+
+#endif
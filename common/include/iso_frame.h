@@ -0,0 +1,28 @@
+#ifndef ISO_FRAME_H
+#define ISO_FRAME_H
+
+#include "frame_codec.h"
+#include "frame_layout.h"
+
+/// Source node ID, also the whole ID message a node subscribes with.
+struct SrcIdField : Field<3> {};
+/// Message type identifier, its class digits give the write priority.
+struct MtiField : Field<4> {};
+/// Trace number, replies echo it back.
+struct TraceField : Field<6> {};
+/// Primary account number, routing rules match its BIN.
+struct PanField : Field<16> {};
+/// Destination node ID.
+struct DstIdField : Field<3> {};
+
+/**
+ * @brief Layout of the frames exchanged by nodes and routers, the one
+ * definition both binaries parse and build frames with.
+ */
+using IsoFrame =
+    FrameLayout<SrcIdField, MtiField, TraceField, PanField, DstIdField>;
+
+static_assert(IsoFrame::size == FRAME_DIGITS,
+              "every digit of a frame belongs to a field");
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// Each power of two range is split into 2^HISTOGRAM_SUB_BITS buckets, so a
+/// recorded value is off by at most 1/16 (~6%) of itself.
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+/// values below HISTOGRAM_SUB_BUCKETS have exact buckets, then one group of
+/// sub buckets for each bit position up to 63
+#define HISTOGRAM_BUCKETS \
+  (HISTOGRAM_SUB_BUCKETS + (64 - HISTOGRAM_SUB_BITS) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * @class LatencyHistogram
+ * @brief Log-linear histogram of latencies with bounded relative error, like HdrHistogram.
+ *
+ * Recording is one bucket index computation and a relaxed atomic increment, so
+ * workers record concurrently without locks. Percentiles are read by the
+ * reporting thread, a concurrent record may or may not be included.
+ */
+class LatencyHistogram {
+ public:
+  /**
+   * @brief Records one value.
+   * @param value Latency, in any unit chosen by the owner.
+   */
+  void record(uint64_t value) {
+    counts_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    total_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max &&
+           !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  /**
+   * @brief Number of recorded values.
+   */
+  uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Largest recorded value, exact.
+   */
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Gets the value at a percentile.
+   * @param percentile Percentile between 0 and 100, e.g. 99.9.
+   * @return Upper bound of the bucket holding the percentile, 0 if nothing is recorded.
+   */
+  uint64_t percentile(double percentile) const {
+    uint64_t total = count();
+    if (total == 0) return 0;
+    // rank of the value, 1 based
+    uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+      seen += counts_[bucket].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        uint64_t upper = upper_bound(bucket);
+        return upper < max() ? upper : max();
+      }
+    }
+    return max();
+  }
+
+  /**
+   * @brief Clears all recorded values, used to start a new report interval.
+   */
+  void reset() {
+    for (auto& count : counts_) count.store(0, std::memory_order_relaxed);
+    total_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Index of the bucket holding a value.
+   */
+  static int bucket_of(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKETS) return static_cast<int>(value);
+    int msb = highest_bit(value);
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    int sub = static_cast<int>(value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return HISTOGRAM_SUB_BUCKETS + shift * HISTOGRAM_SUB_BUCKETS + sub;
+  }
+
+  /**
+   * @brief Largest value falling into a bucket.
+   */
+  static uint64_t upper_bound(int bucket) {
+    if (bucket < HISTOGRAM_SUB_BUCKETS) return static_cast<uint64_t>(bucket);
+    int shift = (bucket - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_SUB_BUCKETS;
+    uint64_t sub = (bucket - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return lower + ((uint64_t(1) << shift) - 1);
+  }
+
+ private:
+  /**
+   * @brief Position of the highest set bit, value is not 0.
+   */
+  static int highest_bit(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+  }
+
+  std::atomic<uint64_t> counts_[HISTOGRAM_BUCKETS] = {};  ///< Values per bucket.
+  std::atomic<uint64_t> total_{0};  ///< Recorded values count.
+  std::atomic<uint64_t> max_{0};    ///< Largest recorded value.
+};
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+/// Bytes of each ring, power of two. one ring per direction.
+#define SHM_RING_CAPACITY (1 << 20)
+
+/// Identifies the setup message of the shared memory transport and its layout version.
+#define SHM_SETUP_MAGIC 0x49534352
+#define SHM_SETUP_VERSION 1
+
+/// Descriptors passed with the setup message, in this order.
+#define SHM_SETUP_FDS 3
+
+/**
+ * @struct ShmSetup
+ * @brief Payload of the setup message sent by the router over the Unix socket.
+ *
+ * Descriptors come along with it: the memory region, the eventfd rung to wake
+ * the router and the eventfd rung to wake the node. The region holds the ring
+ * from node to router first, then the ring from router to node.
+ */
+struct ShmSetup {
+  uint32_t magic;     ///< SHM_SETUP_MAGIC
+  uint32_t version;   ///< SHM_SETUP_VERSION
+  uint64_t capacity;  ///< Bytes of each ring.
+};
+
+/**
+ * @struct ShmRingHeader
+ * @brief Shared state of a ring, at the start of its region.
+ *
+ * Positions grow forever and are masked by capacity, producer and consumer
+ * positions live on their own cache lines so the two processes dont bounce
+ * one line on every frame.
+ */
+struct ShmRingHeader {
+  alignas(64) std::atomic<uint64_t> tail;  ///< Bytes written, only producer stores it.
+  alignas(64) std::atomic<uint64_t> head;  ///< Bytes read, only consumer stores it.
+  alignas(64) std::atomic<uint32_t> consumer_waiting;  ///< Consumer found the ring empty and sleeps.
+  std::atomic<uint32_t> producer_waiting;  ///< Producer found the ring full and sleeps.
+  std::atomic<uint32_t> closed;            ///< One side closed the transport.
+};
+
+/**
+ * @class ShmRing
+ * @brief Single producer single consumer byte ring in memory shared by two processes.
+ *
+ * Frames are copied in and out without system calls. A side about to sleep
+ * sets its waiting flag and checks the ring once more, the other side clears
+ * the flag after each write/read and rings the sleeper's doorbell only if it
+ * was set, so a busy ring needs no wake-ups at all. Writes copy whole units
+ * (frames), so the consumer never sees half of a frame. Lock-free, one thread
+ * per side.
+ */
+class ShmRing {
+ public:
+  /**
+   * @brief Size of the region holding a ring.
+   * @param capacity Bytes of the ring, power of two.
+   */
+  static size_t region_size(size_t capacity) {
+    return sizeof(ShmRingHeader) + capacity;
+  }
+
+  /**
+   * @brief Attaches to a ring region.
+   * @param region Start of the region, region_size() bytes.
+   * @param capacity Bytes of the ring, power of two.
+   * @param initialize true for the side creating the region, it resets positions and flags.
+   */
+  ShmRing(void* region, size_t capacity, bool initialize)
+      : header_(static_cast<ShmRingHeader*>(region)),
+        data_(static_cast<char*>(region) + sizeof(ShmRingHeader)),
+        capacity_(capacity) {
+    if (initialize) {
+      new (header_) ShmRingHeader();
+      header_->tail.store(0);
+      header_->head.store(0);
+      header_->consumer_waiting.store(0);
+      header_->producer_waiting.store(0);
+      header_->closed.store(0);
+    }
+  }
+
+  /**
+   * @brief Copies as many whole units as fit. Producer side.
+   * @param data Pointer to the data.
+   * @param len Data length, multiple of unit.
+   * @param unit Size of the indivisible parts of data, e.g. frame size.
+   * @return Number of bytes written, multiple of unit.
+   */
+  size_t write(const char* data, size_t len, size_t unit) {
+    uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+    uint64_t head = header_->head.load(std::memory_order_acquire);
+    size_t space = capacity_ - static_cast<size_t>(tail - head);
+    size_t count = len < space ? len : space;
+    count -= count % unit;
+    if (count == 0) return 0;
+    copy_in(tail, data, count);
+    // seq_cst pairs with consumer_waiting of prepare_wait()
+    header_->tail.store(tail + count, std::memory_order_seq_cst);
+    return count;
+  }
+
+  /**
+   * @brief Copies up to len bytes out. Consumer side.
+   * @param data Output buffer.
+   * @param len Maximum bytes.
+   * @return Number of bytes read, 0 if the ring is empty.
+   */
+  size_t read(char* data, size_t len) {
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    uint64_t tail = header_->tail.load(std::memory_order_acquire);
+    size_t available = static_cast<size_t>(tail - head);
+    size_t count = len < available ? len : available;
+    if (count == 0) return 0;
+    copy_out(head, data, count);
+    // seq_cst pairs with producer_waiting of prepare_space_wait()
+    header_->head.store(head + count, std::memory_order_seq_cst);
+    return count;
+  }
+
+  /**
+   * @brief Bytes waiting to be read.
+   */
+  size_t readable() const {
+    return static_cast<size_t>(header_->tail.load(std::memory_order_seq_cst) -
+                               header_->head.load(std::memory_order_relaxed));
+  }
+
+  /**
+   * @brief Free bytes.
+   */
+  size_t writable() const {
+    return capacity_ -
+           static_cast<size_t>(header_->tail.load(std::memory_order_relaxed) -
+                               header_->head.load(std::memory_order_seq_cst));
+  }
+
+  /**
+   * @brief Announces the consumer goes to sleep on its doorbell. Consumer side.
+   * @return false if data arrived meanwhile, consumer should read instead of sleeping.
+   */
+  bool prepare_wait() {
+    header_->consumer_waiting.store(1, std::memory_order_seq_cst);
+    if (readable() > 0) {
+      header_->consumer_waiting.store(0, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Checks after a write if the consumer sleeps, clearing its flag. Producer side.
+   * @return true if the caller should ring the consumer's doorbell.
+   */
+  bool take_consumer_waiting() {
+    return header_->consumer_waiting.load(std::memory_order_seq_cst) != 0 &&
+           header_->consumer_waiting.exchange(0) != 0;
+  }
+
+  /**
+   * @brief Announces the producer waits for free space. Producer side.
+   * @param needed Bytes the producer needs.
+   * @return false if space is freed meanwhile, producer should write instead of sleeping.
+   */
+  bool prepare_space_wait(size_t needed) {
+    header_->producer_waiting.store(1, std::memory_order_seq_cst);
+    if (writable() >= needed) {
+      header_->producer_waiting.store(0, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Checks after a read if the producer waits for space, clearing its flag. Consumer side.
+   * @return true if the caller should ring the producer's doorbell.
+   */
+  bool take_producer_waiting() {
+    return header_->producer_waiting.load(std::memory_order_seq_cst) != 0 &&
+           header_->producer_waiting.exchange(0) != 0;
+  }
+
+  /**
+   * @brief Marks the transport closed, the other side sees it on its next empty read.
+   */
+  void close() { header_->closed.store(1, std::memory_order_release); }
+
+  /**
+   * @brief Checks if a side closed the transport.
+   */
+  bool is_closed() const {
+    return header_->closed.load(std::memory_order_acquire) != 0;
+  }
+
+ private:
+  void copy_in(uint64_t position, const char* data, size_t len) {
+    size_t offset = static_cast<size_t>(position & (capacity_ - 1));
+    size_t first = len < capacity_ - offset ? len : capacity_ - offset;
+    memcpy(data_ + offset, data, first);
+    memcpy(data_, data + first, len - first);
+  }
+
+  void copy_out(uint64_t position, char* data, size_t len) const {
+    size_t offset = static_cast<size_t>(position & (capacity_ - 1));
+    size_t first = len < capacity_ - offset ? len : capacity_ - offset;
+    memcpy(data, data_ + offset, first);
+    memcpy(data + first, data_, len - first);
+  }
+
+  ShmRingHeader* header_;  ///< Shared positions and flags.
+  char* data_;             ///< Shared ring bytes.
+  size_t capacity_;        ///< Ring bytes, power of two.
+};
+
+#endif
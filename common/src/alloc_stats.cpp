@@ -0,0 +1,66 @@
+#include "alloc_stats.h"
+
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+bool AllocStats::enabled() {
+#ifdef ISC_ALLOC_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// initialize static variables
+std::atomic<uint64_t> AllocStats::allocations_[ALLOC_STATS_MAX_THREADS] = {};
+std::atomic<uint64_t> AllocStats::bytes_[ALLOC_STATS_MAX_THREADS] = {};
+std::atomic<int> AllocStats::slots_{0};
+thread_local int AllocStats::slot_ = -1;
+
+#ifdef ISC_ALLOC_STATS
+// replaced global allocation functions. they live next to the AllocStats
+// statics, so a static library brings them in wherever counts are read.
+// other forms (nothrow, array) forward to these by default, sized delete is
+// replaced as well, compilers call it directly when the size is known.
+
+void* operator new(size_t size) {
+  AllocStats::record(size);
+  // malloc(0) may return nullptr, new must return a unique pointer
+  void* ptr = std::malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+  AllocStats::record(size);
+  size_t alignment = static_cast<size_t>(align);
+#ifdef _WIN32
+  void* ptr = _aligned_malloc(size == 0 ? 1 : size, alignment);
+#else
+  // aligned_alloc needs a non zero multiple of the alignment
+  size_t rounded = (size + alignment - 1) / alignment * alignment;
+  void* ptr = std::aligned_alloc(alignment, rounded == 0 ? alignment : rounded);
+#endif
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t align) noexcept {
+  operator delete(ptr, align);
+}
+#endif
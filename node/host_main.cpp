@@ -0,0 +1,25 @@
+#include "logger.h"
+#include "node_host.h"
+
+int main(int argc, char* argv[]) {
+    Logger::Initialize();
+    if (argc != 4) {
+        LOG_CRITICAL("Insufficient Argument.\nUsage: ISC-NodeHost.exe <nodes_file> <router_ip> <router_port>");
+        return 1;
+    }
+    try {
+        std::string router_ip = argv[2];
+        int router_port = std::stoi(argv[3]);
+        NodeHost host(router_ip, router_port);
+        if (!host.loadConfig(argv[1]) || host.size() == 0) {
+            LOG_CRITICAL("No node to run.");
+            return 1;
+        }
+        LOG_INFO("Router is on {}:{}", router_ip, router_port);
+        host.run();
+    } catch (const std::exception& e) {
+        LOG_ERROR("Error: " + std::string(e.what())) ;
+    }
+
+    return 0;
+}
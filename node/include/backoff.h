@@ -0,0 +1,56 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <algorithm>
+#include <random>
+
+/// First reconnect delay and its ceiling, in milliseconds.
+#define RECONNECT_BASE_MS 100
+#define RECONNECT_MAX_MS 5000
+
+/**
+ * @class Backoff
+ * @brief Exponential backoff with jitter for reconnecting to the router.
+ *
+ * The delay ceiling doubles on each failed attempt up to a maximum, and the
+ * delay is picked at random between half of the ceiling and the ceiling. So
+ * nodes disconnected together by a router restart spread their reconnects
+ * instead of retrying in lockstep.
+ */
+class Backoff {
+ public:
+  /**
+   * @brief Constructs a Backoff object.
+   * @param base_ms Ceiling of the first delay.
+   * @param max_ms Largest ceiling.
+   * @param seed Seed of the jitter, differs per node.
+   */
+  Backoff(unsigned base_ms, unsigned max_ms, unsigned seed)
+      : _base_ms(base_ms), _max_ms(max_ms), _random(seed) {}
+
+  /**
+   * @brief Gets the delay before the next attempt and grows the ceiling.
+   * @return Delay in milliseconds.
+   */
+  unsigned nextDelayMs() {
+    unsigned ceiling = _base_ms;
+    for (unsigned i = 0; i < _attempt && ceiling < _max_ms; i++) ceiling *= 2;
+    ceiling = std::min(ceiling, _max_ms);
+    if (ceiling < _max_ms) _attempt++;
+    std::uniform_int_distribution<unsigned> jitter(ceiling / 2, ceiling);
+    return jitter(_random);
+  }
+
+  /**
+   * @brief Starts over from the first delay, called once connected.
+   */
+  void reset() { _attempt = 0; }
+
+ private:
+  unsigned _base_ms;     ///< Ceiling of the first delay.
+  unsigned _max_ms;      ///< Largest ceiling.
+  unsigned _attempt = 0; ///< Failed attempts since the last reset, stops growing at the largest ceiling.
+  std::minstd_rand _random;  ///< Jitter source, small enough to keep one per logical node.
+};
+
+#endif
@@ -1,12 +1,20 @@
 #ifndef MESSAGE_H
 #define MESSAGE_H
 
-#include <iomanip>
 #include <iostream>
-#include <sstream>
 #include <string>
 
-#define MSG_LEN 32
+#include "iso_frame.h"
+
+#define MSG_LEN IsoFrame::size
+
+/// ID of the router, frames addressed to it are not forwarded to a node.
+#define ROUTER_ID 999
+/// MTI of the frame offering the router the FrameEncoding in its TRACE.
+#define ENCODING_OFFER_MTI 870
+/// MTI of the last frame a side sends in its current encoding, its later
+/// frames use the FrameEncoding in TRACE.
+#define ENCODING_SWITCH_MTI 880
 
 /**
  * @class Message
@@ -23,9 +31,9 @@ class Message {
    * @brief Processes a received message and generates a response.
    *
    * This method checks if the incoming message length is equal to the expected
-   * length (MSG_LEN). If the destination ID in the message matches the current
-   * node ID, it increments the Message Type Identifier (MTI) and builds a
-   * response message to be sent back.
+   * length (MSG_LEN) and all its fields are digits. If the destination ID in
+   * the message matches the current node ID, it increments the Message Type
+   * Identifier (MTI) and builds a response message to be sent back.
    *
    * @param current_node_id The ID of the current node processing the message.
    * @param message Pointer to the received message.
@@ -36,30 +44,18 @@ class Message {
    */
   static std::string processMessage(int current_node_id, const char* message,
                                     int message_len) {
-    if (message_len != MSG_LEN) return "";
-
-    int index = 0;
-    std::string src_id(message, 3);
-    index += 3;
-    std::string MTI(message + index, 4);
-    index += 4;
-    std::string TRACE(message + index, 6);
-    index += 6;
-    std::string PAN(message + index, 16);
-    index += 16;
-    std::string dstid(message + index, 3);
-
-    int msg_dst = std::stoi(dstid);
+    if (message_len != MSG_LEN || !IsoFrame::valid(message)) return "";
 
+    int64_t msg_dst = IsoFrame::get<DstIdField>(message);
     if (msg_dst != current_node_id) return "";
 
-    int new_mti = std::stoi(MTI) + 10;
-    new_mti = new_mti % 10000;
-    std::ostringstream oss;
-    oss << std::setw(4) << std::setfill('0') << new_mti;
-    std::string mti_str = oss.str();
-
-    std::string response = dstid + mti_str + TRACE + PAN + src_id;
+    // TRACE and PAN are echoed back as they are
+    std::string response(message, MSG_LEN);
+    IsoFrame::set<SrcIdField>(&response[0], msg_dst);
+    IsoFrame::set<MtiField>(&response[0],
+                            IsoFrame::get<MtiField>(message) + 10);
+    IsoFrame::set<DstIdField>(&response[0],
+                              IsoFrame::get<SrcIdField>(message));
     return response;
   }
 
@@ -72,23 +68,15 @@ class Message {
    *
    * @param src_node_id The ID of the source node sending the message.
    * @param dst_node_id The ID of the destination node receiving the message.
+   * @param trace The trace number of the transaction, replies echo it back.
    *
    * @return A string containing the constructed initial message.
    */
-  static std::string buildFirstMessage(int src_node_id, int dst_node_id) {
-    std::string MTI = "2200";
-    std::string TRACE = "123456";
-    std::string PAN = "1111111111111111";
-
-    std::ostringstream oss;
-    oss << std::setw(3) << std::setfill('0') << src_node_id;
-    std::string srcid = oss.str();
-
-    std::ostringstream oss2;
-    oss2 << std::setw(3) << std::setfill('0') << dst_node_id;
-    std::string dstid = oss2.str();
-
-    std::string msg = srcid + MTI + TRACE + PAN + dstid;
+  static std::string buildFirstMessage(int src_node_id, int dst_node_id,
+                                       int trace = 123456) {
+    std::string msg(MSG_LEN, '0');
+    IsoFrame::write(&msg[0], src_node_id, 2200, trace, 1111111111111111ULL,
+                    dst_node_id);
     return msg;
   }
 
@@ -102,10 +90,52 @@ class Message {
    * @return A string containing the formatted current node ID.
    */
   static std::string buildIdMessage(int current_node_id) {
-    std::ostringstream oss;
-    oss << std::setw(3) << std::setfill('0') << current_node_id;
-    std::string idmsg = oss.str();
+    // the ID message is the source field of a frame on its own
+    std::string idmsg(SrcIdField::width, '0');
+    IsoFrame::set<SrcIdField>(&idmsg[0], current_node_id);
     return idmsg;
   }
+
+  /**
+   * @brief Builds an encoding offer or switch message addressed to the router.
+   *
+   * @param current_node_id The ID of the current node.
+   * @param mti ENCODING_OFFER_MTI or ENCODING_SWITCH_MTI.
+   * @param encoding The offered encoding, or the encoding of the following frames.
+   *
+   * @return A string containing the 32 byte message.
+   */
+  static std::string buildEncodingMessage(int current_node_id, int mti,
+                                          FrameEncoding encoding) {
+    std::string msg(MSG_LEN, '0');
+    IsoFrame::write(&msg[0], current_node_id, mti, static_cast<int>(encoding),
+                    0, ROUTER_ID);
+    return msg;
+  }
+
+  /**
+   * @brief Checks if a message is the encoding switch of the router.
+   *
+   * @param message Pointer to the received message of MSG_LEN bytes.
+   *
+   * @return The encoding of the frames following it, -1 for any other message.
+   */
+  static int extractEncodingSwitch(const char* message) {
+    if (IsoFrame::get<SrcIdField>(message) != ROUTER_ID ||
+        IsoFrame::get<MtiField>(message) != ENCODING_SWITCH_MTI) {
+      return -1;
+    }
+    return static_cast<int>(IsoFrame::get<TraceField>(message));
+  }
+
+  /**
+   * @brief Checks if a message is addressed to the router, such messages are not transactions.
+   *
+   * @param message The message.
+   */
+  static bool isToRouter(const std::string& message) {
+    return message.size() == MSG_LEN &&
+           IsoFrame::get<DstIdField>(message.data()) == ROUTER_ID;
+  }
 };
 #endif
\ No newline at end of file
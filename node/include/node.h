@@ -2,8 +2,21 @@
 #define NODE_H
 
 
+#include "alloc_stats.h"
+#include "frame_codec.h"
+#include "rtt_tracker.h"
+#include "shm_socket.h"
 #include "tcp_socket.h"
 
+/// Most transactions whose round trip time is tracked at once.
+#define RTT_MAX_IN_FLIGHT 1024
+/// Transactions without a reply for this long are reported as timed out.
+#define TRANSACTION_TIMEOUT_MS 5000
+/// Period of timeout checks, also the longest wait for a message.
+#define RTT_CHECK_INTERVAL_MS 1000
+/// Period of round trip time percentiles in the log.
+#define RTT_REPORT_INTERVAL_MS 10000
+
 
 /**
  * @class Node
@@ -25,21 +38,41 @@ class Node {
     * @param initiate_messaging A boolean indicating whether this node should initiate messaging.
     * @param router_ip The IP address of the router to which this node connects.
     * @param router_port The port number on the router for TCP communication.
+    * @param low_latency Enables latency tuning of the router connection.
     */
    Node(int nodeid, int dstid, bool initiate_messaging, std::string router_ip,
-        int router_port) {
+        int router_port, bool low_latency = false) {
      this->_id = nodeid;
      this->_dstId = dstid;
      this->_initiate_messaging = initiate_messaging;
-     this->_tcp_socket = new TCPSocket(router_ip, router_port);
+     this->_transport = new TCPSocket(router_ip, router_port);
+     this->_transport->setLowLatency(low_latency);
+   }
+
+   /**
+    * @brief Constructor for a node running on the same host as the router, frames go through shared memory.
+    *
+    * @param nodeid The unique identifier for this node.
+    * @param dstid The unique identifier for the destination node.
+    * @param initiate_messaging A boolean indicating whether this node should initiate messaging.
+    * @param shm_path Unix socket path of the router, its --shm option.
+    * @param low_latency Spins on an empty ring before sleeping.
+    */
+   Node(int nodeid, int dstid, bool initiate_messaging, std::string shm_path,
+        bool low_latency = false) {
+     this->_id = nodeid;
+     this->_dstId = dstid;
+     this->_initiate_messaging = initiate_messaging;
+     this->_transport = new ShmSocket(shm_path);
+     this->_transport->setLowLatency(low_latency);
    }
  
    /**
     * @brief Destructor for the Node class.
     * 
-    * Cleans up the resources used by the Node object, particularly the TCP socket.
+    * Cleans up the resources used by the Node object, particularly the router connection.
     */
-   ~Node() { delete this->_tcp_socket; }
+   ~Node() { delete this->_transport; }
  
    /**
     * @brief Starts the messaging process for the node.
@@ -48,12 +81,30 @@ class Node {
     * based on the node's configuration.
     */
    void start();
+
+   /**
+    * @brief Offers the router packed BCD frames on each connection, halving the bytes of every frame.
+    *
+    * Frames stay ASCII until the router answers the offer, routers without
+    * compact encoding ignore it.
+    *
+    * @param enabled true to offer it.
+    */
+   void setCompactEncoding(bool enabled) { this->_offer_compact = enabled; }
  
   private:
    int _id;                 ///< Unique identifier for this node.
    int _dstId;              ///< Unique identifier for the destination node.
-   TCPSocket* _tcp_socket;  ///< Pointer to the TCP socket used for communication.
+   Transport* _transport;   ///< Pointer to the router connection, TCP or shared memory.
    bool _initiate_messaging;///< Flag indicating if this node should initiate messaging.
+   int _next_trace = 0;     ///< Trace number of the next initiated transaction, from <id>000 on.
+   RttTracker _rtt{RTT_MAX_IN_FLIGHT, TRANSACTION_TIMEOUT_MS}; ///< Round trip times of sent frames.
+   RttTracker::Clock::time_point _next_check;  ///< Time of the next timeout check.
+   RttTracker::Clock::time_point _next_report; ///< Time of the next percentile report.
+   AllocCounts _reported_allocs;              ///< Heap allocations at the last report, built with ISC_ALLOC_STATS.
+   bool _offer_compact = false;                ///< Offers packed BCD frames to the router.
+   FrameEncoding _recv_encoding = FrameEncoding::ASCII;  ///< Encoding of frames from the router on this connection.
+   FrameEncoding _send_encoding = FrameEncoding::ASCII;  ///< Encoding of frames to the router on this connection.
  
    /**
     * @brief Sends a message to the destination node.
@@ -76,13 +127,37 @@ class Node {
     * @return An integer indicating the status of the message sending operation. 0 on success, or non-zero on failure.
     */
    int send_initiator_message();
+
+   /**
+    * @brief Offers packed BCD frames to the router if compact encoding is enabled.
+    *
+    * @return 0 on success or if nothing is offered, non-zero on failure.
+    */
+   int offerEncoding();
+
+   /**
+    * @brief Switches both directions to the encoding announced by the router.
+    *
+    * Frames from the router are read in the new encoding from now on. The node
+    * answers with its own switch message, the last one it sends in ASCII.
+    *
+    * @param encoding Encoding of the frames following the router's switch message.
+    * @return 0 on success, non-zero on failure.
+    */
+   int switchEncoding(FrameEncoding encoding);
  
    /**
     * @brief Closes the connection to the router.
     * 
-    * This function cleans up any resources associated with the TCP connection.
+    * This function cleans up any resources associated with the router connection.
     */
    void closeConnection();
+
+   /**
+    * @brief Expires timed out transactions and logs round trip time percentiles and heap allocations when due.
+    * @param now Current time.
+    */
+   void trackTransactions(RttTracker::Clock::time_point now);
  };
  
 #endif
\ No newline at end of file
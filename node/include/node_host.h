@@ -0,0 +1,130 @@
+#ifndef NODE_HOST_H
+#define NODE_HOST_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "backoff.h"
+#include "message.h"
+#include "tcp_socket.h"
+
+/// Bytes buffered per logical node in each direction, a multiple of MSG_LEN.
+#define HOSTED_BUFFER_SIZE (MSG_LEN * 8)
+
+/**
+ * @class NodeHost
+ * @brief Runs many logical nodes in one process, on one thread.
+ *
+ * Each logical node has its own router connection, handshakes with its own ID
+ * and answers frames with Message::processMessage like an ISC-Node process.
+ * All sockets are non-blocking and served by one poll() loop, a logical node
+ * costs its socket and two small fixed buffers instead of a process.
+ */
+class NodeHost {
+  public:
+   /**
+    * @brief Constructs a NodeHost object.
+    * @param router_ip The IP address of the router.
+    * @param router_port The port number of the router.
+    */
+   NodeHost(std::string router_ip, int router_port);
+
+   /**
+    * @brief Closes the connections of all logical nodes.
+    */
+   ~NodeHost();
+
+   /**
+    * @brief Adds a logical node, call before run().
+    * @param nodeid The unique identifier of the node.
+    * @param dstid The identifier of the node it sends its first message to.
+    * @param initiate_messaging Sends the first message after each handshake.
+    */
+   void addNode(int nodeid, int dstid, bool initiate_messaging);
+
+   /**
+    * @brief Adds the logical nodes of a config file.
+    * each line is `<id> <dstid> [passive]`, passive nodes only answer. empty lines and lines starting with # are skipped.
+    * @param path Path of the config file.
+    * @return false if the file cannot be read or a line is invalid.
+    */
+   bool loadConfig(const std::string& path);
+
+   /**
+    * @brief Gets the number of logical nodes.
+    */
+   size_t size() const { return _nodes.size(); }
+
+   /**
+    * @brief Runs the event loop, never returns.
+    */
+   void run();
+
+  private:
+   friend class NodeHostTest;  ///< drives the handlers of a node over a socketpair
+
+   using Clock = std::chrono::steady_clock;
+
+   enum class State { WAITING, CONNECTING, CONNECTED };
+
+   /**
+    * @brief One logical node and its connection.
+    */
+   struct HostedNode {
+     int id;
+     int dst_id;
+     bool initiate_messaging;
+     State state = State::WAITING;
+     int socket = -1;
+     Clock::time_point deadline;  ///< retry time while WAITING, connect timeout while CONNECTING
+     Backoff backoff;
+     int rx_len = 0;  ///< bytes of a partial frame in rx
+     int tx_len = 0;  ///< bytes waiting to be sent in tx
+     char rx[HOSTED_BUFFER_SIZE];
+     char tx[HOSTED_BUFFER_SIZE];
+
+     HostedNode(int nodeid, int dstid, bool initiate, unsigned seed)
+         : id(nodeid), dst_id(dstid), initiate_messaging(initiate),
+           backoff(RECONNECT_BASE_MS, RECONNECT_MAX_MS, seed) {}
+   };
+
+   std::string _router_ip;  ///< The IP address of the router.
+   int _router_port;        ///< The port number of the router.
+   sockaddr_in _router_addr;
+   std::vector<HostedNode> _nodes;
+
+   /**
+    * @brief Starts a non-blocking connect, the node is CONNECTING or WAITING for a retry afterwards.
+    */
+   void startConnect(HostedNode& node);
+
+   /**
+    * @brief Completes a connect reported writable, queues the handshake and the first message.
+    */
+   void onConnected(HostedNode& node);
+
+   /**
+    * @brief Reads frames and queues their replies, reads at most what the send buffer can take.
+    */
+   void onReadable(HostedNode& node);
+
+   /**
+    * @brief Sends queued bytes until the socket would block.
+    * @return false if the connection is broken.
+    */
+   bool flush(HostedNode& node);
+
+   /**
+    * @brief Appends a message to the send buffer.
+    * @return false if it does not fit.
+    */
+   bool queue(HostedNode& node, const std::string& message);
+
+   /**
+    * @brief Closes the connection of a node and schedules its reconnect after a jittered delay.
+    */
+   void disconnect(HostedNode& node);
+};
+
+#endif
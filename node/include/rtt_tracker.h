@@ -0,0 +1,190 @@
+#ifndef RTT_TRACKER_H
+#define RTT_TRACKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "iso_frame.h"
+#include "latency_histogram.h"
+
+/// Offset and length of the TRACE field in a frame.
+#define TRACE_OFFSET IsoFrame::offset<TraceField>()
+#define TRACE_LENGTH TraceField::width
+
+/**
+ * @class RttTracker
+ * @brief Round trip times of transactions, matched by the TRACE number of their frames.
+ *
+ * A frame sent by the node starts a transaction, the next frame received with
+ * the same TRACE completes it and its round trip time goes to a histogram, in
+ * microseconds. Transactions are kept in an open addressed table sized for the
+ * in-flight limit when constructed, tracking a frame never allocates.
+ * Transactions not completed within the timeout are expired. Not thread safe,
+ * used by the thread of the node.
+ */
+class RttTracker {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Constructs a RttTracker object.
+   * @param max_in_flight Most transactions tracked at once, later ones are not tracked.
+   * @param timeout_ms Transactions older than this are expired.
+   */
+  RttTracker(size_t max_in_flight, unsigned timeout_ms)
+      : _max_in_flight(max_in_flight), _timeout(std::chrono::milliseconds(timeout_ms)) {
+    // at most half full, probe sequences stay short
+    size_t capacity = 1;
+    while (capacity < 2 * max_in_flight) capacity *= 2;
+    _slots.resize(capacity);
+  }
+
+  /**
+   * @brief Starts the transaction of a sent frame, restarts it if its TRACE is already in flight.
+   * @param frame Frame of at least TRACE_OFFSET + TRACE_LENGTH bytes.
+   * @param now Send time.
+   * @return false if the TRACE is invalid or the in-flight limit is reached.
+   */
+  bool onSent(const char* frame, Clock::time_point now) {
+    uint32_t trace;
+    if (!parseTrace(frame, trace)) return false;
+    size_t index = find(trace);
+    if (!_slots[index].used) {
+      if (_in_flight == _max_in_flight) {
+        _overflows++;
+        return false;
+      }
+      _slots[index].used = true;
+      _slots[index].trace = trace;
+      _in_flight++;
+    }
+    _slots[index].sent = now;
+    return true;
+  }
+
+  /**
+   * @brief Completes the transaction of a received frame and records its round trip time.
+   * @param frame Frame of at least TRACE_OFFSET + TRACE_LENGTH bytes.
+   * @param now Receive time.
+   * @return false if no transaction is in flight with its TRACE.
+   */
+  bool onReceived(const char* frame, Clock::time_point now) {
+    uint32_t trace;
+    if (!parseTrace(frame, trace)) return false;
+    size_t index = find(trace);
+    if (!_slots[index].used) return false;
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - _slots[index].sent);
+    _histogram.record(static_cast<uint64_t>(rtt.count()));
+    erase(index);
+    return true;
+  }
+
+  /**
+   * @brief Expires transactions older than the timeout.
+   * @param now Current time.
+   * @param on_timeout Called with the TRACE of each expired transaction.
+   * @return Number of expired transactions.
+   */
+  template <typename Callback>
+  size_t expire(Clock::time_point now, Callback on_timeout) {
+    size_t expired = 0;
+    size_t index = 0;
+    while (index < _slots.size()) {
+      Slot& slot = _slots[index];
+      if (slot.used && now - slot.sent > _timeout) {
+        on_timeout(slot.trace);
+        erase(index);
+        expired++;
+        // erase may move another entry into this slot, check it again
+        continue;
+      }
+      index++;
+    }
+    _timeouts += expired;
+    return expired;
+  }
+
+  /**
+   * @brief Round trip times of completed transactions, in microseconds.
+   */
+  LatencyHistogram& histogram() { return _histogram; }
+
+  /**
+   * @brief Transactions in flight.
+   */
+  size_t inFlight() const { return _in_flight; }
+
+  /**
+   * @brief Expired transactions since constructed.
+   */
+  uint64_t timeouts() const { return _timeouts; }
+
+  /**
+   * @brief Sent frames not tracked because of the in-flight limit, since constructed.
+   */
+  uint64_t overflows() const { return _overflows; }
+
+ private:
+  struct Slot {
+    bool used = false;
+    uint32_t trace = 0;
+    Clock::time_point sent;
+  };
+
+  /**
+   * @brief Parses the decimal TRACE field.
+   */
+  static bool parseTrace(const char* frame, uint32_t& trace) {
+    int64_t value = IsoFrame::get<TraceField>(frame);
+    trace = static_cast<uint32_t>(value);
+    return value >= 0;
+  }
+
+  size_t home(uint32_t trace) const {
+    // multiplicative hash, consecutive TRACE numbers spread over the table
+    return static_cast<size_t>((trace * 2654435761u) >> 8) & (_slots.size() - 1);
+  }
+
+  /**
+   * @brief Slot holding a TRACE, or the free slot ending its probe sequence.
+   */
+  size_t find(uint32_t trace) const {
+    size_t index = home(trace);
+    while (_slots[index].used && _slots[index].trace != trace) {
+      index = (index + 1) & (_slots.size() - 1);
+    }
+    return index;
+  }
+
+  /**
+   * @brief Frees a slot, shifts back later entries of the probe sequence so lookups need no tombstones.
+   */
+  void erase(size_t index) {
+    size_t mask = _slots.size() - 1;
+    _slots[index].used = false;
+    _in_flight--;
+    size_t next = (index + 1) & mask;
+    while (_slots[next].used) {
+      size_t wanted = home(_slots[next].trace);
+      // move the entry if the freed slot lies between its home and it
+      if (((next - wanted) & mask) >= ((next - index) & mask)) {
+        _slots[index] = _slots[next];
+        _slots[next].used = false;
+        index = next;
+      }
+      next = (next + 1) & mask;
+    }
+  }
+
+  size_t _max_in_flight;        ///< Most transactions tracked at once.
+  Clock::duration _timeout;     ///< Age of an expired transaction.
+  std::vector<Slot> _slots;     ///< Open addressed table, allocated once.
+  size_t _in_flight = 0;        ///< Used slots.
+  uint64_t _timeouts = 0;       ///< Expired transactions.
+  uint64_t _overflows = 0;      ///< Untracked sends.
+  LatencyHistogram _histogram;  ///< Round trip times in microseconds.
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef SHMSOCKET_H
+#define SHMSOCKET_H
+
+#include <string>
+
+#include "shm_ring.h"
+#include "transport.h"
+
+/**
+ * @class ShmSocket
+ * @brief Connection to a router running on the same host, through shared memory rings.
+ *
+ * The node connects to the Unix socket of the router and receives a memory
+ * region holding two rings and two eventfd doorbells. Frames are then copied
+ * through the rings without system calls, a doorbell is rung only when the
+ * other side sleeps. The Unix connection stays open, the router sees its
+ * closing when the node exits. Linux only.
+ */
+class ShmSocket : public Transport {
+  public:
+   /**
+    * @brief Constructs a ShmSocket object.
+    * @param path Unix socket path of the router, its --shm option.
+    */
+   ShmSocket(std::string path);
+
+   /**
+    * @brief Destroys the ShmSocket object and closes the connection if open.
+    */
+   ~ShmSocket() override;
+
+   int connect_to_server() override;
+   int recvMessage(int& bytes_received, int needed_bytes) override;
+   int sendMessage(std::string message) override;
+   const char* getBuffer() const override;
+   void closeSocket() override;
+
+   /**
+    * @brief Enables spinning on an empty ring before sleeping on the doorbell.
+    * @param enabled true to enable.
+    */
+   void setLowLatency(bool enabled) override;
+
+  private:
+   std::string _path;            ///< Unix socket path of the router.
+   int _socket = -1;             ///< Unix connection, kept open as liveness signal.
+   void* _region = nullptr;      ///< Mapped region of both rings.
+   size_t _region_size = 0;      ///< Size of the mapping.
+   ShmRing* _to_router = nullptr;  ///< Ring of frames to the router.
+   ShmRing* _to_node = nullptr;    ///< Ring of frames from the router.
+   int _router_doorbell = -1;    ///< Eventfd rung to wake the router.
+   int _node_doorbell = -1;      ///< Eventfd the router rings to wake this node.
+   char* _buffer;                ///< Buffer to hold received messages.
+   bool _low_latency = false;    ///< Spin before sleeping.
+
+   /**
+    * @brief Receives the setup message and descriptors of the router, maps the rings.
+    * @return 0 on success, or 1 on failure.
+    */
+   int attach();
+
+   /**
+    * @brief Sleeps until the router rings the doorbell of the node.
+    * @param timeout_ms Longest wait, -1 waits forever.
+    * @return 1 if rung, 0 on timeout, -1 if the router closed the connection.
+    */
+   int waitDoorbell(int timeout_ms);
+
+   /**
+    * @brief Rings the doorbell of the router.
+    */
+   void wakeRouter();
+ };
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <iostream>
 
+#include "transport.h"
+
 #ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -10,21 +12,27 @@
 #else
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #endif
 
-#define NO_ERR 0
+/// Longest wait of a connect to the router.
+#define CONNECT_TIMEOUT_MS 3000
 
 /**
  * @class TCPSocket
  * @brief A class for managing TCP socket connections.
  * 
  * This class provides functionalities to connect to a TCP server,
- * send and receive messages, and manage the socket lifecycle.
+ * send and receive messages, and manage the socket lifecycle. The socket is
+ * non-blocking and waits with poll(), so connecting gives up after a timeout,
+ * and one recv() reads as many frames as the kernel has, later messages are
+ * served from the buffer without system calls.
  */
-class TCPSocket {
+class TCPSocket : public Transport {
   public:
    /**
     * @brief Constructs a TCPSocket object.
@@ -36,47 +44,71 @@ class TCPSocket {
    /**
     * @brief Destroys the TCPSocket object and closes the socket if open.
     */
-   ~TCPSocket();
+   ~TCPSocket() override;
  
    /**
-    * @brief Connects to the server.
+    * @brief Connects to the server, waits at most CONNECT_TIMEOUT_MS.
     * @return 0 on success, or an error code on failure.
     */
-   int connect_to_server();
+   int connect_to_server() override;
  
    /**
-    * @brief Receives a message from the server.
-    * @param bytes_received Reference to an integer to store the number of bytes received.    
+    * @brief Receives a message from the server, from the buffer if a previous recv() already got it.
+    * @param bytes_received Reference to an integer to store the number of bytes received, needed_bytes on success.
     * @param needed_bytes an integer to store the number of bytes needed to recv from socket
-    * @return 0 on success, or an error code on failure.
+    * @return 0 on success, RECV_TIMEOUT, or an error code on failure.
     */
-   int recvMessage(int& bytes_received,int needed_bytes);
+   int recvMessage(int& bytes_received,int needed_bytes) override;
  
    /**
-    * @brief Sends a message to the server.
+    * @brief Sends a message to the server, waits while the socket buffer is full.
     * @param message The message to send.
-    * @return 0 on success, or an error code on failure.
+    * @return Number of bytes sent, or -1 on failure.
     */
-   int sendMessage(std::string message);
+   int sendMessage(std::string message) override;
  
    /**
     * @brief Retrieves the buffer containing the received message.
     * @return A pointer to the buffer.
     */
-   const char* getBuffer() const;
+   const char* getBuffer() const override;
  
    /**
     * @brief Closes the socket connection.
     */
-   void closeSocket();
+   void closeSocket() override;
+
+   /**
+    * @brief Enables latency tuning of the socket, applied on the next connect.
+    * sets TCP_NODELAY, and on Linux TCP_QUICKACK and SO_BUSY_POLL.
+    * @param enabled true to enable.
+    */
+   void setLowLatency(bool enabled) override;
  
   private:
    std::string _server_ip; ///< The IP address of the server.
    int _server_port;       ///< The port number of the server.
  
    sockaddr_in _server_addr; ///< Structure to hold server address information.
-   int _socket;              ///< The socket file descriptor.
-   char* _buffer;            ///< Buffer to hold received messages.
+   int _socket = -1;         ///< The socket file descriptor.
+   char* _buffer;            ///< Buffer to hold received bytes, not yet consumed ones start at _consumed.
+   int _buffered = 0;        ///< Bytes in _buffer.
+   int _consumed = 0;        ///< Bytes of _buffer already returned as messages.
+   char* _message;           ///< Last received message, zero terminated.
+   bool _low_latency = false; ///< Latency tuning of the socket is enabled.
+
+   /**
+    * @brief Applies latency tuning options on the connected socket.
+    */
+   void tuneSocket();
+
+   /**
+    * @brief Waits until the socket is ready.
+    * @param events POLLIN or POLLOUT.
+    * @param timeout_ms Maximum wait, -1 waits forever.
+    * @return 1 if ready, 0 on timeout, -1 on error.
+    */
+   int waitFor(short events, int timeout_ms);
  };
  
 
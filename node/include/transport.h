@@ -0,0 +1,69 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+
+#define NO_ERR 0
+/// recvMessage() result when the receive timeout expired without a message, the connection is fine.
+#define RECV_TIMEOUT 2
+
+/**
+ * @class Transport
+ * @brief Connection of a node to the router, TCP or shared memory.
+ *
+ * The node speaks the same protocol on every transport: an ID message, then
+ * 32 byte frames in both directions.
+ */
+class Transport {
+  public:
+   virtual ~Transport() = default;
+
+   /**
+    * @brief Connects to the router.
+    * @return 0 on success, or an error code on failure.
+    */
+   virtual int connect_to_server() = 0;
+
+   /**
+    * @brief Receives a message from the router, waits until one arrives or the receive timeout expires.
+    * @param bytes_received Reference to an integer to store the number of bytes received.
+    * @param needed_bytes an integer to store the number of bytes needed to recv
+    * @return 0 on success, RECV_TIMEOUT, or an error code on failure.
+    */
+   virtual int recvMessage(int& bytes_received, int needed_bytes) = 0;
+
+   /**
+    * @brief Sends a message to the router.
+    * @param message The message to send.
+    * @return Number of bytes sent, or -1 on failure.
+    */
+   virtual int sendMessage(std::string message) = 0;
+
+   /**
+    * @brief Retrieves the buffer containing the received message.
+    * @return A pointer to the buffer.
+    */
+   virtual const char* getBuffer() const = 0;
+
+   /**
+    * @brief Closes the connection.
+    */
+   virtual void closeSocket() = 0;
+
+   /**
+    * @brief Enables latency tuning, applied on the next connect.
+    * @param enabled true to enable.
+    */
+   virtual void setLowLatency(bool enabled) = 0;
+
+   /**
+    * @brief Bounds the wait of recvMessage(), lets the caller do periodic work on an idle connection.
+    * @param timeout_ms Longest wait in milliseconds, -1 (default) waits forever.
+    */
+   void setRecvTimeout(int timeout_ms) { _recv_timeout_ms = timeout_ms; }
+
+  protected:
+   int _recv_timeout_ms = -1; ///< Longest wait of recvMessage().
+ };
+
+#endif
@@ -5,25 +5,49 @@
 int main(int argc, char* argv[]) {
     Logger::Initialize();
     //std::cout<<"argc = "<<argc;
-    if (argc != 5) {
-        LOG_CRITICAL("Insufficient Argument.\nUsage: ISC-Node.exe <id> <dstid> <router_ip> <router_port>");
+    // co-located nodes reach the router through shared memory
+    bool shm = argc >= 5 && std::string(argv[3]) == "--shm";
+    bool low_latency = false;
+    bool compact = false;
+    bool valid_flags = argc >= 5;
+    for (int i = 5; i < argc; i++) {
+        std::string flag = argv[i];
+        if (flag == "--low-latency") low_latency = true;
+        else if (flag == "--compact") compact = true;
+        else valid_flags = false;
+    }
+    if (!valid_flags) {
+        LOG_CRITICAL("Insufficient Argument.\nUsage: ISC-Node.exe <id> <dstid> <router_ip> <router_port> [--low-latency] [--compact]\n"
+                     "       ISC-Node.exe <id> <dstid> --shm <unix_socket_path> [--low-latency] [--compact]");
         return 1;
     }
     try {
          
         int id = std::stoi(argv[1]);
         int dstid = std::stoi(argv[2]);
-        std::string router_ip = argv[3];
-        int router_port = std::stoi(argv[4]);
 
         bool initiate_messaging = true;
 
         LOG_INFO("Node {} Started.", id);
         LOG_INFO("Dst Node is : {}", dstid);
+        if (low_latency) LOG_INFO("Low latency mode is on.");
+        if (compact) LOG_INFO("Packed BCD frames are offered to the router.");
+
+        if (shm) {
+            std::string shm_path = argv[4];
+            LOG_INFO("Router is on shared memory {}", shm_path);
+            Node node(id,dstid,initiate_messaging,shm_path,low_latency);
+            node.setCompactEncoding(compact);
+            node.start();
+            return 0;
+        }
+
+        std::string router_ip = argv[3];
+        int router_port = std::stoi(argv[4]);
         LOG_INFO("Router is on {}:{}", router_ip, router_port);
-    
      
-        Node node(id,dstid,initiate_messaging,router_ip,router_port);
+        Node node(id,dstid,initiate_messaging,router_ip,router_port,low_latency);
+        node.setCompactEncoding(compact);
         node.start();
     } catch (const std::exception& e) {
         LOG_ERROR("Error: " + std::string(e.what())) ;
@@ -1,5 +1,9 @@
 #include "node.h"
 
+#include <cstring>
+#include <random>
+
+#include "backoff.h"
 #include "logger.h"
 #include "message.h"
 
@@ -28,29 +32,69 @@ void sleep(int milliseconds)
  * 
  * This method continuously attempts to connect to the server, subscribes to a router,
  * and handles incoming messages. If any errors occur during the process,
- * it will attempt to reconnect after a specified delay.
+ * it will attempt to reconnect after a delay growing exponentially with
+ * jitter, reset once subscribed.
  */
 void Node::start() {
+  // seeded per node, nodes restarted together still pick different delays
+  Backoff backoff(RECONNECT_BASE_MS, RECONNECT_MAX_MS,
+                  std::random_device{}() ^ static_cast<unsigned>(this->_id));
+  // wake up now and then on an idle connection, to expire lost transactions
+  this->_transport->setRecvTimeout(RTT_CHECK_INTERVAL_MS);
+  // nodes initiating towards each other use distinct trace numbers
+  _next_trace = (this->_id * 1000) % 1000000;
+  _next_report = RttTracker::Clock::now() +
+                 std::chrono::milliseconds(RTT_REPORT_INTERVAL_MS);
+  // start up allocations are not charged to transactions
+  _reported_allocs = AllocStats::total();
   while (true) {
-    int byte_send = 0;
-    int errcode = this->_tcp_socket->connect_to_server();
+    int errcode = this->_transport->connect_to_server();
     if (errcode == NO_ERR) {
+      // a new router may not speak the encoding of the previous one
+      _recv_encoding = FrameEncoding::ASCII;
+      _send_encoding = FrameEncoding::ASCII;
 
       int err = subscribe_to_router();
-      if (err != NO_ERR) {closeConnection();continue;}
-
-      err = send_initiator_message();
-      if (err != NO_ERR) {closeConnection();continue;}
+      if (err == NO_ERR) {
+        backoff.reset();
+        err = offerEncoding();
+      }
+      if (err == NO_ERR) {
+        err = send_initiator_message();
+      }
 
-      err = NO_ERR;
       while (err == NO_ERR) {
 
         int recv_bytes = 0;
-        err = this->_tcp_socket->recvMessage(recv_bytes,MESSAGE_LENGTH);
-        if (err != NO_ERR) {closeConnection();continue;}
+        int frame_size = FrameCodec::frame_size(_recv_encoding);
+        err = this->_transport->recvMessage(recv_bytes, frame_size);
+        auto now = RttTracker::Clock::now();
+        if (err == RECV_TIMEOUT) {
+          trackTransactions(now);
+          err = NO_ERR;
+          continue;
+        }
+        if (err != NO_ERR) break;
 
-        if (recv_bytes == MESSAGE_LENGTH) {
-          auto recv_buffer = this->_tcp_socket->getBuffer();
+        if (recv_bytes == frame_size) {
+          auto recv_buffer = this->_transport->getBuffer();
+          char frame[MESSAGE_LENGTH + 1];
+          if (_recv_encoding != FrameEncoding::ASCII) {
+            // packed frames are processed as ASCII ones
+            FrameCodec::unpack(recv_buffer, frame);
+            frame[MESSAGE_LENGTH] = 0;
+            recv_buffer = frame;
+            recv_bytes = MESSAGE_LENGTH;
+          }
+          // logged here, transports see packed frames as raw bytes
+          LOG_INFO("Received MSG : {}", std::string(recv_buffer, recv_bytes));
+          int encoding = Message::extractEncodingSwitch(recv_buffer);
+          if (encoding != -1) {
+            err = switchEncoding(static_cast<FrameEncoding>(encoding));
+            continue;
+          }
+          _rtt.onReceived(recv_buffer, now);
+          trackTransactions(now);
           std::string reply =
               Message::processMessage(this->_id, recv_buffer, recv_bytes);
               err = send_message(reply);
@@ -59,10 +103,11 @@ void Node::start() {
           LOG_WARN("Received MSG Len is invalid. Len = {}",recv_bytes);
         }
       }
-    } else {
-      sleep(5000);
-      LOG_WARN("retry connection to router...");
+      closeConnection();
     }
+    int delay = static_cast<int>(backoff.nextDelayMs());
+    LOG_WARN("retry connection to router in {} ms", delay);
+    sleep(delay);
   }
 }
 
@@ -79,12 +124,31 @@ void Node::start() {
 int Node::send_message(std::string msg){
   int byte_send = 0;
   int retry_count = 0;
+  auto now = RttTracker::Clock::now();
+  bool transaction = msg.size() == MESSAGE_LENGTH && !Message::isToRouter(msg);
+  // ASCII frame is kept for its TRACE, a packed one reuses msg capacity
+  char frame[MESSAGE_LENGTH];
+  if (msg.size() == MESSAGE_LENGTH) memcpy(frame, msg.data(), MESSAGE_LENGTH);
+  if (_send_encoding == FrameEncoding::PACKED_BCD &&
+      msg.size() == MESSAGE_LENGTH) {
+    char packed[COMPACT_MESSAGE_SIZE];
+    if (!FrameCodec::pack(frame, packed)) {
+      LOG_ERROR("MSG has non digit bytes, it cannot be packed : {}", msg);
+      return 1;
+    }
+    msg.assign(packed, COMPACT_MESSAGE_SIZE);
+  }
   while (byte_send <= 0 && retry_count < MAX_RETRY) {
-    byte_send = this->_tcp_socket->sendMessage(msg);
+    byte_send = this->_transport->sendMessage(msg);
     retry_count++;
   }
 
-  if (byte_send > 0) return NO_ERR;  // successfully sent
+  if (byte_send > 0) {
+    // a frame starts a transaction, the frame coming back with its TRACE
+    // completes it. frames to the router are not answered
+    if (transaction) _rtt.onSent(frame, now);
+    return NO_ERR;  // successfully sent
+  }
   return 1; // error occurred
 }
 
@@ -112,19 +176,89 @@ int Node::subscribe_to_router() {
  */
 int Node::send_initiator_message() {
   if (_initiate_messaging) {
-    std::string first_msg = Message::buildFirstMessage(this->_id, this->_dstId);
+    // a new trace number per connection, a late reply of the previous one doesnt match
+    std::string first_msg =
+        Message::buildFirstMessage(this->_id, this->_dstId, _next_trace);
+    _next_trace = (_next_trace + 1) % 1000000;
     return send_message(first_msg);
   } else {
     return 0;  // successfully sent (no action taken)
   }
 }
 
+/**
+ * @brief Offers packed BCD frames to the router.
+ *
+ * The node keeps sending ASCII frames until the router answers with its
+ * switch message, see switchEncoding().
+ *
+ * @return int Returns 0 if compact encoding is disabled,
+ *             otherwise returns the result of the send operation.
+ */
+int Node::offerEncoding() {
+  if (!_offer_compact) return NO_ERR;
+  return send_message(Message::buildEncodingMessage(
+      this->_id, ENCODING_OFFER_MTI, FrameEncoding::PACKED_BCD));
+}
+
+/**
+ * @brief Switches to the encoding announced by the router.
+ *
+ * @param encoding Encoding of the frames following the router's switch message.
+ * @return int Returns the result of sending the node's switch message.
+ */
+int Node::switchEncoding(FrameEncoding encoding) {
+  _recv_encoding = encoding;
+  int err = send_message(
+      Message::buildEncodingMessage(this->_id, ENCODING_SWITCH_MTI, encoding));
+  _send_encoding = encoding;
+  LOG_INFO("Frames are {} from now on.", FrameCodec::name(encoding));
+  return err;
+}
+
 /**
  * @brief Closes the connection to the server.
  * 
- * This method closes the TCP socket associated with the Node,
+ * This method closes the router connection associated with the Node,
  * effectively terminating the connection to the server.
  */
 void Node::closeConnection(){
-  this->_tcp_socket->closeSocket();
+  this->_transport->closeSocket();
+}
+
+/**
+ * @brief Expires timed out transactions and reports round trip times.
+ *
+ * Runs at most every RTT_CHECK_INTERVAL_MS. Each transaction without a reply
+ * for TRANSACTION_TIMEOUT_MS is logged and dropped from the table. Every
+ * RTT_REPORT_INTERVAL_MS the percentiles of the interval are logged, a node
+ * without traffic doesnt fill the log.
+ *
+ * @param now Current time.
+ */
+void Node::trackTransactions(RttTracker::Clock::time_point now) {
+  if (now < _next_check) return;
+  _next_check = now + std::chrono::milliseconds(RTT_CHECK_INTERVAL_MS);
+  _rtt.expire(now, [](uint32_t trace) {
+    LOG_WARN("Transaction {:06} timed out", trace);
+  });
+
+  if (now < _next_report) return;
+  _next_report = now + std::chrono::milliseconds(RTT_REPORT_INTERVAL_MS);
+  LatencyHistogram& rtt = _rtt.histogram();
+  if (rtt.count() == 0) return;
+  LOG_INFO(
+      "RTT : completed={} in_flight={} timed_out={} rtt_us p50={} p99={} "
+      "p999={} max={}",
+      rtt.count(), _rtt.inFlight(), _rtt.timeouts(), rtt.percentile(50),
+      rtt.percentile(99), rtt.percentile(99.9), rtt.max());
+  if (AllocStats::enabled()) {
+    AllocCounts counts = AllocStats::total();
+    uint64_t allocations = counts.allocations - _reported_allocs.allocations;
+    LOG_INFO("Heap : allocations=+{} bytes=+{} per_transaction={:.2f}",
+             allocations, counts.bytes - _reported_allocs.bytes,
+             static_cast<double>(allocations) / rtt.count());
+    _reported_allocs = counts;
+  }
+  rtt.reset();
 }
@@ -0,0 +1,327 @@
+#include "node_host.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#endif
+
+#include "logger.h"
+
+#ifdef _WIN32
+#define poll WSAPoll
+#define SEND_FLAGS 0
+static bool wouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+static bool connectInProgress() { return wouldBlock(); }
+static void closeFd(int socket) { closesocket(socket); }
+#else
+#define SEND_FLAGS MSG_NOSIGNAL
+static bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+static bool connectInProgress() { return errno == EINPROGRESS; }
+static void closeFd(int socket) { close(socket); }
+#endif
+
+/// Longest poll() wait, bounds how late a retry or connect timeout is noticed.
+const int HOST_POLL_TIMEOUT_MS = 100;
+
+/**
+ * @brief Constructs a NodeHost instance for the router at the given address.
+ *
+ * @param router_ip The IP address of the router.
+ * @param router_port The port number of the router.
+ */
+NodeHost::NodeHost(std::string router_ip, int router_port) {
+  _router_ip = router_ip;
+  _router_port = router_port;
+  _router_addr = sockaddr_in{};
+  _router_addr.sin_family = AF_INET;
+  _router_addr.sin_port = htons(router_port);
+  inet_pton(AF_INET, router_ip.c_str(), &_router_addr.sin_addr);
+#ifdef _WIN32
+  WSADATA wsaData;
+  WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+}
+
+/**
+ * @brief Closes the connections of all logical nodes.
+ */
+NodeHost::~NodeHost() {
+  for (auto& node : _nodes) {
+    if (node.socket != -1) closeFd(node.socket);
+  }
+#ifdef _WIN32
+  WSACleanup();
+#endif
+}
+
+/**
+ * @brief Adds a logical node, its jitter is seeded per node.
+ *
+ * @param nodeid The unique identifier of the node.
+ * @param dstid The identifier of the node it sends its first message to.
+ * @param initiate_messaging Sends the first message after each handshake.
+ */
+void NodeHost::addNode(int nodeid, int dstid, bool initiate_messaging) {
+  _nodes.emplace_back(nodeid, dstid, initiate_messaging,
+                      std::random_device{}() ^ static_cast<unsigned>(nodeid));
+}
+
+/**
+ * @brief Adds the logical nodes listed in a config file.
+ *
+ * @param path Path of the config file.
+ * @return bool false if the file cannot be read or a line is invalid.
+ */
+bool NodeHost::loadConfig(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG_CRITICAL("Cannot open node config file : {}", path);
+    return false;
+  }
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    std::istringstream fields(line);
+    std::string id, dst, mode;
+    if (!(fields >> id) || id[0] == '#') continue;
+    fields >> dst >> mode;
+    try {
+      int nodeid = std::stoi(id);
+      int dstid = std::stoi(dst);
+      if (!mode.empty() && mode != "passive") throw std::invalid_argument(mode);
+      addNode(nodeid, dstid, mode.empty());
+    } catch (const std::exception&) {
+      LOG_CRITICAL("Invalid node at {}:{}", path, line_number);
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Runs the event loop of all logical nodes.
+ *
+ * Every iteration starts due connects, polls each socket for what its state
+ * waits for, and serves the ready ones. A connected node is polled for reading
+ * only while its send buffer has room, so a router sending faster than the
+ * node can answer is pushed back by TCP instead of growing memory.
+ */
+void NodeHost::run() {
+  LOG_INFO("Node host started with {} nodes.", _nodes.size());
+  std::vector<pollfd> fds;
+  std::vector<size_t> owners;  // node index of each pollfd
+  fds.reserve(_nodes.size());
+  owners.reserve(_nodes.size());
+
+  while (true) {
+    auto now = Clock::now();
+    fds.clear();
+    owners.clear();
+    for (size_t i = 0; i < _nodes.size(); i++) {
+      HostedNode& node = _nodes[i];
+      if (node.state == State::WAITING && now >= node.deadline) {
+        startConnect(node);
+      } else if (node.state == State::CONNECTING && now >= node.deadline) {
+        LOG_ERROR("Node {} connection timed out.", node.id);
+        disconnect(node);
+      }
+      if (node.state == State::WAITING) continue;
+
+      pollfd fd{};
+      fd.fd = node.socket;
+      if (node.state == State::CONNECTING || node.tx_len > 0) {
+        fd.events |= POLLOUT;
+      }
+      if (node.state == State::CONNECTED &&
+          node.tx_len <= HOSTED_BUFFER_SIZE - MSG_LEN) {
+        fd.events |= POLLIN;
+      }
+      fds.push_back(fd);
+      owners.push_back(i);
+    }
+
+    int ready = fds.empty() ? 0
+                            : poll(fds.data(), static_cast<unsigned>(fds.size()),
+                                   HOST_POLL_TIMEOUT_MS);
+    if (fds.empty()) {
+      // every node waits for a retry
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(HOST_POLL_TIMEOUT_MS));
+      continue;
+    }
+    if (ready <= 0) continue;
+
+    for (size_t k = 0; k < fds.size(); k++) {
+      if (fds[k].revents == 0) continue;
+      HostedNode& node = _nodes[owners[k]];
+      if (node.state == State::CONNECTING) {
+        onConnected(node);
+        continue;
+      }
+      if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+        onReadable(node);
+      }
+      if (node.state == State::CONNECTED && node.tx_len > 0 && !flush(node)) {
+        disconnect(node);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Starts a non-blocking connect to the router.
+ *
+ * @param node The logical node.
+ */
+void NodeHost::startConnect(HostedNode& node) {
+  node.socket = socket(AF_INET, SOCK_STREAM, 0);
+  if (node.socket == -1) {
+    LOG_ERROR("Socket creation failed");
+    disconnect(node);
+    return;
+  }
+#ifdef _WIN32
+  u_long non_blocking = 1;
+  ioctlsocket(node.socket, FIONBIO, &non_blocking);
+#else
+  fcntl(node.socket, F_SETFL, fcntl(node.socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+  node.rx_len = 0;
+  node.tx_len = 0;
+  if (connect(node.socket, reinterpret_cast<sockaddr*>(&_router_addr),
+              sizeof(_router_addr)) == 0) {
+    onConnected(node);
+  } else if (connectInProgress()) {
+    node.state = State::CONNECTING;
+    node.deadline = Clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+  } else {
+    disconnect(node);
+  }
+}
+
+/**
+ * @brief Checks the result of the connect and queues the handshake.
+ *
+ * @param node The logical node.
+ */
+void NodeHost::onConnected(HostedNode& node) {
+  int error = 0;
+  socklen_t len = sizeof(error);
+  getsockopt(node.socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error),
+             &len);
+  if (error != 0) {
+    disconnect(node);
+    return;
+  }
+  node.state = State::CONNECTED;
+  node.backoff.reset();
+  queue(node, Message::buildIdMessage(node.id));
+  if (node.initiate_messaging) {
+    queue(node, Message::buildFirstMessage(node.id, node.dst_id));
+  }
+  LOG_INFO("Node {} connected to Server : [{}:{}]", node.id, _router_ip,
+           _router_port);
+  if (!flush(node)) disconnect(node);
+}
+
+/**
+ * @brief Receives frames and queues their replies.
+ *
+ * Each frame gets at most one reply of the same size, so reading only as many
+ * bytes as complete frames the send buffer has room for never drops a reply.
+ *
+ * @param node The logical node.
+ */
+void NodeHost::onReadable(HostedNode& node) {
+  // completes at most as many frames as there is room for replies
+  int replies = (HOSTED_BUFFER_SIZE - node.tx_len) / MSG_LEN;
+  int room = std::min(HOSTED_BUFFER_SIZE - node.rx_len,
+                      replies * MSG_LEN + MSG_LEN - 1 - node.rx_len);
+  int received = recv(node.socket, node.rx + node.rx_len, room, 0);
+  if (received <= 0) {
+    if (received == -1 && wouldBlock()) return;
+    LOG_ERROR("Node {} connection closed by server", node.id);
+    disconnect(node);
+    return;
+  }
+  node.rx_len += received;
+
+  int offset = 0;
+  for (; node.rx_len - offset >= MSG_LEN; offset += MSG_LEN) {
+    LOG_TRACE("Node {} received MSG : {}", node.id,
+              std::string(node.rx + offset, MSG_LEN));
+    std::string reply = Message::processMessage(node.id, node.rx + offset, MSG_LEN);
+    if (!reply.empty()) queue(node, reply);
+  }
+  // keep the partial frame for the next recv()
+  node.rx_len -= offset;
+  memmove(node.rx, node.rx + offset, node.rx_len);
+}
+
+/**
+ * @brief Sends queued bytes until done or the socket would block.
+ *
+ * @param node The logical node.
+ * @return bool false if the connection is broken.
+ */
+bool NodeHost::flush(HostedNode& node) {
+  int sent_total = 0;
+  while (sent_total < node.tx_len) {
+    int sent = send(node.socket, node.tx + sent_total, node.tx_len - sent_total,
+                    SEND_FLAGS);
+    if (sent > 0) {
+      sent_total += sent;
+    } else if (sent == -1 && wouldBlock()) {
+      break;
+    } else {
+      LOG_ERROR("Node {} send failed.", node.id);
+      return false;
+    }
+  }
+  node.tx_len -= sent_total;
+  memmove(node.tx, node.tx + sent_total, node.tx_len);
+  return true;
+}
+
+/**
+ * @brief Appends a message to the send buffer of a node.
+ *
+ * @param node The logical node.
+ * @param message The message.
+ * @return bool false if it does not fit.
+ */
+bool NodeHost::queue(HostedNode& node, const std::string& message) {
+  int size = static_cast<int>(message.size());
+  if (node.tx_len + size > HOSTED_BUFFER_SIZE) {
+    LOG_WARN("Node {} send buffer is full, message dropped.", node.id);
+    return false;
+  }
+  memcpy(node.tx + node.tx_len, message.data(), size);
+  node.tx_len += size;
+  LOG_TRACE("Node {} queued MSG : {}", node.id, message);
+  return true;
+}
+
+/**
+ * @brief Closes the connection of a node and schedules its reconnect.
+ *
+ * @param node The logical node.
+ */
+void NodeHost::disconnect(HostedNode& node) {
+  if (node.socket != -1) closeFd(node.socket);
+  node.socket = -1;
+  node.state = State::WAITING;
+  node.rx_len = 0;
+  node.tx_len = 0;
+  int delay = static_cast<int>(node.backoff.nextDelayMs());
+  node.deadline = Clock::now() + std::chrono::milliseconds(delay);
+  LOG_WARN("Node {} retry connection to router in {} ms", node.id, delay);
+}
@@ -0,0 +1,272 @@
+#include "shm_socket.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "logger.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+const int SHM_BUFFER_SIZE = 32 * 100;
+const int SHM_SPIN_US = 50;
+
+/**
+ * @brief Constructs a ShmSocket instance for the specified router path.
+ *
+ * @param path Unix socket path the router accepts co-located nodes on.
+ */
+ShmSocket::ShmSocket(std::string path) {
+  this->_buffer = new char[SHM_BUFFER_SIZE];
+  this->_path = path;
+}
+
+/**
+ * @brief Destructor for the ShmSocket class.
+ *
+ * Cleans up allocated resources, the buffer, the mapping and the descriptors.
+ */
+ShmSocket::~ShmSocket() {
+  closeSocket();
+  delete[] _buffer;
+}
+
+#ifdef __linux__
+
+/**
+ * @brief Connects to the Unix socket of the router and maps the rings.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int ShmSocket::connect_to_server() {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (_path.size() >= sizeof(addr.sun_path)) {
+    LOG_ERROR("Shared memory path is too long : {}", _path);
+    return 1;
+  }
+  strncpy(addr.sun_path, _path.c_str(), sizeof(addr.sun_path) - 1);
+
+  _socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_socket == -1) {
+    LOG_ERROR("Socket creation failed");
+    return 1;
+  }
+  if (connect(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ==
+          -1 ||
+      attach() != NO_ERR) {
+    LOG_ERROR("Connection failed.");
+    closeSocket();
+    return 1;
+  }
+
+  LOG_INFO("Connected to Server on shared memory : [{}]", _path);
+  return NO_ERR;
+}
+
+/**
+ * @brief Receives the setup message and maps the rings it describes.
+ *
+ * @return int Returns 0 on success, or 1 on failure.
+ */
+int ShmSocket::attach() {
+  ShmSetup setup{};
+  iovec payload{};
+  payload.iov_base = &setup;
+  payload.iov_len = sizeof(setup);
+  int fds[SHM_SETUP_FDS];
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  if (recvmsg(_socket, &message, MSG_CMSG_CLOEXEC) != sizeof(setup)) return 1;
+  cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (header == nullptr || header->cmsg_type != SCM_RIGHTS ||
+      header->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    return 1;
+  }
+  memcpy(fds, CMSG_DATA(header), sizeof(fds));
+  _router_doorbell = fds[1];
+  _node_doorbell = fds[2];
+
+  size_t capacity = setup.capacity;
+  if (setup.magic != SHM_SETUP_MAGIC || setup.version != SHM_SETUP_VERSION ||
+      capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    LOG_ERROR("Unsupported shared memory setup of the router.");
+    close(fds[0]);
+    return 1;
+  }
+  _region_size = 2 * ShmRing::region_size(capacity);
+  void* region = mmap(nullptr, _region_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fds[0], 0);
+  // mapping keeps the region alive
+  close(fds[0]);
+  if (region == MAP_FAILED) return 1;
+  _region = region;
+  _to_router = new ShmRing(region, capacity, false);
+  _to_node = new ShmRing(static_cast<char*>(region) +
+                             ShmRing::region_size(capacity),
+                         capacity, false);
+  return NO_ERR;
+}
+
+/**
+ * @brief Receives a message from the router ring.
+ *
+ * Spins a while in low latency mode, then sleeps on the doorbell until the
+ * router writes. Frees space in the ring, so the router is woken if it waits
+ * for it.
+ *
+ * @param bytes_received Reference to an integer that will hold the number of
+ * bytes received.
+ * @param needed_bytes an integer to store the number of bytes needed to recv
+ * @return int Returns 0 on success, RECV_TIMEOUT if nothing arrived within the
+ * receive timeout, or 1 on failure.
+ */
+int ShmSocket::recvMessage(int& bytes_received, int needed_bytes) {
+  if (needed_bytes >= SHM_BUFFER_SIZE - 1) {
+    LOG_WARN("needed_bytes is greater than shared memory buffer size");
+    needed_bytes = SHM_BUFFER_SIZE - 1;
+  }
+  bytes_received = 0;
+  auto spin_until = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(_low_latency ? SHM_SPIN_US : 0);
+  while (bytes_received == 0) {
+    bytes_received = static_cast<int>(_to_node->read(_buffer, needed_bytes));
+    if (bytes_received > 0) break;
+    if (_to_node->is_closed()) {
+      LOG_ERROR("Connection closed by server");
+      return 1;
+    }
+    if (std::chrono::steady_clock::now() < spin_until) continue;
+    if (_to_node->prepare_wait()) {
+      int rung = waitDoorbell(_recv_timeout_ms);
+      if (rung == 0) return RECV_TIMEOUT;
+      if (rung < 0) {
+        LOG_ERROR("Connection closed by server");
+        return 1;
+      }
+    }
+  }
+  if (_to_node->take_producer_waiting()) wakeRouter();
+  _buffer[bytes_received] = 0;  // zero terminating
+  return NO_ERR;
+}
+
+/**
+ * @brief Sends a message to the router ring.
+ *
+ * The message is written whole, if the ring is full the node sleeps until
+ * the router frees space.
+ *
+ * @param message The message to be sent to the router.
+ * @return int Returns the number of bytes sent, or -1 on failure.
+ */
+int ShmSocket::sendMessage(std::string message) {
+  while (_to_router->write(message.data(), message.size(), message.size()) ==
+         0) {
+    if (_to_router->is_closed()) {
+      LOG_ERROR("Send reply failed.");
+      return -1;
+    }
+    if (_to_router->prepare_space_wait(message.size()) &&
+        waitDoorbell(-1) <= 0) {
+      LOG_ERROR("Send reply failed.");
+      return -1;
+    }
+  }
+  if (_to_router->take_consumer_waiting()) wakeRouter();
+  LOG_TRACE("Sent MSG : {}", message);
+  return static_cast<int>(message.size());
+}
+
+/**
+ * @brief Sleeps until the router rings the doorbell or closes the connection.
+ *
+ * @param timeout_ms Longest wait in milliseconds, -1 waits forever.
+ * @return int 1 if rung, 0 on timeout, -1 if the router closed the connection.
+ */
+int ShmSocket::waitDoorbell(int timeout_ms) {
+  pollfd fds[2] = {{_node_doorbell, POLLIN, 0}, {_socket, POLLIN, 0}};
+  int ready;
+  while ((ready = poll(fds, 2, timeout_ms)) == -1) {
+    if (errno != EINTR) return -1;
+  }
+  if (ready == 0) return 0;
+  // router never writes on the connection, readable means it is closed
+  if (fds[1].revents != 0) return -1;
+  uint64_t count;
+  read(_node_doorbell, &count, sizeof(count));
+  return 1;
+}
+
+/**
+ * @brief Rings the doorbell of the router.
+ */
+void ShmSocket::wakeRouter() {
+  uint64_t one = 1;
+  write(_router_doorbell, &one, sizeof(one));
+}
+
+/**
+ * @brief Closes the connection.
+ *
+ * Marks the rings closed and wakes the router, so it removes the session
+ * without waiting for the Unix connection to be reported.
+ */
+void ShmSocket::closeSocket() {
+  if (_region != nullptr) {
+    _to_router->close();
+    _to_node->close();
+    wakeRouter();
+    delete _to_router;
+    delete _to_node;
+    _to_router = _to_node = nullptr;
+    munmap(_region, _region_size);
+    _region = nullptr;
+  }
+  for (int* fd : {&_router_doorbell, &_node_doorbell, &_socket}) {
+    if (*fd != -1) close(*fd);
+    *fd = -1;
+  }
+}
+
+#else
+
+int ShmSocket::connect_to_server() {
+  LOG_ERROR("Shared memory transport is not supported on this platform.");
+  return 1;
+}
+int ShmSocket::attach() { return 1; }
+int ShmSocket::recvMessage(int& bytes_received, int needed_bytes) {
+  bytes_received = 0;
+  return 1;
+}
+int ShmSocket::sendMessage(std::string message) { return -1; }
+int ShmSocket::waitDoorbell(int timeout_ms) { return -1; }
+void ShmSocket::wakeRouter() {}
+void ShmSocket::closeSocket() {}
+
+#endif  // __linux__
+
+/**
+ * @brief Retrieves the internal buffer.
+ *
+ * @return const char* Pointer to the internal buffer.
+ */
+const char* ShmSocket::getBuffer() const { return this->_buffer; }
+
+/**
+ * @brief Enables or disables spinning before sleeping on the doorbell.
+ *
+ * @param enabled true to spin on an empty ring.
+ */
+void ShmSocket::setLowLatency(bool enabled) { _low_latency = enabled; }
@@ -7,9 +7,25 @@
 #include <string>
 #include <thread>
 
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#endif
+
 #include "logger.h"
 
 const int BUFFER_SIZE = 32 * 100;
+const int BUSY_POLL_US = 50;
+
+#ifdef _WIN32
+#define poll WSAPoll
+#define SEND_FLAGS 0
+static bool wouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+// a router closing the connection must not kill the node with SIGPIPE
+#define SEND_FLAGS MSG_NOSIGNAL
+static bool wouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+#endif
 /**
  * @brief Constructs a TCPSocket instance with the specified server IP and port.
  *
@@ -18,6 +34,7 @@ const int BUFFER_SIZE = 32 * 100;
  */
 TCPSocket::TCPSocket(std::string server_ip, int server_port) {
   this->_buffer = new char[BUFFER_SIZE];
+  this->_message = new char[BUFFER_SIZE];
   this->_server_ip = server_ip;
   this->_server_port = server_port;
 }
@@ -28,15 +45,18 @@ TCPSocket::TCPSocket(std::string server_ip, int server_port) {
  * Cleans up allocated resources, including the buffer and closes the socket.
  */
 TCPSocket::~TCPSocket() {
-  delete[] _buffer;
   closeSocket();
+  delete[] _buffer;
+  delete[] _message;
 }
 
 /**
  * @brief Connects to the server using the specified server IP and port.
  *
- * Initializes the socket, configures the address structure, and attempts to
- * establish a connection to the server. Logs errors if the connection fails.
+ * Initializes a non-blocking socket, configures the address structure, and
+ * attempts to establish a connection to the server. A router host that drops
+ * SYNs would block connect() for minutes, so the connection is waited with
+ * poll() for at most CONNECT_TIMEOUT_MS. Logs errors if the connection fails.
  *
  * @return int Returns 0 on success, or 1 on failure.
  */
@@ -56,6 +76,14 @@ int TCPSocket::connect_to_server() {
     LOG_ERROR("Socket creation failed");
     return 1;
   }
+#ifdef _WIN32
+  u_long non_blocking = 1;
+  ioctlsocket(_socket, FIONBIO, &non_blocking);
+#else
+  fcntl(_socket, F_SETFL, fcntl(_socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+  _buffered = 0;
+  _consumed = 0;
   // Configure server address
   _server_addr = sockaddr_in{};
   _server_addr.sin_family = AF_INET;
@@ -64,10 +92,27 @@ int TCPSocket::connect_to_server() {
   // Connect to server
   if (connect(_socket, reinterpret_cast<sockaddr*>(&_server_addr),
               sizeof(_server_addr)) == -1) {
-    LOG_ERROR("Connection failed.");
-    closeSocket();
-    return 1;
+#ifdef _WIN32
+    bool in_progress = wouldBlock();
+#else
+    bool in_progress = errno == EINPROGRESS;
+#endif
+    if (!in_progress || waitFor(POLLOUT, CONNECT_TIMEOUT_MS) <= 0) {
+      LOG_ERROR("Connection failed.");
+      closeSocket();
+      return 1;
+    }
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(_socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error),
+               &len);
+    if (error != 0) {
+      LOG_ERROR("Connection failed.");
+      closeSocket();
+      return 1;
+    }
   }
+  tuneSocket();
 
   LOG_INFO("Connected to Server : [{}:{}]", this->_server_ip,
            this->_server_port);
@@ -77,48 +122,91 @@ int TCPSocket::connect_to_server() {
 /**
  * @brief Receives a message from the connected server.
  *
- * Reads data from the socket into the internal buffer and logs the received
- * message. Sets the number of bytes received in the provided reference
- * parameter.
+ * Returns the next message of needed_bytes from the internal buffer. When the
+ * buffer holds less, reads from the socket as much as fits, so a burst of
+ * frames is received with one recv() and served by the following calls. Logs
+ * the received message. Sets the number of bytes received in the provided
+ * reference parameter.
  *
  * @param bytes_received Reference to an integer that will hold the number of
  * bytes received.
  * @param needed_bytes an integer to store the number of bytes needed to recv from socket
- * @return int Returns 0 on success, or 1 on failure.
+ * @return int Returns 0 on success, RECV_TIMEOUT if nothing arrived within the
+ * receive timeout, or 1 on failure.
  */
 int TCPSocket::recvMessage(int& bytes_received, int needed_bytes) {
   if (needed_bytes >= BUFFER_SIZE-1) {
     LOG_WARN("needed_bytes is greater than tcp buffer size");
     needed_bytes = BUFFER_SIZE-1;
   }
-  // Receive response
   bytes_received = 0;
-  bytes_received = recv(_socket, _buffer, needed_bytes, 0);
-  if (bytes_received <= 0) {
-    if (bytes_received == 0) {
+  if (_buffered - _consumed < needed_bytes && _consumed > 0) {
+    // move the partial message to the front, to make room for the rest
+    memmove(_buffer, _buffer + _consumed, _buffered - _consumed);
+    _buffered -= _consumed;
+    _consumed = 0;
+  }
+  while (_buffered - _consumed < needed_bytes) {
+    // Receive response
+    int received = recv(_socket, _buffer + _buffered, BUFFER_SIZE - _buffered, 0);
+    if (received > 0) {
+      _buffered += received;
+      continue;
+    }
+    if (received == -1 && wouldBlock()) {
+      int ready = waitFor(POLLIN, _recv_timeout_ms);
+      // a partial message stays buffered for the next call
+      if (ready == 0) return RECV_TIMEOUT;
+      if (ready < 0) {
+        LOG_ERROR("Receive failed");
+        return 1;
+      }
+      continue;
+    }
+    if (received == 0) {
       LOG_ERROR("Connection closed by server");
     } else {
       LOG_ERROR("Receive failed");
     }
     return 1;
   }
-  _buffer[bytes_received] = 0;  // zero terminating
-  LOG_INFO("Received MSG : {}", std::string(_buffer));
+#ifdef __linux__
+  if (_low_latency) {
+    // kernel drops quick ack mode after a few segments, re-arm it
+    int enable = 1;
+    setsockopt(_socket, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+  }
+#endif
+  memcpy(_message, _buffer + _consumed, needed_bytes);
+  _message[needed_bytes] = 0;  // zero terminating
+  _consumed += needed_bytes;
+  bytes_received = needed_bytes;
   return NO_ERR;
 }
 
 /**
  * @brief Sends a message to the connected server.
  *
- * Writes the specified message to the socket and logs the sent message.
+ * Writes the specified message to the socket and logs the sent message. While
+ * the socket buffer is full, waits for it to drain.
  *
  * @param message The message to be sent to the server.
  * @return int Returns the number of bytes sent, or -1 on failure.
  */
 int TCPSocket::sendMessage(std::string message) {
-  int bytes_sent = send(_socket, message.c_str(), message.size(), 0);
-  if (bytes_sent == -1) {
-    LOG_ERROR("Send reply failed.");
+  int bytes_sent = 0;
+  int size = static_cast<int>(message.size());
+  while (bytes_sent < size) {
+    int sent = send(_socket, message.c_str() + bytes_sent, size - bytes_sent,
+                    SEND_FLAGS);
+    if (sent > 0) {
+      bytes_sent += sent;
+    } else if (sent == -1 && wouldBlock() && waitFor(POLLOUT, -1) > 0) {
+      continue;
+    } else {
+      LOG_ERROR("Send reply failed.");
+      return -1;
+    }
   }
   LOG_TRACE("Sent MSG : {}", message);
   return bytes_sent;
@@ -127,13 +215,12 @@ int TCPSocket::sendMessage(std::string message) {
 /**
  * @brief Retrieves the internal buffer.
  *
- * Provides a constant pointer to the internal buffer used for receiving
- * messages.
+ * Provides a constant pointer to the last message returned by recvMessage().
  *
  * @return const char* Pointer to the internal buffer.
  */
 const char* TCPSocket::getBuffer() const {
-  return this->_buffer;  // Return a const pointer to the internal data
+  return this->_message;  // Return a const pointer to the internal data
 }
 
 /**
@@ -142,10 +229,65 @@ const char* TCPSocket::getBuffer() const {
  * Handles the cleanup of the socket and releases any associated resources.
  */
 void TCPSocket::closeSocket() {
+  if (_socket == -1) return;
 #ifdef _WIN32
   closesocket(_socket);
   WSACleanup();
 #else
   close(_socket);
 #endif
+  _socket = -1;
+  _buffered = 0;
+  _consumed = 0;
+}
+
+/**
+ * @brief Enables or disables latency tuning of the socket.
+ *
+ * @param enabled true to tune the socket on the next connect.
+ */
+void TCPSocket::setLowLatency(bool enabled) { _low_latency = enabled; }
+
+/**
+ * @brief Applies latency tuning options on the connected socket.
+ *
+ * Frames are small and sent one by one, so Nagle's algorithm and delayed ACK
+ * would hold them back. Busy polling needs CAP_NET_ADMIN to go above the
+ * system default, its failure is ignored.
+ */
+void TCPSocket::tuneSocket() {
+  if (!_low_latency) return;
+  int enable = 1;
+  setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY,
+             reinterpret_cast<const char*>(&enable), sizeof(enable));
+#ifdef __linux__
+  setsockopt(_socket, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+  int busy_poll = BUSY_POLL_US;
+  setsockopt(_socket, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll));
+#endif
+}
+
+/**
+ * @brief Waits until the socket is ready for the given events.
+ *
+ * @param events POLLIN or POLLOUT.
+ * @param timeout_ms Maximum wait in milliseconds, -1 waits forever.
+ * @return int 1 if ready, 0 on timeout, -1 on error or hang up without the
+ * event.
+ */
+int TCPSocket::waitFor(short events, int timeout_ms) {
+  pollfd fd{};
+  fd.fd = _socket;
+  fd.events = events;
+  int ready;
+  do {
+    ready = poll(&fd, 1, timeout_ms);
+#ifdef _WIN32
+  } while (false);
+#else
+  } while (ready == -1 && errno == EINTR);
+#endif
+  // a closed or reset socket reports POLLHUP/POLLERR, recv()/send() reports it
+  if (ready == 0) return 0;
+  return ready > 0 && (fd.revents & (events | POLLHUP | POLLERR)) ? 1 : -1;
 }
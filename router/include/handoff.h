@@ -0,0 +1,131 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "message.h"
+#include "outbox.h"
+#include "session.h"
+
+#define HANDOFF_LISTENER 1
+#define HANDOFF_SESSION 2
+#define HANDOFF_END 3
+
+/// node_id of a session record carries the node ID in its low bits and the
+/// read and write FrameEncoding of the session above them, older routers send
+/// 0 there (ASCII)
+#define HANDOFF_NODE_ID_MASK 0xFFFF
+#define HANDOFF_READ_ENCODING_SHIFT 16
+#define HANDOFF_WRITE_ENCODING_SHIFT 24
+
+/// Time a session socket gets to take the frames pending for it before handoff.
+#define HANDOFF_FLUSH_TIMEOUT_MS 1000
+/// Time nodes get to send the rest of partially received frames before handoff.
+#define HANDOFF_FRAME_TIMEOUT_MS 1000
+
+/**
+ * @struct HandoffRecord
+ * @brief Payload sent along with each file descriptor during handoff.
+ */
+struct HandoffRecord {
+  int32_t kind;     ///< HANDOFF_LISTENER, HANDOFF_SESSION or HANDOFF_END
+  int32_t node_id;  ///< Node ID of the session and its encodings, NONE if not handshaked yet
+};
+
+/**
+ * @class Handoff
+ * @brief Hot upgrade of the router by passing listening and session sockets to a new process.
+ *
+ * The running router listens on a Unix socket. A new router process started
+ * with the same handoff path connects to it, the old router lets its reads
+ * reach a frame boundary, stops its event loop, drains its read/write queues,
+ * writes every outbox of the handed off sessions to its node and sends the
+ * listening socket and every node session socket with its node ID over
+ * SCM_RIGHTS, then exits. The new
+ * process registers the received sessions and continues serving, so nodes
+ * keep their TCP connections. Linux/Unix only.
+ */
+class Handoff {
+ public:
+  /**
+   * @brief Takes over sockets of a running router listening on the handoff path.
+   * @param path Unix socket path of the running router.
+   * @return The received listening socket, or -1 if no router is running there or transfer failed.
+   */
+  static int take_over(const std::string& path);
+
+  /**
+   * @brief Listens on the handoff path for a new router process.
+   * @param path Unix socket path.
+   * @return true on success.
+   */
+  static bool listen(const std::string& path);
+
+  /**
+   * @brief Checks if a new router process is waiting for the sockets.
+   */
+  static bool requested() {
+    return requester_socket_.load(std::memory_order_relaxed) != -1;
+  }
+
+  /**
+   * @brief Checks if a session socket is passed to the new process.
+   * peer router links are re-established by connectors of the new process,
+   * shared memory rings die with this process and co-located nodes reconnect.
+   */
+  static bool handed_off(const Session& session) {
+    return session.get_id() != ROUTER_NODE_ID &&
+           session.get_channel() == nullptr;
+  }
+
+  /**
+   * @brief Turns down the waiting process, it exits and this router continues serving.
+   */
+  static void refuse();
+
+  /**
+   * @brief Sends listening and session sockets to the waiting process.
+   * caller must stop dispatching and drain the worker queues before. outboxes
+   * are flushed first, the handoff is refused if a node doesnt take its frames.
+   * @param server_socket Listening socket descriptor.
+   * @param budget Write order of the outboxes.
+   * @return false on failure, on success the process exits and it doesnt return.
+   */
+  static bool transfer(int server_socket, const OutboxBudget& budget);
+
+  /**
+   * @brief Writes the outboxes of the sessions to hand off until they are empty.
+   * a partially sent frame is completed, so the new router reads and writes
+   * every node stream from a frame boundary.
+   * @param budget Write order of the outboxes.
+   * @param timeout_ms Time each socket gets to take its frames.
+   * @return false if a socket didnt take all of its frames in time, the rest
+   * stays in its outbox waiting for writability.
+   */
+  static bool flush_outboxes(const OutboxBudget& budget, int timeout_ms);
+
+  /**
+   * @brief Sends one record with an optional descriptor.
+   * @param unix_socket Connected Unix socket.
+   * @param fd Descriptor to pass, -1 for none.
+   * @param record Record payload.
+   * @return true on success.
+   */
+  static bool send_record(int unix_socket, int fd, const HandoffRecord& record);
+
+  /**
+   * @brief Receives one record and its descriptor.
+   * @param unix_socket Connected Unix socket.
+   * @param record Received record payload.
+   * @return Received descriptor, -1 if the record has none or on failure.
+   */
+  static int recv_record(int unix_socket, HandoffRecord& record);
+
+ private:
+  /// Connection of the new process waiting for handoff, -1 if none.
+  static std::atomic<int> requester_socket_;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef LOOP_WATCHDOG_H
+#define LOOP_WATCHDOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "latency_histogram.h"
+
+/// Frames of a captured event loop stack.
+#define STALL_STACK_DEPTH 32
+
+/**
+ * @class LoopWatchdog
+ * @brief Measures the busy part of each event loop iteration and captures the loop stack when it runs too long.
+ *
+ * The loop is busy from select() returning until it calls select() again,
+ * every session waits meanwhile. Busy time and the time from readiness to
+ * dispatch of the ready sockets are recorded in histograms, reported with the
+ * metrics. With a threshold set, a watchdog thread checks the running
+ * iteration and, once it exceeds the threshold, signals the loop thread to
+ * capture its own stack (glibc only, other platforms log the stall alone).
+ * The stack shows where the loop is stuck, e.g. on a lock or a blocking log.
+ * Recording is a clock read and a relaxed atomic store.
+ */
+class LoopWatchdog {
+ public:
+  /**
+   * @brief Registers the calling thread as the event loop and starts the watchdog thread.
+   * @param threshold_ms Busy time reported as a stall, 0 only keeps histograms.
+   */
+  static void start(unsigned threshold_ms);
+
+  /**
+   * @brief Marks select() returned, the loop is busy from now on.
+   */
+  static void busy() {
+    busy_since_us_.store(now_us(), std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Marks ready sockets were handed to workers.
+   */
+  static void dispatched() {
+    int64_t since = busy_since_us_.load(std::memory_order_relaxed);
+    if (since != 0) dispatch_us_.record(now_us() - since);
+  }
+
+  /**
+   * @brief Marks the loop is about to wait in select() again, records the iteration.
+   */
+  static void idle() {
+    int64_t since = busy_since_us_.load(std::memory_order_relaxed);
+    if (since == 0) return;
+    busy_us_.record(now_us() - since);
+    busy_since_us_.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Logs busy and dispatch percentiles and stalls since the last report, histograms start over.
+   */
+  static void report();
+
+ private:
+  static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /**
+   * @brief Watchdog thread, checks the running iteration every few milliseconds.
+   */
+  static void watch();
+
+  /**
+   * @brief Captures the stack of the loop thread and logs it.
+   * @param busy_ms Time the iteration has run so far.
+   */
+  static void capture_stack(int64_t busy_ms);
+
+  static std::atomic<int64_t> busy_since_us_;  ///< Start of the running iteration, 0 while waiting in select().
+  static LatencyHistogram busy_us_;      ///< Busy time of iterations, in microseconds.
+  static LatencyHistogram dispatch_us_;  ///< select() return to dispatch of ready sockets, in microseconds.
+  static std::atomic<uint64_t> stalls_;  ///< Iterations longer than the threshold.
+  static unsigned threshold_ms_;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "outbox.h"
+#include "session.h"
+
+/**
+ * @struct PeerAddress
+ * @brief Address of a peer router given with --peer, parsed by RouterConfig.
+ */
+struct PeerAddress {
+  std::string ip;  ///< IPv4 address in dotted form.
+  int port = 0;    ///< Listening port of the peer, 1..65535.
+};
+
+/**
+ * @class PeerLink
+ * @brief A persistent TCP link to another router.
+ *
+ * Frames for the peer are appended to an outbox, a dedicated writer thread
+ * takes everything collected so far and sends it with one send(), so frames
+ * are batched naturally while the previous send is in progress. The outbox
+ * has the budget of node outboxes, a stalled peer cannot grow router memory.
+ * Announcements are never dropped, a link which would lose one is closed and
+ * announces every node again when it is reopened.
+ */
+class PeerLink {
+ public:
+  /**
+   * @brief Constructor, PeerLink::start() should be called to run the writer.
+   * @param session Session of the connected non-blocking socket to the peer,
+   * it closes the socket once the writer and workers released it.
+   * @param initiated true if this router connected to the peer.
+   * @param budget Outbox budget, drop-oldest and backpressure drop the new
+   * frame instead: evicting could lose an announcement and senders of the
+   * peer router cannot be paused.
+   */
+  PeerLink(std::shared_ptr<Session> session, bool initiated,
+           const OutboxBudget& budget);
+
+  /**
+   * @brief Starts the writer thread, the thread owns a reference to the link.
+   * @param self The link to start.
+   */
+  static void start(std::shared_ptr<PeerLink> self);
+
+  /**
+   * @brief Appends a frame to the outbox under the budget and wakes the writer.
+   * frames over the budget close the link under the disconnect policy, or
+   * if they are control frames.
+   * @param frame Pointer to the frame.
+   * @param len Length of the frame.
+   */
+  void enqueue(const char* frame, size_t len);
+
+  /**
+   * @brief Marks the link as closed, writer thread exits and shuts the socket down.
+   */
+  void close();
+
+  /**
+   * @brief Blocks until the link is closed.
+   */
+  void wait_closed();
+
+  /**
+   * @brief Gets the socket of the link.
+   */
+  int get_socket() const { return socket_; }
+
+  /**
+   * @brief Checks if this router connected to the peer, or accepted the link.
+   */
+  bool is_initiated() const { return initiated_; }
+
+  /**
+   * @brief Sets the token the peer sent in its hello frame, under Mesh lock.
+   * @param token Token of the peer router.
+   */
+  void set_peer_token(int token) { peer_token_ = token; }
+
+  /**
+   * @brief Gets the token of the peer router, 0 until its hello frame is read.
+   */
+  int get_peer_token() const { return peer_token_; }
+
+ private:
+  /**
+   * @brief Writer thread body, sends outbox batches until the link is closed.
+   */
+  void writer();
+
+  /**
+   * @brief Sends a batch, waits while the socket buffer is full until the
+   * link is closed or over its budget.
+   * @param batch Frames to send.
+   * @return Bytes sent, SOCKET_ERROR on socket error.
+   */
+  int send_batch(const std::string& batch);
+
+  int socket_;                  ///< Socket connected to the peer router
+  std::shared_ptr<Session> session_;  ///< Keeps socket_ open until the writer exits
+  bool initiated_;              ///< This router connected to the peer
+  int peer_token_;              ///< Token of the peer router, guarded by Mesh
+  Outbox outbox_;               ///< Frames waiting to be sent
+  OutboxBudget budget_;         ///< Limits of outbox_
+  bool pending_;                ///< Frames were queued since the writer took them
+  bool overflowed_;             ///< Budget closes the link, writer removes it
+  bool closed_;                 ///< Link is closed, writer should exit
+  bool writer_done_;            ///< Writer has exited and shut the socket down
+  std::mutex mutex_;            ///< Protects flags
+  std::condition_variable cond_;  ///< Signals new frames and close to writer
+  std::condition_variable done_cond_;  ///< Signals writer exit to wait_closed()
+};
+
+/**
+ * @class Mesh
+ * @brief Federates several routers, each router forwards frames of remote node IDs over inter-router links.
+ *
+ * A router connects to its configured peers and handshakes with ROUTER_NODE_ID.
+ * Both sides send a hello frame with a random router token and their listening
+ * port, then announce their locally attached node IDs with control frames and
+ * keep announcing attach/detach changes. Two routers which peer each other get
+ * two links, the one initiated by the router with the lower token is kept.
+ * Links are accepted only from the IP of a configured peer, and kept only if
+ * their hello gives that peer's port, a node cannot claim routes. Frames received from a peer are only
+ * delivered to local nodes and never forwarded again, so a full mesh of
+ * routers is loop free.
+ */
+class Mesh {
+ public:
+  /**
+   * @brief Starts connector threads for the configured peers.
+   * @param peers Peer addresses.
+   * @param listen_port Listening port of this router, sent in hello frames.
+   * @param budget Outbox budget of the links.
+   */
+  static void start(const std::vector<PeerAddress>& peers, int listen_port,
+                    const OutboxBudget& budget);
+
+  /**
+   * @brief Registers an established inter-router link and announces local nodes on it.
+   * @param socket Socket of the link, its session is registered in Sessions.
+   * @param initiated true if this router connected to the peer.
+   * @return The link object, nullptr if the session is removed meanwhile.
+   */
+  static std::shared_ptr<PeerLink> attach_link(int socket, bool initiated);
+
+  /**
+   * @brief Checks if a connection may link as a peer router.
+   * @param ip Remote address of the connection.
+   * @return true if ip is the address of a configured peer.
+   */
+  static bool is_peer_address(const std::string& ip);
+
+  /**
+   * @brief Checks the first frame read from a link.
+   *
+   * A link this router accepted must start with the hello frame of a
+   * configured peer, its listening port and the IP of the connection make the
+   * peer address. Links this router initiated and links taken over by a hot
+   * upgrade are not checked.
+   *
+   * @param socket Socket of the link.
+   * @param frame The first 32 byte frame read from it.
+   * @return true if the link may be used, false if it should be removed.
+   */
+  static bool verify_link(int socket, const char* frame);
+
+  /**
+   * @brief Removes a link and all routes learned from it.
+   * @param socket Socket of the link.
+   */
+  static void detach_link(int socket);
+
+  /**
+   * @brief Announces to all peers that a node ID is attached/detached on this router.
+   * @param operation CONTROL_ATTACH or CONTROL_DETACH.
+   * @param node_id The node ID.
+   */
+  static void announce(int operation, int node_id);
+
+  /**
+   * @brief Applies a control frame received from a peer.
+   * @param socket Socket of the link the frame came from.
+   * @param frame The 32 byte control frame.
+   */
+  static void handle_control(int socket, const char* frame);
+
+  /**
+   * @brief Forwards a frame to the router that owns the destination node.
+   * @param dst_id Destination node ID.
+   * @param frame The 32 byte frame.
+   * @return true if a remote route exists and frame is queued.
+   */
+  static bool forward_remote(int dst_id, const char* frame);
+
+ private:
+  /**
+   * @brief Connector thread body, keeps a link to the peer alive.
+   * @param peer Peer address.
+   */
+  static void connector(PeerAddress peer);
+
+  /**
+   * @brief Records the token of a link's peer and finds a second link to it.
+   * @param socket Socket of the link the hello frame came from.
+   * @param token Token of the peer router.
+   * @return The dropped link, already removed with its routes moved to the
+   * kept one, or nullptr.
+   */
+  static std::shared_ptr<PeerLink> register_peer(int socket, int token);
+
+  /**
+   * @brief Blocks while another link to the peer of a closed link is up.
+   * @param link The closed link.
+   */
+  static void wait_other_link(const std::shared_ptr<PeerLink>& link);
+
+  /// IPs of configured peers, links are accepted only from them.
+  static std::unordered_set<std::string> peer_ips_;
+
+  /// "ip:port" of configured peers, accepted links are kept only for them.
+  static std::unordered_set<std::string> peer_addresses_;
+
+  /// Outbox budget of new links.
+  static OutboxBudget link_budget_;
+
+  /// Random token of this router, sent in hello frames.
+  static int token_;
+
+  /// Listening port of this router, sent in hello frames.
+  static int listen_port_;
+
+  /// Node IDs attached to this router, as announced.
+  static std::unordered_set<int> local_nodes_;
+
+  /// Established links by socket.
+  static std::unordered_map<int, std::shared_ptr<PeerLink>> links_;
+
+  /// Remote node ID to socket of the link which announced it.
+  static std::unordered_map<int, int> remote_routes_;
+
+  /// Mutex for links_, remote_routes_ and local_nodes_. announcements are
+  /// queued under it, so a new link gets the node IDs and then their changes.
+  static std::shared_mutex mesh_mutex_;
+};
+
+#endif
@@ -3,16 +3,53 @@
 
 #include <iostream>
 #include <string>
-#define ID_MESSAGE_SIZE 3
-#define DATA_MESSAGE_SIZE 32
+
+#include "iso_frame.h"
+#define ID_MESSAGE_SIZE SrcIdField::width
+#define DATA_MESSAGE_SIZE IsoFrame::size
+
+/// ID reserved for routers, node IDs are 0..998.
+/// a connection which handshakes with this ID is an inter-router link.
+#define ROUTER_NODE_ID 999
+#define CONTROL_ATTACH 9001
+#define CONTROL_DETACH 9002
+/// First control frame on an inter-router link, its TRACE is the token of the
+/// sending router and its PAN the listening port. routers which link each
+/// other keep one of their two links.
+#define CONTROL_HELLO 9003
+
+/// MTI of heartbeat frames sent by the router to idle nodes.
+/// nodes echo it back to ROUTER_NODE_ID like any frame addressed to them.
+#define HEARTBEAT_MTI 800
+
+/// Frame a node sends to ROUTER_NODE_ID to offer the FrameEncoding in its TRACE.
+/// routers without compact encoding take it for a heartbeat reply and ignore it.
+#define ENCODING_OFFER_MTI 870
+
+/// Last frame a side sends in its current encoding, later frames in that
+/// direction use the FrameEncoding in its TRACE. the router answers an offer
+/// with it, the node answers the router's one.
+#define ENCODING_SWITCH_MTI 880
+
+/// Number of PriorityClass values.
+#define PRIORITY_CLASSES 3
+
+/**
+ * @brief Write priority of a frame, derived from the class digits of its MTI.
+ * lower value is sent first.
+ */
+enum class PriorityClass {
+    NETWORK_MANAGEMENT = 0,  ///< 08xx, echo/sign-on/key exchange
+    REVERSAL = 1,            ///< 04xx, reversals and chargebacks
+    FINANCIAL = 2            ///< any other MTI, bulk traffic
+};
 
 /**
  * @class Message
  * @brief Provides static utility functions to extract source and destination IDs from messages.
  *
  * The Message class offers static methods to parse message strings and retrieve source and destination
- * identifiers based on fixed positions within the message content. It assumes that the message format
- * contains numeric IDs at specific offsets.
+ * identifiers. Field positions come from the IsoFrame layout shared with the node.
  */
 class Message
 {
@@ -27,15 +64,7 @@ public:
         if (msg_len < ID_MESSAGE_SIZE) {
             return -1; // Message too short to contain source ID
         }
-        try {
-            // Convert the initial segment of the message to an integer
-            int id = std::stoi(msg);
-            return id;
-        }
-        catch (const std::invalid_argument&) {
-            // Error: The message does not start with a valid number
-        }
-        return -1; // Failed to parse source ID
+        return static_cast<int>(IsoFrame::get<SrcIdField>(msg));
     }
 
     /**
@@ -48,15 +77,137 @@ public:
         if (msg_len < DATA_MESSAGE_SIZE) {
             return -1; // Message too short to contain destination ID
         }
-        try {
-            // Convert substring starting at offset 29 to an integer
-            int id = std::stoi(msg + 29);
-            return id;
-        }
-        catch (const std::invalid_argument&) {
-            // Error: The substring does not contain a valid number
+        return static_cast<int>(IsoFrame::get<DstIdField>(msg));
+    }
+
+    /**
+     * @brief Gets write priority of a 32 byte message from the class digits of its MTI.
+     * @param msg Pointer to the message.
+     * @return Priority class, FINANCIAL for unknown classes.
+     */
+    static PriorityClass get_priority_class(const char* msg) {
+        constexpr int mti = IsoFrame::offset<MtiField>();
+        if (msg[mti] != '0') return PriorityClass::FINANCIAL;
+        switch (msg[mti + 1]) {
+        case '8':
+            return PriorityClass::NETWORK_MANAGEMENT;
+        case '4':
+            return PriorityClass::REVERSAL;
+        default:
+            return PriorityClass::FINANCIAL;
         }
-        return -1; // Failed to parse destination ID
+    }
+
+    /**
+     * @brief Checks if a 32 byte message is an inter-router control frame.
+     * control frames have ROUTER_NODE_ID as source.
+     * @param msg Pointer to the message.
+     * @return true for control frames.
+     */
+    static bool is_control_frame(const char* msg) {
+        return IsoFrame::get<SrcIdField>(msg) == ROUTER_NODE_ID;
+    }
+
+    /**
+     * @brief Builds a control frame which announces attach/detach of a node to peer routers.
+     * layout is the same as data frames: src=999, MTI=operation, node id in dst field.
+     * @param operation CONTROL_ATTACH or CONTROL_DETACH.
+     * @param node_id The announced node ID.
+     * @return The 32 byte control frame.
+     */
+    static std::string build_control_frame(int operation, int node_id) {
+        return build_router_frame(operation, 0, node_id);
+    }
+
+    /**
+     * @brief Builds the hello frame a router sends first on an inter-router link.
+     * @param token Token of the sending router, 1..999999.
+     * @param listen_port Listening port of the sending router.
+     * @return The 32 byte control frame.
+     */
+    static std::string build_hello_frame(int token, int listen_port) {
+        return build_router_frame(CONTROL_HELLO, token, 0, listen_port);
+    }
+
+    /**
+     * @brief Extracts the router token of a hello frame.
+     * @param msg Pointer to the hello frame.
+     * @return The token, -1 if invalid.
+     */
+    static int extract_router_token(const char* msg) {
+        return static_cast<int>(IsoFrame::get<TraceField>(msg));
+    }
+
+    /**
+     * @brief Extracts the listening port of the router sending a hello frame.
+     * @param msg Pointer to the hello frame.
+     * @return The port, -1 if invalid.
+     */
+    static int64_t extract_router_port(const char* msg) {
+        return IsoFrame::get<PanField>(msg);
+    }
+
+    /**
+     * @brief Builds a heartbeat frame sent from the router to a node.
+     * @param node_id Destination node ID.
+     * @return The 32 byte heartbeat frame.
+     */
+    static std::string build_heartbeat_frame(int node_id) {
+        return build_router_frame(HEARTBEAT_MTI, 0, node_id);
+    }
+
+    /**
+     * @brief Extracts operation of a control frame.
+     * @param msg Pointer to the control frame.
+     * @return CONTROL_ATTACH, CONTROL_DETACH, CONTROL_HELLO or -1 if invalid.
+     */
+    static int extract_control_operation(const char* msg) {
+        return static_cast<int>(IsoFrame::get<MtiField>(msg));
+    }
+
+    /**
+     * @brief Builds the encoding switch frame the router sends to a node.
+     * @param node_id Destination node ID.
+     * @param encoding Encoding of the frames following it.
+     * @return The 32 byte switch frame.
+     */
+    static std::string build_encoding_frame(int node_id, FrameEncoding encoding) {
+        return build_router_frame(ENCODING_SWITCH_MTI,
+                                  static_cast<int>(encoding), node_id);
+    }
+
+    /**
+     * @brief Extracts the MTI of a frame.
+     * @param msg Pointer to the frame.
+     * @return The MTI, -1 if invalid.
+     */
+    static int extract_mti(const char* msg) {
+        return static_cast<int>(IsoFrame::get<MtiField>(msg));
+    }
+
+    /**
+     * @brief Extracts the encoding carried by an encoding offer or switch frame.
+     * @param msg Pointer to the frame.
+     * @return The TRACE field, -1 if invalid.
+     */
+    static int extract_encoding(const char* msg) {
+        return static_cast<int>(IsoFrame::get<TraceField>(msg));
+    }
+
+private:
+    /**
+     * @brief Builds a frame sent by the router, src=ROUTER_NODE_ID.
+     * @param mti MTI of the frame.
+     * @param trace TRACE of the frame.
+     * @param node_id Value of the dst field.
+     * @param pan Value of the PAN field, zero in all but hello frames.
+     * @return The 32 byte frame.
+     */
+    static std::string build_router_frame(int mti, int trace, int node_id,
+                                          int64_t pan = 0) {
+        char frame[DATA_MESSAGE_SIZE];
+        IsoFrame::write(frame, ROUTER_NODE_ID, mti, trace, pan, node_id);
+        return std::string(frame, DATA_MESSAGE_SIZE);
     }
 };
 
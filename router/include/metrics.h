@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "alloc_stats.h"
+#include "latency_histogram.h"
+#include "message.h"
+
+/**
+ * @brief Router counters, each one is incremented when the router takes the related action.
+ */
+enum class Metric {
+  FRAMES_DROPPED_NEWEST,        ///< new frames discarded by a full outbox
+  FRAMES_DROPPED_OLDEST,        ///< pending frames evicted from a full outbox
+  SLOW_CONSUMERS_DISCONNECTED,  ///< sessions removed for exceeding outbox budget
+  SENDERS_PAUSED,               ///< senders paused by backpressure
+  SENDERS_RESUMED,              ///< paused senders resumed
+  COUNT
+};
+
+/**
+ * @class Metrics
+ * @brief Process wide counters and per priority class queue stats, reported periodically to the log by the event loop.
+ */
+class Metrics {
+ public:
+  /**
+   * @brief Adds to a counter.
+   * @param metric Counter to increment.
+   * @param value Amount added.
+   */
+  static void increment(Metric metric, uint64_t value = 1) {
+    counters_[static_cast<int>(metric)].fetch_add(value,
+                                                  std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Reads a counter.
+   * @param metric Counter to read.
+   * @return Current value.
+   */
+  static uint64_t get(Metric metric) {
+    return counters_[static_cast<int>(metric)].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Records time a frame waited in an outbox.
+   * @param frame_class Priority class of the frame.
+   * @param wait_us Time from arrival to being taken for send, in microseconds.
+   */
+  static void record_wait(PriorityClass frame_class, uint64_t wait_us) {
+    waits_[static_cast<int>(frame_class)].record(wait_us);
+  }
+
+  /**
+   * @brief Sets number of frames of a class pending in all outboxes, sampled before a report.
+   * @param frame_class Priority class.
+   * @param depth Pending frames.
+   */
+  static void set_depth(PriorityClass frame_class, uint64_t depth) {
+    depths_[static_cast<int>(frame_class)].store(depth,
+                                                 std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Sets the period of reporting, 0 disables reports.
+   * @param interval_ms Period in milliseconds.
+   */
+  static void set_report_interval(unsigned interval_ms);
+
+  /**
+   * @brief Checks if the period has elapsed, the caller samples gauges and calls report().
+   * @param now_ms Current time in milliseconds.
+   * @return true if a report is due, the next one is due one period later.
+   */
+  static bool report_due(int64_t now_ms);
+
+  /**
+   * @brief Logs counters which changed since the last report and wait percentiles of each priority class.
+   * wait histograms start over after each report. heap allocations since the
+   * last report are logged per frame sent and per thread slot when built
+   * with ISC_ALLOC_STATS.
+   */
+  static void report();
+
+ private:
+  static std::atomic<uint64_t> counters_[static_cast<int>(Metric::COUNT)];
+  static uint64_t reported_[static_cast<int>(Metric::COUNT)];  ///< Values at the last report.
+  static LatencyHistogram waits_[PRIORITY_CLASSES];  ///< Outbox wait times per class, in microseconds.
+  static std::atomic<uint64_t> depths_[PRIORITY_CLASSES];  ///< Pending frames per class.
+  static AllocCounts reported_allocations_[ALLOC_STATS_MAX_THREADS];  ///< Slot counts at the last report.
+  static unsigned report_interval_ms_;
+  static int64_t next_report_ms_;
+};
+
+#endif
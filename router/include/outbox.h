@@ -0,0 +1,468 @@
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "message.h"
+
+/// Maximum bytes taken from an outbox by one flush. the rest waits for the
+/// next flush, so frames of higher priority arriving meanwhile go out before it
+#define FLUSH_MAX_BYTES (64 * 1024)
+
+/**
+ * @brief Action taken when a destination exceeds its outbox budget.
+ */
+enum class SlowConsumerPolicy {
+  DROP_NEWEST,   ///< the new frame is discarded
+  DROP_OLDEST,   ///< the oldest pending frame is discarded to make room
+  DISCONNECT,    ///< the destination session is removed
+  BACKPRESSURE   ///< the frame is queued, reads from the sender pause until the outbox drains
+};
+
+/**
+ * @brief Result of Outbox::push().
+ */
+enum class PushResult {
+  QUEUED,          ///< frame is queued within budget
+  DROPPED_NEWEST,  ///< frame is discarded
+  DROPPED_OLDEST,  ///< frame is queued, the oldest one is discarded
+  OVER_BUDGET,     ///< budget is exceeded, caller applies DISCONNECT/BACKPRESSURE
+  NOT_ENCODABLE    ///< frame is discarded, it has bytes the destination encoding cannot carry
+};
+
+/**
+ * @brief Order of pending frames of different priority classes.
+ */
+enum class WritePriority {
+  FIFO,     ///< arrival order, priority classes are only measured
+  STRICT,   ///< higher class first, lower classes wait while it has frames
+  WEIGHTED  ///< classes take turns, each sends up to its weight in frames per turn
+};
+
+/**
+ * @struct OutboxBudget
+ * @brief Per-destination limits of pending frames, 0 means unlimited, and their write order.
+ */
+struct OutboxBudget {
+  size_t max_frames = 0;  ///< Maximum pending frames.
+  size_t max_bytes = 0;   ///< Maximum pending bytes.
+  SlowConsumerPolicy policy = SlowConsumerPolicy::DROP_NEWEST;  ///< Action on exceeding.
+  WritePriority priority = WritePriority::FIFO;  ///< Order of priority classes.
+  unsigned lane_weights[PRIORITY_CLASSES] = {8, 4, 1};  ///< Frames per turn of each class in WEIGHTED order.
+};
+
+/**
+ * @class Outbox
+ * @brief Frames pending for one destination session, bounded by a budget.
+ *
+ * Frames of a destination wait here instead of in the shared write queue, the
+ * write queue only carries a flush request per destination. So the router
+ * memory held for one slow node is bounded, and the oldest frame of a node can
+ * be evicted. Frames are kept in one lane per priority class (one lane in FIFO
+ * order), each frame is stamped with its arrival time so its wait can be
+ * measured when it leaves. Frames are kept in the wire encoding of the
+ * destination, packed BCD frames take half of the memory. Thread-safe.
+ */
+class Outbox {
+ public:
+  /**
+   * @brief Appends a frame, applying the budget.
+   * @param frame Pointer to the frame, ASCII frames are packed if the outbox encoding is PACKED_BCD.
+   * @param len Frame length.
+   * @param budget Limits, policy and write order.
+   * @param sender Sender socket, it is paused under BACKPRESSURE policy and returned by the next take(). NONE if there is no sender.
+   * @param needs_flush Set to true if caller should queue a flush for the class of the frame, false if one is already queued for the same or a higher class, or the socket is full.
+   * @return What happened to the frame.
+   */
+  PushResult push(const char* frame, size_t len, const OutboxBudget& budget,
+                  int sender, bool& needs_flush) {
+    int frame_class = static_cast<int>(Message::get_priority_class(frame));
+    int lane = lane_of(frame_class, budget);
+    int64_t now_us = steady_now_us();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    needs_flush = false;
+    char packed[COMPACT_MESSAGE_SIZE];
+    if (encoding_.load(std::memory_order_relaxed) == FrameEncoding::PACKED_BCD &&
+        len == FRAME_DIGITS) {
+      if (!FrameCodec::pack(frame, packed)) {
+        dropped_++;
+        return PushResult::NOT_ENCODABLE;
+      }
+      frame = packed;
+      len = COMPACT_MESSAGE_SIZE;
+    }
+    PushResult result = PushResult::QUEUED;
+    if (over_budget(len, budget)) {
+      switch (budget.policy) {
+        case SlowConsumerPolicy::DROP_NEWEST:
+          dropped_++;
+          return PushResult::DROPPED_NEWEST;
+        case SlowConsumerPolicy::DROP_OLDEST:
+          // frames have same size, evicting one makes room for the new one.
+          // lower classes are evicted first, a frame never evicts a higher one
+          if (!evict_oldest(lane)) {
+            dropped_++;
+            return PushResult::DROPPED_NEWEST;
+          }
+          dropped_++;
+          result = PushResult::DROPPED_OLDEST;
+          break;
+        case SlowConsumerPolicy::DISCONNECT:
+          return PushResult::OVER_BUDGET;
+        case SlowConsumerPolicy::BACKPRESSURE:
+          // frame is kept, sender stops after it. it is registered under the
+          // same lock, so the flush that drains this frame resumes it
+          if (sender >= 0) waiters_.push_back(sender);
+          result = PushResult::OVER_BUDGET;
+          break;
+      }
+    }
+    Lane& target = lanes_[lane];
+    // compact consumed head once it dominates the buffer
+    if (target.head > 0 && target.head >= target.data.size() / 2) {
+      target.data.erase(0, target.head);
+      target.head = 0;
+      target.stamps.erase(target.stamps.begin(),
+                          target.stamps.begin() + target.stamp_head);
+      target.stamp_head = 0;
+    }
+    target.data.append(frame, len);
+    target.stamps.push_back(
+        Stamp{now_us, static_cast<uint32_t>(len), static_cast<uint8_t>(frame_class)});
+    frames_++;
+    bytes_ += len;
+    depth_[frame_class]++;
+    // a flush queued for a lower class is overtaken by a new request
+    if (frame_class < flush_class_) {
+      flush_class_ = frame_class;
+      needs_flush = true;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Queues the last frame in the current encoding, later frames are sent in the new one.
+   *
+   * The marker goes right after the unsent tail, ahead of every pending frame
+   * whatever its class, and pending frames are converted to the new encoding.
+   * So the destination reads all frames before the marker in the old encoding
+   * and all after it in the new one. Pending frames the new encoding cannot
+   * carry are dropped. The marker is not subject to the budget.
+   * @param marker Pointer to the marker frame.
+   * @param len Marker length.
+   * @param encoding Encoding of frames after the marker.
+   * @param needs_flush Set to true if caller should queue a flush for the class of the marker.
+   */
+  void switch_encoding(const char* marker, size_t len, FrameEncoding encoding,
+                       bool& needs_flush) {
+    int marker_class = static_cast<int>(Message::get_priority_class(marker));
+    std::lock_guard<std::mutex> lock(mutex_);
+    needs_flush = false;
+    for (Lane& lane : lanes_) {
+      convert_lane(lane, encoding);
+    }
+    carry_.append(marker, len);
+    carry_frames_++;
+    frames_++;
+    bytes_ += len;
+    encoding_.store(encoding, std::memory_order_relaxed);
+    // a queued flush takes the tail first, unless it waits for writability
+    if (marker_class < flush_class_) {
+      flush_class_ = marker_class;
+      needs_flush = true;
+    }
+  }
+
+  /**
+   * @brief Sets the encoding of later frames without a marker, for a destination already reading it.
+   * @param encoding Encoding of queued frames.
+   */
+  void set_encoding(FrameEncoding encoding) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    encoding_.store(encoding, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Gets the encoding frames are queued in, without the lock.
+   */
+  FrameEncoding get_encoding() const {
+    return encoding_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Takes pending frames in write order, at most FLUSH_MAX_BYTES besides a partially sent tail.
+   * @param frames Output buffer, filled with the frames to send.
+   * @param waiters Output, senders paused by this outbox, they may resume.
+   * @param budget Write order.
+   * @param next_class Output, class of the highest frame left, caller queues the next flush for it. -1 if outbox is empty.
+   * @param on_frame Callable (PriorityClass, uint64_t wait_us), called for each taken frame with its time in the outbox.
+   * @return Number of taken frames.
+   */
+  template <typename Callback>
+  size_t take(std::string& frames, std::vector<int>& waiters,
+              const OutboxBudget& budget, int& next_class,
+              Callback&& on_frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // read under the lock, every stamp is older than it
+    int64_t now_us = steady_now_us();
+    // unsent tail of the previous flush goes first, it may be a partial frame
+    frames.clear();
+    frames.swap(carry_);
+    size_t taken = carry_frames_;
+    carry_frames_ = 0;
+
+    if (budget.priority == WritePriority::WEIGHTED) {
+      // each class sends up to its weight per turn, until lanes are empty or
+      // there is no room left
+      size_t turn_frames = 0;
+      do {
+        turn_frames = 0;
+        for (int lane = 0; lane < PRIORITY_CLASSES; lane++) {
+          turn_frames += take_lane(lane, budget.lane_weights[lane], frames,
+                                   now_us, on_frame);
+        }
+        taken += turn_frames;
+      } while (turn_frames > 0);
+    } else {
+      for (int lane = 0; lane < PRIORITY_CLASSES; lane++) {
+        taken += take_lane(lane, SIZE_MAX, frames, now_us, on_frame);
+      }
+    }
+    frames_ -= taken;
+    bytes_ -= frames.size();
+
+    // frames left, the flush stays scheduled and caller queues it
+    next_class = highest_class();
+    flush_class_ = next_class == -1 ? PRIORITY_CLASSES : next_class;
+    waiters.swap(waiters_);
+    waiters_.clear();
+    return taken;
+  }
+
+  /**
+   * @brief Puts back the unsent tail of taken frames, it goes out first on the next take().
+   * flush stays marked as scheduled, socket writability triggers the next flush.
+   * @param data Pointer to unsent bytes, it may start in the middle of a frame.
+   * @param len Unsent bytes count.
+   * @param frame_size Frame size, used to count frames.
+   * @return Number of frames put back, partially sent frame included.
+   */
+  size_t put_back(const char* data, size_t len, size_t frame_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    carry_.insert(0, data, len);
+    size_t frames = (len + frame_size - 1) / frame_size;
+    carry_frames_ += frames;
+    frames_ += frames;
+    bytes_ += len;
+    // new frames cannot overtake the tail, next flush waits for writability
+    flush_class_ = -1;
+    return frames;
+  }
+
+  /**
+   * @brief Checks if a partially sent flush waits for the destination to become writable.
+   */
+  bool waiting_writable() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flush_class_ == -1;
+  }
+
+  /**
+   * @brief Gets the highest class having pending frames, used to queue the flush of a blocked outbox.
+   * @return Priority class index, lowest class if only a partially sent tail is left, -1 if empty.
+   */
+  int pending_class() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int pending = highest_class();
+    if (pending == -1 && carry_frames_ > 0) return PRIORITY_CLASSES - 1;
+    return pending;
+  }
+
+  /**
+   * @brief Checks if pending frames fell to half of the budget, paused senders may resume.
+   * @param budget Limits of the outbox.
+   */
+  bool below_low_watermark(const OutboxBudget& budget) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (budget.max_frames == 0 || frames_ <= budget.max_frames / 2) &&
+           (budget.max_bytes == 0 || bytes_ <= budget.max_bytes / 2);
+  }
+
+  /**
+   * @brief Number of pending frames of a priority class, a partially sent tail is not included.
+   * @param frame_class Priority class.
+   */
+  size_t get_depth(PriorityClass frame_class) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return depth_[static_cast<int>(frame_class)];
+  }
+
+  /**
+   * @brief Number of frames dropped by the budget during the session lifetime.
+   */
+  uint64_t get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  /**
+   * @brief Arrival time and class of a pending frame.
+   */
+  struct Stamp {
+    int64_t enqueued_us;  ///< Arrival time in microseconds.
+    uint32_t len;         ///< Frame length.
+    uint8_t frame_class;  ///< PriorityClass of the frame.
+  };
+
+  /**
+   * @brief Pending frames of one priority class, data before head is consumed.
+   */
+  struct Lane {
+    std::string data;
+    size_t head = 0;
+    std::vector<Stamp> stamps;  ///< One per frame in data, in the same order.
+    size_t stamp_head = 0;
+  };
+
+  static int64_t steady_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /**
+   * @brief Highest class having frames in lanes, -1 if lanes are empty.
+   */
+  int highest_class() const {
+    for (int frame_class = 0; frame_class < PRIORITY_CLASSES; frame_class++) {
+      if (depth_[frame_class] > 0) return frame_class;
+    }
+    return -1;
+  }
+
+  /**
+   * @brief Lane holding a class, FIFO order keeps all classes in one lane.
+   */
+  static int lane_of(int frame_class, const OutboxBudget& budget) {
+    return budget.priority == WritePriority::FIFO ? 0 : frame_class;
+  }
+
+  /**
+   * @brief Checks if adding len bytes would exceed the budget.
+   */
+  bool over_budget(size_t len, const OutboxBudget& budget) const {
+    return (budget.max_frames > 0 && frames_ + 1 > budget.max_frames) ||
+           (budget.max_bytes > 0 && bytes_ + len > budget.max_bytes);
+  }
+
+  /**
+   * @brief Discards the oldest frame of the lowest lane, not higher than the given one.
+   * @return false if those lanes are empty.
+   */
+  bool evict_oldest(int min_lane) {
+    for (int lane = PRIORITY_CLASSES - 1; lane >= min_lane; lane--) {
+      Lane& victim = lanes_[lane];
+      if (victim.stamp_head == victim.stamps.size()) continue;
+      const Stamp& stamp = victim.stamps[victim.stamp_head++];
+      victim.head += stamp.len;
+      frames_--;
+      bytes_ -= stamp.len;
+      depth_[stamp.frame_class]--;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Moves up to max_frames frames of a lane to the output, within FLUSH_MAX_BYTES.
+   * at least one frame is taken if the output is empty.
+   * @return Number of moved frames.
+   */
+  template <typename Callback>
+  size_t take_lane(int lane, size_t max_frames, std::string& frames,
+                   int64_t now_us, Callback& on_frame) {
+    Lane& source = lanes_[lane];
+    size_t count = 0;
+    size_t bytes = 0;
+    while (source.stamp_head + count < source.stamps.size() &&
+           count < max_frames) {
+      const Stamp& stamp = source.stamps[source.stamp_head + count];
+      size_t filled = frames.size() + bytes;
+      if (filled > 0 && filled + stamp.len > FLUSH_MAX_BYTES) break;
+      on_frame(static_cast<PriorityClass>(stamp.frame_class),
+               static_cast<uint64_t>(now_us - stamp.enqueued_us));
+      depth_[stamp.frame_class]--;
+      bytes += stamp.len;
+      count++;
+    }
+    // frames of a lane are contiguous, one copy for all of them
+    frames.append(source.data, source.head, bytes);
+    source.head += bytes;
+    source.stamp_head += count;
+    if (source.stamp_head == source.stamps.size()) {
+      source.data.clear();
+      source.head = 0;
+      source.stamps.clear();
+      source.stamp_head = 0;
+    }
+    return count;
+  }
+
+  /**
+   * @brief Converts pending frames of a lane to an encoding, frames it cannot carry are dropped.
+   */
+  void convert_lane(Lane& lane, FrameEncoding encoding) {
+    std::string data;
+    std::vector<Stamp> stamps;
+    size_t offset = lane.head;
+    for (size_t i = lane.stamp_head; i < lane.stamps.size(); i++) {
+      Stamp stamp = lane.stamps[i];
+      const char* frame = lane.data.data() + offset;
+      offset += stamp.len;
+      char converted[FRAME_DIGITS];
+      size_t len = stamp.len;
+      if (encoding == FrameEncoding::PACKED_BCD && stamp.len == FRAME_DIGITS) {
+        if (!FrameCodec::pack(frame, converted)) {
+          frames_--;
+          bytes_ -= stamp.len;
+          depth_[stamp.frame_class]--;
+          dropped_++;
+          continue;
+        }
+        frame = converted;
+        len = COMPACT_MESSAGE_SIZE;
+      } else if (encoding == FrameEncoding::ASCII &&
+                 stamp.len == COMPACT_MESSAGE_SIZE) {
+        FrameCodec::unpack(frame, converted);
+        frame = converted;
+        len = FRAME_DIGITS;
+      }
+      data.append(frame, len);
+      bytes_ = bytes_ - stamp.len + len;
+      stamp.len = static_cast<uint32_t>(len);
+      stamps.push_back(stamp);
+    }
+    lane.data.swap(data);
+    lane.head = 0;
+    lane.stamps.swap(stamps);
+    lane.stamp_head = 0;
+  }
+
+  std::mutex mutex_;
+  Lane lanes_[PRIORITY_CLASSES];  ///< Pending frames per lane, only the first one in FIFO order.
+  std::string carry_;             ///< Unsent tail of the previous flush.
+  size_t carry_frames_ = 0;       ///< Frames in carry_, partial one included.
+  size_t frames_ = 0;             ///< Pending frames count, carry_ included.
+  size_t bytes_ = 0;              ///< Pending bytes count, carry_ included.
+  size_t depth_[PRIORITY_CLASSES] = {};  ///< Pending frames per class, carry_ excluded.
+  int flush_class_ = PRIORITY_CLASSES;   ///< Class of the queued flush request, PRIORITY_CLASSES if none, -1 while waiting for writability.
+  std::vector<int> waiters_;      ///< Sender sockets paused by this outbox.
+  std::atomic<uint64_t> dropped_{0};  ///< Dropped frames count.
+  std::atomic<FrameEncoding> encoding_{FrameEncoding::ASCII};  ///< Wire encoding of the destination, frames are queued in it. changed under the lock.
+};
+
+#endif
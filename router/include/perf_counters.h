@@ -0,0 +1,101 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+/// Threads with their own counters, event loop and workers.
+#define PERF_MAX_THREADS 64
+
+/**
+ * @brief Work a thread does in the router, counters are reported per role.
+ */
+enum class ThreadRole {
+  EVENT_LOOP,    ///< select() loop, accepts and dispatches events
+  READ_WORKER,   ///< reads and routes frames in shared scheduling
+  WRITE_WORKER,  ///< flushes outboxes in shared scheduling
+  WORKER,        ///< reads and writes owned sessions in affine scheduling
+  COUNT
+};
+
+/**
+ * @brief Counted events, hardware ones first.
+ */
+enum class PerfEvent {
+  CYCLES,            ///< CPU cycles in user space
+  INSTRUCTIONS,      ///< retired instructions in user space
+  CACHE_MISSES,      ///< last level cache misses in user space
+  TASK_CLOCK,        ///< CPU time of the thread, in nanoseconds
+  CONTEXT_SWITCHES,  ///< voluntary and involuntary switches of the thread
+  COUNT
+};
+
+/**
+ * @class PerfCounters
+ * @brief Per thread hardware and software counters read with perf_event_open, reported per thread role and per forwarded message.
+ *
+ * Each thread opens its own counter groups when it starts, so a group is
+ * scheduled on the PMU as a whole and its counters are comparable. The event
+ * loop reads all groups when metrics are reported and logs the deltas of each
+ * role along with the frames written by do_writes() meanwhile. Counters the
+ * kernel or the machine does not offer (e.g. hardware events in most VMs, or
+ * context switches under perf_event_paranoid 2) are left out of the report.
+ * Linux only, disabled unless enable() is called.
+ */
+class PerfCounters {
+ public:
+  /**
+   * @brief Turns counting on, call it before threads start.
+   * @return false if the platform has no perf_event_open.
+   */
+  static bool enable();
+
+  /**
+   * @brief Checks if counting is on.
+   */
+  static bool enabled() { return enabled_; }
+
+  /**
+   * @brief Opens counter groups of the calling thread, does nothing if counting is off.
+   * @param role Role of the thread in reports.
+   */
+  static void open_thread(ThreadRole role);
+
+  /**
+   * @brief Counts frames written to destinations, per message figures divide by them.
+   * @param frames Written frames.
+   */
+  static void add_messages(uint64_t frames) {
+    if (enabled_) messages_.fetch_add(frames, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Reads every thread's counters and logs the deltas since the last report per role.
+   */
+  static void report();
+
+ private:
+  /**
+   * @brief Counter groups of one thread.
+   */
+  struct ThreadCounters {
+    ThreadRole role;
+    int hardware_fd = -1;  ///< Leader of cycles, instructions and cache misses.
+    int software_fd = -1;  ///< Leader of task clock and context switches.
+    int events[2][static_cast<int>(PerfEvent::COUNT)];  ///< Events of each group in read order.
+    int event_counts[2] = {0, 0};
+    uint64_t last[static_cast<int>(PerfEvent::COUNT)] = {};  ///< Raw values at the last report.
+    uint64_t last_enabled[2] = {0, 0};  ///< Time each group was enabled at the last report.
+    uint64_t last_running[2] = {0, 0};  ///< Time each group was on the PMU at the last report.
+  };
+
+  static bool enabled_;
+  static std::atomic<uint64_t> messages_;
+  static uint64_t reported_messages_;
+  static std::mutex mutex_;  ///< Guards threads_, taken by starting threads and the report.
+  static ThreadCounters threads_[PERF_MAX_THREADS];
+  static int thread_count_;
+};
+
+#endif
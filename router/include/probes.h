@@ -0,0 +1,63 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * USDT probes of the router forward path, provider isc_router.
+ *
+ * A probe compiles to a nop and a note in the binary, guarded by a semaphore
+ * the tracer increments while attached, so its arguments are not even
+ * evaluated until perf or bpftrace attaches to it. Probes are compiled in when
+ * <sys/sdt.h> (systemtap-sdt-dev) is available, ISC_NO_USDT removes them.
+ * Arguments are plain integers, fd is the socket descriptor of the session the
+ * probe is about:
+ *
+ *   accept(fd, sessions)                      connection accepted, sessions after it
+ *   handshake(fd, node_id)                    node registered its ID
+ *   receive(fd, src_id, dst_id)               frame read from a session
+ *   enqueue(dst_fd, src_fd, dst_id, depth)    frame appended to an outbox, depth is frames pending there
+ *   dequeue(fd, worker, batch)                write worker took a flush request, batch is requests taken with it
+ *   send(fd, dst_id, frames, depth)           flush written, depth is frames still pending
+ *   remove(fd, node_id)                       session removed
+ *
+ * bpftrace scripts using them are in router/bpftrace.
+ */
+
+#if !defined(ISC_NO_USDT) && !defined(_WIN32) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+// probe notes carry the address of isc_router_<name>_semaphore
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define ROUTER_USDT 1
+#endif
+#endif
+
+#ifdef ROUTER_USDT
+/// Declares the semaphore of a probe, they are defined in probes.cpp.
+#define ROUTER_PROBE_SEMAPHORE(name) \
+  extern "C" volatile unsigned short isc_router_##name##_semaphore
+
+ROUTER_PROBE_SEMAPHORE(accept);
+ROUTER_PROBE_SEMAPHORE(handshake);
+ROUTER_PROBE_SEMAPHORE(receive);
+ROUTER_PROBE_SEMAPHORE(enqueue);
+ROUTER_PROBE_SEMAPHORE(dequeue);
+ROUTER_PROBE_SEMAPHORE(send);
+ROUTER_PROBE_SEMAPHORE(remove);
+
+/// Checks if a tracer is attached to the probe.
+#define ROUTER_PROBE_ENABLED(name) \
+  __builtin_expect(isc_router_##name##_semaphore != 0, 0)
+
+#define ROUTER_PROBE2(name, a, b) \
+  do { if (ROUTER_PROBE_ENABLED(name)) DTRACE_PROBE2(isc_router, name, a, b); } while (0)
+#define ROUTER_PROBE3(name, a, b, c) \
+  do { if (ROUTER_PROBE_ENABLED(name)) DTRACE_PROBE3(isc_router, name, a, b, c); } while (0)
+#define ROUTER_PROBE4(name, a, b, c, d) \
+  do { if (ROUTER_PROBE_ENABLED(name)) DTRACE_PROBE4(isc_router, name, a, b, c, d); } while (0)
+#else
+#define ROUTER_PROBE2(name, a, b) do { } while (0)
+#define ROUTER_PROBE3(name, a, b, c) do { } while (0)
+#define ROUTER_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+#endif
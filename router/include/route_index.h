@@ -0,0 +1,169 @@
+#ifndef ROUTE_INDEX_H
+#define ROUTE_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "message.h"
+
+#define ANY_MTI -1
+#define NO_ROUTE -1
+
+/// Largest 16 digit PAN, upper bound of a rule without PAN restriction.
+#define MAX_PAN 9999999999999999ULL
+
+/**
+ * @struct RouteRule
+ * @brief One routing rule, frames with matching MTI and PAN in [pan_low, pan_high] go to dst_id.
+ */
+struct RouteRule {
+  int mti;            ///< MTI to match, ANY_MTI matches all
+  uint64_t pan_low;   ///< First PAN of the range, inclusive
+  uint64_t pan_high;  ///< Last PAN of the range, inclusive
+  int dst_id;         ///< Destination node ID
+};
+
+/**
+ * @class RouteIndex
+ * @brief Immutable lookup structure built from a set of route rules.
+ *
+ * Rules of each MTI are flattened into disjoint PAN intervals where the
+ * narrowest covering rule wins (longest BIN prefix). Interval starts and
+ * destinations are kept in two flat arrays, so a lookup is a binary search
+ * over contiguous uint64_t values, no pointer chasing. MTI specific rules
+ * have precedence over ANY_MTI rules.
+ */
+class RouteIndex {
+ public:
+  /**
+   * @brief Builds the index from rules. overlapping rules are allowed.
+   * @param rules Routing rules.
+   */
+  explicit RouteIndex(const std::vector<RouteRule>& rules) {
+    std::vector<int> mtis;
+    for (auto& rule : rules) mtis.push_back(rule.mti);
+    std::sort(mtis.begin(), mtis.end());
+    mtis.erase(std::unique(mtis.begin(), mtis.end()), mtis.end());
+
+    for (int mti : mtis) {
+      std::vector<RouteRule> group;
+      for (auto& rule : rules) {
+        if (rule.mti == mti) group.push_back(rule);
+      }
+      if (mti == ANY_MTI) {
+        any_mti_ = flatten(group);
+      } else {
+        mti_keys_.push_back(mti);
+        by_mti_.push_back(flatten(group));
+      }
+    }
+    rules_count_ = rules.size();
+  }
+
+  /**
+   * @brief Resolves destination of a 32 byte data message.
+   * @param msg Pointer to the message.
+   * @param msg_len Length of the message.
+   * @return Destination node ID, or NO_ROUTE if no rule matches.
+   */
+  int resolve(const char* msg, int msg_len) const {
+    if (msg_len < DATA_MESSAGE_SIZE) return NO_ROUTE;
+
+    int64_t pan_value = IsoFrame::get<PanField>(msg);
+    int64_t mti_value = IsoFrame::get<MtiField>(msg);
+    if (pan_value < 0 || mti_value < 0) return NO_ROUTE;
+    uint64_t pan = static_cast<uint64_t>(pan_value);
+    int mti = static_cast<int>(mti_value);
+
+    auto key = std::lower_bound(mti_keys_.begin(), mti_keys_.end(), mti);
+    if (key != mti_keys_.end() && *key == mti) {
+      int dst = by_mti_[key - mti_keys_.begin()].find(pan);
+      if (dst != NO_ROUTE) return dst;
+    }
+    return any_mti_.find(pan);
+  }
+
+  /**
+   * @brief Gets the number of rules the index is built from.
+   */
+  size_t rules_count() const { return rules_count_; }
+
+  /**
+   * @brief Converts fixed width ASCII digits to a number.
+   * @return false if a non-digit character is found.
+   */
+  static bool parse_digits(const char* digits, int len, uint64_t& value) {
+    value = 0;
+    for (int i = 0; i < len; i++) {
+      unsigned d = static_cast<unsigned char>(digits[i]) - '0';
+      if (d > 9) return false;
+      value = value * 10 + d;
+    }
+    return true;
+  }
+
+ private:
+  /**
+   * @brief Disjoint PAN intervals of one MTI. interval i covers
+   * [starts[i], starts[i+1]) and routes to dsts[i].
+   */
+  struct Intervals {
+    std::vector<uint64_t> starts;
+    std::vector<int> dsts;
+
+    int find(uint64_t pan) const {
+      auto it = std::upper_bound(starts.begin(), starts.end(), pan);
+      if (it == starts.begin()) return NO_ROUTE;
+      return dsts[(it - starts.begin()) - 1];
+    }
+  };
+
+  /**
+   * @brief Sweeps the rule boundaries and keeps the narrowest active rule for
+   * each elementary interval. O(n log n) in rules count.
+   */
+  static Intervals flatten(const std::vector<RouteRule>& rules) {
+    // boundary events : (position, is_start, rule index)
+    std::vector<std::pair<uint64_t, std::pair<int, size_t>>> events;
+    for (size_t i = 0; i < rules.size(); i++) {
+      events.push_back({rules[i].pan_low, {1, i}});
+      if (rules[i].pan_high < MAX_PAN) {
+        events.push_back({rules[i].pan_high + 1, {0, i}});
+      }
+    }
+    std::sort(events.begin(), events.end());
+
+    // active rules ordered by width, narrowest first
+    std::set<std::pair<uint64_t, size_t>> active;
+    Intervals out;
+    size_t e = 0;
+    while (e < events.size()) {
+      uint64_t position = events[e].first;
+      for (; e < events.size() && events[e].first == position; e++) {
+        size_t i = events[e].second.second;
+        auto key = std::make_pair(rules[i].pan_high - rules[i].pan_low, i);
+        if (events[e].second.first) {
+          active.insert(key);
+        } else {
+          active.erase(key);
+        }
+      }
+      int dst = active.empty() ? NO_ROUTE : rules[active.begin()->second].dst_id;
+      // merge with previous interval if destination didnt change
+      if (!out.dsts.empty() && out.dsts.back() == dst) continue;
+      out.starts.push_back(position);
+      out.dsts.push_back(dst);
+    }
+    return out;
+  }
+
+  std::vector<int> mti_keys_;        ///< Sorted MTIs which have specific rules
+  std::vector<Intervals> by_mti_;    ///< Intervals of each MTI in mti_keys_
+  Intervals any_mti_;                ///< Intervals of ANY_MTI rules
+  size_t rules_count_ = 0;
+};
+
+#endif
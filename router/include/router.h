@@ -3,36 +3,110 @@
 
 #include <queue>
 #include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "router_config.h"
 #include "sessions.h"
 #include "signaling_queue.h"
+#include "timer_wheel.h"
+
+/**
+ * @struct WorkerTask
+ * @brief Item of a worker mailbox in session-affine scheduling.
+ */
+struct WorkerTask
+{
+    enum Kind { READ, WRITE };
+    Kind kind;   ///< READ when the socket is readable, WRITE to flush the session outbox.
+    int socket;  ///< Socket of a session owned by the worker.
+
+    bool operator==(const WorkerTask& other) const {
+        return kind == other.kind && socket == other.socket;
+    }
+};
 
 /**
  * @class Router
- * @brief Manages network routing and handling of client connections.
+ * @brief TCP front end of the RouterCore, manages client connections and their reads/writes.
  */
 class Router
 {
 public:
     /**
-     * @brief Starts the router with specified thread count and port.
-     * @param thread_count Number of worker threads to spawn.
-     * @param port Port number to listen on.
+     * @brief Starts the router with specified config.
+     * @param config Router settings, include worker thread count and port.
      * @return Status code indicating success or failure.
      */
-    static int start(unsigned thread_count, unsigned port);
+    static int start(const RouterConfig& config);
+
+    /**
+     * @brief Gets the routing core of the TCP front end.
+     * in-process producers of the same process attach and submit to it directly.
+     * @return Core routing frames between node sessions.
+     */
+    static RouterCore& core() { return core_; }
 
 private:
+    friend class RouterTest;  ///< drives reads of sessions over socketpairs without the event loop
+
     /**
      * @brief a handler for worker threads to handle received events.
      * @param thread_id identifier of thread.
+     * @param cpu CPU the thread is pinned to, NO_CPU for floating thread.
      */
-    static void worker_thread_read_handler(int thread_id);
+    static void worker_thread_read_handler(int thread_id, int cpu);
 
     /**
      * @brief a handler for worker threads to handle write events.
      * @param thread_id identifier of thread.
+     * @param cpu CPU the thread is pinned to, NO_CPU for floating thread.
      */
-    static void worker_thread_write_handler(int thread_id);
+    static void worker_thread_write_handler(int thread_id, int cpu);
+
+    /**
+     * @brief a handler for workers of session-affine scheduling, it does reads and writes of sessions it owns.
+     * @param thread_id identifier of thread, index of its mailbox.
+     * @param cpu CPU the thread is pinned to, NO_CPU for floating thread.
+     */
+    static void worker_thread_affine_handler(int thread_id, int cpu);
+
+    /**
+     * @brief Queues a read of a readable socket to the mailbox of its owner worker, session-affine mode only.
+     * @param socket Readable socket descriptor.
+     */
+    static void dispatch_read(int socket);
+
+    /**
+     * @brief Chooses the owner worker of a session by the configured owner policy.
+     * @param session Session without owner.
+     * @return Worker index.
+     */
+    static int assign_owner(const std::shared_ptr<Session>& session);
+
+    /**
+     * @brief Binds an accepted session to its owner worker in session-affine mode and starts its idle tracking.
+     * @param session Accepted session, nullptr is ignored.
+     */
+    static void accept_session(const std::shared_ptr<Session>& session);
+
+    /**
+     * @brief Starts idle tracking of a session, no-op if idle timeout and heartbeat are disabled.
+     * @param session Accepted session.
+     */
+    static void watch_session(const std::shared_ptr<Session>& session);
+
+    /**
+     * @brief Timer callback of a session, reaps it or sends a heartbeat when it is idle, then reschedules it.
+     * @param weak_session Session of the expired timer, dropped if it is removed meanwhile.
+     */
+    static void check_session(std::weak_ptr<Session>& weak_session);
+
+    /**
+     * @brief Samples pending frames per priority class over all outboxes and logs metrics.
+     */
+    static void report_metrics();
 
     /**
      * @brief Starts the event listener or Event loop to monitor socket intruppt and handle them to worker threads.
@@ -41,57 +115,196 @@ private:
     static void start_event_listener(int server_socket);
 
     /**
-     * @brief Performs read operations on sockets.
+     * @brief Waits until worker threads finish every queued read and write task.
+     * event loop should not dispatch new events meanwhile.
+     */
+    static void drain_workers();
+
+    /**
+     * @brief Checks if reads of every session to hand off stopped at a frame boundary.
+     * reads dont start a new frame while a hot upgrade is pending.
+     */
+    static bool reads_at_frame_boundary();
+
+    /**
+     * @brief Ends a refused hot upgrade, reads continue and frames a node didnt take wait for writability.
+     */
+    static void end_handoff();
+
+    /**
+     * @brief Resumes the read task of a session, worker threads call it for each ready socket.
+     * the task of a new session is created here.
      * @param ready_read_socket Socket descriptor ready for reading.
-     * @param recv_buffer Buffer to store received data. each thread has specific recv_buffer for itself and pass it to do_reads() 
      */
-    static void do_reads(int ready_read_socket,char* recv_buffer);
+    static void do_reads(int ready_read_socket);
+
+    /**
+    * Reads a session for its lifetime, as a coroutine owned by the session.
+    * Reads the 3-byte ID message of a new session, then 32-byte messages, or 16-byte ones unpacked
+    * to 32 bytes after the node switched to packed BCD. The task is suspended whenever the socket
+    * or the shared memory link of the session has no more data, in the middle of a frame too,
+    * while the session is paused by backpressure, and at a frame boundary while a hot upgrade is
+    * pending.
+    * @param session Session read by the task, it owns the task.
+    * @return The task, it returns on socket error.
+    */
+    static SessionTask read_session(Session& session);
+
+    /**
+    * Processes a message received from the specified session.
+    * Extracts the destination ID, and forwards it if valid.
+    * Frames of a local node with a remote destination are forwarded to the peer router,
+    * frames of a peer router are delivered only to local nodes.
+    * @param src_session Session the message is read from.
+    * @param frame The 32-byte ASCII message, null terminated.
+    * @param from_peer true if the socket is an inter-router link.
+    * @return false if the destination is over budget and reads of the session are paused. */
+    static bool process_message(Session& src_session, char* frame, bool from_peer);
 
     /**
-    * Processes an incoming message from the specified socket.
-    * Reads a 32-byte message, extracts the destination ID, and forwards it if valid.
-    * @param ready_read_socket Socket descriptor ready for reading.
-    * @param recv_buffer Buffer to store received data.
-    * @return Number of bytes read from the socket. -1 on Socket Error. 0 on dst not found */
-    static int process_message(int ready_read_socket, char* recv_buffer);
+    * Handles the encoding frames a node sends to the router.
+    * An offer is answered with a switch frame and later frames to the node are encoded,
+    * a switch frame of the node changes the encoding of its later frames.
+    * @param src_session Session of the node.
+    * @param frame The offer or switch frame.
+    */
+    static void handle_encoding_frame(Session& src_session, const char* frame);
 
     /**
-    * Handles the handshake process by reading the initial 3-byte ID message.
+    * Handles the initial 3-byte ID message of a session.
     * Extracts the source ID and registers the session.
-    * @param ready_read_socket Socket descriptor ready for reading.
-    * @param recv_buffer Buffer to store received data.
-    * @return Number of bytes read from the socket. -1 on Socket Error.
+    * @param socket Socket descriptor of the session.
+    * @param id_message The ID message, null terminated.
+    * @return false if the session is refused, a router ID from an address which is not a configured peer.
+    */
+    static bool handle_handshake(int socket, const char* id_message);
+
+    /**
+     * @brief Resumes the write task of a session, worker threads call it for each flush request of write queue.
+     * @param dst_socket Socket descriptor of the destination session.
+     */
+    static void do_writes(int dst_socket);
+
+    /**
+    * Sends the outbox of a session for its lifetime, as a coroutine owned by the session.
+    * Each resumption takes the pending frames and sends them without waiting. The task awaits
+    * the socket being writable when the send took only a part of them, the rest stays in the
+    * outbox, and is suspended until the next flush request when all were sent.
+    * @param session Session written by the task, it owns the task.
+    * @return The task, it returns on socket error.
     */
-    static int handle_handshake(int ready_read_socket,
-                          char* recv_buffer);
+    static SessionTask write_session(Session& session);
 
     /**
-     * @brief insert write task in write queue, worker threads will pop write task and do them
-     * @param task Pair containing socket descriptor and message string.
+     * @brief Registers a socket with a full buffer, the event loop queues a flush when select() reports it writable.
+     * @param socket Socket descriptor of the session.
      */
-    static void do_writes(std::pair<int, std::string> task);
+    static void wait_writable(int socket);
 
     /**
-     * @brief Forwards a message to the destination session. it push message on write queue, worker threads will pop write task and do them
+     * @brief Forwards a message to the destination session. it appends message to the session outbox and queues a flush request, worker threads will pop it and send.
+     * when the outbox budget is exceeded the slow consumer policy is applied.
      * @param dst_session pointer to the destination session.
-     * @param msg Message to be forwarded.
+     * @param frame Pointer to the 32 byte frame.
+     * @param src_socket Socket of the sender, paused by backpressure. NONE for frames generated by the router.
+     * @return false if the sender should stop reading because of backpressure.
      */
-    static void forward(std::shared_ptr<Session> dst_session, std::string msg);
+    static bool forward(std::shared_ptr<Session> dst_session, const char* frame, int src_socket = NONE);
+
+    /**
+     * @brief Applies a slow consumer action taken by an outbox, updates metrics.
+     * @param result Outbox push result.
+     * @param dst_session Destination session.
+     * @param src_socket Socket of the sender.
+     * @return false if the sender should stop reading.
+     */
+    static bool handle_over_budget(PushResult result, const std::shared_ptr<Session>& dst_session, int src_socket);
+
+    /**
+     * @brief Stops monitoring a sender socket for reads, backpressure policy.
+     * @param socket Sender socket descriptor.
+     * @param dst_session Destination whose outbox is over budget.
+     */
+    static void pause_reads(int socket, const std::shared_ptr<Session>& dst_session);
+
+    /**
+     * @brief Queues a flush of a session outbox to its writer, write queue or owner mailbox.
+     * @param session Destination session.
+     * @param frame_class Index of the highest priority class waiting in the outbox, selects the queue lane.
+     */
+    static void schedule_flush(const std::shared_ptr<Session>& session, int frame_class);
+
+    /**
+     * @brief Resumes paused senders whose destination drained or is removed, and forgets removed senders.
+     * drained outboxes resume their senders directly, this catches the rest.
+     */
+    static void sweep_paused_senders();
+
+    /**
+     * @brief Monitors a paused sender again and queues a read for data left in its socket.
+     * @param socket Sender socket descriptor.
+     */
+    static void resume_reads(int socket);
 
 
 
 
     // Static member variables managing concurrency and socket states.
 
+    /// Routing core, node sessions are its endpoints and forward() is their delivery.
+    static RouterCore core_;
+
     /** Queue of sockets ready for reading, they signals by select
      * use std::list as internal queuing mechanism for building queue with linked-list. it helps efficient add/remove to/from FIFO heads.
     */
     static SignalingQueue<int> ready_read_sockets_queue_;
     
-    /** Queue of sockets ready for writing along with messages, worker threads push to it after process received msg
-    * use std::list as internal queuing mechanism for building queue with linked-list. it helps efficient add/remove to/from FIFO heads.
+    /** Queue of sockets having frames in their outbox, worker threads push to it after process received msg
+    * a socket is queued once until its outbox is flushed, frames themselves wait in the outbox.
     */
-    static SignalingQueue<std::pair<int, std::string>> ready_write_sockets_queue_;
+    static SignalingQueue<int> ready_write_sockets_queue_;
+
+    /// Per-worker task queues of session-affine scheduling, empty in shared mode.
+    /// only the owner worker touches sockets of its sessions, so sessions are not locked.
+    static std::vector<std::unique_ptr<SignalingQueue<WorkerTask>>> mailboxes_;
+
+    /// Owner selection policy of session-affine scheduling.
+    static OwnerPolicy owner_policy_;
+
+    /// Idle check timers of sessions, driven by the event loop.
+    /// a session has one timer, activity only updates a timestamp and the timer
+    /// checks it on expiry, so busy sessions dont touch the wheel.
+    static TimerWheel<std::weak_ptr<Session>> session_timers_;
+
+    /// Idle timeout and heartbeat period in milliseconds, 0 disables them.
+    static unsigned idle_timeout_ms_;
+    static unsigned heartbeat_ms_;
+
+    /// Pending frames limit per destination and slow consumer policy.
+    static OutboxBudget outbox_budget_;
+
+    /// Sender sockets paused by backpressure, event loop doesnt monitor them.
+    /// sender and destination sessions are kept to detect removed ones.
+    struct PausedSender {
+        std::weak_ptr<Session> sender;
+        std::weak_ptr<Session> dst;
+    };
+    static std::unordered_map<int, PausedSender> paused_sockets_;
+    static std::mutex paused_mutex_;
+    static std::atomic<int> paused_count_;
+
+    /// Sockets whose buffer is full, their outbox is flushed again when select() reports them writable.
+    static std::vector<int> blocked_writers_;
+    static std::mutex blocked_mutex_;
+
+    /// Unix socket accepting co-located nodes on shared memory, SOCKET_ERROR if disabled.
+    static int shm_listener_;
+
+    /// Coarse clock updated by the event loop on each iteration, workers use it to stamp activity.
+    static std::atomic<int64_t> now_ms_;
+
+    /// A hot upgrade waits for reads to reach a frame boundary, read tasks dont start a new frame.
+    static std::atomic<bool> handoff_pending_;
 
 };
 
@@ -0,0 +1,97 @@
+#ifndef ROUTER_CONFIG_H
+#define ROUTER_CONFIG_H
+
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "outbox.h"
+#include "session_pool.h"
+
+#define THREAD_COUNT 4
+
+/**
+ * @brief How socket events are distributed over worker threads.
+ */
+enum class SchedulingMode {
+  SHARED,  ///< Read and write workers take any socket from shared queues, sockets are locked.
+  AFFINE   ///< Each session is owned by one worker, its reads and writes go to the owner mailbox.
+};
+
+/**
+ * @brief How the owner worker of a new session is chosen in affine scheduling.
+ */
+enum class OwnerPolicy {
+  HASH,         ///< Socket descriptor modulo worker count.
+  LEAST_LOADED  ///< Worker owning fewest sessions.
+};
+
+/**
+ * @struct RouterConfig
+ * @brief Runtime settings of the router, filled from command line arguments.
+ */
+struct RouterConfig {
+  unsigned port = 0;                  ///< Listening port.
+  std::string bind_address = "127.0.0.1";  ///< IPv4 address the listening socket is bound to.
+  unsigned thread_count = THREAD_COUNT;  ///< Number of worker threads.
+  unsigned read_workers = 0;   ///< Workers doing reads, 0 derives it from thread_count.
+  unsigned write_workers = 0;  ///< Workers doing writes, 0 derives it from thread_count.
+  int loop_cpu = -1;           ///< CPU of the event loop thread, -1 doesnt pin.
+  std::vector<int> worker_cpus;  ///< CPU of each worker, read workers first. empty doesnt pin.
+  BalancePolicy balance_policy =
+      BalancePolicy::ROUND_ROBIN;  ///< Pool member selection strategy.
+  std::string routes_file;  ///< Content routing rules, empty disables it.
+  unsigned routes_reload_ms = 1000;  ///< Period of checking rules file changes.
+  std::vector<PeerAddress> peers;  ///< Peer routers to link with.
+  std::string handoff_path;  ///< Unix socket path for hot upgrade, empty disables it.
+  std::string shm_path;  ///< Unix socket path accepting co-located nodes on shared memory, empty disables it.
+  bool low_latency = false;  ///< Spinning workers and latency tuned sockets.
+  unsigned spin_us = 50;     ///< Spin time of idle workers before parking, in low latency mode.
+  int socket_buffer = 0;     ///< SO_RCVBUF/SO_SNDBUF of sessions, 0 keeps system default.
+  unsigned idle_timeout_ms = 0;  ///< Sessions without received data are removed after it, 0 disables it.
+  unsigned heartbeat_ms = 0;     ///< Idle nodes get a heartbeat frame this often, 0 disables it.
+  OutboxBudget outbox_budget;  ///< Pending frames limit per destination and slow consumer policy.
+  unsigned metrics_interval_ms = 10000;  ///< Period of metrics reports, 0 disables them.
+  bool perf_counters = false;  ///< Per thread perf_event_open counters, reported with metrics.
+  unsigned stall_threshold_ms = 0;  ///< Event loop iterations longer than it log the loop stack, 0 disables it.
+  SchedulingMode scheduling = SchedulingMode::SHARED;  ///< Worker scheduling mode.
+  OwnerPolicy owner_policy = OwnerPolicy::HASH;  ///< Owner selection in affine mode.
+
+  /**
+   * @brief Parses command line arguments into a config.
+   *
+   * Usage: ISC-Router <listen_port> [--option value]...
+   *
+   * @param argc Arguments count.
+   * @param argv Arguments vector.
+   * @param config Output config, untouched fields keep their defaults.
+   * @return true on success, false if arguments are invalid.
+   */
+  static bool parse(int argc, char* argv[], RouterConfig& config);
+
+  /**
+   * @brief Reads options from a config file, one "key value" per line.
+   * keys are option names without "--", e.g. "worker-cpus 2,3,4,5".
+   * @param path Path of config file.
+   * @param config Output config.
+   * @return true on success.
+   */
+  static bool load_file(const std::string& path, RouterConfig& config);
+
+  /**
+   * @brief Applies one option to the config.
+   * @param option Option name with leading "--".
+   * @param value Option value.
+   * @param config Output config.
+   * @return true if option and value are valid.
+   */
+  static bool apply_option(const std::string& option, const std::string& value,
+                           RouterConfig& config);
+
+  /**
+   * @brief Usage string printed on invalid arguments.
+   */
+  static const char* usage();
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef ROUTER_CORE_H
+#define ROUTER_CORE_H
+
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "message.h"
+#include "route_index.h"
+#include "session.h"
+#include "session_pool.h"
+
+#define MAX_CLIENTS_COUNT 999
+
+/// Handles of in-process endpoints count down from it, socket descriptors
+/// used as handles of network sessions are never negative.
+#define LOCAL_HANDLE_BASE -2
+
+/**
+ * @brief Outcome of submitting a frame to the core.
+ */
+enum class SubmitResult {
+  DELIVERED,  ///< frame is handed to the delivery of the selected endpoint
+  NOT_FOUND,  ///< no endpoint is attached with the destination ID
+  REJECTED    ///< delivery refused it, the producer should stop submitting (backpressure)
+};
+
+/**
+ * @class RouterCore
+ * @brief Transport agnostic routing core, decides the endpoint of each frame and hands it to the endpoint's delivery.
+ *
+ * Endpoints attach with a node ID and a delivery callback. Several endpoints
+ * of one ID form a pool, balanced by the BalancePolicy. A frame is resolved by
+ * the optional content resolver first, then by its dst field. The core owns no
+ * socket and no thread: the TCP front end (Router) attaches its node sessions
+ * with a delivery queuing frames to their outbox, in-process producers and
+ * benchmarks attach plain callbacks and submit frames without system calls.
+ * Several cores can live in one process. Thread safe, submit() only takes a
+ * shared lock.
+ */
+class RouterCore {
+ public:
+  /**
+   * @brief Receives a frame routed to an endpoint.
+   * called without the core lock, an endpoint may get a frame being delivered
+   * while it is detached.
+   * @param dst Session of the selected endpoint.
+   * @param frame Frame of DATA_MESSAGE_SIZE bytes.
+   * @param src Handle passed to submit() by the producer.
+   * @return false if the producer should stop submitting.
+   */
+  using Delivery = std::function<bool(const std::shared_ptr<Session>& dst,
+                                      const char* frame, int src)>;
+
+  /**
+   * @brief Content based routing stage.
+   * @return Destination node ID, NO_ROUTE falls back to the dst field of the frame.
+   */
+  using Resolver = std::function<int(const char* frame, int len)>;
+
+  /**
+   * @brief Called under the core lock when an ID gets its first endpoint or loses its last one.
+   * @param node_id Node ID.
+   * @param attached true on first attach, false on last detach.
+   */
+  using MembershipListener = std::function<void(int node_id, bool attached)>;
+
+  /**
+   * @brief Creates an empty core.
+   * @param policy Pool member selection strategy.
+   */
+  explicit RouterCore(BalancePolicy policy = BalancePolicy::ROUND_ROBIN)
+      : policy_(policy) {}
+
+  /**
+   * @brief Changes the pool member selection strategy.
+   */
+  void set_balance_policy(BalancePolicy policy);
+
+  /**
+   * @brief Sets the content based routing stage, set it before frames are submitted.
+   */
+  void set_resolver(Resolver resolver);
+
+  /**
+   * @brief Sets the listener of ID membership changes, set it before endpoints attach.
+   */
+  void set_listener(MembershipListener listener);
+
+  /**
+   * @brief Attaches an endpoint under a node ID.
+   * @param node_id Node ID, below MAX_CLIENTS_COUNT.
+   * @param delivery Receives frames routed to the endpoint.
+   * @param session Session of a network endpoint, its socket is the handle. nullptr creates an in-process one.
+   * @return Handle of the endpoint, NONE if the ID is invalid or the session is already attached.
+   */
+  int attach(int node_id, Delivery delivery,
+             std::shared_ptr<Session> session = nullptr);
+
+  /**
+   * @brief Detaches an endpoint, other endpoints of the same ID keep serving.
+   * @param handle Handle returned by attach().
+   * @return false if no endpoint has the handle.
+   */
+  bool detach(int handle);
+
+  /**
+   * @brief Routes a frame to an endpoint.
+   * @param frame Frame of DATA_MESSAGE_SIZE bytes.
+   * @param len Frame length.
+   * @param src Handle of the producer, passed to the delivery.
+   * @param dst_id Optional output, resolved destination ID, e.g. to try other routers on NOT_FOUND.
+   * @return Outcome of routing.
+   */
+  SubmitResult submit(const char* frame, int len = DATA_MESSAGE_SIZE,
+                      int src = NONE, int* dst_id = nullptr);
+
+  /**
+   * @brief Selects the endpoint a frame with the given destination would be delivered to.
+   * @param node_id Destination node ID.
+   * @param frame The frame, used by PAN_HASH. may be nullptr.
+   * @param len Frame length.
+   * @return Session of the endpoint, nullptr if none is attached.
+   */
+  std::shared_ptr<Session> find(int node_id, const char* frame = nullptr,
+                                int len = 0) const;
+
+  /**
+   * @brief Gets IDs having at least one endpoint.
+   */
+  std::vector<int> node_ids() const;
+
+  /**
+   * @brief Gets the number of endpoints attached under an ID.
+   */
+  size_t endpoints(int node_id) const;
+
+ private:
+  struct Endpoint {
+    std::shared_ptr<Session> session;
+    std::shared_ptr<const Delivery> delivery;  ///< shared, submit() copies it out of the lock
+  };
+
+  mutable std::shared_mutex mutex_;
+  std::unordered_map<int, std::shared_ptr<SessionPool>> pools_;  ///< Endpoints by node ID.
+  std::unordered_map<int, Endpoint> endpoints_;  ///< Endpoints by handle.
+  BalancePolicy policy_;
+  Resolver resolver_;
+  MembershipListener listener_;
+  int next_local_handle_ = LOCAL_HANDLE_BASE;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef ROUTING_TABLE_H
+#define ROUTING_TABLE_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "route_index.h"
+
+/**
+ * @class RoutingTable
+ * @brief Optional content based routing stage, resolves destination from MTI and PAN prefix.
+ *
+ * Rules are read from a text file, one rule per line:
+ *   <mti|*> <pan_prefix|pan_prefix_low-pan_prefix_high|*> <dst_id>
+ * e.g. "0200 400000-499999 007" or "* 411111 005". Lines starting with # are comments.
+ *
+ * The active RouteIndex is immutable and replaced atomically on reload, lookups
+ * never wait for a reload. each thread caches the active index and refreshes
+ * it only when the table version changes.
+ */
+class RoutingTable {
+ public:
+  /**
+   * @brief Loads rules file and activates the new index.
+   * @param path Path of rules file.
+   * @return true on success. on failure the previous index stays active.
+   */
+  static bool load(const std::string& path);
+
+  /**
+   * @brief Starts a thread that reloads the rules file whenever it changes.
+   * @param path Path of rules file.
+   * @param interval_ms Period of checking file modification time.
+   */
+  static void start_watcher(const std::string& path, unsigned interval_ms);
+
+  /**
+   * @brief Checks if any rules table is loaded.
+   */
+  static bool enabled() { return version_.load(std::memory_order_relaxed) != 0; }
+
+  /**
+   * @brief Resolves destination of a message with the active index.
+   * @param msg Pointer to the message.
+   * @param msg_len Length of the message.
+   * @return Destination node ID, or NO_ROUTE if no rule matches.
+   */
+  static int resolve(const char* msg, int msg_len);
+
+ private:
+  /**
+   * @brief Parses one rule line.
+   * @return false if the line is malformed.
+   */
+  static bool parse_rule(const std::string& line, RouteRule& rule);
+
+  /// Active index, accessed with std::atomic_load/std::atomic_store.
+  static std::shared_ptr<const RouteIndex> active_;
+
+  /// Incremented on each successful load, 0 means no table.
+  static std::atomic<unsigned> version_;
+};
+
+#endif
@@ -1,13 +1,26 @@
 #ifndef SESSION_H
 #define SESSION_H
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <shared_mutex>
 
+#include "outbox.h"
+#include "session_task.h"
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif
+
 #define NONE -1 
 
+class ShmChannel;
+
 /**
  * @brief Represents a network session.
  */
-class Session
+class Session : public std::enable_shared_from_this<Session>
 {
 public:
     /**
@@ -16,15 +29,51 @@ public:
      */
     Session(int socket) {
         this->socket_ = socket;
-        this->mutex_ = std::make_shared<std::shared_mutex>();
         this->id_ = NONE;
+        this->outstanding_ = 0;
+        this->owner_ = NONE;
+        this->read_scheduled_ = false;
+        this->last_activity_ms_ = 0;
+        this->close_on_destroy_ = false;
+        this->read_encoding_ = FrameEncoding::ASCII;
+        this->mid_frame_ = false;
     }
 
     /**
-     * @brief Destructor for the session.
+     * @brief Destructor for the session, closes the socket if the session is released.
+     * socket is closed here and not on removal, so no other connection reuses the descriptor while a worker still holds the session.
      */
     ~Session() {
-        
+        if (this->close_on_destroy_) {
+#ifdef _WIN32
+            closesocket(this->socket_);
+#else
+            close(this->socket_);
+#endif
+        }
+    }
+
+    /**
+     * @brief Marks the socket to be closed when the last reference to the session is dropped.
+     */
+    void close_on_destroy() {
+        this->close_on_destroy_ = true;
+    }
+
+    /**
+     * @brief Records activity on the session.
+     * @param now_ms Current time in milliseconds.
+     */
+    void touch(int64_t now_ms) {
+        this->last_activity_ms_.store(now_ms, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Gets the time of the last activity on the session.
+     * @return Time in milliseconds.
+     */
+    int64_t get_last_activity() const {
+        return this->last_activity_ms_.load(std::memory_order_relaxed);
     }
 
     /**
@@ -53,16 +102,151 @@ public:
 
     /**
      * @brief Gets the shared mutex used for thread synchronization for avoid read/write on single socket from multiple thread.
-     * @return A shared pointer to the mutex.
+     * only shared scheduling locks it, an owner worker is alone on its sessions.
+     * @return The mutex of the session.
      */
-    std::shared_ptr<std::shared_mutex> get_mutex() const {
+    std::shared_mutex& get_mutex() {
         return this->mutex_;
     }
 
+    /**
+     * @brief Gets the number of frames queued for this session but not yet sent.
+     * @return Outstanding frames count.
+     */
+    int get_outstanding() const {
+        return this->outstanding_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Adjusts the outstanding frames counter, forward() adds and the write task subtracts.
+     * @param delta Value added to the counter.
+     */
+    void add_outstanding(int delta) {
+        this->outstanding_.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Gets the worker owning this session in session-affine scheduling.
+     * @return Worker index, NONE if not assigned yet.
+     */
+    int get_owner() const {
+        return this->owner_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Assigns the owner worker if the session has none, it doesnt change for the session lifetime.
+     * @param owner Proposed worker index.
+     * @return The owner of the session, it differs from proposed one if another thread assigned first.
+     */
+    int claim_owner(int owner) {
+        int expected = NONE;
+        if (this->owner_.compare_exchange_strong(expected, owner, std::memory_order_acq_rel)) {
+            return owner;
+        }
+        return expected;
+    }
+
+    /**
+     * @brief Marks a read task as queued for this session, in a mailbox or the shared read queue.
+     * @return false if a read task is already queued and not started yet.
+     */
+    bool schedule_read() {
+        return !this->read_scheduled_.exchange(true, std::memory_order_acq_rel);
+    }
+
+    /**
+     * @brief Clears the queued read mark, the reading worker calls it before reading.
+     */
+    void clear_read_scheduled() {
+        this->read_scheduled_.store(false, std::memory_order_release);
+    }
+
+    /**
+     * @brief Gets the encoding of frames received on this session, frames sent are encoded by the outbox.
+     * @return Wire encoding, ASCII until the node switches.
+     */
+    FrameEncoding get_read_encoding() const {
+        return this->read_encoding_;
+    }
+
+    /**
+     * @brief Sets the encoding of frames received after the current one, only the reading worker calls it.
+     * @param encoding Wire encoding.
+     */
+    void set_read_encoding(FrameEncoding encoding) {
+        this->read_encoding_ = encoding;
+    }
+
+    /**
+     * @brief Records if the read task holds part of a frame, only the reading worker calls it.
+     * @param mid_frame true while bytes of an incomplete frame are buffered.
+     */
+    void set_mid_frame(bool mid_frame) {
+        this->mid_frame_.store(mid_frame, std::memory_order_release);
+    }
+
+    /**
+     * @brief Checks if the read task holds part of a frame, a hot upgrade waits for the rest before the socket is handed off.
+     */
+    bool is_mid_frame() const {
+        return this->mid_frame_.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Gets frames pending to be sent on this session.
+     * @return Reference to the outbox.
+     */
+    Outbox& get_outbox() {
+        return this->outbox_;
+    }
+
+    /**
+     * @brief Attaches the shared memory link of a co-located node, set once before the session is dispatched.
+     * @param channel Rings of the node, the session socket is its doorbell.
+     */
+    void set_channel(std::shared_ptr<ShmChannel> channel) {
+        this->channel_ = std::move(channel);
+    }
+
+    /**
+     * @brief Gets the shared memory link of the session.
+     * @return Pointer to the channel, nullptr for TCP sessions.
+     */
+    ShmChannel* get_channel() const {
+        return this->channel_.get();
+    }
+
+    /**
+     * @brief Gets the task reading this session, created by the first worker reading it.
+     * @return Reference to the task, not valid() before the first read.
+     */
+    SessionTask& get_read_task() {
+        return this->read_task_;
+    }
+
+    /**
+     * @brief Gets the task sending the outbox of this session, created by the first flush request.
+     * @return Reference to the task, not valid() before the first flush.
+     */
+    SessionTask& get_write_task() {
+        return this->write_task_;
+    }
+
 private:
     int socket_; ///< Socket descriptor associated with the session
     int id_; ///< Unique identifier for the session
-    std::shared_ptr<std::shared_mutex> mutex_; ///< Mutex for thread-safe read/write on single socket
+    std::shared_mutex mutex_; ///< Mutex for thread-safe read/write on single socket, shared scheduling only
+    std::atomic<int> outstanding_; ///< Frames waiting in write queue, used by least-outstanding balancing
+    std::atomic<int> owner_; ///< Worker owning the session in session-affine scheduling
+    std::atomic<bool> read_scheduled_; ///< A read task is queued in the owner mailbox
+    std::atomic<int64_t> last_activity_ms_; ///< Time of the last received data, used for idle detection
+    std::atomic<bool> close_on_destroy_; ///< Session is removed, its socket is closed on destruction
+    FrameEncoding read_encoding_; ///< Encoding of received frames, reads of a session are serialized
+    std::atomic<bool> mid_frame_; ///< Read task holds bytes of an incomplete frame
+    Outbox outbox_; ///< Frames waiting to be sent, bounded by the slow consumer budget
+    std::shared_ptr<ShmChannel> channel_; ///< Shared memory link, nullptr for TCP sessions
+    SessionTask read_task_; ///< Handshake and frame reads, its frame refers to the session so it is destroyed first
+    SessionTask write_task_; ///< Outbox sends, its frame refers to the session and the outbox so it is destroyed first
 };
 
 
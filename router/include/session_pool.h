@@ -0,0 +1,161 @@
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "message.h"
+#include "session.h"
+
+/// Number of points each pool member owns on the consistent hashing ring.
+/// more points gives smoother distribution of PANs between members.
+#define VIRTUAL_NODES_PER_SESSION 64
+
+/**
+ * @brief Strategy used to pick one session among sessions sharing a node ID.
+ */
+enum class BalancePolicy {
+  ROUND_ROBIN,        ///< rotate between pool members
+  LEAST_OUTSTANDING,  ///< member with fewest frames waiting in write queue
+  PAN_HASH            ///< consistent hashing on PAN, same PAN sticks to same member
+};
+
+/**
+ * @class SessionPool
+ * @brief Holds all sessions registered under one logical node ID.
+ *
+ * Several connections can register with the same ID, the router then selects
+ * one of them per message. Mutating methods (add/remove) must be called under
+ * the Sessions unique lock, select() is safe under the Sessions shared lock
+ * since it only touches atomics.
+ */
+class SessionPool {
+ public:
+  /**
+   * @brief Adds a session to the pool and rebuilds the hashing ring.
+   * @param session The session to add.
+   */
+  void add(std::shared_ptr<Session> session) {
+    members_.push_back(session);
+    rebuild_ring();
+  }
+
+  /**
+   * @brief Removes the session associated with the given socket.
+   * @param socket Socket descriptor of the session to remove.
+   * @return true if a member was removed.
+   */
+  bool remove(int socket) {
+    auto it = std::find_if(members_.begin(), members_.end(),
+                           [socket](const std::shared_ptr<Session>& s) {
+                             return s->get_socket() == socket;
+                           });
+    if (it == members_.end()) return false;
+    members_.erase(it);
+    rebuild_ring();
+    return true;
+  }
+
+  /**
+   * @brief Checks if the pool has no member.
+   * @return true if the pool is empty.
+   */
+  bool empty() const { return members_.empty(); }
+
+  /**
+   * @brief Gets the number of sessions in the pool.
+   * @return Members count.
+   */
+  size_t size() const { return members_.size(); }
+
+  /**
+   * @brief Selects a pool member for the given message.
+   * @param policy Balancing strategy.
+   * @param msg The message to route, used by PAN_HASH. may be nullptr.
+   * @param msg_len Length of the message.
+   * @return Selected session, or nullptr if the pool is empty.
+   */
+  std::shared_ptr<Session> select(BalancePolicy policy, const char* msg,
+                                  int msg_len) {
+    if (members_.empty()) return nullptr;
+    if (members_.size() == 1) return members_[0];
+
+    switch (policy) {
+      case BalancePolicy::LEAST_OUTSTANDING: {
+        // linear scan is fine, pools are a handful of processes
+        size_t best = 0;
+        int best_outstanding = members_[0]->get_outstanding();
+        for (size_t i = 1; i < members_.size(); i++) {
+          int outstanding = members_[i]->get_outstanding();
+          if (outstanding < best_outstanding) {
+            best = i;
+            best_outstanding = outstanding;
+          }
+        }
+        return members_[best];
+      }
+      case BalancePolicy::PAN_HASH:
+        if (msg != nullptr && msg_len >= DATA_MESSAGE_SIZE) {
+          constexpr int pan = IsoFrame::offset<PanField>();
+          uint32_t h = hash(msg + pan, PanField::width);
+          // first ring point clockwise from the PAN hash
+          auto it = std::lower_bound(
+              ring_.begin(), ring_.end(), std::make_pair(h, size_t(0)));
+          if (it == ring_.end()) it = ring_.begin();
+          return members_[it->second];
+        }
+        // message has no PAN, fall back to round robin
+        break;
+      case BalancePolicy::ROUND_ROBIN:
+        break;
+    }
+    unsigned n = next_.fetch_add(1, std::memory_order_relaxed);
+    return members_[n % members_.size()];
+  }
+
+ private:
+  /**
+   * @brief FNV-1a hash, cheap and good enough for spreading PANs on the ring.
+   */
+  static uint32_t hash(const char* data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+      h ^= static_cast<unsigned char>(data[i]);
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  /**
+   * @brief Recomputes ring points of all members.
+   * each member gets VIRTUAL_NODES_PER_SESSION points derived from its socket,
+   * so adding/removing a member only moves the PANs of its own points.
+   */
+  void rebuild_ring() {
+    ring_.clear();
+    ring_.reserve(members_.size() * VIRTUAL_NODES_PER_SESSION);
+    for (size_t i = 0; i < members_.size(); i++) {
+      int key[2] = {members_[i]->get_socket(), 0};
+      for (int v = 0; v < VIRTUAL_NODES_PER_SESSION; v++) {
+        key[1] = v;
+        ring_.emplace_back(hash(reinterpret_cast<const char*>(key), sizeof(key)),
+                           i);
+      }
+    }
+    std::sort(ring_.begin(), ring_.end());
+  }
+
+  /// Sessions registered under this node ID.
+  std::vector<std::shared_ptr<Session>> members_;
+
+  /// Consistent hashing ring, sorted (point, member index) pairs.
+  std::vector<std::pair<uint32_t, size_t>> ring_;
+
+  /// Round robin cursor, atomic since select() runs under a shared lock.
+  std::atomic<unsigned> next_{0};
+};
+
+#endif
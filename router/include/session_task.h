@@ -0,0 +1,220 @@
+#ifndef SESSION_TASK_H
+#define SESSION_TASK_H
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+/// Bytes of a pooled coroutine frame, larger frames come from the heap.
+#define TASK_FRAME_SIZE 512
+/// Frames the pool grows by when it runs out.
+#define TASK_FRAMES_PER_CHUNK 64
+/// Free frames a thread keeps, the ones it releases above are shared.
+#define TASK_FRAMES_PER_THREAD (TASK_FRAMES_PER_CHUNK * 2)
+
+/// Result of FrameReader::read() when the task was suspended for more data.
+#define READ_PENDING 0
+
+/**
+ * @class FramePool
+ * @brief Fixed size blocks for coroutine frames of session tasks.
+ *
+ * A frame is taken when a session starts its task and given back when the
+ * session is destroyed, awaiting never allocates. Each thread keeps a cache
+ * of free blocks, chunks are allocated by the thread which runs out of them,
+ * so frames of tasks started on a pinned worker are on its memory node.
+ * Freed blocks are kept for the next sessions and never returned to the
+ * system.
+ */
+class FramePool {
+ public:
+  /**
+   * @brief Takes a block for a coroutine frame.
+   * @param size Frame size, above TASK_FRAME_SIZE the frame is allocated with new.
+   */
+  static void* allocate(size_t size);
+
+  /**
+   * @brief Gives back a block taken by allocate(), to the cache of the calling thread.
+   * @param frame Pointer to the frame.
+   * @param size Frame size, the one passed to allocate().
+   */
+  static void release(void* frame, size_t size);
+
+  /**
+   * @brief Gets the number of pooled blocks in use.
+   */
+  static size_t in_use();
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  /// Free blocks of one thread, given to the shared list when the thread exits.
+  struct ThreadCache {
+    FreeBlock* free_list = nullptr;
+    size_t count = 0;
+    ~ThreadCache();
+  };
+
+  static thread_local ThreadCache cache_;
+  static FreeBlock* free_list_;       ///< Blocks over the cache limit and of exited threads
+  static std::atomic<size_t> in_use_; ///< Blocks taken and not given back
+  static std::mutex mutex_;           ///< Guards free_list_, sessions end on any thread
+};
+
+/**
+ * @class SessionTask
+ * @brief A session handler written as a coroutine, owned by its session.
+ *
+ * The task starts suspended, the worker reading the session resumes it and
+ * it runs until it awaits data the socket doesnt have yet. Resumptions of a
+ * task are serialized like reads of its session. The frame is destroyed with
+ * the task, a suspended task is simply dropped.
+ */
+class SessionTask {
+ public:
+  struct promise_type {
+    SessionTask get_return_object() {
+      return SessionTask(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    // frame stays until its owner drops the task, done() is checked meanwhile
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { throw; }
+
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+    static void operator delete(void* frame, size_t size) {
+      FramePool::release(frame, size);
+    }
+  };
+
+  SessionTask() = default;
+  SessionTask(const SessionTask&) = delete;
+  SessionTask& operator=(const SessionTask&) = delete;
+  SessionTask(SessionTask&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  SessionTask& operator=(SessionTask&& other) noexcept {
+    if (this != &other) {
+      if (handle_) handle_.destroy();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
+  }
+  ~SessionTask() {
+    if (handle_) handle_.destroy();
+  }
+
+  /**
+   * @brief Checks if the task is created.
+   */
+  bool valid() const { return static_cast<bool>(handle_); }
+
+  /**
+   * @brief Checks if the task returned, it is not resumed anymore.
+   */
+  bool done() const { return handle_.done(); }
+
+  /**
+   * @brief Runs the task until its next suspension.
+   */
+  void resume() { handle_.resume(); }
+
+ private:
+  explicit SessionTask(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * @class FrameReader
+ * @brief Reads fixed size frames for a task, suspending it in the middle of a
+ * frame until the rest arrives.
+ *
+ * Bytes of a partial frame stay in the caller's buffer, which lives in the
+ * task frame, so nothing is dropped when a frame is split across reads.
+ *
+ * @tparam Source Callable int(char* buffer, int len), returns the bytes read
+ * without waiting, 0 if there are none, or a negative value on error.
+ */
+template <class Source>
+class FrameReader {
+ public:
+  explicit FrameReader(Source source) : source_(std::move(source)) {}
+
+  struct Awaiter {
+    FrameReader& reader;
+    char* buffer;
+    int len;
+    int result;
+
+    bool await_ready() {
+      result = reader.fill(buffer, len);
+      return result != READ_PENDING;
+    }
+    void await_suspend(std::coroutine_handle<>) noexcept {}
+    int await_resume() const noexcept { return result; }
+  };
+
+  /**
+   * @brief Reads a frame, the task is suspended if the source has not all of it.
+   *
+   * A resumed task gets READ_PENDING and reads again with the same buffer and
+   * length:  do { n = co_await reader.read(buf, len); } while (n == READ_PENDING);
+   *
+   * @param buffer Frame buffer, it holds the partial frame between reads.
+   * @param len Frame size.
+   * @return len, READ_PENDING or the negative error of the source.
+   */
+  Awaiter read(char* buffer, int len) {
+    return Awaiter{*this, buffer, len, READ_PENDING};
+  }
+
+  /**
+   * @brief Gets the bytes of the current frame read so far.
+   */
+  int pending() const { return filled_; }
+
+ private:
+  int fill(char* buffer, int len) {
+    int count = source_(buffer + filled_, len - filled_);
+    if (count < 0) return count;
+    filled_ += count;
+    if (filled_ < len) return READ_PENDING;
+    filled_ = 0;
+    return len;
+  }
+
+  Source source_;
+  int filled_ = 0;
+};
+
+/**
+ * @class Writable
+ * @brief Suspends a task until its socket can take more bytes.
+ *
+ * The wait is registered after the task is suspended, so a resumption queued
+ * by the event loop meanwhile finds the task ready to continue.
+ *
+ * @tparam Arm Callable void(), registers the socket to be reported writable.
+ */
+template <class Arm>
+class Writable {
+ public:
+  explicit Writable(Arm arm) : arm_(std::move(arm)) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<>) { arm_(); }
+  void await_resume() const noexcept {}
+
+ private:
+  Arm arm_;
+};
+
+#endif
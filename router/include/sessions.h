@@ -1,18 +1,19 @@
 #ifndef SESSIONS_H
 #define SESSIONS_H
 
+#include "router_core.h"
 #include "session.h"
 #include <unordered_map>
-
-#define MAX_CLIENTS_COUNT 999
+#include <vector>
 
 /**
  * @class Sessions
  * @brief Manages connected client sessions.
  *
  * This class provides static methods to initialize, accept, retrieve,
- * add, find, and remove client sessions. It maintains internal mappings
- * between sockets and session IDs for efficient session management.
+ * add, find, and remove client sessions. It maintains the sessions of
+ * accepted sockets, node sessions are attached to the RouterCore which
+ * routes frames between them by their ID.
  */
 class Sessions
 {
@@ -20,8 +21,11 @@ public:
     /**
      * @brief Initialize the session management with a maximum number of clients.
      * @param max_clients_count Maximum number of clients to support.
+     * @param core Routing core node sessions are attached to.
+     * @param delivery Delivery of node sessions, queues frames to their outbox.
      */
-    static void init_sessions(int max_clients_count);
+    static void init_sessions(int max_clients_count, RouterCore* core,
+                              RouterCore::Delivery delivery);
 
     /**
      * @brief Accepts a new client connection.
@@ -31,23 +35,34 @@ public:
 
     /**
      * @brief Retrieve the list of accepted client sockets.
-     * @return Const reference to vector of accepted client sockets.
+     * @return Copy of accepted client sockets, taken under the sessions lock.
+     */
+    static std::vector<int> get_accpeted_sockets();
+
+    /**
+     * @brief Get the number of accepted client sockets.
      */
-    static const std::vector<int>& get_accpeted_sockets();
+    static size_t accepted_count();
 
     /**
      * @brief Add a new node with its associated socket and node ID.
+     * if other sessions already registered with this ID, the session joins their pool in the core.
      * @param socket Socket descriptor for the session.
-     * @param node_id Unique identifier for the session node.
+     * @param node_id Identifier of the logical node.
      */
     static void add_node(int socket, int node_id);
 
     /**
-     * @brief Find a session by its node ID.
-     * @param node_id The ID of the session node to find.
-     * @return Shared pointer to the found Session, or nullptr if not found.
+     * @brief Mark a session as an inter-router link, it gets ROUTER_NODE_ID and doesnt join any pool.
+     * @param socket Socket descriptor of the link.
+     */
+    static void add_peer(int socket);
+
+    /**
+     * @brief Get a snapshot of all sessions.
+     * @return Vector of sessions.
      */
-    static std::shared_ptr<Session> find_session_by_id(int node_id);
+    static std::vector<std::shared_ptr<Session>> get_sessions();
 
     /**
      * @brief Find a session by its client socket.
@@ -67,9 +82,9 @@ private:
     /// we need access to session by its socket, we use unordered_map for access by O(1)
     static std::unordered_map<int, std::shared_ptr<Session>> sessions_by_socket_;
 
-    /// Map of node IDs to Session objects.
-    /// we need access to session by its id, we use unordered_map for access by O(1)
-    static std::unordered_map<int, std::shared_ptr<Session>> sessions_by_id_;
+    /// Routing core holding node sessions by their ID, and their delivery.
+    static RouterCore* core_;
+    static RouterCore::Delivery delivery_;
 
     /// List of accepted client sockets.
     /// we need a continues memory for keeps accepted sockets, we will iterate it for fill fd_set.
@@ -0,0 +1,136 @@
+#ifndef SHM_TRANSPORT_H
+#define SHM_TRANSPORT_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "message.h"
+#include "shm_ring.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/select.h>
+#endif
+
+class Session;
+
+/**
+ * @class ShmChannel
+ * @brief Shared memory link of one co-located node, the pair of rings and their doorbells.
+ *
+ * Session socket of the node is the eventfd the node rings, select() reports
+ * it readable like a TCP socket with data, so shared memory sessions join the
+ * event loop and routing tables like TCP ones. The node also rings it when it
+ * frees space in a full ring, the reader then resumes the flush.
+ */
+class ShmChannel {
+ public:
+  /**
+   * @brief Attaches to a mapped region holding both rings.
+   * @param region Mapped region, released on destruction.
+   * @param region_size Size of the mapping.
+   * @param capacity Bytes of each ring.
+   * @param router_doorbell Eventfd rung by the node, the session socket. session closes it.
+   * @param node_doorbell Eventfd rung by the router, closed on destruction.
+   */
+  ShmChannel(void* region, size_t region_size, size_t capacity,
+             int router_doorbell, int node_doorbell);
+
+  /**
+   * @brief Marks the rings closed, wakes the node and releases the mapping.
+   */
+  ~ShmChannel();
+
+  /**
+   * @brief Resets the doorbell of the router, called before draining the ring.
+   */
+  void acknowledge();
+
+  /**
+   * @brief Reads up to len bytes sent by the node, like TcpServer::read_async().
+   * @param buffer Output buffer.
+   * @param len Maximum bytes.
+   * @return Bytes read, 0 if no more data, SOCKET_ERROR if the node closed the transport.
+   */
+  int read(char* buffer, int len);
+
+  /**
+   * @brief Rings the router doorbell if frames are left in the ring, so select() reports the session again.
+   * otherwise waits for the node's next write. called when reading stops before an empty read, e.g. unknown destination.
+   */
+  void rearm();
+
+  /**
+   * @brief Writes whole frames to the node without waiting, like TcpServer::send_some().
+   * if the ring is full, the node rings the router doorbell once it frees space.
+   * @param buffer Frames to send.
+   * @param len Bytes to send.
+   * @param frame_size Size of the frames in the node's encoding, the ring takes multiples of it.
+   * @return Bytes written, less than len if the ring is full, SOCKET_ERROR if the node closed the transport.
+   */
+  int write(const char* buffer, int len, int frame_size = DATA_MESSAGE_SIZE);
+
+ private:
+  /**
+   * @brief Rings the node's doorbell.
+   */
+  void wake_node();
+
+  void* region_;
+  size_t region_size_;
+  ShmRing to_router_;    ///< Frames from the node.
+  ShmRing to_node_;      ///< Frames to the node.
+  int router_doorbell_;  ///< Eventfd rung by the node.
+  int node_doorbell_;    ///< Eventfd rung by the router.
+};
+
+/**
+ * @class ShmTransport
+ * @brief Accepts co-located nodes on a Unix socket and sets up their shared memory rings.
+ *
+ * A node connects to the Unix socket, the router maps a region holding two
+ * SPSC rings (node to router, router to node), creates an eventfd doorbell for
+ * each side and passes the three descriptors with SCM_RIGHTS. Frames then skip
+ * loopback TCP in both directions. The node handshakes with its ID through the
+ * ring like a TCP node. The Unix connection stays open as a liveness signal,
+ * it is closed by the kernel when the node process dies. Driven by the event
+ * loop thread only. Linux only.
+ */
+class ShmTransport {
+ public:
+  /**
+   * @brief Listens on a Unix socket path for co-located nodes.
+   * @param path Unix socket path, an existing file is replaced.
+   * @return Listening socket, SOCKET_ERROR on failure.
+   */
+  static int listen(const std::string& path);
+
+  /**
+   * @brief Accepts a node, sets up its rings and registers its session.
+   * @param listen_socket Socket returned by listen().
+   * @return Session of the node, nullptr on failure.
+   */
+  static std::shared_ptr<Session> accept_node(int listen_socket);
+
+  /**
+   * @brief Adds Unix connections of live shared memory sessions to the select set, closes the rest.
+   * @param readfds Descriptor set of the event loop.
+   * @return Highest added descriptor, -1 if none.
+   */
+  static int set_fds(fd_set& readfds);
+
+  /**
+   * @brief Removes sessions whose Unix connection is readable, it means the node closed it or died.
+   * @param readfds Descriptor set returned by select().
+   */
+  static void check_fds(const fd_set& readfds);
+
+ private:
+  /// Session socket of each node by its Unix connection.
+  static std::unordered_map<int, std::weak_ptr<Session>> connections_;
+};
+
+#endif
@@ -1,14 +1,41 @@
 #ifndef SIGNALINGQUEUE_H
 #define SIGNALINGQUEUE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+#define CPU_RELAX() asm volatile("yield")
+#else
+#define CPU_RELAX() std::this_thread::yield()
+#endif
+
 /**
  * @brief A thread-safe queue implementation with signaling capabilities.
  */
 template <typename T>
 class SignalingQueue {
 private:
-    /// Underlying queue storing elements
-    std::queue<T> m_queue;
+    /// Underlying queues storing elements, one per priority lane, lane 0 is the highest.
+    std::vector<std::queue<T>> m_lanes = std::vector<std::queue<T>>(1);
+
+    /// Number of items in all lanes.
+    size_t m_count = 0;
+
+    /// Items popped from a lane per turn, empty means strict priority.
+    std::vector<unsigned> m_weights;
+
+    /// Lane having the current turn and its remaining items, in weighted mode.
+    size_t m_turn_lane = 0;
+    unsigned m_turn_left = 0;
 
     /// Mutex for synchronizing access to the queue.
     std::mutex m_mutex;
@@ -16,28 +43,117 @@ private:
     /// Condition variable for signaling availability of new items.
     std::condition_variable m_cond;
 
+    /// Items pushed but not yet reported finished by task_done().
+    std::atomic<int> m_unfinished{0};
+
+    /// Number of items, readable without the mutex by spinning consumers.
+    std::atomic<size_t> m_size{0};
+
+    /// Consumers parked on m_cond, push() skips notify when nobody waits.
+    int m_waiters = 0;
+
+    /// How long pop() spins before parking on the condition variable, 0 disables spinning.
+    std::chrono::nanoseconds m_spin{0};
+
+    /**
+     * @brief Busy waits until an item is available or spin budget is spent.
+     */
+    void spin_wait()
+    {
+        auto deadline = std::chrono::steady_clock::now() + m_spin;
+        int rounds = 0;
+        while (m_size.load(std::memory_order_acquire) == 0) {
+            CPU_RELAX();
+            // reading the clock is costlier than pause, check it every 64 rounds
+            if (++rounds % 64 == 0 && std::chrono::steady_clock::now() >= deadline) {
+                return;
+            }
+        }
+    }
+
+    /// Condition variable for signaling all items are finished.
+    std::condition_variable m_done_cond;
+
+    /**
+     * @brief Removes the next item in lane order, called with the mutex held and the queue not empty.
+     */
+    T take_front()
+    {
+        size_t lane = 0;
+        if (m_weights.empty()) {
+            // strict, the highest non-empty lane
+            while (m_lanes[lane].empty()) lane++;
+        } else {
+            // weighted, lanes take turns, an empty lane passes its turn on
+            while (m_turn_left == 0 || m_lanes[m_turn_lane].empty()) {
+                m_turn_lane = (m_turn_lane + 1) % m_lanes.size();
+                m_turn_left = m_weights[m_turn_lane];
+            }
+            m_turn_left--;
+            lane = m_turn_lane;
+        }
+        T item = std::move(m_lanes[lane].front());
+        m_lanes[lane].pop();
+        m_count--;
+        return item;
+    }
+
 public:
+    /**
+     * @brief Sets spin-then-park behaviour of pop(), used by low latency mode.
+     * spinning consumers see new items without a futex wake-up.
+     * @param spin Maximum spinning time before parking, 0 parks immediately.
+     */
+    void set_spin(std::chrono::nanoseconds spin)
+    {
+        m_spin = spin;
+    }
+
+    /**
+     * @brief Splits the queue into priority lanes, called before any push.
+     * @param count Number of lanes, lane 0 is popped first.
+     * @param weights Items popped from each lane per turn, so lower lanes are not starved. empty means strict priority.
+     */
+    void set_lanes(size_t count, const std::vector<unsigned>& weights = {})
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_lanes.resize(count > 0 ? count : 1);
+        m_weights = weights;
+        // zero weights would never get a turn
+        for (auto& weight : m_weights) weight = weight > 0 ? weight : 1;
+        m_weights.resize(m_weights.empty() ? 0 : m_lanes.size(), 1);
+        m_turn_lane = 0;
+        m_turn_left = m_weights.empty() ? 0 : m_weights[0];
+    }
+
     /**
      * @brief Pushes an element into the queue and notifies one waiting thread
      * @param item The element to be added to the queue.
-     * @param skip_if_repeated If true, skips insertion if the last element is equal to item.
+     * @param skip_if_repeated If true, skips insertion if the last element of the lane is equal to item.
+     * @param lane Priority lane, the last lane if it is out of range.
      */
-    void push(T item, bool skip_if_repeated=false)
+    void push(T item, bool skip_if_repeated=false, size_t lane=0)
     {
 
         std::unique_lock<std::mutex> lock(m_mutex);
 
-        if (skip_if_repeated && m_queue.size() > 0) {
-            if (m_queue.back() == item) {
+        auto& queue = m_lanes[lane < m_lanes.size() ? lane : m_lanes.size() - 1];
+        if (skip_if_repeated && queue.size() > 0) {
+            if (queue.back() == item) {
                 return; // Skip inserting duplicate at the end
             }
         }
 
 
-        m_queue.push(item);
+        queue.push(item);
+        m_count++;
+        m_unfinished++;
+        m_size.store(m_count, std::memory_order_release);
 
         // Notify one waiting thread that an item is available
-        m_cond.notify_one();
+        if (m_waiters > 0) {
+            m_cond.notify_one();
+        }
     }
 
     /**
@@ -47,14 +163,117 @@ public:
      */
     T pop()
     {
+        if (m_spin.count() > 0) {
+            spin_wait();
+        }
+
         std::unique_lock<std::mutex> lock(m_mutex);
 
         // Wait until the queue is not empty
-        m_cond.wait(lock, [this]() { return !m_queue.empty(); });
+        if (m_count == 0) {
+            m_waiters++;
+            m_cond.wait(lock, [this]() { return m_count > 0; });
+            m_waiters--;
+        }
 
-        T item = m_queue.front();
-        m_queue.pop();
+        T item = take_front();
+        m_size.store(m_count, std::memory_order_relaxed);
         return item;
     }
+
+    /**
+     * @brief Pushes a range of elements with one lock acquisition and wakes up as many waiting threads as needed.
+     * @param first Iterator to the first element.
+     * @param last Iterator past the last element.
+     * @param skip_if_repeated If true, skips each element equal to the last element of the lane.
+     * @param lane Priority lane of all elements, the last lane if it is out of range.
+     */
+    template <typename Iterator>
+    void push_batch(Iterator first, Iterator last, bool skip_if_repeated=false, size_t lane=0)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        auto& queue = m_lanes[lane < m_lanes.size() ? lane : m_lanes.size() - 1];
+        int pushed = 0;
+        for (; first != last; ++first) {
+            if (skip_if_repeated && queue.size() > 0 && queue.back() == *first) {
+                continue;
+            }
+            queue.push(*first);
+            pushed++;
+        }
+        if (pushed == 0) return;
+        m_count += pushed;
+        m_unfinished += pushed;
+        m_size.store(m_count, std::memory_order_release);
+
+        // one waiter per item at most, the rest stays parked
+        if (m_waiters >= pushed) {
+            for (int i = 0; i < pushed; i++) m_cond.notify_one();
+        } else if (m_waiters > 0) {
+            m_cond.notify_all();
+        }
+    }
+
+    /**
+     * @brief Pops up to max elements with one lock acquisition.
+     * This operation blocks if the queue is empty until an item is available,
+     * then takes whatever is queued without waiting for more.
+     * @param items Output vector, it is cleared first.
+     * @param max Maximum number of elements to pop.
+     * @return Number of popped elements, at least 1.
+     */
+    size_t pop_batch(std::vector<T>& items, size_t max)
+    {
+        items.clear();
+        if (m_spin.count() > 0) {
+            spin_wait();
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_count == 0) {
+            m_waiters++;
+            m_cond.wait(lock, [this]() { return m_count > 0; });
+            m_waiters--;
+        }
+
+        // lanes are drained in priority order within the batch as well
+        while (m_count > 0 && items.size() < max) {
+            items.push_back(take_front());
+        }
+        m_size.store(m_count, std::memory_order_relaxed);
+        return items.size();
+    }
+
+    /**
+     * @brief Reports that processing of popped items is finished.
+     * @param count Number of finished items, size of the batch for pop_batch().
+     */
+    void task_done(int count=1)
+    {
+        if ((m_unfinished -= count) == 0) {
+            // lock so a waiter between its check and wait doesnt miss the signal
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done_cond.notify_all();
+        }
+    }
+
+    /**
+     * @brief Checks if every pushed item is popped and reported by task_done().
+     */
+    bool idle() const
+    {
+        return m_unfinished.load() == 0;
+    }
+
+    /**
+     * @brief Blocks until every pushed item is popped and reported by task_done().
+     */
+    void wait_until_done()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cond.wait(lock, [this]() { return m_unfinished == 0; });
+    }
 };
 #endif
\ No newline at end of file
@@ -10,17 +10,24 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <netinet/tcp.h>
 
 #endif
+#include <cerrno>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #ifdef _WIN32
 #define GET_SOCKET_ERROR() WSAGetLastError()
 #else
 #define GET_SOCKET_ERROR() errno
+#define SOCKET_ERROR -1
 #endif
 
+/// Pending connections kept by the kernel, the event loop accepts one per round.
+#define LISTEN_BACKLOG SOMAXCONN
+
 
 /**
  * @class TcpServer
@@ -30,14 +37,16 @@ class TcpServer
 {
 public:
     /**
-     * @brief Starts a TCP server listening on the specified port.
+     * @brief Starts a TCP server listening on the specified address and port.
      * @param port The port number to bind the server socket.
+     * @param bind_address IPv4 address to bind the server socket, 0.0.0.0 listens on all interfaces.
      * @return The server socket descriptor, or -1 on failure.
      */
-    static int start_tcp_server(int port);
+    static int start_tcp_server(int port, const std::string& bind_address);
 
     /**
      * @brief Accepts an incoming client connection.
+     * the connection is closed if its descriptor doesnt fit in an fd_set.
      * @param server_socket The server socket descriptor.
      * @return The client socket descriptor, or error code on failure.
      */
@@ -67,6 +76,84 @@ public:
      */
     static int send_to_client(int client_socket, std::string buffer);
 
+    /**
+     * @brief Sends whole buffer on a non-blocking socket, waits for writability when the socket buffer is full.
+     * @param client_socket The socket descriptor.
+     * @param buffer Pointer to the data.
+     * @param len Length of the data.
+     * @return Number of bytes sent (equal to len), or SOCKET_ERROR on failure.
+     */
+    static int send_all(int client_socket, const char* buffer, int len);
+
+    /**
+     * @brief Sends as much as the socket buffer takes without waiting.
+     * @param client_socket The non-blocking socket descriptor.
+     * @param buffer Pointer to the data.
+     * @param len Length of the data.
+     * @return Number of bytes sent, less than len if socket buffer is full, or SOCKET_ERROR on failure.
+     */
+    static int send_some(int client_socket, const char* buffer, int len);
+
+    /**
+     * @brief Sends whole buffer, waits for writability when the socket buffer is full but gives up after a timeout.
+     * @param client_socket The socket descriptor.
+     * @param buffer Pointer to the data.
+     * @param len Length of the data.
+     * @param timeout_ms Maximum time spent on the buffer in milliseconds.
+     * @return Number of bytes sent, less than len if the timeout expired, or SOCKET_ERROR on failure.
+     */
+    static int send_within(int client_socket, const char* buffer, int len, int timeout_ms);
+
+    /**
+     * @brief Connects to a remote TCP server, used for inter-router links.
+     * the socket is blocking during connect and set to non-blocking after it.
+     * @param ip IPv4 address of the server.
+     * @param port Port of the server.
+     * @return The connected socket descriptor, or SOCKET_ERROR on failure.
+     */
+    static int connect_to(const std::string& ip, int port);
+
+    /**
+     * @brief Gets the IPv4 address of the remote end of a socket.
+     * @param client_socket The socket descriptor.
+     * @return Address in dotted form, empty if the socket is not an IPv4 TCP socket.
+     */
+    static std::string peer_ip(int client_socket);
+
+    /**
+     * @brief Waits until a socket is writable or timeout expires.
+     * @param client_socket The socket descriptor.
+     * @param timeout_ms Maximum waiting time in milliseconds.
+     * @return true if the socket is writable.
+     */
+    static bool wait_writable(int client_socket, int timeout_ms);
+
+    /**
+     * @brief Shuts down both directions of a socket without releasing the descriptor.
+     * pending and later reads/writes on it fail, so workers using it let it go.
+     * @param client_socket The socket descriptor.
+     */
+    static void shutdown_socket(int client_socket);
+
+    /**
+     * @brief Closes a socket descriptor.
+     * @param client_socket The socket descriptor.
+     */
+    static void close_socket(int client_socket);
+
+    /**
+     * @brief Sets socket tuning applied to every accepted and connected socket.
+     * @param low_latency Enables TCP_NODELAY, and on Linux TCP_QUICKACK and SO_BUSY_POLL.
+     * @param buffer_size SO_RCVBUF/SO_SNDBUF size in bytes, 0 keeps the system default.
+     */
+    static void configure(bool low_latency, int buffer_size);
+
+    /**
+     * @brief Applies configured tuning options on a socket.
+     * @param client_socket The socket descriptor.
+     */
+    static void tune_socket(int client_socket);
+
     /**
      * @brief Sets file descriptor set for select and adds server/socket descriptors.
      * @param fd Reference to fd_set to modify.
@@ -74,7 +161,7 @@ public:
      * @param clients_socket Vector of client socket descriptors.
      * @return Updated maximum file descriptor value.
      */
-    static int reset_fd_set(fd_set& fd, int server_socket, std::vector<int> clients_socket);
+    static int reset_fd_set(fd_set& fd, int server_socket, const std::vector<int>& clients_socket);
 
 private:
     /**
@@ -82,6 +169,15 @@ private:
      * @return true if no more data is available, false otherwise.
      */
     static bool no_more_data();
+
+    /**
+     * @brief Re-arms TCP_QUICKACK, kernel clears it after some ACKs. no-op if low latency is off.
+     * @param client_socket The socket descriptor.
+     */
+    static void quick_ack(int client_socket);
+
+    static bool low_latency_;  ///< Low latency tuning is enabled.
+    static int buffer_size_;   ///< Socket buffers size, 0 for system default.
 };
 
 #endif // TCPSERVER_H
@@ -0,0 +1,34 @@
+#ifndef THREAD_AFFINITY_H
+#define THREAD_AFFINITY_H
+
+#include <cstddef>
+
+#define NO_CPU -1
+
+/**
+ * @class ThreadAffinity
+ * @brief Pins threads to CPUs and allocates per-thread buffers on the memory node of the pinned CPU.
+ */
+class ThreadAffinity {
+ public:
+  /**
+   * @brief Pins the calling thread to one CPU.
+   * @param cpu CPU index, NO_CPU leaves the thread floating.
+   * @return true if the thread is pinned.
+   */
+  static bool pin_current_thread(int cpu);
+
+  /**
+   * @brief Allocates a zeroed buffer whose pages are local to the calling thread.
+   *
+   * Pages are mapped fresh and touched by the calling thread, under the default
+   * first-touch policy the kernel places them on the NUMA node of the CPU the
+   * thread is running on, so the thread should be pinned before the call.
+   *
+   * @param size Buffer size in bytes.
+   * @return Pointer to the buffer, nullptr on failure.
+   */
+  static char* allocate_local(size_t size);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// Wheel geometry, each level has 64 slots and covers 64 times the range of
+/// the level below it. 4 levels cover 64^4 ticks.
+#define WHEEL_LEVELS 4
+#define WHEEL_SLOT_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_SLOT_BITS)
+#define WHEEL_SLOT_MASK (WHEEL_SLOTS - 1)
+
+/**
+ * @class TimerWheel
+ * @brief Hierarchical hashed timer wheel, O(1) schedule and O(1) amortized expiry per timer.
+ *
+ * Timers are put in a slot chosen by their expiry tick, near timers on the
+ * first level and far ones on upper levels. When the first level wraps around,
+ * one slot of the upper level is cascaded down, so each tick touches only the
+ * slot that expires instead of scanning all timers. Timers cannot be
+ * cancelled, the payload is checked when it expires (e.g. a weak_ptr of a
+ * removed session is simply dropped). Not thread-safe, it is driven by one
+ * thread.
+ *
+ * @tparam T Timer payload.
+ */
+template <typename T>
+class TimerWheel {
+ public:
+  /**
+   * @brief Constructs an empty wheel.
+   * @param tick_ms Resolution of the wheel in milliseconds.
+   * @param now_ms Current time in milliseconds, tick 0 starts here.
+   */
+  explicit TimerWheel(uint64_t tick_ms, uint64_t now_ms = 0)
+      : tick_ms_(tick_ms), start_ms_(now_ms) {}
+
+  /**
+   * @brief Resets the wheel origin, used before the first timer is scheduled.
+   * @param now_ms Current time in milliseconds.
+   */
+  void reset(uint64_t now_ms) {
+    start_ms_ = now_ms;
+    current_tick_ = 0;
+  }
+
+  /**
+   * @brief Schedules a timer.
+   * @param delay_ms Delay from the current tick, rounded up to the tick resolution.
+   * @param item Payload passed to the expiry callback.
+   */
+  void schedule(uint64_t delay_ms, T item) {
+    uint64_t delay_ticks = (delay_ms + tick_ms_ - 1) / tick_ms_;
+    if (delay_ticks == 0) delay_ticks = 1;
+    insert(current_tick_ + delay_ticks, std::move(item));
+    size_++;
+  }
+
+  /**
+   * @brief Advances the wheel to the given time and calls on_expired for each due timer.
+   * on_expired may schedule new timers.
+   * @param now_ms Current time in milliseconds.
+   * @param on_expired Callable taking the payload (T&).
+   */
+  template <typename Callback>
+  void advance(uint64_t now_ms, Callback&& on_expired) {
+    if (now_ms < start_ms_) return;
+    uint64_t target_tick = (now_ms - start_ms_) / tick_ms_;
+    while (current_tick_ < target_tick) {
+      current_tick_++;
+      cascade();
+
+      // slot is taken out first, callbacks may schedule into the wheel
+      std::vector<Entry> expired;
+      expired.swap(slots_[0][current_tick_ & WHEEL_SLOT_MASK]);
+      for (auto& entry : expired) {
+        size_--;
+        on_expired(entry.item);
+      }
+    }
+  }
+
+  /**
+   * @brief Number of scheduled timers.
+   */
+  size_t size() const { return size_; }
+
+ private:
+  struct Entry {
+    uint64_t expires;  ///< Absolute expiry tick.
+    T item;
+  };
+
+  /**
+   * @brief Puts an entry on the level covering its distance from the current tick.
+   */
+  void insert(uint64_t expires, T item) {
+    uint64_t max_delta =
+        (uint64_t(1) << (WHEEL_SLOT_BITS * WHEEL_LEVELS)) - 1;
+    if (expires - current_tick_ > max_delta) {
+      expires = current_tick_ + max_delta;
+    }
+    uint64_t delta = expires - current_tick_;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= (uint64_t(1) << (WHEEL_SLOT_BITS * (level + 1)))) {
+      level++;
+    }
+    int slot = (expires >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+    slots_[level][slot].push_back(Entry{expires, std::move(item)});
+  }
+
+  /**
+   * @brief Moves entries of upper levels one level down when lower level wraps.
+   */
+  void cascade() {
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+      // lower level didnt wrap on this tick, upper ones didnt either
+      if ((current_tick_ >> (WHEEL_SLOT_BITS * (level - 1))) & WHEEL_SLOT_MASK) {
+        return;
+      }
+      int slot = (current_tick_ >> (WHEEL_SLOT_BITS * level)) & WHEEL_SLOT_MASK;
+      std::vector<Entry> entries;
+      entries.swap(slots_[level][slot]);
+      for (auto& entry : entries) {
+        insert(entry.expires, std::move(entry.item));
+      }
+    }
+  }
+
+  std::vector<Entry> slots_[WHEEL_LEVELS][WHEEL_SLOTS];  ///< Timer lists per level and slot.
+  uint64_t tick_ms_;           ///< Tick resolution in milliseconds.
+  uint64_t start_ms_;          ///< Time of tick 0.
+  uint64_t current_tick_ = 0;  ///< Last processed tick.
+  size_t size_ = 0;            ///< Scheduled timers count.
+};
+
+#endif
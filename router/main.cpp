@@ -3,26 +3,29 @@
 
 #include "logger.h"
 #include "router.h"
+#include "router_config.h"
 #include <vector>
-
-
-#define THREAD_COUNT 4
+#ifndef _WIN32
+#include <csignal>
+#endif
 
 int main(int argc, char* argv[]) {
   try {
     Logger::Initialize("logs/router.log");
+#ifndef _WIN32
+    // a node closing its connection makes send() fail, it must not kill the router
+    signal(SIGPIPE, SIG_IGN);
+#endif
     // std::cout<<"argc = "<<argc;
-    if (argc != 2) {
-      LOG_CRITICAL(
-          "Insufficient Argument.\nUsage: ISC-Router.exe <listen_port>");
+    RouterConfig config;
+    if (!RouterConfig::parse(argc, argv, config)) {
+      LOG_CRITICAL("Insufficient Argument.\n{}", RouterConfig::usage());
       return 1;
     }
 
-    int router_port = std::stoi(argv[1]);
-
-    LOG_INFO("Router started to listen on {} port.", router_port);
+    LOG_INFO("Router started to listen on {}:{}.", config.bind_address, config.port);
 
-    Router::start(THREAD_COUNT, router_port);
+    Router::start(config);
     
 
   } catch (std::exception& e) {
@@ -0,0 +1,281 @@
+#include "handoff.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "logger.h"
+#include "message.h"
+#include "metrics.h"
+#include "sessions.h"
+#include "tcpserver.h"
+
+#ifndef _WIN32
+#include <sys/un.h>
+
+/**
+ * @brief Fills a Unix socket address.
+ * @return false if the path is too long.
+ */
+static bool make_unix_address(const std::string& path, sockaddr_un& addr) {
+  addr = sockaddr_un{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LOG_ERROR("Handoff path is too long : {}", path);
+    return false;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  return true;
+}
+
+int Handoff::take_over(const std::string& path) {
+  sockaddr_un addr;
+  if (!make_unix_address(path, addr)) return SOCKET_ERROR;
+
+  int unix_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (unix_socket == -1) return SOCKET_ERROR;
+  if (connect(unix_socket, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+    // no router is running on this path, start from scratch
+    close(unix_socket);
+    return SOCKET_ERROR;
+  }
+  LOG_INFO("Taking over sockets of the running router on {}", path);
+
+  int server_socket = SOCKET_ERROR;
+  int sessions_count = 0;
+  HandoffRecord record;
+  while (true) {
+    int fd = recv_record(unix_socket, record);
+    if (record.kind == HANDOFF_END) {
+      break;
+    } else if (record.kind == HANDOFF_LISTENER && fd != -1) {
+      server_socket = fd;
+    } else if (record.kind == HANDOFF_SESSION && fd != -1) {
+      // register socket as if it is accepted and handshaked here
+      Sessions::accept_client(fd);
+      if (record.node_id == ROUTER_NODE_ID) {
+        Sessions::add_peer(fd);
+      } else if (record.node_id != NONE) {
+        Sessions::add_node(fd, record.node_id & HANDOFF_NODE_ID_MASK);
+        // node keeps the encodings it negotiated with the old router
+        auto session = Sessions::find_session_by_socket(fd);
+        if (session != nullptr) {
+          session->set_read_encoding(static_cast<FrameEncoding>(
+              (record.node_id >> HANDOFF_READ_ENCODING_SHIFT) & 0xFF));
+          session->get_outbox().set_encoding(static_cast<FrameEncoding>(
+              (record.node_id >> HANDOFF_WRITE_ENCODING_SHIFT) & 0xFF));
+        }
+      }
+      sessions_count++;
+    } else {
+      // the old router still owns all sockets, it resumes serving
+      LOG_CRITICAL("Handoff is interrupted, the old router keeps running.");
+      close(unix_socket);
+      spdlog::shutdown();
+      // worker threads are blocked on their queues, leave without unwinding
+      // them. received sockets are closed, the old router still has them
+      std::_Exit(1);
+    }
+  }
+  close(unix_socket);
+  LOG_INFO("Took over listening socket and {} sessions.", sessions_count);
+  return server_socket;
+}
+
+bool Handoff::listen(const std::string& path) {
+  sockaddr_un addr;
+  if (!make_unix_address(path, addr)) return false;
+
+  int listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_socket == -1) return false;
+  // path may be left from the previous router process
+  unlink(path.c_str());
+  if (bind(listen_socket, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+      ::listen(listen_socket, 1) == -1) {
+    LOG_ERROR("Cannot listen on handoff path {}", path);
+    close(listen_socket);
+    return false;
+  }
+
+  std::thread([listen_socket]() {
+    while (true) {
+      int requester = accept(listen_socket, nullptr, nullptr);
+      if (requester == -1) continue;
+      LOG_INFO("New router process requested handoff.");
+      // event loop notices the request and calls transfer()
+      int previous = requester_socket_.exchange(requester);
+      if (previous != -1) close(previous);
+    }
+  }).detach();
+  return true;
+}
+
+bool Handoff::flush_outboxes(const OutboxBudget& budget, int timeout_ms) {
+  std::string frames;
+  std::vector<int> waiters;
+  for (auto& session : Sessions::get_sessions()) {
+    if (!handed_off(*session)) continue;
+    Outbox& outbox = session->get_outbox();
+    int frame_size = FrameCodec::frame_size(outbox.get_encoding());
+    int next_class = -1;
+    // a take is limited to FLUSH_MAX_BYTES, paused senders are resumed by the
+    // event loop sweep if the handoff is refused
+    do {
+      size_t frames_count = outbox.take(
+          frames, waiters, budget, next_class,
+          [](PriorityClass frame_class, uint64_t wait_us) {
+            Metrics::record_wait(frame_class, wait_us);
+          });
+      session->add_outstanding(-int(frames_count));
+      if (frames.empty()) break;
+      int sent_byte = TcpServer::send_within(
+          session->get_socket(), frames.data(), frames.size(), timeout_ms);
+      if (sent_byte == SOCKET_ERROR) {
+        // connection is lost anyway, the new router removes the session
+        LOG_ERROR("Socket {} failed while flushing its outbox for handoff.",
+                  session->get_socket());
+        break;
+      }
+      if (static_cast<size_t>(sent_byte) < frames.size()) {
+        size_t unsent_frames = outbox.put_back(
+            frames.data() + sent_byte, frames.size() - sent_byte, frame_size);
+        session->add_outstanding(int(unsent_frames));
+        LOG_ERROR("Node {} didnt take its {} pending frames in {} ms.",
+                  session->get_id(), unsent_frames, timeout_ms);
+        return false;
+      }
+    } while (next_class != -1);
+  }
+  return true;
+}
+
+void Handoff::refuse() {
+  int requester = requester_socket_.exchange(-1);
+  if (requester == -1) return;
+  // take_over() of the new process sees the connection closed and exits
+  close(requester);
+  LOG_ERROR("Handoff refused, router continues serving.");
+}
+
+bool Handoff::transfer(int server_socket, const OutboxBudget& budget) {
+  if (!requested()) return false;
+  // nodes get every frame queued for them before their sockets move, the new
+  // process starts with empty outboxes
+  if (!flush_outboxes(budget, HANDOFF_FLUSH_TIMEOUT_MS)) {
+    refuse();
+    return false;
+  }
+  int requester = requester_socket_.exchange(-1);
+  if (requester == -1) return false;
+
+  HandoffRecord record{HANDOFF_LISTENER, NONE};
+  bool ok = send_record(requester, server_socket, record);
+
+  int sessions_count = 0;
+  for (auto& session : Sessions::get_sessions()) {
+    if (!ok) break;
+    if (!handed_off(*session)) continue;
+    int32_t node_id = session->get_id();
+    if (node_id != NONE) {
+      node_id |= static_cast<int32_t>(session->get_read_encoding())
+                     << HANDOFF_READ_ENCODING_SHIFT |
+                 static_cast<int32_t>(session->get_outbox().get_encoding())
+                     << HANDOFF_WRITE_ENCODING_SHIFT;
+    }
+    record = HandoffRecord{HANDOFF_SESSION, node_id};
+    ok = send_record(requester, session->get_socket(), record);
+    sessions_count++;
+  }
+
+  if (ok) {
+    record = HandoffRecord{HANDOFF_END, NONE};
+    ok = send_record(requester, -1, record);
+  }
+  close(requester);
+
+  if (!ok) {
+    LOG_ERROR("Handoff failed, router continues serving.");
+    return false;
+  }
+  LOG_INFO("Handed off listening socket and {} sessions, exiting.",
+           sessions_count);
+  spdlog::shutdown();
+  // worker threads are blocked on their queues, leave without unwinding them
+  std::_Exit(0);
+}
+
+bool Handoff::send_record(int unix_socket, int fd,
+                          const HandoffRecord& record) {
+  iovec payload{};
+  payload.iov_base = const_cast<HandoffRecord*>(&record);
+  payload.iov_len = sizeof(record);
+
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+
+  // ancillary data carries the descriptor, kernel duplicates it into receiver
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  if (fd != -1) {
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+  }
+  return sendmsg(unix_socket, &message, 0) == sizeof(record);
+}
+
+int Handoff::recv_record(int unix_socket, HandoffRecord& record) {
+  record = HandoffRecord{0, NONE};
+  iovec payload{};
+  payload.iov_base = &record;
+  payload.iov_len = sizeof(record);
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  if (recvmsg(unix_socket, &message, MSG_WAITALL) != sizeof(record)) {
+    record.kind = 0;
+    return -1;
+  }
+  cmsghdr* header = CMSG_FIRSTHDR(&message);
+  if (header == nullptr || header->cmsg_type != SCM_RIGHTS) return -1;
+  int fd;
+  memcpy(&fd, CMSG_DATA(header), sizeof(int));
+  return fd;
+}
+
+#else
+
+int Handoff::take_over(const std::string& path) {
+  LOG_ERROR("Socket handoff is not supported on this platform.");
+  return SOCKET_ERROR;
+}
+bool Handoff::listen(const std::string& path) {
+  LOG_ERROR("Socket handoff is not supported on this platform.");
+  return false;
+}
+void Handoff::refuse() {}
+bool Handoff::transfer(int server_socket, const OutboxBudget& budget) {
+  return false;
+}
+bool Handoff::flush_outboxes(const OutboxBudget& budget, int timeout_ms) {
+  return false;
+}
+bool Handoff::send_record(int unix_socket, int fd,
+                          const HandoffRecord& record) {
+  return false;
+}
+int Handoff::recv_record(int unix_socket, HandoffRecord& record) { return -1; }
+
+#endif  // _WIN32
+
+// initialize static variables
+std::atomic<int> Handoff::requester_socket_{-1};
@@ -0,0 +1,135 @@
+#include "loop_watchdog.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+#include "logger.h"
+
+#ifdef __GLIBC__
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+/// Longest wait for the loop thread to capture its stack.
+#define STACK_CAPTURE_TIMEOUT_MS 100
+
+#ifdef __GLIBC__
+static pthread_t loop_thread;
+static void* stack_frames[STALL_STACK_DEPTH];
+static int stack_depth = 0;
+/// Sequence number of the capture waiting for the handler, 0 if none.
+static std::atomic<uint64_t> capture_request{0};
+/// Sequence number of the last capture written to stack_frames.
+static std::atomic<uint64_t> captured{0};
+
+/**
+ * @brief Runs on the loop thread, saves its return addresses, symbols are resolved by the watchdog thread.
+ *
+ * The handler claims the pending request before it writes stack_frames, so a
+ * signal delivered after its capture timed out or was already served leaves
+ * the buffer alone.
+ */
+static void on_stall_signal(int) {
+  uint64_t sequence = capture_request.exchange(0, std::memory_order_acquire);
+  if (sequence == 0) return;
+  stack_depth = backtrace(stack_frames, STALL_STACK_DEPTH);
+  captured.store(sequence, std::memory_order_release);
+}
+#endif
+
+void LoopWatchdog::start(unsigned threshold_ms) {
+  threshold_ms_ = threshold_ms;
+  if (threshold_ms == 0) return;
+#ifdef __GLIBC__
+  loop_thread = pthread_self();
+  // first backtrace() loads libgcc, it must not happen in the signal handler
+  backtrace(stack_frames, STALL_STACK_DEPTH);
+  struct sigaction action {};
+  action.sa_handler = on_stall_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGRTMIN, &action, nullptr);
+#endif
+  std::thread(watch).detach();
+  LOG_INFO("Event loop watchdog reports iterations longer than {} ms.",
+           threshold_ms);
+}
+
+void LoopWatchdog::watch() {
+  // a stall is seen at most a quarter of the threshold late
+  auto period = std::chrono::milliseconds(std::max(1u, threshold_ms_ / 4));
+  int64_t reported_since = 0;
+  while (true) {
+    std::this_thread::sleep_for(period);
+    int64_t since = busy_since_us_.load(std::memory_order_relaxed);
+    if (since == 0 || since == reported_since) continue;
+    int64_t busy_ms = (now_us() - since) / 1000;
+    if (busy_ms < threshold_ms_) continue;
+    // one report per stalled iteration
+    reported_since = since;
+    stalls_.fetch_add(1, std::memory_order_relaxed);
+    capture_stack(busy_ms);
+  }
+}
+
+void LoopWatchdog::capture_stack(int64_t busy_ms) {
+#ifdef __GLIBC__
+  // only the watchdog thread captures, no request is pending here
+  static uint64_t sequence = 0;
+  sequence++;
+  capture_request.store(sequence, std::memory_order_release);
+  pthread_kill(loop_thread, SIGRTMIN);
+  bool done = false;
+  for (int waited = 0; waited < STACK_CAPTURE_TIMEOUT_MS && !done; waited++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    done = captured.load(std::memory_order_acquire) == sequence;
+  }
+  if (!done) {
+    uint64_t expected = sequence;
+    if (capture_request.compare_exchange_strong(expected, 0)) {
+      // withdrawn, a late signal finds no request and writes nothing
+      LOG_WARN("Event loop stalled for {} ms, its stack could not be captured.",
+               busy_ms);
+      return;
+    }
+    // the handler claimed the request and is writing the stack, it is waited
+    // out so the next capture doesnt reuse the buffer under it
+    while (captured.load(std::memory_order_acquire) != sequence) {
+      std::this_thread::yield();
+    }
+  }
+  int depth = stack_depth;
+  LOG_WARN("Event loop stalled for {} ms, loop thread stack:", busy_ms);
+  // names of non exported functions need the binary and addr2line
+  char** symbols = backtrace_symbols(stack_frames, depth);
+  for (int i = 0; i < depth; i++) {
+    LOG_WARN("  #{} {}", i, symbols != nullptr ? symbols[i] : "?");
+  }
+  free(symbols);
+#else
+  LOG_WARN("Event loop stalled for {} ms.", busy_ms);
+#endif
+}
+
+void LoopWatchdog::report() {
+  uint64_t iterations = busy_us_.count();
+  if (iterations == 0) return;
+  LOG_INFO(
+      "Metrics : event_loop iterations={} busy_us p50={} p99={} p999={} "
+      "max={} dispatch_us p50={} p99={} p999={} max={} stalls={}",
+      iterations, busy_us_.percentile(50), busy_us_.percentile(99),
+      busy_us_.percentile(99.9), busy_us_.max(), dispatch_us_.percentile(50),
+      dispatch_us_.percentile(99), dispatch_us_.percentile(99.9),
+      dispatch_us_.max(), stalls_.exchange(0, std::memory_order_relaxed));
+  busy_us_.reset();
+  dispatch_us_.reset();
+}
+
+// initialize static variables
+std::atomic<int64_t> LoopWatchdog::busy_since_us_{0};
+LatencyHistogram LoopWatchdog::busy_us_;
+LatencyHistogram LoopWatchdog::dispatch_us_;
+std::atomic<uint64_t> LoopWatchdog::stalls_{0};
+unsigned LoopWatchdog::threshold_ms_ = 0;
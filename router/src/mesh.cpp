@@ -0,0 +1,372 @@
+#include "mesh.h"
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "logger.h"
+#include "message.h"
+#include "metrics.h"
+#include "sessions.h"
+#include "tcpserver.h"
+
+#define PEER_RECONNECT_DELAY_MS 1000
+
+PeerLink::PeerLink(std::shared_ptr<Session> session, bool initiated,
+                   const OutboxBudget& budget) {
+  this->socket_ = session->get_socket();
+  this->session_ = std::move(session);
+  this->initiated_ = initiated;
+  this->peer_token_ = 0;
+  this->budget_ = budget;
+  if (budget_.policy != SlowConsumerPolicy::DISCONNECT) {
+    budget_.policy = SlowConsumerPolicy::DROP_NEWEST;
+  }
+  this->pending_ = false;
+  this->overflowed_ = false;
+  this->closed_ = false;
+  this->writer_done_ = false;
+}
+
+void PeerLink::start(std::shared_ptr<PeerLink> self) {
+  // thread keeps the link alive until it exits
+  std::thread([self]() { self->writer(); }).detach();
+}
+
+void PeerLink::enqueue(const char* frame, size_t len) {
+  bool needs_flush = false;
+  PushResult result = outbox_.push(frame, len, budget_, NONE, needs_flush);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (closed_) return;
+  if (result == PushResult::OVER_BUDGET ||
+      (result != PushResult::QUEUED && Message::is_control_frame(frame))) {
+    // a lost announcement leaves stale routes on the peer, reopened link
+    // announces every node again
+    if (!overflowed_) Metrics::increment(Metric::SLOW_CONSUMERS_DISCONNECTED);
+    overflowed_ = true;
+  } else if (result == PushResult::DROPPED_NEWEST) {
+    Metrics::increment(Metric::FRAMES_DROPPED_NEWEST);
+  }
+  pending_ = true;
+  cond_.notify_one();
+}
+
+void PeerLink::close() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  closed_ = true;
+  cond_.notify_all();
+}
+
+void PeerLink::wait_closed() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this]() { return writer_done_; });
+}
+
+void PeerLink::writer() {
+  std::string batch;
+  std::vector<int> waiters;
+  int next_class = -1;
+  while (true) {
+    bool overflowed = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // frames left by the previous batch are taken without waiting
+      cond_.wait(lock, [this, next_class]() {
+        return closed_ || overflowed_ || pending_ || next_class != -1;
+      });
+      if (closed_) break;
+      overflowed = overflowed_;
+      pending_ = false;
+    }
+    if (overflowed) {
+      LOG_WARN("Peer router on link {} is too slow, link will removed.", socket_);
+      Sessions::removeSession(socket_);
+      close();
+      continue;
+    }
+
+    // take every frame collected so far, up to FLUSH_MAX_BYTES, they go out
+    // with one send()
+    outbox_.take(batch, waiters, budget_, next_class,
+                 [](PriorityClass, uint64_t) {});
+    if (batch.empty()) continue;
+    int sent = send_batch(batch);
+    if (sent == SOCKET_ERROR) {
+      LOG_ERROR("Error on sending to peer router, link will removed.");
+      // removing the session detaches the link and closes it
+      Sessions::removeSession(socket_);
+      close();
+    }
+  }
+
+  // removed session closes the socket when workers still reading it release
+  // it too, the descriptor is not reused under them
+  TcpServer::shutdown_socket(socket_);
+  session_.reset();
+  std::unique_lock<std::mutex> lock(mutex_);
+  writer_done_ = true;
+  done_cond_.notify_all();
+}
+
+int PeerLink::send_batch(const std::string& batch) {
+  size_t offset = 0;
+  while (true) {
+    int sent = TcpServer::send_some(socket_, batch.data() + offset,
+                                    batch.size() - offset);
+    if (sent == SOCKET_ERROR) return SOCKET_ERROR;
+    offset += sent;
+    if (offset == batch.size()) return offset;
+    {
+      // a peer which stopped reading must not hold the writer, the budget
+      // and close() end the link. the rest of the batch is dropped with it
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (closed_ || overflowed_) return offset;
+    }
+    TcpServer::wait_writable(socket_, 100);
+  }
+}
+
+void Mesh::start(const std::vector<PeerAddress>& peers, int listen_port,
+                 const OutboxBudget& budget) {
+  link_budget_ = budget;
+  listen_port_ = listen_port;
+  for (auto& peer : peers) {
+    peer_ips_.insert(peer.ip);
+    peer_addresses_.insert(peer.ip + ":" + std::to_string(peer.port));
+  }
+  // links accepted from peers send it too, even without configured peers
+  std::random_device random;
+  token_ = std::uniform_int_distribution<int>(1, 999999)(random);
+  for (auto& peer : peers) {
+    std::thread(connector, peer).detach();
+  }
+}
+
+void Mesh::connector(PeerAddress peer) {
+  std::string address = peer.ip + ":" + std::to_string(peer.port);
+  while (true) {
+    int peer_socket = TcpServer::connect_to(peer.ip, peer.port);
+    if (peer_socket != SOCKET_ERROR) {
+      // handshake as a router, then register the link as a session so the
+      // event loop reads frames coming from the peer
+      std::string id_msg = std::to_string(ROUTER_NODE_ID);
+      if (TcpServer::send_all(peer_socket, id_msg.c_str(), ID_MESSAGE_SIZE) ==
+          ID_MESSAGE_SIZE) {
+        Sessions::accept_client(peer_socket);
+        Sessions::add_peer(peer_socket);
+        auto link = attach_link(peer_socket, true);
+        if (link != nullptr) {
+          LOG_INFO("Link to peer router {} established.", address);
+
+          link->wait_closed();
+          LOG_WARN("Link to peer router {} closed.", address);
+          // the peer may also link to this router, its link is used meanwhile
+          wait_other_link(link);
+        }
+      } else {
+        TcpServer::close_socket(peer_socket);
+      }
+    }
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(PEER_RECONNECT_DELAY_MS));
+  }
+}
+
+std::shared_ptr<PeerLink> Mesh::attach_link(int socket, bool initiated) {
+  auto session = Sessions::find_session_by_socket(socket);
+  if (session == nullptr) return nullptr;
+  auto link = std::make_shared<PeerLink>(session, initiated, link_budget_);
+  {
+    // announce() waits until the snapshot is queued, a change of a node is
+    // queued after it and is not missed or reordered
+    std::unique_lock<std::shared_mutex> lock(mesh_mutex_);
+    links_[socket] = link;
+    auto hello = Message::build_hello_frame(token_, listen_port_);
+    link->enqueue(hello.c_str(), hello.size());
+    for (int node_id : local_nodes_) {
+      auto frame = Message::build_control_frame(CONTROL_ATTACH, node_id);
+      link->enqueue(frame.c_str(), frame.size());
+    }
+  }
+  PeerLink::start(link);
+  return link;
+}
+
+bool Mesh::is_peer_address(const std::string& ip) {
+  // filled before the event loop starts, read only afterwards
+  return peer_ips_.count(ip) > 0;
+}
+
+bool Mesh::verify_link(int socket, const char* frame) {
+  {
+    std::shared_lock<std::shared_mutex> lock(mesh_mutex_);
+    auto it = links_.find(socket);
+    if (it == links_.end() || it->second->is_initiated()) return true;
+  }
+  // the IP alone lets any process of a peer host link, e.g. a node on the
+  // same loopback. the port is the one the peer listens on
+  std::string address = TcpServer::peer_ip(socket) + ":" +
+                        std::to_string(Message::extract_router_port(frame));
+  if (Message::is_control_frame(frame) &&
+      Message::extract_control_operation(frame) == CONTROL_HELLO &&
+      peer_addresses_.count(address) > 0) {
+    return true;
+  }
+  LOG_WARN("Peer router link {} is refused, it did not say hello as a configured peer ({}).",
+           socket, address);
+  return false;
+}
+
+void Mesh::detach_link(int socket) {
+  std::shared_ptr<PeerLink> link;
+  {
+    std::unique_lock<std::shared_mutex> lock(mesh_mutex_);
+    auto it = links_.find(socket);
+    if (it == links_.end()) return;
+    link = it->second;
+    links_.erase(it);
+
+    // the peer may have closed its duplicate link first, its nodes stay
+    // reachable through the other link
+    int replacement = SOCKET_ERROR;
+    for (auto& other : links_) {
+      if (link->get_peer_token() != 0 &&
+          other.second->get_peer_token() == link->get_peer_token()) {
+        replacement = other.first;
+        break;
+      }
+    }
+    for (auto route = remote_routes_.begin(); route != remote_routes_.end();) {
+      if (route->second != socket) {
+        ++route;
+      } else if (replacement != SOCKET_ERROR) {
+        route->second = replacement;
+        ++route;
+      } else {
+        route = remote_routes_.erase(route);
+      }
+    }
+  }
+  link->close();
+  LOG_INFO("Peer router link {} detached.", socket);
+}
+
+void Mesh::announce(int operation, int node_id) {
+  std::unique_lock<std::shared_mutex> lock(mesh_mutex_);
+  if (operation == CONTROL_ATTACH) {
+    local_nodes_.insert(node_id);
+  } else {
+    local_nodes_.erase(node_id);
+  }
+  if (links_.empty()) return;
+  auto frame = Message::build_control_frame(operation, node_id);
+  for (auto& link : links_) {
+    link.second->enqueue(frame.c_str(), frame.size());
+  }
+}
+
+void Mesh::handle_control(int socket, const char* frame) {
+  int node_id = Message::extract_dst_id(frame, DATA_MESSAGE_SIZE);
+  int operation = Message::extract_control_operation(frame);
+
+  if (operation == CONTROL_HELLO) {
+    auto dropped = register_peer(socket, Message::extract_router_token(frame));
+    if (dropped != nullptr) {
+      // links are sessions, the event loop stops reading it then its writer
+      // closes the socket
+      Sessions::removeSession(dropped->get_socket());
+      dropped->close();
+    }
+    return;
+  }
+
+  std::unique_lock<std::shared_mutex> lock(mesh_mutex_);
+  // frames still coming on a dropped duplicate link also came on the kept one
+  if (links_.count(socket) == 0) return;
+  if (operation == CONTROL_ATTACH) {
+    remote_routes_[node_id] = socket;
+    LOG_INFO("Node {} is reachable via peer router link {}.", node_id, socket);
+  } else if (operation == CONTROL_DETACH) {
+    auto it = remote_routes_.find(node_id);
+    if (it != remote_routes_.end() && it->second == socket) {
+      remote_routes_.erase(it);
+      LOG_INFO("Node {} is detached from peer router link {}.", node_id,
+               socket);
+    }
+  } else {
+    LOG_ERROR("Invalid control frame from peer router link {}.", socket);
+  }
+}
+
+std::shared_ptr<PeerLink> Mesh::register_peer(int socket, int token) {
+  std::unique_lock<std::shared_mutex> lock(mesh_mutex_);
+  auto it = links_.find(socket);
+  if (it == links_.end()) return nullptr;
+  auto link = it->second;
+  link->set_peer_token(token);
+  // a router linked to itself or a token clash keeps its links
+  if (token == token_) return nullptr;
+
+  for (auto& other : links_) {
+    if (other.first == socket || other.second->get_peer_token() != token ||
+        other.second->is_initiated() == link->is_initiated()) {
+      continue;
+    }
+    // both routers keep the link initiated by the lower token, they drop the
+    // same one without asking each other
+    std::shared_ptr<PeerLink> kept = other.second;
+    std::shared_ptr<PeerLink> dropped = link;
+    if (link->is_initiated() == (token_ < token)) std::swap(kept, dropped);
+
+    for (auto& route : remote_routes_) {
+      if (route.second == dropped->get_socket()) {
+        route.second = kept->get_socket();
+      }
+    }
+    links_.erase(dropped->get_socket());
+    LOG_INFO("Peer router link {} duplicates link {}, it is closed.",
+             dropped->get_socket(), kept->get_socket());
+    return dropped;
+  }
+  return nullptr;
+}
+
+void Mesh::wait_other_link(const std::shared_ptr<PeerLink>& link) {
+  while (true) {
+    std::shared_ptr<PeerLink> other;
+    {
+      std::shared_lock<std::shared_mutex> lock(mesh_mutex_);
+      int token = link->get_peer_token();
+      if (token == 0) return;
+      for (auto& it : links_) {
+        if (it.second->get_peer_token() == token) {
+          other = it.second;
+          break;
+        }
+      }
+    }
+    if (other == nullptr) return;
+    other->wait_closed();
+  }
+}
+
+bool Mesh::forward_remote(int dst_id, const char* frame) {
+  std::shared_lock<std::shared_mutex> lock(mesh_mutex_);
+  auto route = remote_routes_.find(dst_id);
+  if (route == remote_routes_.end()) return false;
+  auto link = links_.find(route->second);
+  if (link == links_.end()) return false;
+  link->second->enqueue(frame, DATA_MESSAGE_SIZE);
+  return true;
+}
+
+// initialize static variables
+std::unordered_map<int, std::shared_ptr<PeerLink>> Mesh::links_;
+std::unordered_map<int, int> Mesh::remote_routes_;
+std::shared_mutex Mesh::mesh_mutex_;
+std::unordered_set<std::string> Mesh::peer_ips_;
+std::unordered_set<std::string> Mesh::peer_addresses_;
+OutboxBudget Mesh::link_budget_;
+int Mesh::token_ = 0;
+int Mesh::listen_port_ = 0;
+std::unordered_set<int> Mesh::local_nodes_;
@@ -0,0 +1,81 @@
+#include "metrics.h"
+
+#include <string>
+
+#include "logger.h"
+
+/// Names of counters in log reports, in Metric order.
+static const char* METRIC_NAMES[] = {
+    "frames_dropped_newest", "frames_dropped_oldest",
+    "slow_consumers_disconnected", "senders_paused", "senders_resumed"};
+
+void Metrics::set_report_interval(unsigned interval_ms) {
+  report_interval_ms_ = interval_ms;
+  next_report_ms_ = 0;
+}
+
+/// Names of priority classes in log reports, in PriorityClass order.
+static const char* CLASS_NAMES[] = {"network_management", "reversal",
+                                    "financial"};
+
+bool Metrics::report_due(int64_t now_ms) {
+  if (report_interval_ms_ == 0 || now_ms < next_report_ms_) return false;
+  bool first = next_report_ms_ == 0;
+  next_report_ms_ = now_ms + report_interval_ms_;
+  return !first;
+}
+
+void Metrics::report() {
+  std::string report;
+  for (int i = 0; i < static_cast<int>(Metric::COUNT); i++) {
+    uint64_t value = counters_[i].load(std::memory_order_relaxed);
+    if (value == reported_[i]) continue;
+    report += fmt::format(" {}={} (+{})", METRIC_NAMES[i], value,
+                          value - reported_[i]);
+    reported_[i] = value;
+  }
+  // quiet router doesnt fill the log
+  if (!report.empty()) LOG_INFO("Metrics :{}", report);
+
+  uint64_t sent_frames = 0;
+  for (int i = 0; i < PRIORITY_CLASSES; i++) {
+    uint64_t depth = depths_[i].load(std::memory_order_relaxed);
+    uint64_t sent = waits_[i].count();
+    sent_frames += sent;
+    if (depth == 0 && sent == 0) continue;
+    LOG_INFO(
+        "Metrics : class={} depth={} sent={} wait_us p50={} p99={} p999={} "
+        "max={}",
+        CLASS_NAMES[i], depth, sent, waits_[i].percentile(50),
+        waits_[i].percentile(99), waits_[i].percentile(99.9), waits_[i].max());
+    waits_[i].reset();
+  }
+
+  if (!AllocStats::enabled()) return;
+  AllocCounts allocated;
+  std::string threads;
+  for (int slot = 0; slot < AllocStats::slots(); slot++) {
+    AllocCounts counts = AllocStats::slot_counts(slot);
+    uint64_t allocations = counts.allocations - reported_allocations_[slot].allocations;
+    allocated.allocations += allocations;
+    allocated.bytes += counts.bytes - reported_allocations_[slot].bytes;
+    reported_allocations_[slot] = counts;
+    if (allocations > 0) threads += fmt::format(" {}:+{}", slot, allocations);
+  }
+  if (allocated.allocations == 0) return;
+  LOG_INFO(
+      "Metrics : heap allocations=+{} bytes=+{} per_frame={:.2f} threads{}",
+      allocated.allocations, allocated.bytes,
+      sent_frames == 0 ? 0.0
+                       : static_cast<double>(allocated.allocations) / sent_frames,
+      threads);
+}
+
+// initialize static variables
+std::atomic<uint64_t> Metrics::counters_[static_cast<int>(Metric::COUNT)] = {};
+uint64_t Metrics::reported_[static_cast<int>(Metric::COUNT)] = {};
+LatencyHistogram Metrics::waits_[PRIORITY_CLASSES];
+std::atomic<uint64_t> Metrics::depths_[PRIORITY_CLASSES] = {};
+AllocCounts Metrics::reported_allocations_[ALLOC_STATS_MAX_THREADS];
+unsigned Metrics::report_interval_ms_ = 0;
+int64_t Metrics::next_report_ms_ = 0;
@@ -0,0 +1,206 @@
+#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "logger.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// Names of thread roles in reports, in ThreadRole order.
+static const char* ROLE_NAMES[] = {"event_loop", "read_worker", "write_worker",
+                                   "worker"};
+
+/// Names of events in reports, in PerfEvent order.
+static const char* EVENT_NAMES[] = {"cycles", "instructions", "cache_misses",
+                                    "cpu_ns", "ctx_switches"};
+
+bool PerfCounters::enable() {
+#ifdef __linux__
+  enabled_ = true;
+  return true;
+#else
+  LOG_WARN("Perf counters are not supported on this platform.");
+  return false;
+#endif
+}
+
+#ifdef __linux__
+/**
+ * @brief Opens one counter of the calling thread.
+ * @param group Leader descriptor, -1 opens a leader.
+ * @return Descriptor, -1 on failure.
+ */
+static int open_event(uint32_t type, uint64_t config, bool exclude_kernel,
+                      int group) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = exclude_kernel;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(
+      syscall(SYS_perf_event_open, &attr, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+}
+
+/**
+ * @brief perf_event_open type and config of each PerfEvent.
+ */
+static const struct {
+  uint32_t type;
+  uint64_t config;
+} EVENT_CODES[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+/**
+ * @brief Opens a group, members the kernel refuses are left out.
+ * @param first First event of the group, its leader.
+ * @param last Last event of the group.
+ * @param events Output, opened events in read order.
+ * @param count Output, number of opened events.
+ * @return Leader descriptor, -1 if the leader cannot be opened.
+ */
+static int open_group(PerfEvent first, PerfEvent last, bool exclude_kernel,
+                      int* events, int& count) {
+  count = 0;
+  int leader = -1;
+  for (int event = static_cast<int>(first); event <= static_cast<int>(last);
+       event++) {
+    int fd = open_event(EVENT_CODES[event].type, EVENT_CODES[event].config,
+                        exclude_kernel, leader);
+    if (fd == -1) {
+      if (leader == -1) return -1;
+      continue;
+    }
+    if (leader == -1) leader = fd;
+    events[count++] = event;
+  }
+  return leader;
+}
+#endif
+
+void PerfCounters::open_thread(ThreadRole role) {
+  if (!enabled_) return;
+#ifdef __linux__
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (thread_count_ == PERF_MAX_THREADS) return;
+  ThreadCounters& counters = threads_[thread_count_];
+  counters.role = role;
+  // user space only, allowed under the default perf_event_paranoid
+  counters.hardware_fd =
+      open_group(PerfEvent::CYCLES, PerfEvent::CACHE_MISSES, true,
+                 counters.events[0], counters.event_counts[0]);
+  int hardware_error = errno;
+  // context switches happen in the kernel, without kernel counting the
+  // thread keeps its CPU time only
+  counters.software_fd =
+      open_group(PerfEvent::TASK_CLOCK, PerfEvent::CONTEXT_SWITCHES, false,
+                 counters.events[1], counters.event_counts[1]);
+  if (counters.software_fd == -1) {
+    counters.software_fd =
+        open_group(PerfEvent::TASK_CLOCK, PerfEvent::TASK_CLOCK, true,
+                   counters.events[1], counters.event_counts[1]);
+  }
+  if (counters.hardware_fd == -1 && thread_count_ == 0) {
+    LOG_WARN("Hardware perf counters are not available : {}",
+             strerror(hardware_error));
+  }
+  thread_count_++;
+#endif
+}
+
+void PerfCounters::report() {
+  if (!enabled_) return;
+#ifdef __linux__
+  uint64_t messages = messages_.load(std::memory_order_relaxed);
+  uint64_t new_messages = messages - reported_messages_;
+  reported_messages_ = messages;
+
+  constexpr int EVENTS = static_cast<int>(PerfEvent::COUNT);
+  constexpr int ROLES = static_cast<int>(ThreadRole::COUNT);
+  uint64_t deltas[ROLES][EVENTS] = {};
+  bool counted[ROLES][EVENTS] = {};
+  int threads[ROLES] = {};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int t = 0; t < thread_count_; t++) {
+      ThreadCounters& counters = threads_[t];
+      int role = static_cast<int>(counters.role);
+      threads[role]++;
+      int leaders[2] = {counters.hardware_fd, counters.software_fd};
+      for (int g = 0; g < 2; g++) {
+        if (leaders[g] == -1) continue;
+        // nr, time enabled, time running, then one value per event
+        uint64_t values[3 + EVENTS];
+        if (read(leaders[g], values, sizeof(values)) <
+            static_cast<ssize_t>((3 + counters.event_counts[g]) *
+                                 sizeof(uint64_t))) {
+          continue;
+        }
+        // raw counts only grow, the delta since the last report is scaled
+        // up by the share of the interval the group shared the PMU with
+        // other groups
+        uint64_t enabled = values[1] - counters.last_enabled[g];
+        uint64_t running = values[2] - counters.last_running[g];
+        double scale = running > 0 && running < enabled
+                           ? static_cast<double>(enabled) / running
+                           : 1.0;
+        counters.last_enabled[g] = values[1];
+        counters.last_running[g] = values[2];
+        for (int i = 0; i < counters.event_counts[g]; i++) {
+          int event = counters.events[g][i];
+          uint64_t raw = values[3 + i] - counters.last[event];
+          deltas[role][event] += static_cast<uint64_t>(raw * scale);
+          counted[role][event] = true;
+          counters.last[event] = values[3 + i];
+        }
+      }
+    }
+  }
+
+  LOG_INFO("Perf : messages=+{}", new_messages);
+  for (int role = 0; role < ROLES; role++) {
+    if (threads[role] == 0) continue;
+    std::string totals, per_msg;
+    for (int event = 0; event < EVENTS; event++) {
+      if (!counted[role][event]) continue;
+      totals += fmt::format(" {}={}", EVENT_NAMES[event], deltas[role][event]);
+      // idle router, nothing to divide by
+      if (new_messages == 0) continue;
+      per_msg += fmt::format(" {}={:.2f}", EVENT_NAMES[event],
+                             static_cast<double>(deltas[role][event]) /
+                                 new_messages);
+    }
+    uint64_t cycles = deltas[role][static_cast<int>(PerfEvent::CYCLES)];
+    uint64_t instructions =
+        deltas[role][static_cast<int>(PerfEvent::INSTRUCTIONS)];
+    if (cycles > 0) {
+      totals += fmt::format(" ipc={:.2f}",
+                            static_cast<double>(instructions) / cycles);
+    }
+    LOG_INFO("Perf : role={} threads={}{}{}{}", ROLE_NAMES[role],
+             threads[role], totals, per_msg.empty() ? "" : " per_msg", per_msg);
+  }
+#endif
+}
+
+// initialize static variables
+bool PerfCounters::enabled_ = false;
+std::atomic<uint64_t> PerfCounters::messages_{0};
+uint64_t PerfCounters::reported_messages_ = 0;
+std::mutex PerfCounters::mutex_;
+PerfCounters::ThreadCounters PerfCounters::threads_[PERF_MAX_THREADS];
+int PerfCounters::thread_count_ = 0;
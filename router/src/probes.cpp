@@ -0,0 +1,18 @@
+#include "probes.h"
+
+#ifdef ROUTER_USDT
+// semaphores of the probes, C linkage from their declarations in probes.h.
+// perf and bpftrace find them through the probe notes and increment them
+// while attached
+#define ROUTER_PROBE_SEMAPHORE_DEFINE(name)                       \
+  __attribute__((section(".probes"))) volatile unsigned short \
+      isc_router_##name##_semaphore = 0
+
+ROUTER_PROBE_SEMAPHORE_DEFINE(accept);
+ROUTER_PROBE_SEMAPHORE_DEFINE(handshake);
+ROUTER_PROBE_SEMAPHORE_DEFINE(receive);
+ROUTER_PROBE_SEMAPHORE_DEFINE(enqueue);
+ROUTER_PROBE_SEMAPHORE_DEFINE(dequeue);
+ROUTER_PROBE_SEMAPHORE_DEFINE(send);
+ROUTER_PROBE_SEMAPHORE_DEFINE(remove);
+#endif
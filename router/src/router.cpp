@@ -1,13 +1,44 @@
 #include "router.h"
 
+#include <algorithm>
+#include <chrono>
+#include <string_view>
 #include <thread>
 
+#include "handoff.h"
 #include "logger.h"
+#include "loop_watchdog.h"
+#include "mesh.h"
 #include "message.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "probes.h"
+#include "routing_table.h"
+#include "shm_transport.h"
 #include "tcpserver.h"
+#include "thread_affinity.h"
 
+// select() wakes up at least this often, so sockets registered by other
+// threads (e.g. peer router links) join the monitored set in time
+#define EVENT_LOOP_TIMEOUT_MS 100
 
-#define RECV_BUFF_SIZE 32 * 3000
+// resolution of idle timers
+#define TIMER_TICK_MS 100
+
+/**
+ * @brief Monotonic time in milliseconds.
+ */
+static int64_t steady_now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// max items a worker takes from its queue at once. reads are kept small so
+// sockets spread over read workers, writes of one batch are coalesced per
+// destination
+#define READ_BATCH_SIZE 16
+#define WRITE_BATCH_SIZE 256
 
 void sleep(int milliseconds) {
 #ifdef _WIN32
@@ -17,74 +48,366 @@ void sleep(int milliseconds) {
 #endif  // _WIN32
 }
 
-int Router::start(unsigned thread_count, unsigned port) {
+int Router::start(const RouterConfig &config) {
+  unsigned thread_count = config.thread_count;
+  unsigned port = config.port;
+
+  // idle workers spin a while before parking, so a frame arriving right after
+  // doesnt pay for a futex wake-up
+  if (config.low_latency && std::thread::hardware_concurrency() <= 1) {
+    // a spinning worker only delays the thread it is waiting for
+    LOG_WARN("Single CPU system, workers park without spinning.");
+  } else if (config.low_latency) {
+    auto spin = std::chrono::microseconds(config.spin_us);
+    ready_read_sockets_queue_.set_spin(spin);
+    ready_write_sockets_queue_.set_spin(spin);
+  }
+  TcpServer::configure(config.low_latency, config.socket_buffer);
+
+  outbox_budget_ = config.outbox_budget;
+  // flush requests of outboxes holding higher classes are popped first
+  std::vector<unsigned> lane_weights;
+  if (outbox_budget_.priority == WritePriority::WEIGHTED) {
+    lane_weights.assign(outbox_budget_.lane_weights,
+                        outbox_budget_.lane_weights + PRIORITY_CLASSES);
+  }
+  if (outbox_budget_.priority != WritePriority::FIFO) {
+    ready_write_sockets_queue_.set_lanes(PRIORITY_CLASSES, lane_weights);
+  }
+  Metrics::set_report_interval(config.metrics_interval_ms);
+  // each thread opens its counters when it starts, so before any of them
+  if (config.perf_counters && PerfCounters::enable() &&
+      config.metrics_interval_ms == 0) {
+    LOG_WARN("Perf counters are reported with metrics, set --metrics-interval-ms.");
+  }
+  idle_timeout_ms_ = config.idle_timeout_ms;
+  heartbeat_ms_ = config.heartbeat_ms;
+  now_ms_ = steady_now_ms();
+  session_timers_.reset(now_ms_);
+
   // start worker-threads
   std::vector<std::thread> threads;
   threads.reserve(thread_count);
 
-  int read_thread_count = thread_count / 2;
-  int write_thread_count = thread_count / 2;
-  if (thread_count % 2 == 1) {
-    read_thread_count++;
-  }
+  // thread topology comes from config, cpu list is indexed by thread id
+  auto worker_cpu = [&config](unsigned thread_id) {
+    return thread_id < config.worker_cpus.size() ? config.worker_cpus[thread_id]
+                                                 : NO_CPU;
+  };
+  unsigned read_thread_count = config.read_workers;
+
+  if (config.scheduling == SchedulingMode::AFFINE) {
+    // every worker reads and writes sessions it owns, roles dont apply
+    owner_policy_ = config.owner_policy;
+    for (unsigned i = 0; i < thread_count; ++i) {
+      mailboxes_.push_back(std::make_unique<SignalingQueue<WorkerTask>>());
+      if (outbox_budget_.priority != WritePriority::FIFO) {
+        mailboxes_.back()->set_lanes(PRIORITY_CLASSES, lane_weights);
+      }
+      if (config.low_latency) {
+        mailboxes_.back()->set_spin(std::chrono::microseconds(config.spin_us));
+      }
+    }
+    for (unsigned i = 0; i < thread_count; ++i) {
+      threads.emplace_back(worker_thread_affine_handler, i, worker_cpu(i));
+    }
+    LOG_INFO("Session-affine scheduling on {} workers.", thread_count);
+  } else {
+    for (unsigned i = 0; i < read_thread_count; ++i) {
+      threads.emplace_back(worker_thread_read_handler, i, worker_cpu(i));
+    }
 
-  for (int i = 0; i < read_thread_count; ++i) {
-    threads.emplace_back(worker_thread_read_handler, i);
+    for (unsigned i = read_thread_count; i < thread_count; ++i) {
+      threads.emplace_back(worker_thread_write_handler, i, worker_cpu(i));
+    }
   }
+  // init Sessions class, it preserve needed memory. node sessions are
+  // endpoints of the core, frames routed to them go to their outbox
+  core_.set_balance_policy(config.balance_policy);
+  core_.set_listener([](int node_id, bool attached) {
+    // peer routers can route the ID to us while it has a session
+    Mesh::announce(attached ? CONTROL_ATTACH : CONTROL_DETACH, node_id);
+  });
+  Sessions::init_sessions(
+      MAX_CLIENTS_COUNT, &core_,
+      [](const std::shared_ptr<Session> &dst_session, const char *frame,
+         int src_socket) { return forward(dst_session, frame, src_socket); });
 
-  for (int i = read_thread_count; i < thread_count; ++i) {
-    threads.emplace_back(worker_thread_write_handler, i);
+  // optional content based routing, table is reloaded when file changes
+  if (!config.routes_file.empty()) {
+    if (!RoutingTable::load(config.routes_file)) return -1;
+    RoutingTable::start_watcher(config.routes_file, config.routes_reload_ms);
+    core_.set_resolver([](const char *frame, int len) {
+      return RoutingTable::resolve(frame, len);
+    });
   }
-  // init Sessions class, it preserve needed memory
-  Sessions::init_sessions(MAX_CLIENTS_COUNT);
 
-  // start TCP server and get its socket
-  auto server_socket = TcpServer::start_tcp_server(port);
+  // take over sockets of a running router if there is one on the handoff
+  // path, otherwise start TCP server and get its socket
+  int server_socket = SOCKET_ERROR;
+  if (!config.handoff_path.empty()) {
+    server_socket = Handoff::take_over(config.handoff_path);
+  }
+  if (server_socket == SOCKET_ERROR) {
+    server_socket = TcpServer::start_tcp_server(port, config.bind_address);
+  } else {
+    for (auto &session : Sessions::get_sessions()) accept_session(session);
+  }
   if (server_socket == SOCKET_ERROR) return -1;
 
+  // wait for the next upgrade
+  if (!config.handoff_path.empty()) {
+    Handoff::listen(config.handoff_path);
+  }
+
+  // co-located nodes exchange frames through shared memory
+  if (!config.shm_path.empty()) {
+    shm_listener_ = ShmTransport::listen(config.shm_path);
+    if (shm_listener_ == SOCKET_ERROR) return -1;
+  }
+
+  // link with peer routers, links are registered as sessions
+  Mesh::start(config.peers, config.port, config.outbox_budget);
+
   // start event loop/listener
+  if (ThreadAffinity::pin_current_thread(config.loop_cpu)) {
+    LOG_INFO("Event loop pinned to CPU {}.", config.loop_cpu);
+  }
+  LoopWatchdog::start(config.stall_threshold_ms);
   start_event_listener(server_socket);
 
   return 0;
 }
-void Router::worker_thread_read_handler(int thread_id) {
+void Router::worker_thread_read_handler(int thread_id, int cpu) {
   LOG_TRACE("Read Worker Thread {} started.", thread_id);
-  // recv_buffer is a pre-allocated buffer for each thread.
-  // this buffer will use for recv messages and we dont new memory for each
-  // reception.
-  char *recv_buffer = new char[RECV_BUFF_SIZE]();
+  if (ThreadAffinity::pin_current_thread(cpu)) {
+    LOG_TRACE("Read Worker Thread {} pinned to CPU {}.", thread_id, cpu);
+  }
+  PerfCounters::open_thread(ThreadRole::READ_WORKER);
+  std::vector<int> ready_read_sockets;
+  ready_read_sockets.reserve(READ_BATCH_SIZE);
   while (true) {
-    //  Retrieves a socket that is ready for reading from the queue.
-    int ready_read_socket = ready_read_sockets_queue_.pop();
-    // do existing read event
-    do_reads(ready_read_socket, recv_buffer);
+    //  Retrieves sockets that are ready for reading from the queue, one lock
+    //  for the whole batch. under light traffic the batch has one socket.
+    size_t count =
+        ready_read_sockets_queue_.pop_batch(ready_read_sockets, READ_BATCH_SIZE);
+    // do existing read events
+    for (int ready_read_socket : ready_read_sockets) {
+      auto session = Sessions::find_session_by_socket(ready_read_socket);
+      // data arriving from now on needs a new read task
+      if (session != nullptr) session->clear_read_scheduled();
+      do_reads(ready_read_socket);
+    }
+    ready_read_sockets_queue_.task_done(count);
   }
-  delete[] recv_buffer;
 }
-void Router::worker_thread_write_handler(int thread_id) {
+void Router::worker_thread_write_handler(int thread_id, int cpu) {
   LOG_TRACE("Write Worker Thread {} started.", thread_id);
+  if (ThreadAffinity::pin_current_thread(cpu)) {
+    LOG_TRACE("Write Worker Thread {} pinned to CPU {}.", thread_id, cpu);
+  }
+  PerfCounters::open_thread(ThreadRole::WRITE_WORKER);
 
+  std::vector<int> ready_write_sockets;
+  ready_write_sockets.reserve(WRITE_BATCH_SIZE);
   while (true) {
-    //  Retrieves a socket that is ready for writing from the queue.
-    auto ready_write_task = ready_write_sockets_queue_.pop();
-    // do existing write task on dst sockets
-    do_writes(ready_write_task);
+    //  Retrieves sockets to flush from the queue, one lock for the whole batch.
+    size_t count =
+        ready_write_sockets_queue_.pop_batch(ready_write_sockets, WRITE_BATCH_SIZE);
+    // each outbox goes out with one send() call
+    for (int ready_write_socket : ready_write_sockets) {
+      ROUTER_PROBE3(dequeue, ready_write_socket, thread_id, count);
+      do_writes(ready_write_socket);
+    }
+    ready_write_sockets_queue_.task_done(count);
   }
 }
+void Router::worker_thread_affine_handler(int thread_id, int cpu) {
+  LOG_TRACE("Affine Worker Thread {} started.", thread_id);
+  if (ThreadAffinity::pin_current_thread(cpu)) {
+    LOG_TRACE("Affine Worker Thread {} pinned to CPU {}.", thread_id, cpu);
+  }
+  PerfCounters::open_thread(ThreadRole::WORKER);
+  auto &mailbox = *mailboxes_[thread_id];
+  std::vector<WorkerTask> tasks;
+  tasks.reserve(WRITE_BATCH_SIZE);
+  while (true) {
+    size_t count = mailbox.pop_batch(tasks, WRITE_BATCH_SIZE);
+    for (auto &task : tasks) {
+      if (task.kind == WorkerTask::READ) {
+        auto session = Sessions::find_session_by_socket(task.socket);
+        // data arriving from now on needs a new read task
+        if (session != nullptr) session->clear_read_scheduled();
+        do_reads(task.socket);
+      } else {
+        ROUTER_PROBE3(dequeue, task.socket, thread_id, count);
+        do_writes(task.socket);
+      }
+    }
+    mailbox.task_done(count);
+  }
+}
+void Router::dispatch_read(int socket) {
+  auto session = Sessions::find_session_by_socket(socket);
+  if (session == nullptr) return;
+  // select() reports the socket until its owner reads it, queue it once
+  if (!session->schedule_read()) return;
+  int owner = session->get_owner();
+  if (owner == NONE) {
+    // peer links are accepted by their connector thread, they are bound on
+    // their first event
+    owner = session->claim_owner(assign_owner(session));
+  }
+  // reads take the lowest lane, pending writes drain before more frames are
+  // read in, and they only exist because of earlier reads
+  mailboxes_[owner]->push(WorkerTask{WorkerTask::READ, socket}, false,
+                          PRIORITY_CLASSES - 1);
+}
+int Router::assign_owner(const std::shared_ptr<Session> &session) {
+  int workers = mailboxes_.size();
+  if (owner_policy_ == OwnerPolicy::HASH) {
+    return session->get_socket() % workers;
+  }
+  // least loaded, accepts are rare so counting sessions here is cheap enough
+  std::vector<int> owned(workers, 0);
+  for (auto &other : Sessions::get_sessions()) {
+    int owner = other->get_owner();
+    if (owner != NONE) owned[owner]++;
+  }
+  return std::min_element(owned.begin(), owned.end()) - owned.begin();
+}
+void Router::report_metrics() {
+  uint64_t depths[PRIORITY_CLASSES] = {};
+  for (auto &session : Sessions::get_sessions()) {
+    for (int i = 0; i < PRIORITY_CLASSES; i++) {
+      depths[i] += session->get_outbox().get_depth(PriorityClass(i));
+    }
+  }
+  for (int i = 0; i < PRIORITY_CLASSES; i++) {
+    Metrics::set_depth(PriorityClass(i), depths[i]);
+  }
+  Metrics::report();
+  LoopWatchdog::report();
+  PerfCounters::report();
+}
 void Router::start_event_listener(int server_socket) {
   fd_set readfds;
+  fd_set writefds;
+  // reused each round, the loop runs far more often than frames arrive and
+  // would otherwise allocate every round
+  std::vector<int> ready_sockets;
+  std::vector<int> sockets;
+  std::vector<int> all_sockets;
+  std::vector<int> blocked;
+  std::vector<int> still_blocked;
+  int64_t handoff_deadline_ms = 0;
+  PerfCounters::open_thread(ThreadRole::EVENT_LOOP);
 
   // this the event loop, listening to new events infinitely.
   while (true) {
+    int64_t now = steady_now_ms();
+    now_ms_.store(now, std::memory_order_relaxed);
+    // expired idle timers, only due slots are visited
+    session_timers_.advance(now, check_session);
+    if (Metrics::report_due(now)) report_metrics();
+
+    if (Handoff::requested()) {
+      // new router process takes over. reads finish the frame they are in,
+      // then dispatching stops and queued tasks finish, so no frame is left
+      // in router memory and the new router starts each stream at a frame
+      // boundary. on success transfer() wont return
+      if (!handoff_pending_.exchange(true, std::memory_order_acq_rel)) {
+        handoff_deadline_ms = now + HANDOFF_FRAME_TIMEOUT_MS;
+      }
+      if (reads_at_frame_boundary()) {
+        drain_workers();
+        // a worker may have started a frame before it saw the flag
+        if (reads_at_frame_boundary()) {
+          Handoff::transfer(server_socket, outbox_budget_);
+          end_handoff();
+        }
+      } else if (now >= handoff_deadline_ms) {
+        LOG_ERROR("Nodes didnt complete their frames in {} ms.",
+                  HANDOFF_FRAME_TIMEOUT_MS);
+        Handoff::refuse();
+        end_handoff();
+      }
+    }
+
     // reset descriptors set, reseting is demanded by select()
-    int max_sd = TcpServer::reset_fd_set(readfds, server_socket,
-                                         Sessions::get_accpeted_sockets());
+    // Sessions copies accepted sockets under its lock, connectors and workers
+    // may add/remove sessions while select() waits on the copy
+    sockets = Sessions::get_accpeted_sockets();
+    all_sockets = sockets;
+    if (paused_count_.load(std::memory_order_acquire) > 0) {
+      sweep_paused_senders();
+      // senders paused by backpressure are not read until destination drains
+      std::unique_lock<std::mutex> lock(paused_mutex_);
+      sockets.erase(std::remove_if(sockets.begin(), sockets.end(),
+                                   [](int socket) {
+                                     return paused_sockets_.count(socket) > 0;
+                                   }),
+                    sockets.end());
+    }
+    int max_sd = TcpServer::reset_fd_set(readfds, server_socket, sockets);
+
+    // sockets with full buffer, only live ones, closed descriptors break select
+    FD_ZERO(&writefds);
+    blocked.clear();
+    {
+      std::unique_lock<std::mutex> lock(blocked_mutex_);
+      blocked.swap(blocked_writers_);
+    }
+    for (int socket : blocked) {
+      if (std::find(all_sockets.begin(), all_sockets.end(), socket) ==
+          all_sockets.end()) {
+        continue;
+      }
+      FD_SET(socket, &writefds);
+      if (socket > max_sd) max_sd = socket;
+    }
+    if (shm_listener_ != SOCKET_ERROR) {
+      FD_SET(shm_listener_, &readfds);
+      max_sd = std::max({max_sd, shm_listener_, ShmTransport::set_fds(readfds)});
+    }
 
     // Wait for activity or event, include connect new client, recv new data,
     // terminate client connections
-    int activity = select(max_sd + 1, &readfds, nullptr, nullptr, nullptr);
+    timeval timeout{};
+    timeout.tv_usec = EVENT_LOOP_TIMEOUT_MS * 1000;
+    LoopWatchdog::idle();
+    int activity = select(max_sd + 1, &readfds, &writefds, nullptr, &timeout);
+    LoopWatchdog::busy();
+    // writable ones are flushed, the others keep waiting
+    still_blocked.clear();
+    for (int socket : blocked) {
+      if (activity > 0 && FD_ISSET(socket, &writefds)) {
+        auto session = Sessions::find_session_by_socket(socket);
+        int frame_class =
+            session != nullptr ? session->get_outbox().pending_class() : -1;
+        if (frame_class != -1) schedule_flush(session, frame_class);
+      } else if (std::find(all_sockets.begin(), all_sockets.end(), socket) !=
+                 all_sockets.end()) {
+        still_blocked.push_back(socket);
+      }
+    }
+    if (!still_blocked.empty()) {
+      std::unique_lock<std::mutex> lock(blocked_mutex_);
+      for (int socket : still_blocked) {
+        if (std::find(blocked_writers_.begin(), blocked_writers_.end(),
+                      socket) == blocked_writers_.end()) {
+          blocked_writers_.push_back(socket);
+        }
+      }
+    }
+
+    if (activity == 0) {
+      continue;
+    }
     if (activity == SOCKET_ERROR) {
       int err = GET_SOCKET_ERROR();
+      // stack capture signal of the watchdog, select() is never restarted
+      if (err == EINTR) continue;
       LOG_CRITICAL("Error on select() err code : {}", err);
       continue;
     }
@@ -98,21 +421,141 @@ void Router::start_event_listener(int server_socket) {
       // register accepted socket on Sessions class, session is responsible for
       // managing connections
       Sessions::accept_client(new_client_socket);
+      ROUTER_PROBE2(accept, new_client_socket,
+                    Sessions::accepted_count());
+      accept_session(Sessions::find_session_by_socket(new_client_socket));
       LOG_INFO("Accept new node request {}.",new_client_socket);
     }
+    if (shm_listener_ != SOCKET_ERROR) {
+      // closed connections of co-located nodes, then new ones
+      ShmTransport::check_fds(readfds);
+      if (FD_ISSET(shm_listener_, &readfds)) {
+        accept_session(ShmTransport::accept_node(shm_listener_));
+      }
+    }
 
-    // push intruppted client sockets to the queue
-    for (int i = 0; i < activity; i++) {
-      int socket = readfds.fd_array[i];
-      if (socket != server_socket) {
-        bool dont_push_if_repeated_event = true;
-        ready_read_sockets_queue_.push(socket, dont_push_if_repeated_event);
+    // push intruppted client sockets to the queue, all of them under one lock
+    // fd_set is scanned with FD_ISSET, fd_array only exists on Windows
+    ready_sockets.clear();
+    for (int socket : sockets) {
+      if (FD_ISSET(socket, &readfds)) {
+        ready_sockets.push_back(socket);
+      }
+    }
+    if (mailboxes_.empty()) {
+      // select() reports a socket until a worker reads it, queue it once.
+      // duplicates kept workers busy with empty reads under load
+      ready_sockets.erase(
+          std::remove_if(ready_sockets.begin(), ready_sockets.end(),
+                         [](int socket) {
+                           auto session = Sessions::find_session_by_socket(socket);
+                           return session == nullptr || !session->schedule_read();
+                         }),
+          ready_sockets.end());
+      bool dont_push_if_repeated_event = true;
+      ready_read_sockets_queue_.push_batch(ready_sockets.begin(),
+                                           ready_sockets.end(),
+                                           dont_push_if_repeated_event);
+    } else {
+      // session-affine, each socket goes to the mailbox of its owner
+      for (int socket : ready_sockets) {
+        dispatch_read(socket);
       }
     }
+    if (!ready_sockets.empty()) LoopWatchdog::dispatched();
+  }
+}
+
+void Router::accept_session(const std::shared_ptr<Session> &session) {
+  if (session == nullptr) return;
+  // the owner is fixed for the session lifetime, before any of its events
+  if (!mailboxes_.empty()) session->claim_owner(assign_owner(session));
+  watch_session(session);
+}
+void Router::watch_session(const std::shared_ptr<Session> &session) {
+  if (session == nullptr || (idle_timeout_ms_ == 0 && heartbeat_ms_ == 0)) {
+    return;
+  }
+  int64_t now = now_ms_.load(std::memory_order_relaxed);
+  session->touch(now);
+  unsigned first_check = idle_timeout_ms_ == 0 ? heartbeat_ms_
+                         : heartbeat_ms_ == 0
+                             ? idle_timeout_ms_
+                             : std::min(idle_timeout_ms_, heartbeat_ms_);
+  session_timers_.schedule(first_check, std::weak_ptr<Session>(session));
+}
+void Router::check_session(std::weak_ptr<Session> &weak_session) {
+  auto session = weak_session.lock();
+  if (session == nullptr) return;
+  int socket = session->get_socket();
+  // removed session, its socket may be reused by a new session already
+  if (Sessions::find_session_by_socket(socket) != session) return;
+  // peer router links are watched by their connectors
+  if (session->get_id() == ROUTER_NODE_ID) return;
+
+  int64_t idle = now_ms_.load(std::memory_order_relaxed) -
+                 session->get_last_activity();
+  if (idle_timeout_ms_ > 0 && idle >= idle_timeout_ms_) {
+    LOG_WARN("Session on socket {} (node {}) is idle for {} ms, it will removed.",
+             socket, session->get_id(), idle);
+    Sessions::removeSession(socket);
+    // workers still using the socket fail fast, descriptor is closed when the
+    // last of them releases the session
+    TcpServer::shutdown_socket(socket);
+    return;
+  }
+
+  int64_t next_check = idle_timeout_ms_ > 0 ? idle_timeout_ms_ - idle : INT64_MAX;
+  // heartbeat needs the node ID, nodes echo it back and it counts as activity
+  if (heartbeat_ms_ > 0 && session->get_id() != NONE) {
+    if (idle >= heartbeat_ms_) {
+      LOG_TRACE("Heartbeat to node {} on socket {}.", session->get_id(), socket);
+      forward(session, Message::build_heartbeat_frame(session->get_id()).c_str());
+      next_check = std::min<int64_t>(next_check, heartbeat_ms_);
+    } else {
+      next_check = std::min<int64_t>(next_check, heartbeat_ms_ - idle);
+    }
+  } else if (idle_timeout_ms_ == 0) {
+    // heartbeat only, node ID is not known yet
+    next_check = heartbeat_ms_;
+  }
+  session_timers_.schedule(next_check, std::move(weak_session));
+}
+void Router::drain_workers() {
+  // reads produce writes, so read queue is drained first
+  ready_read_sockets_queue_.wait_until_done();
+  ready_write_sockets_queue_.wait_until_done();
+
+  // a read in one mailbox may queue writes to a mailbox drained before, so
+  // repeat until all of them are idle together
+  bool idle = false;
+  while (!idle) {
+    for (auto &mailbox : mailboxes_) mailbox->wait_until_done();
+    idle = std::all_of(mailboxes_.begin(), mailboxes_.end(),
+                       [](auto &mailbox) { return mailbox->idle(); });
+  }
+}
+
+bool Router::reads_at_frame_boundary() {
+  for (auto &session : Sessions::get_sessions()) {
+    if (Handoff::handed_off(*session) && session->is_mid_frame()) return false;
+  }
+  return true;
+}
+
+void Router::end_handoff() {
+  // parked read tasks continue on the next read of their socket
+  handoff_pending_.store(false, std::memory_order_release);
+  for (auto &session : Sessions::get_sessions()) {
+    if (session->get_channel() != nullptr ||
+        !session->get_outbox().waiting_writable()) {
+      continue;
+    }
+    wait_writable(session->get_socket());
   }
 }
 
-void Router::do_reads(int ready_read_socket, char *recv_buffer) {
+void Router::do_reads(int ready_read_socket) {
   // find session related to this socket
   auto src_session = Sessions::find_session_by_socket(ready_read_socket);
   if (src_session == nullptr) {
@@ -120,11 +563,11 @@ void Router::do_reads(int ready_read_socket, char *recv_buffer) {
     LOG_ERROR("The socket doesnt exist and alive yet.1");
     return;
   } else {
-    
-    auto socket_mutex = src_session->get_mutex();
-
-    // lock with socket mutex, its serialize each socket reads and writes
-    std::unique_lock<std::shared_mutex> lock(*socket_mutex);
+    // lock with socket mutex, its serialize each socket reads and writes.
+    // in session-affine mode only the owner worker touches the socket
+    std::unique_lock<std::shared_mutex> lock(src_session->get_mutex(),
+                                             std::defer_lock);
+    if (mailboxes_.empty()) lock.lock();
 
     auto src_session = Sessions::find_session_by_socket(ready_read_socket);
     if (src_session == nullptr) {
@@ -132,138 +575,486 @@ void Router::do_reads(int ready_read_socket, char *recv_buffer) {
       LOG_ERROR("The socket doesnt exist and alive yet.2");
       return;
     }
+    // reads queued before the sender got paused are stale, resume_reads()
+    // queues a new one
+    if (paused_count_.load(std::memory_order_acquire) > 0) {
+      std::unique_lock<std::mutex> paused_lock(paused_mutex_);
+      if (paused_sockets_.count(ready_read_socket) > 0) return;
+    }
 
-    int bytes_read = 0;
-    do {
-      int session_id = src_session->get_id();
-      if (session_id == NONE) {
-        bytes_read = handle_handshake(ready_read_socket, recv_buffer);
-      } else {
-        bytes_read = process_message(ready_read_socket, recv_buffer);
-      }
+    src_session->touch(now_ms_.load(std::memory_order_relaxed));
+    // doorbell of a co-located node is reset before its ring is drained, so
+    // a frame written meanwhile rings it again
+    ShmChannel *channel = src_session->get_channel();
+    if (channel != nullptr) channel->acknowledge();
 
-      // loop until there is no more data, or socket error
-      // bytes_read is -1 on socket error
-      // bytes_read is 0 on dst not found
-      // bytes_read is 0 on no more data
-    } while (bytes_read > 0);
+    // task reads until there is no more data, a paused sender or socket error
+    SessionTask &task = src_session->get_read_task();
+    if (!task.valid()) task = read_session(*src_session);
+    if (task.done()) return;
+    task.resume();
 
-    if (bytes_read == SOCKET_ERROR) {
+    if (task.done()) {
       // remove halted socket and session from Session holder class
       LOG_ERROR("Error on socket recv, session will removed.");
       Sessions::removeSession(ready_read_socket);
+    } else if (channel != nullptr) {
+      // unlike a socket, the doorbell is not reported again for frames left
+      // in the ring
+      channel->rearm();
+      // node also rings when it frees space in its ring, resume the flush
+      // stopped by the full ring
+      Outbox &outbox = src_session->get_outbox();
+      if (outbox.waiting_writable()) {
+        int frame_class = outbox.pending_class();
+        if (frame_class != -1) schedule_flush(src_session, frame_class);
+      }
     }
   }
 }
-int Router::process_message(int ready_read_socket, char *recv_buffer) {
-  // looking for Following 32 byte messages
-  // here we recv 32 byte
-  int bytes_read =
-      TcpServer::read_async(ready_read_socket, recv_buffer, DATA_MESSAGE_SIZE);
-  if (bytes_read == DATA_MESSAGE_SIZE) {
-    // if 32 byte received, extract dst id, if destination node register
-    // itself, forward msg to destination node
-
-    // std::string message(recv_buffer, DATA_MESSAGE_SIZE);
-    LOG_DEBUG("Received MSG : {}", recv_buffer);
-    FLOG_INFO("Received MSG  : {}", recv_buffer);
-
-    // add null terminating.
-    recv_buffer[DATA_MESSAGE_SIZE] = 0;
-
-    int dst_id = Message::extract_dst_id(recv_buffer, bytes_read);
-    auto dst_session = Sessions::find_session_by_id(dst_id);
-    if (dst_session == nullptr) {
-      LOG_ERROR("Destination not found: {}", dst_id);
-      return 0;
-    } else {
-      // ▄▀Performance Penalty▀▄ :
-      // copy received bytes to new allocated string and push it to write queue
-      // for better performance we could eliminate this string and
-      // dont allocate any other memory and call kernel api anymore
-      auto msg = std::string(recv_buffer, DATA_MESSAGE_SIZE);
-      forward(dst_session, msg);
-    }
-  } else if (bytes_read == SOCKET_ERROR) {
-    LOG_ERROR(
-        "read_async() return error. connection crashed or terminated by "
-        "client");
-  } else if (bytes_read != 0) {
-    // message len is insuffcient. this bytes will drop unfortunately.
-    LOG_ERROR(
-        "Received MSG length is insufficient for MSG processing, {} bytes will "
-        "drop.",
-        bytes_read);
-  }
-  return bytes_read;
-}
-int Router::handle_handshake(int ready_read_socket, char *recv_buffer) {
-  // looking for first id msg, 3 byte
-  // this session has'nt associated id, it means currently we should wait for id
-  // msg here we recv just 3 byte as id msg
-  int bytes_read =
-      TcpServer::read_async(ready_read_socket, recv_buffer, ID_MESSAGE_SIZE);
-  if (bytes_read == ID_MESSAGE_SIZE) {
-    // if 3 byte received, convert it to int and keep it in Sessions holder
-    // class
-
-    // add null terminating.
-    recv_buffer[ID_MESSAGE_SIZE] = 0;
-
-    int src_id = Message::extract_src_id(recv_buffer, bytes_read);
-    Sessions::add_node(ready_read_socket, src_id);
-    // it may be removed since its, connection terminated.
-    LOG_INFO("Initiate a node with ID : {}", src_id);
-  } else if (bytes_read == SOCKET_ERROR) {
-    LOG_ERROR(
-        "read_async() return error. connection crashed or terminated by "
-        "client");
-  } else if( bytes_read != 0) {
-    // message len is insuffcient. this bytes will drop unfortunately.
-    LOG_ERROR(
-        "Received MSG length is insufficient for node handshaking, {} bytes "
-        "will drop.",
-        bytes_read);
-  }
-  return bytes_read;
+SessionTask Router::read_session(Session &session) {
+  int socket = session.get_socket();
+  ShmChannel *channel = session.get_channel();
+  FrameReader reader([socket, channel, &session](char *buffer, int len) {
+    int count = channel != nullptr ? channel->read(buffer, len)
+                                   : TcpServer::read_async(socket, buffer, len);
+    // len is the rest of the frame, the task suspends holding a part of it
+    // when fewer bytes came
+    if (count > 0) session.set_mid_frame(count < len);
+    return count;
+  });
+  // one extra byte for null terminating
+  char frame[DATA_MESSAGE_SIZE + 1];
+  char packed[COMPACT_MESSAGE_SIZE];
+  int bytes_read = 0;
+
+  // this session has'nt associated id, it means currently we should wait for
+  // 3 byte id msg. sessions taken over by handoff have their id already
+  while (session.get_id() == NONE) {
+    do {
+      // a hot upgrade hands the socket off at a frame boundary, the new
+      // router reads the rest of the stream
+      while (reader.pending() == 0 &&
+             handoff_pending_.load(std::memory_order_acquire)) {
+        co_await std::suspend_always{};
+      }
+      bytes_read = co_await reader.read(frame, ID_MESSAGE_SIZE);
+    } while (bytes_read == READ_PENDING);
+    if (bytes_read == SOCKET_ERROR) break;
+    frame[ID_MESSAGE_SIZE] = 0;
+    if (!handle_handshake(socket, frame)) {
+      bytes_read = SOCKET_ERROR;
+      break;
+    }
+  }
+
+  bool from_peer = session.get_id() == ROUTER_NODE_ID;
+  // first frame of a link tells which router it is
+  bool link_checked = !from_peer;
+  while (bytes_read != SOCKET_ERROR) {
+    // looking for Following 32 byte messages, or 16 byte packed ones which
+    // are unpacked, routing works on ASCII frames
+    FrameEncoding encoding = session.get_read_encoding();
+    char *wire_buffer = encoding == FrameEncoding::ASCII ? frame : packed;
+    do {
+      while (reader.pending() == 0 &&
+             handoff_pending_.load(std::memory_order_acquire)) {
+        co_await std::suspend_always{};
+      }
+      bytes_read =
+          co_await reader.read(wire_buffer, FrameCodec::frame_size(encoding));
+    } while (bytes_read == READ_PENDING);
+    if (bytes_read == SOCKET_ERROR) break;
+    if (encoding != FrameEncoding::ASCII) FrameCodec::unpack(packed, frame);
+    frame[DATA_MESSAGE_SIZE] = 0;
+    if (!link_checked) {
+      if (!Mesh::verify_link(socket, frame)) {
+        bytes_read = SOCKET_ERROR;
+        break;
+      }
+      link_checked = true;
+    }
+    if (!process_message(session, frame, from_peer)) {
+      // destination is over budget, rest of the data stays in socket buffer
+      // until resume_reads() queues a read of this sender
+      co_await std::suspend_always{};
+    }
+  }
+  LOG_ERROR(
+      "read_async() return error. connection crashed or terminated by "
+      "client");
 }
-void Router::do_writes(std::pair<int, std::string> task) {
-  // pick write task from queue and do send on dst socket
-  auto dst_socket = task.first;
-  std::string msg = task.second;
+bool Router::process_message(Session &src_session, char *frame,
+                             bool from_peer) {
+  int ready_read_socket = src_session.get_socket();
+  // extract dst id, if destination node register itself, forward msg to
+  // destination node
+  LOG_DEBUG("Received MSG : {}", frame);
+  FLOG_INFO("Received MSG  : {}", frame);
+  ROUTER_PROBE3(receive, ready_read_socket,
+                Message::extract_src_id(frame, DATA_MESSAGE_SIZE),
+                Message::extract_dst_id(frame, DATA_MESSAGE_SIZE));
 
+  if (from_peer && Message::is_control_frame(frame)) {
+    // route announcement of peer router
+    Mesh::handle_control(ready_read_socket, frame);
+    return true;
+  }
+
+  if (!from_peer &&
+      Message::extract_dst_id(frame, DATA_MESSAGE_SIZE) == ROUTER_NODE_ID) {
+    int mti = Message::extract_mti(frame);
+    if (mti == ENCODING_OFFER_MTI || mti == ENCODING_SWITCH_MTI) {
+      handle_encoding_frame(src_session, frame);
+      return true;
+    }
+    // heartbeat reply of a node, reading it already refreshed the session
+    LOG_TRACE("Heartbeat reply on socket {}.", ready_read_socket);
+    return true;
+  }
+
+  // core resolves the destination, content based routing first then the
+  // dst field of message, and forwards the frame to its session
+  int dst_id = NO_ROUTE;
+  SubmitResult result =
+      core_.submit(frame, DATA_MESSAGE_SIZE, ready_read_socket, &dst_id);
+  if (result == SubmitResult::NOT_FOUND) {
+    // destination may be attached to a peer router, frames of peers are not
+    // forwarded again to avoid loops
+    if (!from_peer && Mesh::forward_remote(dst_id, frame)) {
+      return true;
+    }
+    LOG_ERROR("Destination not found: {}", dst_id);
+  } else if (result == SubmitResult::REJECTED) {
+    // destination is over budget, stop reading this sender
+    return false;
+  }
+  return true;
+}
+void Router::handle_encoding_frame(Session &src_session, const char *frame) {
+  int encoding = Message::extract_encoding(frame);
+  if (encoding != static_cast<int>(FrameEncoding::ASCII) &&
+      encoding != static_cast<int>(FrameEncoding::PACKED_BCD)) {
+    // unknown encodings are refused by not answering, node stays on ASCII
+    LOG_WARN("Node {} sent unknown frame encoding {}.", src_session.get_id(),
+             encoding);
+    return;
+  }
+  if (Message::extract_mti(frame) == ENCODING_SWITCH_MTI) {
+    // next frame of the node is read in the new encoding
+    src_session.set_read_encoding(static_cast<FrameEncoding>(encoding));
+    LOG_INFO("Node {} sends {} frames.", src_session.get_id(),
+             FrameCodec::name(static_cast<FrameEncoding>(encoding)));
+    return;
+  }
+  // offer, the switch frame is the last one the node gets in ASCII
+  bool needs_flush = false;
+  std::string marker = Message::build_encoding_frame(
+      src_session.get_id(), static_cast<FrameEncoding>(encoding));
+  src_session.get_outbox().switch_encoding(marker.data(), marker.size(),
+                                           static_cast<FrameEncoding>(encoding),
+                                           needs_flush);
+  src_session.add_outstanding(1);
+  if (needs_flush) {
+    schedule_flush(src_session.shared_from_this(),
+                   static_cast<int>(Message::get_priority_class(marker.data())));
+  }
+  LOG_INFO("Node {} receives {} frames.", src_session.get_id(),
+           FrameCodec::name(static_cast<FrameEncoding>(encoding)));
+}
+bool Router::handle_handshake(int socket, const char *id_message) {
+  // convert it to int and keep it in Sessions holder class
+  int src_id = Message::extract_src_id(id_message, ID_MESSAGE_SIZE);
+  if (src_id == ROUTER_NODE_ID) {
+    // a peer router opened an inter-router link. a link announces routes, any
+    // client of the node port must not open one
+    std::string ip = TcpServer::peer_ip(socket);
+    if (!Mesh::is_peer_address(ip)) {
+      LOG_WARN("Router handshake from {} on socket {} is refused, it is not a configured peer.",
+               ip, socket);
+      return false;
+    }
+    Sessions::add_peer(socket);
+    Mesh::attach_link(socket, false);
+    LOG_INFO("Peer router linked on socket {}", socket);
+    return true;
+  }
+  Sessions::add_node(socket, src_id);
+  ROUTER_PROBE2(handshake, socket, src_id);
+  LOG_INFO("Initiate a node with ID : {}", src_id);
+  return true;
+}
+void Router::do_writes(int dst_socket) {
+  // pick flush request from queue and resume the write task of dst socket
   auto dst_session = Sessions::find_session_by_socket(dst_socket);
   if (dst_session != nullptr) {
-    // socket still alive/exist
-    auto socket_mutex = dst_session->get_mutex();
-    std::unique_lock<std::shared_mutex> lock(*socket_mutex);
-    // send msg to dst
-    int sent_byte = TcpServer::send_to_client(dst_socket, msg);
-
-    if (sent_byte == msg.size()) {
-      LOG_TRACE("MSG Forwarded to : {}", dst_session->get_id());
-      FLOG_INFO("Forwarded MSG : {}", msg);
-    } else if (sent_byte == SOCKET_ERROR) {
-      // remove halted/Errored socket and session from Session holder class
-      LOG_ERROR("Error on socket send, session will removed.");
-      Sessions::removeSession(dst_session->get_socket());
-    } else {
-      LOG_ERROR("Error on MSG sending. invalid sent byte {}", sent_byte);
-    }
+    // socket still alive/exist. frames are taken under the socket lock, so
+    // two flushes of the same outbox send their frames in take order
+    std::unique_lock<std::shared_mutex> lock(dst_session->get_mutex(),
+                                             std::defer_lock);
+    if (mailboxes_.empty()) lock.lock();
+
+    SessionTask &task = dst_session->get_write_task();
+    if (!task.valid()) task = write_session(*dst_session);
+    if (task.done()) return;
+    task.resume();
   } else {
     // dst session is not exist. it may terminated or Errored
     LOG_ERROR("Error on MSG sending: dst session is not exist.");
   }
 }
-void Router::forward(std::shared_ptr<Session> dst_session, std::string msg) {
-  // push msg to write queue, worker will pop and do send on corresponding
-  // sockets
-  auto dst_socket = dst_session->get_socket();
-  ready_write_sockets_queue_.push(std::make_pair(dst_socket, msg));
+SessionTask Router::write_session(Session &session) {
+  int socket = session.get_socket();
+  ShmChannel *channel = session.get_channel();
+  Outbox &outbox = session.get_outbox();
+  // swapped with the outbox data, so no memory is allocated per flush
+  std::string frames;
+  std::vector<int> paused_senders;
+  while (true) {
+    int next_class = -1;
+    size_t frames_count = outbox.take(
+        frames, paused_senders, outbox_budget_, next_class,
+        [](PriorityClass frame_class, uint64_t wait_us) {
+          Metrics::record_wait(frame_class, wait_us);
+        });
+    // frames left the outbox, they dont count in balancing anymore
+    session.add_outstanding(-int(frames_count));
+
+    bool blocked = false;
+    if (!frames.empty()) {
+      // send frames to dst without waiting, a slow node must not hold the
+      // worker
+      int frame_size = FrameCodec::frame_size(outbox.get_encoding());
+      int sent_byte =
+          channel != nullptr
+              ? channel->write(frames.data(), frames.size(), frame_size)
+              : TcpServer::send_some(socket, frames.data(), frames.size());
+
+      if (sent_byte == SOCKET_ERROR) {
+        // remove halted/Errored socket and session from Session holder class
+        LOG_ERROR("Error on socket send, session will removed.");
+        Sessions::removeSession(socket);
+        co_return;
+      }
+      if (static_cast<size_t>(sent_byte) == frames.size()) {
+        ROUTER_PROBE4(send, socket, session.get_id(), frames_count,
+                      session.get_outstanding());
+        PerfCounters::add_messages(frames_count);
+        LOG_TRACE("{} MSG Forwarded to : {}", frames_count, session.get_id());
+        if (Logger::File()->should_log(spdlog::level::info)) {
+          // a line per frame, a whole batch outgrows the inline format buffer
+          // and allocates
+          for (size_t offset = 0; offset < frames.size(); offset += frame_size) {
+            FLOG_INFO("Forwarded MSG : {}",
+                      std::string_view(frames.data() + offset, frame_size));
+          }
+        }
+        // flush was limited, rest goes in the lane of its highest class
+        if (next_class != -1) {
+          schedule_flush(session.shared_from_this(), next_class);
+        }
+      } else {
+        size_t unsent_frames = outbox.put_back(
+            frames.data() + sent_byte, frames.size() - sent_byte, frame_size);
+        session.add_outstanding(int(unsent_frames));
+        blocked = true;
+      }
+    }
+    // senders paused by this outbox continue once it is drained to half,
+    // otherwise the event loop resumes them later
+    if (!paused_senders.empty() && outbox.below_low_watermark(outbox_budget_)) {
+      for (int sender : paused_senders) resume_reads(sender);
+    }
+    paused_senders.clear();
+
+    if (blocked && channel == nullptr) {
+      // socket buffer is full, rest waits in the outbox until the event loop
+      // sees the socket writable
+      co_await Writable([socket]() { wait_writable(socket); });
+    } else {
+      // ring of a co-located node is resumed by its doorbell, see do_reads(),
+      // an empty outbox by the next forward()
+      co_await std::suspend_always{};
+    }
+  }
+}
+void Router::wait_writable(int socket) {
+  std::unique_lock<std::mutex> lock(blocked_mutex_);
+  if (std::find(blocked_writers_.begin(), blocked_writers_.end(), socket) ==
+      blocked_writers_.end()) {
+    blocked_writers_.push_back(socket);
+  }
+}
+bool Router::forward(std::shared_ptr<Session> dst_session, const char *frame,
+                     int src_socket) {
+  // append msg to outbox of dst, a flush request is queued only for the first
+  // pending frame, worker will pop it and send all frames of the outbox
+  bool needs_flush = false;
+  PushResult result = dst_session->get_outbox().push(
+      frame, DATA_MESSAGE_SIZE, outbox_budget_, src_socket, needs_flush);
+  bool keep_reading = true;
+  if (result != PushResult::QUEUED) {
+    keep_reading = handle_over_budget(result, dst_session, src_socket);
+  }
+  // backpressure keeps the frame, drop-oldest replaces one
+  if (result == PushResult::QUEUED ||
+      (result == PushResult::OVER_BUDGET &&
+       outbox_budget_.policy == SlowConsumerPolicy::BACKPRESSURE)) {
+    dst_session->add_outstanding(1);
+    ROUTER_PROBE4(enqueue, dst_session->get_socket(), src_socket,
+                  dst_session->get_id(), dst_session->get_outstanding());
+  }
+  if (needs_flush) {
+    schedule_flush(dst_session,
+                   static_cast<int>(Message::get_priority_class(frame)));
+  }
+  return keep_reading;
+}
+void Router::schedule_flush(const std::shared_ptr<Session> &session,
+                            int frame_class) {
+  int socket = session->get_socket();
+  if (!mailboxes_.empty()) {
+    // session-affine, hand the flush over to the worker owning dst socket.
+    // peer links get their owner on their first event, a frame may come first
+    int owner = session->get_owner();
+    if (owner == NONE) {
+      owner = session->claim_owner(assign_owner(session));
+    }
+    mailboxes_[owner]->push(WorkerTask{WorkerTask::WRITE, socket}, false,
+                            frame_class);
+  } else {
+    ready_write_sockets_queue_.push(socket, false, frame_class);
+  }
+}
+bool Router::handle_over_budget(PushResult result,
+                                const std::shared_ptr<Session> &dst_session,
+                                int src_socket) {
+  int dst_id = dst_session->get_id();
+  switch (result) {
+    case PushResult::DROPPED_NEWEST:
+      Metrics::increment(Metric::FRAMES_DROPPED_NEWEST);
+      LOG_DEBUG("Outbox of node {} is full, new frame dropped. total dropped {}",
+                dst_id, dst_session->get_outbox().get_dropped());
+      return true;
+    case PushResult::DROPPED_OLDEST:
+      Metrics::increment(Metric::FRAMES_DROPPED_OLDEST);
+      LOG_DEBUG("Outbox of node {} is full, oldest frame dropped. total dropped {}",
+                dst_id, dst_session->get_outbox().get_dropped());
+      return true;
+    case PushResult::OVER_BUDGET:
+      if (outbox_budget_.policy == SlowConsumerPolicy::DISCONNECT) {
+        // frames from other senders may hit the budget at the same time
+        if (Sessions::find_session_by_socket(dst_session->get_socket()) !=
+            dst_session) {
+          return true;
+        }
+        Metrics::increment(Metric::SLOW_CONSUMERS_DISCONNECTED);
+        LOG_WARN("Node {} on socket {} is too slow, session will removed.",
+                 dst_id, dst_session->get_socket());
+        Sessions::removeSession(dst_session->get_socket());
+        TcpServer::shutdown_socket(dst_session->get_socket());
+        return true;
+      }
+      if (src_socket == NONE) return true;
+      pause_reads(src_socket, dst_session);
+      return false;
+    case PushResult::NOT_ENCODABLE:
+      LOG_ERROR("Frame to node {} has non digit bytes, it cannot be packed and is dropped.",
+                dst_id);
+      return true;
+    default:
+      return true;
+  }
+}
+void Router::pause_reads(int socket,
+                         const std::shared_ptr<Session> &dst_session) {
+  std::unique_lock<std::mutex> lock(paused_mutex_);
+  bool inserted =
+      paused_sockets_
+          .insert_or_assign(socket,
+                            PausedSender{Sessions::find_session_by_socket(socket),
+                                         dst_session})
+          .second;
+  paused_count_.store(paused_sockets_.size(), std::memory_order_release);
+  if (!inserted) return;
+  Metrics::increment(Metric::SENDERS_PAUSED);
+  LOG_DEBUG("Reads from socket {} paused by backpressure.", socket);
+}
+void Router::sweep_paused_senders() {
+  std::vector<int> drained;
+  {
+    std::unique_lock<std::mutex> lock(paused_mutex_);
+    for (auto it = paused_sockets_.begin(); it != paused_sockets_.end();) {
+      auto sender = it->second.sender.lock();
+      if (sender == nullptr ||
+          Sessions::find_session_by_socket(it->first) != sender) {
+        // sender is removed, its socket may belong to a new session now
+        it = paused_sockets_.erase(it);
+        continue;
+      }
+      // outbox may be drained before the sender got paused, or the
+      // destination is removed and nobody drains it anymore
+      auto dst = it->second.dst.lock();
+      if (dst == nullptr ||
+          Sessions::find_session_by_socket(dst->get_socket()) != dst ||
+          dst->get_outbox().below_low_watermark(outbox_budget_)) {
+        drained.push_back(it->first);
+      }
+      ++it;
+    }
+    paused_count_.store(paused_sockets_.size(), std::memory_order_release);
+  }
+  for (int socket : drained) resume_reads(socket);
+}
+void Router::resume_reads(int socket) {
+  {
+    std::unique_lock<std::mutex> lock(paused_mutex_);
+    if (paused_sockets_.erase(socket) == 0) return;
+    paused_count_.store(paused_sockets_.size(), std::memory_order_release);
+  }
+  Metrics::increment(Metric::SENDERS_RESUMED);
+  // sender may have data left in its socket, select() wouldnt report it
+  // before the next event loop round
+  if (mailboxes_.empty()) {
+    auto session = Sessions::find_session_by_socket(socket);
+    if (session == nullptr || !session->schedule_read()) return;
+    bool dont_push_if_repeated_event = true;
+    ready_read_sockets_queue_.push(socket, dont_push_if_repeated_event);
+  } else {
+    dispatch_read(socket);
+  }
 }
 
 // initialize static variables
 
+RouterCore Router::core_;
 SignalingQueue<int> Router::ready_read_sockets_queue_;
 
-SignalingQueue<std::pair<int, std::string>> Router::ready_write_sockets_queue_;
\ No newline at end of file
+SignalingQueue<int> Router::ready_write_sockets_queue_;
+
+std::vector<std::unique_ptr<SignalingQueue<WorkerTask>>> Router::mailboxes_;
+
+OwnerPolicy Router::owner_policy_ = OwnerPolicy::HASH;
+
+TimerWheel<std::weak_ptr<Session>> Router::session_timers_(TIMER_TICK_MS);
+
+unsigned Router::idle_timeout_ms_ = 0;
+
+unsigned Router::heartbeat_ms_ = 0;
+
+OutboxBudget Router::outbox_budget_;
+
+std::unordered_map<int, Router::PausedSender> Router::paused_sockets_;
+
+std::mutex Router::paused_mutex_;
+
+std::atomic<int> Router::paused_count_{0};
+
+std::vector<int> Router::blocked_writers_;
+int Router::shm_listener_ = SOCKET_ERROR;
+
+std::mutex Router::blocked_mutex_;
+
+std::atomic<int64_t> Router::now_ms_{0};
+
+std::atomic<bool> Router::handoff_pending_{false};
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "router_config.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "logger.h"
+#include "tcpserver.h"
+
+/**
+ * @brief Converts balance policy name to its enum value.
+ * @return true if the name is known.
+ */
+static bool parse_balance_policy(const std::string& name,
+                                 BalancePolicy& policy) {
+  if (name == "round-robin") {
+    policy = BalancePolicy::ROUND_ROBIN;
+  } else if (name == "least-outstanding") {
+    policy = BalancePolicy::LEAST_OUTSTANDING;
+  } else if (name == "pan-hash") {
+    policy = BalancePolicy::PAN_HASH;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Converts slow consumer policy name to its enum value.
+ * @return true if the name is known.
+ */
+static bool parse_slow_consumer_policy(const std::string& name,
+                                       SlowConsumerPolicy& policy) {
+  if (name == "drop-newest") {
+    policy = SlowConsumerPolicy::DROP_NEWEST;
+  } else if (name == "drop-oldest") {
+    policy = SlowConsumerPolicy::DROP_OLDEST;
+  } else if (name == "disconnect") {
+    policy = SlowConsumerPolicy::DISCONNECT;
+  } else if (name == "backpressure") {
+    policy = SlowConsumerPolicy::BACKPRESSURE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Converts write priority name to its enum value.
+ * @return true if the name is known.
+ */
+static bool parse_write_priority(const std::string& name,
+                                 WritePriority& priority) {
+  if (name == "fifo") {
+    priority = WritePriority::FIFO;
+  } else if (name == "strict") {
+    priority = WritePriority::STRICT;
+  } else if (name == "weighted") {
+    priority = WritePriority::WEIGHTED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Parses comma separated CPU list, e.g. "2,3,4,5".
+ * @return true if all items are numbers.
+ */
+static bool parse_cpu_list(const std::string& list, std::vector<int>& cpus) {
+  cpus.clear();
+  std::stringstream items(list);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos) {
+      return false;
+    }
+    cpus.push_back(std::stoi(item));
+  }
+  return !cpus.empty();
+}
+
+/**
+ * @brief Splits a peer address "ip:port", connectors get it already checked.
+ * @return true if ip is an IPv4 address and port is 1..65535.
+ */
+static bool parse_peer_address(const std::string& value, PeerAddress& peer) {
+  auto colon = value.rfind(':');
+  if (colon == std::string::npos) return false;
+  std::string ip = value.substr(0, colon);
+  std::string port = value.substr(colon + 1);
+  in_addr addr{};
+  if (inet_pton(AF_INET, ip.c_str(), &addr) != 1) return false;
+  if (port.empty() || port.size() > 5 ||
+      port.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  peer.ip = ip;
+  peer.port = std::stoi(port);
+  return peer.port >= 1 && peer.port <= 65535;
+}
+
+bool RouterConfig::apply_option(const std::string& option,
+                                const std::string& value,
+                                RouterConfig& config) {
+  if (option == "--bind") {
+    // connectors of other hosts reach the router on this address
+    in_addr addr{};
+    if (inet_pton(AF_INET, value.c_str(), &addr) != 1) {
+      LOG_CRITICAL("Bind address should be an IPv4 address : {}", value);
+      return false;
+    }
+    config.bind_address = value;
+  } else if (option == "--balance") {
+    if (!parse_balance_policy(value, config.balance_policy)) {
+      LOG_CRITICAL("Unknown balance policy : {}", value);
+      return false;
+    }
+  } else if (option == "--routes") {
+    config.routes_file = value;
+  } else if (option == "--routes-reload-ms") {
+    config.routes_reload_ms = std::stoi(value);
+  } else if (option == "--peer") {
+    PeerAddress peer;
+    if (!parse_peer_address(value, peer)) {
+      LOG_CRITICAL("Peer address should be ip:port : {}", value);
+      return false;
+    }
+    config.peers.push_back(peer);
+  } else if (option == "--handoff") {
+    config.handoff_path = value;
+  } else if (option == "--shm") {
+    config.shm_path = value;
+  } else if (option == "--threads") {
+    config.thread_count = std::stoi(value);
+  } else if (option == "--read-workers") {
+    config.read_workers = std::stoi(value);
+  } else if (option == "--write-workers") {
+    config.write_workers = std::stoi(value);
+  } else if (option == "--loop-cpu") {
+    config.loop_cpu = std::stoi(value);
+  } else if (option == "--worker-cpus") {
+    if (!parse_cpu_list(value, config.worker_cpus)) {
+      LOG_CRITICAL("Invalid CPU list : {}", value);
+      return false;
+    }
+  } else if (option == "--low-latency") {
+    if (value != "on" && value != "off") {
+      LOG_CRITICAL("Low latency mode should be on or off : {}", value);
+      return false;
+    }
+    config.low_latency = value == "on";
+  } else if (option == "--spin-us") {
+    config.spin_us = std::stoi(value);
+  } else if (option == "--socket-buffer") {
+    config.socket_buffer = std::stoi(value);
+  } else if (option == "--idle-timeout-ms") {
+    config.idle_timeout_ms = std::stoi(value);
+  } else if (option == "--heartbeat-ms") {
+    config.heartbeat_ms = std::stoi(value);
+  } else if (option == "--max-queued-frames") {
+    config.outbox_budget.max_frames = std::stoul(value);
+  } else if (option == "--max-queued-bytes") {
+    config.outbox_budget.max_bytes = std::stoul(value);
+  } else if (option == "--slow-consumer") {
+    if (!parse_slow_consumer_policy(value, config.outbox_budget.policy)) {
+      LOG_CRITICAL("Unknown slow consumer policy : {}", value);
+      return false;
+    }
+  } else if (option == "--write-priority") {
+    if (!parse_write_priority(value, config.outbox_budget.priority)) {
+      LOG_CRITICAL("Unknown write priority : {}", value);
+      return false;
+    }
+  } else if (option == "--lane-weights") {
+    // same format as CPU lists, one positive weight per priority class
+    std::vector<int> weights;
+    if (!parse_cpu_list(value, weights) || weights.size() != PRIORITY_CLASSES ||
+        std::count(weights.begin(), weights.end(), 0) > 0) {
+      LOG_CRITICAL("Lane weights should be {} positive numbers : {}",
+                   PRIORITY_CLASSES, value);
+      return false;
+    }
+    for (int i = 0; i < PRIORITY_CLASSES; i++) {
+      config.outbox_budget.lane_weights[i] = weights[i];
+    }
+  } else if (option == "--metrics-interval-ms") {
+    config.metrics_interval_ms = std::stoi(value);
+  } else if (option == "--perf-counters") {
+    if (value != "on" && value != "off") {
+      LOG_CRITICAL("Perf counters should be on or off : {}", value);
+      return false;
+    }
+    config.perf_counters = value == "on";
+  } else if (option == "--stall-threshold-ms") {
+    config.stall_threshold_ms = std::stoi(value);
+  } else if (option == "--scheduling") {
+    if (value == "shared") {
+      config.scheduling = SchedulingMode::SHARED;
+    } else if (value == "affine") {
+      config.scheduling = SchedulingMode::AFFINE;
+    } else {
+      LOG_CRITICAL("Unknown scheduling mode : {}", value);
+      return false;
+    }
+  } else if (option == "--owner-policy") {
+    if (value == "hash") {
+      config.owner_policy = OwnerPolicy::HASH;
+    } else if (value == "least-loaded") {
+      config.owner_policy = OwnerPolicy::LEAST_LOADED;
+    } else {
+      LOG_CRITICAL("Unknown owner policy : {}", value);
+      return false;
+    }
+  } else if (option == "--config") {
+    return load_file(value, config);
+  } else {
+    LOG_CRITICAL("Unknown option : {}", option);
+    return false;
+  }
+  return true;
+}
+
+bool RouterConfig::load_file(const std::string& path, RouterConfig& config) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG_CRITICAL("Cannot open config file : {}", path);
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string key, value;
+    if (!(fields >> key) || key[0] == '#') continue;
+    if (!(fields >> value)) {
+      LOG_CRITICAL("Config key {} needs a value.", key);
+      return false;
+    }
+    // file keys are option names without leading dashes
+    if (!apply_option("--" + key, value, config)) return false;
+  }
+  return true;
+}
+
+bool RouterConfig::parse(int argc, char* argv[], RouterConfig& config) {
+  if (argc < 2) {
+    return false;
+  }
+  config.port = std::stoi(argv[1]);
+
+  for (int i = 2; i < argc; i++) {
+    std::string option = argv[i];
+    // every option has exactly one value
+    if (i + 1 >= argc) {
+      LOG_CRITICAL("Option {} needs a value.", option);
+      return false;
+    }
+    std::string value = argv[++i];
+    if (!apply_option(option, value, config)) return false;
+  }
+
+  // role assignment, explicit worker counts override the total thread count,
+  // a single one takes its threads and leaves the rest to the other role
+  if (config.read_workers == 0 && config.write_workers == 0) {
+    config.write_workers = config.thread_count / 2;
+    config.read_workers = config.thread_count - config.write_workers;
+  } else if (config.write_workers == 0) {
+    if (config.read_workers < config.thread_count) {
+      config.write_workers = config.thread_count - config.read_workers;
+    }
+  } else if (config.read_workers == 0) {
+    if (config.write_workers < config.thread_count) {
+      config.read_workers = config.thread_count - config.write_workers;
+    }
+  }
+  if (config.read_workers == 0 || config.write_workers == 0) {
+    LOG_CRITICAL("Router needs at least one read worker and one write worker.");
+    return false;
+  }
+  config.thread_count = config.read_workers + config.write_workers;
+  return true;
+}
+
+const char* RouterConfig::usage() {
+  return "Usage: ISC-Router.exe <listen_port> [--bind <ip>] "
+         "[--balance round-robin|least-outstanding|pan-hash] "
+         "[--routes <rules_file>] [--routes-reload-ms <ms>] "
+         "[--peer <ip:port>]... [--handoff <unix_socket_path>] "
+         "[--shm <unix_socket_path>] "
+         "[--threads <n>] [--read-workers <n>] [--write-workers <n>] "
+         "[--loop-cpu <cpu>] [--worker-cpus <cpu,cpu,...>] "
+         "[--low-latency on|off] [--spin-us <us>] [--socket-buffer <bytes>] "
+         "[--scheduling shared|affine] [--owner-policy hash|least-loaded] "
+         "[--idle-timeout-ms <ms>] [--heartbeat-ms <ms>] "
+         "[--max-queued-frames <n>] [--max-queued-bytes <n>] "
+         "[--slow-consumer drop-newest|drop-oldest|disconnect|backpressure] "
+         "[--write-priority fifo|strict|weighted] [--lane-weights <n,n,n>] "
+         "[--metrics-interval-ms <ms>] [--perf-counters on|off] "
+         "[--stall-threshold-ms <ms>] "
+         "[--config <file>]";
+}
@@ -0,0 +1,109 @@
+#include "router_core.h"
+
+#include <mutex>
+
+void RouterCore::set_balance_policy(BalancePolicy policy) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  policy_ = policy;
+}
+
+void RouterCore::set_resolver(Resolver resolver) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  resolver_ = std::move(resolver);
+}
+
+void RouterCore::set_listener(MembershipListener listener) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  listener_ = std::move(listener);
+}
+
+int RouterCore::attach(int node_id, Delivery delivery,
+                       std::shared_ptr<Session> session) {
+  if (node_id < 0 || node_id >= MAX_CLIENTS_COUNT) return NONE;
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (session == nullptr) {
+    // in-process endpoint, its session only carries the ID and load counters
+    session = std::make_shared<Session>(next_local_handle_--);
+  }
+  int handle = session->get_socket();
+  if (endpoints_.count(handle) > 0) return NONE;
+  session->set_id(node_id);
+  endpoints_[handle] = Endpoint{
+      session, std::make_shared<const Delivery>(std::move(delivery))};
+
+  auto& pool = pools_[node_id];
+  if (pool == nullptr) {
+    pool = std::make_shared<SessionPool>();
+  }
+  pool->add(session);
+  if (pool->size() == 1 && listener_) listener_(node_id, true);
+  return handle;
+}
+
+bool RouterCore::detach(int handle) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto it = endpoints_.find(handle);
+  if (it == endpoints_.end()) return false;
+  int node_id = it->second.session->get_id();
+  endpoints_.erase(it);
+
+  // remove only this endpoint from the pool, other endpoints of the same ID
+  // keep serving
+  auto pool_it = pools_.find(node_id);
+  if (pool_it != pools_.end()) {
+    pool_it->second->remove(handle);
+    if (pool_it->second->empty()) {
+      pools_.erase(pool_it);
+      if (listener_) listener_(node_id, false);
+    }
+  }
+  return true;
+}
+
+SubmitResult RouterCore::submit(const char* frame, int len, int src,
+                                int* dst_id) {
+  // resolver is set before frames flow, it is read without the lock
+  int dst = resolver_ ? resolver_(frame, len) : NO_ROUTE;
+  if (dst == NO_ROUTE) {
+    dst = Message::extract_dst_id(frame, len);
+  }
+  if (dst_id != nullptr) *dst_id = dst;
+
+  std::shared_ptr<Session> session;
+  std::shared_ptr<const Delivery> delivery;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto pool_it = pools_.find(dst);
+    if (pool_it == pools_.end()) return SubmitResult::NOT_FOUND;
+    session = pool_it->second->select(policy_, frame, len);
+    if (session == nullptr) return SubmitResult::NOT_FOUND;
+    delivery = endpoints_.at(session->get_socket()).delivery;
+  }
+  // delivery may detach endpoints, e.g. a slow consumer, so it runs unlocked
+  return (*delivery)(session, frame, src) ? SubmitResult::DELIVERED
+                                          : SubmitResult::REJECTED;
+}
+
+std::shared_ptr<Session> RouterCore::find(int node_id, const char* frame,
+                                          int len) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = pools_.find(node_id);
+  if (it == pools_.end()) return nullptr;
+  return it->second->select(policy_, frame, len);
+}
+
+std::vector<int> RouterCore::node_ids() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<int> ids;
+  ids.reserve(pools_.size());
+  for (auto& pool : pools_) {
+    ids.push_back(pool.first);
+  }
+  return ids;
+}
+
+size_t RouterCore::endpoints(int node_id) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  auto it = pools_.find(node_id);
+  return it == pools_.end() ? 0 : it->second->size();
+}
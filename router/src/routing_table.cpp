@@ -0,0 +1,126 @@
+#include "routing_table.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "logger.h"
+
+/**
+ * @brief Converts a PAN prefix to the lowest/highest 16 digit PAN starting with it.
+ * @return false if the prefix is not numeric or longer than a PAN.
+ */
+static bool prefix_to_pan(const std::string& prefix, bool high,
+                          uint64_t& pan) {
+  if (prefix.empty() || prefix.size() > PanField::width) return false;
+  std::string padded = prefix + std::string(PanField::width - prefix.size(),
+                                            high ? '9' : '0');
+  return RouteIndex::parse_digits(padded.c_str(), PanField::width, pan);
+}
+
+bool RoutingTable::parse_rule(const std::string& line, RouteRule& rule) {
+  std::istringstream fields(line);
+  std::string mti, pan, dst;
+  if (!(fields >> mti >> pan >> dst)) return false;
+
+  uint64_t value;
+  if (mti == "*") {
+    rule.mti = ANY_MTI;
+  } else if (mti.size() == MtiField::width &&
+             RouteIndex::parse_digits(mti.c_str(), MtiField::width, value)) {
+    rule.mti = static_cast<int>(value);
+  } else {
+    return false;
+  }
+
+  if (pan == "*") {
+    rule.pan_low = 0;
+    rule.pan_high = MAX_PAN;
+  } else {
+    auto dash = pan.find('-');
+    std::string low = pan.substr(0, dash);
+    std::string high = dash == std::string::npos ? low : pan.substr(dash + 1);
+    if (!prefix_to_pan(low, false, rule.pan_low) ||
+        !prefix_to_pan(high, true, rule.pan_high) ||
+        rule.pan_low > rule.pan_high) {
+      return false;
+    }
+  }
+
+  if (dst.size() != ID_MESSAGE_SIZE ||
+      !RouteIndex::parse_digits(dst.c_str(), ID_MESSAGE_SIZE, value)) {
+    return false;
+  }
+  rule.dst_id = static_cast<int>(value);
+  return true;
+}
+
+bool RoutingTable::load(const std::string& path) {
+  std::ifstream file(path);
+  if (!file) {
+    LOG_ERROR("Cannot open routing table file : {}", path);
+    return false;
+  }
+
+  std::vector<RouteRule> rules;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    line_number++;
+    auto first = line.find_first_not_of(" \t\r");
+    if (first == std::string::npos || line[first] == '#') continue;
+
+    RouteRule rule;
+    if (!parse_rule(line, rule)) {
+      LOG_ERROR("Invalid routing rule at {}:{}, table is not loaded.", path,
+                line_number);
+      return false;
+    }
+    rules.push_back(rule);
+  }
+
+  // build the new index aside, traffic keeps using the current one
+  std::shared_ptr<const RouteIndex> index =
+      std::make_shared<const RouteIndex>(rules);
+  std::atomic_store(&active_, index);
+  unsigned version = version_.fetch_add(1) + 1;
+  LOG_INFO("Routing table version {} loaded with {} rules.", version,
+           rules.size());
+  return true;
+}
+
+void RoutingTable::start_watcher(const std::string& path,
+                                 unsigned interval_ms) {
+  std::thread([path, interval_ms]() {
+    std::error_code err;
+    auto last_write = std::filesystem::last_write_time(path, err);
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+      auto write_time = std::filesystem::last_write_time(path, err);
+      if (err || write_time == last_write) continue;
+      last_write = write_time;
+      load(path);
+    }
+  }).detach();
+}
+
+int RoutingTable::resolve(const char* msg, int msg_len) {
+  // per thread cached index, hot path only reads the version counter and
+  // doesnt touch shared_ptr reference count
+  thread_local std::shared_ptr<const RouteIndex> cached;
+  thread_local unsigned cached_version = 0;
+
+  unsigned version = version_.load(std::memory_order_acquire);
+  if (version == 0) return NO_ROUTE;
+  if (version != cached_version) {
+    cached = std::atomic_load(&active_);
+    cached_version = version;
+  }
+  return cached->resolve(msg, msg_len);
+}
+
+// initialize static variables
+std::shared_ptr<const RouteIndex> RoutingTable::active_ = nullptr;
+std::atomic<unsigned> RoutingTable::version_{0};
@@ -0,0 +1,78 @@
+#include "session_task.h"
+
+#include <new>
+
+#include "thread_affinity.h"
+
+FramePool::ThreadCache::~ThreadCache() {
+  if (free_list == nullptr) return;
+  FreeBlock* last = free_list;
+  while (last->next != nullptr) last = last->next;
+  std::unique_lock<std::mutex> lock(mutex_);
+  last->next = free_list_;
+  free_list_ = free_list;
+}
+
+void* FramePool::allocate(size_t size) {
+  if (size > TASK_FRAME_SIZE) return ::operator new(size);
+  ThreadCache& cache = cache_;
+  if (cache.free_list == nullptr) {
+    // blocks released by other threads first, a chunk only when there are none
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (int i = 0; i < TASK_FRAMES_PER_CHUNK && free_list_ != nullptr; i++) {
+      FreeBlock* block = free_list_;
+      free_list_ = block->next;
+      block->next = cache.free_list;
+      cache.free_list = block;
+      cache.count++;
+    }
+  }
+  if (cache.free_list == nullptr) {
+    // chunks are never freed, their blocks go around between sessions. pages
+    // are touched by this thread, so they are local to its CPU once pinned
+    char* chunk = ThreadAffinity::allocate_local(TASK_FRAME_SIZE *
+                                                 TASK_FRAMES_PER_CHUNK);
+    if (chunk == nullptr) throw std::bad_alloc();
+    for (int i = 0; i < TASK_FRAMES_PER_CHUNK; i++) {
+      auto* block = reinterpret_cast<FreeBlock*>(chunk + i * TASK_FRAME_SIZE);
+      block->next = cache.free_list;
+      cache.free_list = block;
+    }
+    cache.count += TASK_FRAMES_PER_CHUNK;
+  }
+  FreeBlock* block = cache.free_list;
+  cache.free_list = block->next;
+  cache.count--;
+  in_use_.fetch_add(1, std::memory_order_relaxed);
+  return block;
+}
+
+void FramePool::release(void* frame, size_t size) {
+  if (size > TASK_FRAME_SIZE) {
+    ::operator delete(frame);
+    return;
+  }
+  in_use_.fetch_sub(1, std::memory_order_relaxed);
+  auto* block = static_cast<FreeBlock*>(frame);
+  ThreadCache& cache = cache_;
+  if (cache.count < TASK_FRAMES_PER_THREAD) {
+    block->next = cache.free_list;
+    cache.free_list = block;
+    cache.count++;
+    return;
+  }
+  // sessions removed by the event loop would pile up in its cache
+  std::unique_lock<std::mutex> lock(mutex_);
+  block->next = free_list_;
+  free_list_ = block;
+}
+
+size_t FramePool::in_use() {
+  return in_use_.load(std::memory_order_relaxed);
+}
+
+// initialize static variables
+thread_local FramePool::ThreadCache FramePool::cache_;
+FramePool::FreeBlock* FramePool::free_list_ = nullptr;
+std::atomic<size_t> FramePool::in_use_{0};
+std::mutex FramePool::mutex_;
@@ -1,9 +1,15 @@
 #include "sessions.h"
+#include <algorithm>
 #include <iostream>
 #include "logger.h"
+#include "mesh.h"
+#include "message.h"
+#include "probes.h"
 
-void Sessions::init_sessions(int max_clients_count) {
+void Sessions::init_sessions(int max_clients_count, RouterCore* core, RouterCore::Delivery delivery) {
 	accepted_clients_.reserve(max_clients_count);
+	core_ = core;
+	delivery_ = std::move(delivery);
 }
 void Sessions::accept_client(int client_socket) {
 	std::unique_lock<std::shared_mutex> lock(*sessions_mutex_);
@@ -18,9 +24,15 @@ void Sessions::accept_client(int client_socket) {
 	}
 	sessions_by_socket_[client_socket] = std::make_shared<Session>(client_socket);
 }
-const std::vector<int>& Sessions::get_accpeted_sockets() {
+std::vector<int> Sessions::get_accpeted_sockets() {
+	// connectors and workers add/remove sockets while the event loop iterates its copy
+	std::shared_lock<std::shared_mutex> lock(*sessions_mutex_);
 	return accepted_clients_;
 }
+size_t Sessions::accepted_count() {
+	std::shared_lock<std::shared_mutex> lock(*sessions_mutex_);
+	return accepted_clients_.size();
+}
 void Sessions::add_node(int client_socket,int node_id){
 	std::unique_lock<std::shared_mutex> lock(*sessions_mutex_);
 	
@@ -29,34 +41,39 @@ void Sessions::add_node(int client_socket,int node_id){
 		return;
 	}
 
-	if(node_id >= MAX_CLIENTS_COUNT ){
+	// first session of an ID is announced to peer routers by the core listener
+	auto& session = sessions_by_socket_[client_socket];
+	if (core_->attach(node_id, delivery_, session) == NONE) {
 		LOG_ERROR("node is invalid. id = {}", node_id);
 		return;
 	}
-
-	if (sessions_by_id_.count(node_id) == 1) {
-		LOG_WARN("Nodeid Exist, restart connection , ID : {}", node_id);
+	size_t pool_size = core_->endpoints(node_id);
+	if (pool_size > 1) {
+		LOG_INFO("Node ID {} has {} sessions in its pool.", node_id, pool_size);
 	}
-
-
-	auto& session = sessions_by_socket_[client_socket];
-	session->set_id(node_id);
-	sessions_by_id_[node_id] = session;
 }
-std::shared_ptr<Session> Sessions::find_session_by_socket(int client_socket) {
+void Sessions::add_peer(int client_socket) {
+	std::unique_lock<std::shared_mutex> lock(*sessions_mutex_);
+	auto it = sessions_by_socket_.find(client_socket);
+	if (it != sessions_by_socket_.end()) {
+		it->second->set_id(ROUTER_NODE_ID);
+	}
+}
+std::vector<std::shared_ptr<Session>> Sessions::get_sessions() {
 	std::shared_lock<std::shared_mutex> lock(*sessions_mutex_);
-	if (sessions_by_socket_.count(client_socket) == 0) {
-		return nullptr;
+	std::vector<std::shared_ptr<Session>> sessions;
+	sessions.reserve(sessions_by_socket_.size());
+	for (auto& session : sessions_by_socket_) {
+		sessions.push_back(session.second);
 	}
-	auto session = sessions_by_socket_[client_socket];
-	return session;
+	return sessions;
 }
-std::shared_ptr<Session> Sessions::find_session_by_id(int node_id){
+std::shared_ptr<Session> Sessions::find_session_by_socket(int client_socket) {
 	std::shared_lock<std::shared_mutex> lock(*sessions_mutex_);
-	if (sessions_by_id_.count(node_id) == 0) {
+	if (sessions_by_socket_.count(client_socket) == 0) {
 		return nullptr;
 	}
-	auto session = sessions_by_id_[node_id];
+	auto session = sessions_by_socket_[client_socket];
 	return session;
 }
 void Sessions::removeSession(int socket){
@@ -69,9 +86,14 @@ void Sessions::removeSession(int socket){
 		sessions_by_socket_.erase(socket);
 
 		int id = session->get_id();
-		if (id != NONE) {
-			session = sessions_by_id_[id];
-			sessions_by_id_.erase(id);
+		ROUTER_PROBE2(remove, socket, id);
+		// sockets are closed when the last user releases the session, a peer link writer is one of them
+		session->close_on_destroy();
+		if (id == ROUTER_NODE_ID) {
+			Mesh::detach_link(socket);
+		} else if (id != NONE) {
+			// remove only this session from the pool, other sessions of the same ID keep serving
+			core_->detach(socket);
 		}
 	}
 
@@ -85,6 +107,7 @@ void Sessions::removeSession(int socket){
 
 // sinitialize static variables
 std::unordered_map<int, std::shared_ptr<Session>> Sessions::sessions_by_socket_ = std::unordered_map<int, std::shared_ptr<Session>>();
-std::unordered_map<int, std::shared_ptr<Session>> Sessions::sessions_by_id_ = std::unordered_map<int, std::shared_ptr<Session>>();
+RouterCore* Sessions::core_ = nullptr;
+RouterCore::Delivery Sessions::delivery_;
 std::vector<int> Sessions::accepted_clients_ = std::vector<int>();
 std::shared_ptr<std::shared_mutex> Sessions::sessions_mutex_ = std::make_shared<std::shared_mutex>();
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "shm_transport.h"
+
+#include <cstring>
+
+#include "logger.h"
+#include "message.h"
+#include "session.h"
+#include "sessions.h"
+#include "tcpserver.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+
+ShmChannel::ShmChannel(void* region, size_t region_size, size_t capacity,
+                       int router_doorbell, int node_doorbell)
+    : region_(region),
+      region_size_(region_size),
+      to_router_(region, capacity, true),
+      to_node_(static_cast<char*>(region) + ShmRing::region_size(capacity),
+               capacity, true),
+      router_doorbell_(router_doorbell),
+      node_doorbell_(node_doorbell) {
+  // router waits on the doorbell from the start, the ID message rings it
+  to_router_.prepare_wait();
+}
+
+ShmChannel::~ShmChannel() {
+  // node blocked on its doorbell sees the closed rings
+  to_router_.close();
+  to_node_.close();
+  wake_node();
+  munmap(region_, region_size_);
+  close(node_doorbell_);
+}
+
+void ShmChannel::acknowledge() {
+  uint64_t count;
+  // non-blocking, fails with EAGAIN if nobody rang
+  ::read(router_doorbell_, &count, sizeof(count));
+}
+
+int ShmChannel::read(char* buffer, int len) {
+  while (true) {
+    size_t count = to_router_.read(buffer, len);
+    if (count > 0) {
+      if (to_router_.take_producer_waiting()) wake_node();
+      return static_cast<int>(count);
+    }
+    if (to_router_.is_closed()) return SOCKET_ERROR;
+    // ring is empty, node rings the doorbell on its next write unless data
+    // arrived meanwhile
+    if (to_router_.prepare_wait()) return 0;
+  }
+}
+
+void ShmChannel::rearm() {
+  // empty ring waits for the node like an empty read does
+  if (to_router_.prepare_wait()) return;
+  uint64_t one = 1;
+  ::write(router_doorbell_, &one, sizeof(one));
+}
+
+int ShmChannel::write(const char* buffer, int len, int frame_size) {
+  if (to_node_.is_closed()) return SOCKET_ERROR;
+  size_t written = 0;
+  while (true) {
+    size_t count = to_node_.write(buffer + written, len - written, frame_size);
+    if (count > 0 && to_node_.take_consumer_waiting()) wake_node();
+    written += count;
+    if (written == static_cast<size_t>(len)) break;
+    // ring is full, node rings the router doorbell when it frees space
+    // unless it already did
+    if (to_node_.prepare_space_wait(frame_size)) break;
+  }
+  return static_cast<int>(written);
+}
+
+void ShmChannel::wake_node() {
+  uint64_t one = 1;
+  ::write(node_doorbell_, &one, sizeof(one));
+}
+
+int ShmTransport::listen(const std::string& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LOG_ERROR("Shared memory transport path is too long : {}", path);
+    return SOCKET_ERROR;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  int listen_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_socket == -1) return SOCKET_ERROR;
+  // path may be left from the previous router process
+  unlink(path.c_str());
+  if (bind(listen_socket, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+      ::listen(listen_socket, SOMAXCONN) == -1) {
+    LOG_ERROR("Cannot listen on shared memory transport path {}", path);
+    close(listen_socket);
+    return SOCKET_ERROR;
+  }
+  LOG_INFO("Co-located nodes are accepted on {}", path);
+  return listen_socket;
+}
+
+std::shared_ptr<Session> ShmTransport::accept_node(int listen_socket) {
+  int connection = accept4(listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+  if (connection == -1) return nullptr;
+  // select() can only watch descriptors below FD_SETSIZE, FD_SET of a larger
+  // one writes past the fd_set. the event loop watches the connection
+  if (connection >= FD_SETSIZE) {
+    LOG_ERROR("Connection {} is beyond FD_SETSIZE, co-located node refused.",
+              connection);
+    close(connection);
+    return nullptr;
+  }
+
+  size_t capacity = SHM_RING_CAPACITY;
+  size_t region_size = 2 * ShmRing::region_size(capacity);
+  int memory = memfd_create("isc-shm-rings", MFD_CLOEXEC);
+  if (memory == -1 || ftruncate(memory, region_size) == -1) {
+    LOG_ERROR("Cannot create shared memory for a co-located node.");
+    if (memory != -1) close(memory);
+    close(connection);
+    return nullptr;
+  }
+  void* region = mmap(nullptr, region_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, memory, 0);
+  int router_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int node_doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (region == MAP_FAILED || router_doorbell == -1 || node_doorbell == -1) {
+    LOG_ERROR("Cannot map shared memory for a co-located node.");
+    if (region != MAP_FAILED) munmap(region, region_size);
+    if (router_doorbell != -1) close(router_doorbell);
+    if (node_doorbell != -1) close(node_doorbell);
+    close(memory);
+    close(connection);
+    return nullptr;
+  }
+  // the router doorbell becomes the session socket, it is watched too
+  if (router_doorbell >= FD_SETSIZE) {
+    LOG_ERROR("Doorbell {} is beyond FD_SETSIZE, co-located node refused.",
+              router_doorbell);
+    munmap(region, region_size);
+    close(router_doorbell);
+    close(node_doorbell);
+    close(memory);
+    close(connection);
+    return nullptr;
+  }
+  auto channel = std::make_shared<ShmChannel>(region, region_size, capacity,
+                                              router_doorbell, node_doorbell);
+
+  // setup message carries the region and both doorbells
+  ShmSetup setup{SHM_SETUP_MAGIC, SHM_SETUP_VERSION, capacity};
+  iovec payload{};
+  payload.iov_base = &setup;
+  payload.iov_len = sizeof(setup);
+  int fds[SHM_SETUP_FDS] = {memory, router_doorbell, node_doorbell};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  msghdr message{};
+  message.msg_iov = &payload;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(header), fds, sizeof(fds));
+  bool sent = sendmsg(connection, &message, MSG_NOSIGNAL) == sizeof(setup);
+  // mapping keeps the region alive
+  close(memory);
+  if (!sent) {
+    LOG_ERROR("Cannot send shared memory setup to a co-located node.");
+    close(router_doorbell);
+    close(connection);
+    return nullptr;
+  }
+
+  // doorbell of the router is the session socket, the node handshakes its ID
+  // through the ring like a TCP node
+  Sessions::accept_client(router_doorbell);
+  auto session = Sessions::find_session_by_socket(router_doorbell);
+  if (session == nullptr) {
+    close(router_doorbell);
+    close(connection);
+    return nullptr;
+  }
+  session->set_channel(channel);
+  connections_[connection] = session;
+  LOG_INFO("Accept new co-located node on shared memory {}.", router_doorbell);
+  return session;
+}
+
+int ShmTransport::set_fds(fd_set& readfds) {
+  int max_fd = -1;
+  for (auto it = connections_.begin(); it != connections_.end();) {
+    auto session = it->second.lock();
+    if (session == nullptr ||
+        Sessions::find_session_by_socket(session->get_socket()) != session) {
+      // session is removed, closing the connection tells the node
+      close(it->first);
+      it = connections_.erase(it);
+      continue;
+    }
+    FD_SET(it->first, &readfds);
+    if (it->first > max_fd) max_fd = it->first;
+    ++it;
+  }
+  return max_fd;
+}
+
+void ShmTransport::check_fds(const fd_set& readfds) {
+  for (auto it = connections_.begin(); it != connections_.end();) {
+    if (!FD_ISSET(it->first, &readfds)) {
+      ++it;
+      continue;
+    }
+    // node never writes on the connection, readable means it is closed
+    char byte;
+    if (recv(it->first, &byte, 1, MSG_DONTWAIT) > 0) {
+      ++it;
+      continue;
+    }
+    auto session = it->second.lock();
+    if (session != nullptr &&
+        Sessions::find_session_by_socket(session->get_socket()) == session) {
+      LOG_INFO("Co-located node on shared memory {} is gone, session is removed.",
+               session->get_socket());
+      Sessions::removeSession(session->get_socket());
+    }
+    close(it->first);
+    it = connections_.erase(it);
+  }
+}
+
+#else
+
+ShmChannel::ShmChannel(void* region, size_t region_size, size_t capacity,
+                       int router_doorbell, int node_doorbell)
+    : region_(region),
+      region_size_(region_size),
+      to_router_(region, capacity, false),
+      to_node_(region, capacity, false),
+      router_doorbell_(router_doorbell),
+      node_doorbell_(node_doorbell) {}
+ShmChannel::~ShmChannel() {}
+void ShmChannel::acknowledge() {}
+int ShmChannel::read(char* buffer, int len) { return SOCKET_ERROR; }
+void ShmChannel::rearm() {}
+int ShmChannel::write(const char* buffer, int len, int frame_size) {
+  return SOCKET_ERROR;
+}
+void ShmChannel::wake_node() {}
+
+int ShmTransport::listen(const std::string& path) {
+  LOG_ERROR("Shared memory transport is not supported on this platform.");
+  return SOCKET_ERROR;
+}
+std::shared_ptr<Session> ShmTransport::accept_node(int listen_socket) {
+  return nullptr;
+}
+int ShmTransport::set_fds(fd_set& readfds) { return -1; }
+void ShmTransport::check_fds(const fd_set& readfds) {}
+
+#endif  // __linux__
+
+// initialize static variables
+std::unordered_map<int, std::weak_ptr<Session>> ShmTransport::connections_;
@@ -1,9 +1,13 @@
 #include "tcpserver.h"
+#include <algorithm>
+#include <chrono>
 #include "logger.h"
 
+// busy poll budget of a blocking read on the socket, in microseconds
+#define BUSY_POLL_US 50
 
 
-int TcpServer::start_tcp_server(int port) {
+int TcpServer::start_tcp_server(int port, const std::string& bind_address) {
 #ifdef _WIN32
     // Initialize Winsock
     WSADATA wsaData;
@@ -19,12 +23,19 @@ int TcpServer::start_tcp_server(int port) {
         LOG_ERROR("Socket creation failed");
         return SOCKET_ERROR;
     }
+    // let a restarted router bind while old connections are in TIME_WAIT
+    int reuse = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
     // Configure server address
     auto servAddr = sockaddr_in{};
     servAddr.sin_family = AF_INET;
     servAddr.sin_port = htons(port);
 
-    inet_pton(AF_INET, "127.0.0.1", &servAddr.sin_addr);
+    if (inet_pton(AF_INET, bind_address.c_str(), &servAddr.sin_addr) != 1) {
+        LOG_ERROR("Invalid bind address {}", bind_address);
+        return SOCKET_ERROR;
+    }
 
     //bind the socket to its local address
     int bindStatus = bind(server_socket, (struct sockaddr*)&servAddr,
@@ -34,13 +45,23 @@ int TcpServer::start_tcp_server(int port) {
         LOG_ERROR("Error binding socket to local address");
         return SOCKET_ERROR;
     }
-    listen(server_socket, 5);
+    listen(server_socket, LISTEN_BACKLOG);
     return server_socket;
 }
 int TcpServer::accept_client(int server_socket) {
     int new_client = accept(server_socket, nullptr, nullptr);
+#ifndef _WIN32
+    // select() can only watch descriptors below FD_SETSIZE, FD_SET of a larger
+    // one writes past the fd_set
+    if (new_client >= FD_SETSIZE) {
+        LOG_ERROR("Socket {} is beyond FD_SETSIZE, connection refused.", new_client);
+        close(new_client);
+        return SOCKET_ERROR;
+    }
+#endif
     int err = set_client_socket_nonblocking(new_client);
     if (err == 0) {
+        tune_socket(new_client);
         return new_client;
     }
     return err;
@@ -89,6 +110,7 @@ int TcpServer::read_async(int client_socket, char* buffer,int buffer_len) {
             buffer_len - total_read, 0);
 
         if (bytes_read > 0) {
+            quick_ack(client_socket);
             total_read += bytes_read;
             if(total_read == buffer_len)
                 break;
@@ -126,8 +148,155 @@ int TcpServer::send_to_client(int client_socket, std::string buffer) {
     }
     return bytesSent;
 }
+int TcpServer::send_all(int client_socket, const char* buffer, int len) {
+    int total_sent = 0;
+    while (total_sent < len) {
+        int bytes_sent = send(client_socket, buffer + total_sent, len - total_sent, 0);
+        if (bytes_sent > 0) {
+            total_sent += bytes_sent;
+        }
+        else if (bytes_sent == SOCKET_ERROR && no_more_data()) {
+            // socket buffer is full, wait until peer reads
+            wait_writable(client_socket, 100);
+        }
+        else {
+            int err = GET_SOCKET_ERROR();
+            LOG_ERROR("Error on send. err code : {}", err);
+            return SOCKET_ERROR;
+        }
+    }
+    return total_sent;
+}
+int TcpServer::send_some(int client_socket, const char* buffer, int len) {
+    int total_sent = 0;
+    while (total_sent < len) {
+        int bytes_sent = send(client_socket, buffer + total_sent, len - total_sent, 0);
+        if (bytes_sent > 0) {
+            total_sent += bytes_sent;
+        }
+        else if (bytes_sent == SOCKET_ERROR && no_more_data()) {
+            // socket buffer is full, caller keeps the rest
+            break;
+        }
+        else {
+            int err = GET_SOCKET_ERROR();
+            LOG_ERROR("Error on send. err code : {}", err);
+            return SOCKET_ERROR;
+        }
+    }
+    return total_sent;
+}
+int TcpServer::send_within(int client_socket, const char* buffer, int len, int timeout_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    int total_sent = 0;
+    while (total_sent < len) {
+        int bytes_sent = send(client_socket, buffer + total_sent, len - total_sent, 0);
+        if (bytes_sent > 0) {
+            total_sent += bytes_sent;
+        }
+        else if (bytes_sent == SOCKET_ERROR && no_more_data()) {
+            // socket buffer is full, wait until peer reads or time is up
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) break;
+            wait_writable(client_socket, static_cast<int>(std::min<int64_t>(left, 100)));
+        }
+        else {
+            int err = GET_SOCKET_ERROR();
+            LOG_ERROR("Error on send. err code : {}", err);
+            return SOCKET_ERROR;
+        }
+    }
+    return total_sent;
+}
+int TcpServer::connect_to(const std::string& ip, int port) {
+    int peer_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (peer_socket == -1) {
+        LOG_ERROR("Socket creation failed");
+        return SOCKET_ERROR;
+    }
+    auto peerAddr = sockaddr_in{};
+    peerAddr.sin_family = AF_INET;
+    peerAddr.sin_port = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &peerAddr.sin_addr);
+
+    if (connect(peer_socket, (struct sockaddr*)&peerAddr, sizeof(peerAddr)) == -1) {
+        close_socket(peer_socket);
+        return SOCKET_ERROR;
+    }
+    if (set_client_socket_nonblocking(peer_socket) != 0) {
+        return SOCKET_ERROR;
+    }
+    tune_socket(peer_socket);
+    return peer_socket;
+}
+bool TcpServer::wait_writable(int client_socket, int timeout_ms) {
+    fd_set writefds;
+    FD_ZERO(&writefds);
+    FD_SET(client_socket, &writefds);
+    timeval timeout{};
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    return select(client_socket + 1, nullptr, &writefds, nullptr, &timeout) > 0;
+}
+void TcpServer::configure(bool low_latency, int buffer_size) {
+    low_latency_ = low_latency;
+    buffer_size_ = buffer_size;
+}
+void TcpServer::tune_socket(int client_socket) {
+    if (buffer_size_ > 0) {
+        setsockopt(client_socket, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size_, sizeof(buffer_size_));
+        setsockopt(client_socket, SOL_SOCKET, SO_SNDBUF, (const char*)&buffer_size_, sizeof(buffer_size_));
+    }
+    if (!low_latency_) return;
+
+    // 32 byte frames must not wait behind Nagle for the ACK of previous one
+    int enable = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+#ifdef __linux__
+    setsockopt(client_socket, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+    // needs CAP_NET_ADMIN to raise above net.core.busy_read, failure is harmless
+    int busy_poll = BUSY_POLL_US;
+    setsockopt(client_socket, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll));
+#endif
+}
+void TcpServer::quick_ack(int client_socket) {
+#ifdef __linux__
+    if (low_latency_) {
+        int enable = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(enable));
+    }
+#endif
+}
+std::string TcpServer::peer_ip(int client_socket) {
+    auto peerAddr = sockaddr_in{};
+    socklen_t len = sizeof(peerAddr);
+    if (getpeername(client_socket, (struct sockaddr*)&peerAddr, &len) != 0 ||
+        peerAddr.sin_family != AF_INET) {
+        return "";
+    }
+    char ip[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &peerAddr.sin_addr, ip, sizeof(ip)) == nullptr) {
+        return "";
+    }
+    return ip;
+}
+void TcpServer::shutdown_socket(int client_socket) {
+#ifdef _WIN32
+    shutdown(client_socket, SD_BOTH);
+#else
+    shutdown(client_socket, SHUT_RDWR);
+#endif
+}
+void TcpServer::close_socket(int client_socket) {
+#ifdef _WIN32
+    closesocket(client_socket);
+#else
+    close(client_socket);
+#endif
+}
 int TcpServer::reset_fd_set(fd_set &fd, int server_socket,
-    std::vector<int> clients_socket) {
+    const std::vector<int> &clients_socket) {
 // reset fd to clear all
 FD_ZERO(&fd);
 
@@ -142,4 +311,8 @@ FD_SET(sd, &fd);
 if (sd > max_sd) max_sd = sd;
 }
 return max_sd;
-}
\ No newline at end of file
+}
+
+// initialize static variables
+bool TcpServer::low_latency_ = false;
+int TcpServer::buffer_size_ = 0;
@@ -0,0 +1,54 @@
+#include "thread_affinity.h"
+
+#include <cstring>
+
+#include "logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+bool ThreadAffinity::pin_current_thread(int cpu) {
+  if (cpu == NO_CPU) return false;
+#ifdef _WIN32
+  DWORD_PTR mask = DWORD_PTR(1) << cpu;
+  if (SetThreadAffinityMask(GetCurrentThread(), mask) == 0) {
+    LOG_ERROR("Cannot pin thread to CPU {}", cpu);
+    return false;
+  }
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    LOG_ERROR("Cannot pin thread to CPU {}", cpu);
+    return false;
+  }
+#else
+  LOG_WARN("Thread pinning is not supported on this platform.");
+  return false;
+#endif
+  return true;
+}
+
+char* ThreadAffinity::allocate_local(size_t size) {
+#ifdef _WIN32
+  // VirtualAlloc commits pages on first touch as well
+  char* buffer = static_cast<char*>(
+      VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+  if (buffer == nullptr) return nullptr;
+#else
+  // fresh anonymous mapping, malloc may return pages touched by other threads
+  void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) return nullptr;
+  char* buffer = static_cast<char*>(mapped);
+#endif
+  // first touch from this thread places the pages
+  memset(buffer, 0, size);
+  return buffer;
+}
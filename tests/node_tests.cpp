@@ -1,9 +1,22 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <fstream>
 #include <iostream>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "../node/include/backoff.h"
+#include "../node/include/logger.h"
+// after logger.h, it sets the spdlog level macros
+#include <spdlog/sinks/null_sink.h>
 #include "../node/include/message.h"
+#include "../node/include/node_host.h"
+#include "../node/include/rtt_tracker.h"
 
 using namespace std;
 
@@ -39,11 +52,172 @@ TEST_F(MyTestFixture, Test_Process_Message3) {
   EXPECT_EQ(Message::processMessage(3,"0052210123456111111111111111003",31), "");
 }
 
+TEST_F(MyTestFixture, Test_Process_Message4) {
+  // frames with a non digit are not answered, MTI wraps at 4 digits
+  EXPECT_EQ(Message::processMessage(3,"0052210123456111111X111111111003",32), "");
+  EXPECT_EQ(Message::processMessage(3,"00599951234561111111111111111003",32), "00300051234561111111111111111005");
+}
+
 TEST_F(MyTestFixture, Test_Id_Message) {
   EXPECT_EQ(Message::buildIdMessage(3), "003");
 }
 
+TEST_F(MyTestFixture, Test_Backoff_Jitter_And_Cap) {
+  Backoff backoff(100, 1000, 7);
+  unsigned ceilings[] = {100, 200, 400, 800, 1000, 1000};
+  for (unsigned ceiling : ceilings) {
+    unsigned delay = backoff.nextDelayMs();
+    EXPECT_GE(delay, ceiling / 2);
+    EXPECT_LE(delay, ceiling);
+  }
+  backoff.reset();
+  EXPECT_LE(backoff.nextDelayMs(), 100u);
+}
+
+TEST_F(MyTestFixture, Test_Rtt_Match_And_Expire) {
+  RttTracker rtt(4, 100);
+  auto start = RttTracker::Clock::now();
+  std::string frame = Message::buildFirstMessage(1, 2, 42);
+  EXPECT_EQ(frame.substr(TRACE_OFFSET, TRACE_LENGTH), "000042");
+  for (int trace = 1; trace <= 4; trace++) {
+    EXPECT_TRUE(rtt.onSent(Message::buildFirstMessage(1, 2, trace).c_str(), start));
+  }
+  // table is sized for the in-flight limit
+  EXPECT_FALSE(rtt.onSent(frame.c_str(), start));
+  EXPECT_EQ(rtt.overflows(), 1u);
+
+  std::string reply = Message::processMessage(2, Message::buildFirstMessage(1, 2, 3).c_str(), 32);
+  EXPECT_TRUE(rtt.onReceived(reply.c_str(), start + std::chrono::microseconds(250)));
+  EXPECT_FALSE(rtt.onReceived(reply.c_str(), start));
+  EXPECT_EQ(rtt.histogram().count(), 1u);
+  EXPECT_LE(rtt.histogram().max(), 250u);
+
+  std::vector<uint32_t> expired;
+  rtt.expire(start + std::chrono::milliseconds(200),
+             [&](uint32_t trace) { expired.push_back(trace); });
+  EXPECT_EQ(expired.size(), 3u);
+  EXPECT_EQ(rtt.inFlight(), 0u);
+  EXPECT_TRUE(rtt.onSent(frame.c_str(), start));
+}
+
+/**
+ * Google Test Fixture class for NodeHost, a logical node is connected to one
+ * end of a socketpair and the test plays the router on the other end.
+ */
+class NodeHostTest : public ::testing::Test {
+ protected:
+  NodeHost host{"127.0.0.1", 6060};
+  int router = -1;
+
+  void TearDown() override {
+    if (router != -1) close(router);
+  }
+
+  /**
+   * @brief Writes a config file for NodeHost::loadConfig.
+   */
+  static string writeConfig(const string& content) {
+    string path = ::testing::TempDir() + "node_host_test.conf";
+    ofstream(path) << content;
+    return path;
+  }
+
+  bool initiates(size_t index) { return host._nodes[index].initiate_messaging; }
+
+#ifndef _WIN32
+  /**
+   * @brief Adds a logical node connected to a socketpair.
+   */
+  void connectNode(int nodeid) {
+    host.addNode(nodeid, 5, false);
+    int pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+    fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+    host._nodes.back().socket = pair[0];
+    host._nodes.back().state = NodeHost::State::CONNECTED;
+    router = pair[1];
+  }
+
+  void sendFromRouter(const string& bytes) {
+    ASSERT_EQ(send(router, bytes.data(), bytes.size(), 0),
+              static_cast<ssize_t>(bytes.size()));
+  }
+
+  void readable() { host.onReadable(host._nodes.back()); }
+  int rxLen() { return host._nodes.back().rx_len; }
+  int txLen() { return host._nodes.back().tx_len; }
+  void setTxLen(int len) { host._nodes.back().tx_len = len; }
+  string tx() { return string(host._nodes.back().tx, txLen()); }
+#endif
+};
+
+TEST_F(NodeHostTest, Test_Load_Config) {
+  string path = writeConfig(
+      "# logical nodes of one host\n"
+      "\n"
+      "   # indented comment\n"
+      "3 5\n"
+      "5 3 passive\n"
+      "  7 3  \n");
+  EXPECT_TRUE(host.loadConfig(path));
+  ASSERT_EQ(host.size(), 3u);
+  EXPECT_TRUE(initiates(0));
+  EXPECT_FALSE(initiates(1));
+  EXPECT_TRUE(initiates(2));
+}
+
+TEST_F(NodeHostTest, Test_Load_Config_Bad_Lines) {
+  for (const char* line : {"3 x\n", "3 5 active\n", "3\n", "abc 5\n"}) {
+    NodeHost other("127.0.0.1", 6060);
+    EXPECT_FALSE(other.loadConfig(writeConfig(string("3 5\n") + line))) << line;
+  }
+  EXPECT_FALSE(host.loadConfig(::testing::TempDir() + "missing_node_host.conf"));
+}
+
+#ifndef _WIN32
+TEST_F(NodeHostTest, Test_Frame_Split_Across_Reads) {
+  connectNode(3);
+  string frame = "00522101234561111111111111111003";
+  string reply = Message::processMessage(3, frame.c_str(), MSG_LEN);
+
+  // partial frame is kept, nothing is answered yet
+  sendFromRouter(frame.substr(0, 20));
+  readable();
+  EXPECT_EQ(rxLen(), 20);
+  EXPECT_EQ(txLen(), 0);
+
+  sendFromRouter(frame.substr(20) + frame);
+  readable();
+  EXPECT_EQ(rxLen(), 0);
+  EXPECT_EQ(tx(), reply + reply);
+}
+
+TEST_F(NodeHostTest, Test_Reply_Room) {
+  connectNode(3);
+  string frame = "00522101234561111111111111111003";
+  string reply = Message::processMessage(3, frame.c_str(), MSG_LEN);
+
+  // room for one reply, one frame is completed and the next one is only started
+  setTxLen(HOSTED_BUFFER_SIZE - MSG_LEN);
+  sendFromRouter(frame + frame + frame);
+  readable();
+  EXPECT_EQ(txLen(), HOSTED_BUFFER_SIZE);
+  EXPECT_EQ(rxLen(), MSG_LEN - 1);
+
+  // send buffer drained, the rest is read and answered, no reply is dropped
+  setTxLen(0);
+  readable();
+  EXPECT_EQ(rxLen(), 0);
+  EXPECT_EQ(tx(), reply + reply);
+}
+#endif
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
+  // node host logs to the console logger, tests discard it
+  for (const char *name : {"console", "file"}) {
+    spdlog::register_logger(std::make_shared<spdlog::logger>(
+        name, std::make_shared<spdlog::sinks::null_sink_mt>()));
+  }
   return RUN_ALL_TESTS();
 }
\ No newline at end of file
@@ -0,0 +1,1226 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <future>
+#include <memory>
+#include <thread>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../common/include/alloc_stats.h"
+#include "../common/include/latency_histogram.h"
+#include "../router/include/handoff.h"
+#include "../router/include/logger.h"
+#include "../router/include/mesh.h"
+// after logger.h, it sets the spdlog level macros
+#include <spdlog/sinks/null_sink.h>
+#include "../router/include/message.h"
+#include "../router/include/outbox.h"
+#include "../router/include/route_index.h"
+#include "../router/include/router.h"
+#include "../router/include/router_config.h"
+#include "../router/include/router_core.h"
+#include "../router/include/session_pool.h"
+#include "../router/include/session_task.h"
+#include "../router/include/sessions.h"
+#include "../common/include/shm_ring.h"
+#include "../router/include/signaling_queue.h"
+#include "../router/include/timer_wheel.h"
+
+using namespace std;
+
+/**
+ * Google Test Fixture class for router components, builds a pool of three
+ * sessions registered under one node ID.
+ */
+class SessionPoolFixture : public ::testing::Test {
+ public:
+  void SetUp() override {
+    for (int socket = 10; socket < 13; socket++) {
+      pool.add(make_shared<Session>(socket));
+    }
+  }
+
+  SessionPool pool;
+};
+
+TEST_F(SessionPoolFixture, Test_Round_Robin) {
+  EXPECT_EQ(pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0)->get_socket(), 10);
+  EXPECT_EQ(pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0)->get_socket(), 11);
+  EXPECT_EQ(pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0)->get_socket(), 12);
+  EXPECT_EQ(pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0)->get_socket(), 10);
+}
+
+TEST_F(SessionPoolFixture, Test_Least_Outstanding) {
+  auto first = pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0);
+  auto second = pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0);
+  auto third = pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0);
+  first->add_outstanding(3);
+  second->add_outstanding(1);
+  third->add_outstanding(2);
+  EXPECT_EQ(pool.select(BalancePolicy::LEAST_OUTSTANDING, nullptr, 0), second);
+}
+
+TEST_F(SessionPoolFixture, Test_Pan_Hash_Sticky) {
+  const char* msg = "00322001234561111111111111111005";
+  auto chosen = pool.select(BalancePolicy::PAN_HASH, msg, 32);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(pool.select(BalancePolicy::PAN_HASH, msg, 32), chosen);
+  }
+  // removing another member must not move this PAN
+  int other = chosen->get_socket() == 10 ? 11 : 10;
+  EXPECT_TRUE(pool.remove(other));
+  EXPECT_EQ(pool.select(BalancePolicy::PAN_HASH, msg, 32), chosen);
+}
+
+TEST_F(SessionPoolFixture, Test_Remove_All) {
+  EXPECT_TRUE(pool.remove(10));
+  EXPECT_TRUE(pool.remove(11));
+  EXPECT_FALSE(pool.remove(11));
+  EXPECT_TRUE(pool.remove(12));
+  EXPECT_TRUE(pool.empty());
+  EXPECT_EQ(pool.select(BalancePolicy::ROUND_ROBIN, nullptr, 0), nullptr);
+}
+
+TEST(RouteIndexTest, Test_Longest_Prefix_And_Mti) {
+  vector<RouteRule> rules = {
+      {ANY_MTI, 4000000000000000ULL, 4999999999999999ULL, 7},
+      {ANY_MTI, 4111110000000000ULL, 4111119999999999ULL, 5},
+      {800, 0, MAX_PAN, 9},
+  };
+  RouteIndex index(rules);
+  // narrowest BIN wins
+  EXPECT_EQ(index.resolve("00322004123454111111111111111005", 32), 5);
+  EXPECT_EQ(index.resolve("00322004123454222222222222222005", 32), 7);
+  // MTI specific rule has precedence
+  EXPECT_EQ(index.resolve("00308001234564111111111111111005", 32), 9);
+  // no rule for this PAN
+  EXPECT_EQ(index.resolve("00322001234561111111111111111005", 32), NO_ROUTE);
+  // malformed PAN
+  EXPECT_EQ(index.resolve("0032200123456111111111111111X005", 32), NO_ROUTE);
+}
+
+TEST(MeshTest, Test_Control_Frame) {
+  string frame = Message::build_control_frame(CONTROL_ATTACH, 5);
+  EXPECT_EQ(frame, "99990010000000000000000000000005");
+  EXPECT_TRUE(Message::is_control_frame(frame.c_str()));
+  EXPECT_EQ(Message::extract_control_operation(frame.c_str()), CONTROL_ATTACH);
+  EXPECT_EQ(Message::extract_dst_id(frame.c_str(), 32), 5);
+  EXPECT_FALSE(Message::is_control_frame("00322001234561111111111111111005"));
+
+  frame = Message::build_hello_frame(123456, 6061);
+  EXPECT_EQ(Message::extract_control_operation(frame.c_str()), CONTROL_HELLO);
+  EXPECT_EQ(Message::extract_router_token(frame.c_str()), 123456);
+  EXPECT_EQ(Message::extract_router_port(frame.c_str()), 6061);
+}
+
+TEST(RouterConfigTest, Test_Peer_Address) {
+  RouterConfig config;
+  EXPECT_TRUE(RouterConfig::apply_option("--peer", "127.0.0.1:6061", config));
+  ASSERT_EQ(config.peers.size(), 1u);
+  EXPECT_EQ(config.peers[0].ip, "127.0.0.1");
+  EXPECT_EQ(config.peers[0].port, 6061);
+  // connectors never see an address they cannot connect to
+  for (const char *value : {"127.0.0.1:", "127.0.0.1:abc", "127.0.0.1:0",
+                            "127.0.0.1:65536", "127.0.0.1:99999999999",
+                            "localhost:6061", ":6061", "127.0.0.1"}) {
+    EXPECT_FALSE(RouterConfig::apply_option("--peer", value, config)) << value;
+  }
+  EXPECT_EQ(config.peers.size(), 1u);
+}
+
+TEST(RouterConfigTest, Test_Bind_Address) {
+  RouterConfig config;
+  EXPECT_EQ(config.bind_address, "127.0.0.1");
+  EXPECT_TRUE(RouterConfig::apply_option("--bind", "0.0.0.0", config));
+  EXPECT_EQ(config.bind_address, "0.0.0.0");
+  for (const char *value : {"", "localhost", "10.0.0", "10.0.0.1:6060"}) {
+    EXPECT_FALSE(RouterConfig::apply_option("--bind", value, config)) << value;
+  }
+  EXPECT_EQ(config.bind_address, "0.0.0.0");
+}
+
+TEST(RouterConfigTest, Test_Worker_Roles) {
+  auto roles = [](std::vector<std::string> args, RouterConfig &config) {
+    args.insert(args.begin(), {"router", "6060"});
+    std::vector<char *> argv;
+    for (auto &arg : args) argv.push_back(arg.data());
+    return RouterConfig::parse(int(argv.size()), argv.data(), config);
+  };
+  RouterConfig split;
+  ASSERT_TRUE(roles({"--threads", "5"}, split));
+  EXPECT_EQ(split.read_workers, 3u);
+  EXPECT_EQ(split.write_workers, 2u);
+  // one role count takes its threads, the other role gets the rest
+  RouterConfig reads;
+  ASSERT_TRUE(roles({"--threads", "8", "--read-workers", "2"}, reads));
+  EXPECT_EQ(reads.read_workers, 2u);
+  EXPECT_EQ(reads.write_workers, 6u);
+  EXPECT_EQ(reads.thread_count, 8u);
+  RouterConfig writes;
+  ASSERT_TRUE(roles({"--write-workers", "1", "--threads", "4"}, writes));
+  EXPECT_EQ(writes.read_workers, 3u);
+  EXPECT_EQ(writes.write_workers, 1u);
+  // both override the total
+  RouterConfig both;
+  ASSERT_TRUE(
+      roles({"--threads", "8", "--read-workers", "3", "--write-workers", "1"},
+            both));
+  EXPECT_EQ(both.thread_count, 4u);
+  // nothing left for the other role
+  RouterConfig full;
+  EXPECT_FALSE(roles({"--threads", "2", "--read-workers", "2"}, full));
+}
+
+TEST(FrameLayoutTest, Test_Fields) {
+  // offsets fold at compile time
+  static_assert(IsoFrame::offset<TraceField>() == 7);
+  static_assert(IsoFrame::offset<DstIdField>() == 29);
+  static_assert(IsoFrame::get<PanField>("00322001234561111111111111111005") ==
+                1111111111111111);
+
+  char frame[DATA_MESSAGE_SIZE];
+  IsoFrame::write(frame, 3, 2200, 123456, 1111111111111111ULL, 5);
+  EXPECT_EQ(string(frame, 32), "00322001234561111111111111111005");
+  IsoFrame::set<MtiField>(frame, 12210);
+  EXPECT_EQ(IsoFrame::get<MtiField>(frame), 2210);
+  EXPECT_TRUE(IsoFrame::valid(frame));
+  frame[20] = 'X';
+  EXPECT_FALSE(IsoFrame::valid(frame));
+  EXPECT_FALSE(IsoFrame::valid<PanField>(frame));
+  EXPECT_EQ(IsoFrame::get<PanField>(frame), -1);
+  EXPECT_EQ(Message::extract_dst_id(frame, 32), 5);
+  // only the three digits of the field are parsed
+  EXPECT_EQ(Message::extract_src_id("0052", 4), 5);
+  EXPECT_EQ(Message::extract_src_id("0X5", 3), -1);
+}
+
+TEST(SignalingQueueTest, Test_Spin_Then_Park) {
+  SignalingQueue<int> queue;
+  queue.set_spin(std::chrono::microseconds(200));
+  std::thread consumer([&queue]() {
+    // first pop finds the item while spinning, second one parks
+    for (int expected = 1; expected <= 2; expected++) {
+      EXPECT_EQ(queue.pop(), expected);
+      queue.task_done();
+    }
+  });
+  queue.push(1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  queue.push(2);
+  queue.wait_until_done();
+  consumer.join();
+}
+
+TEST(SignalingQueueTest, Test_Batch) {
+  SignalingQueue<int> queue;
+  std::vector<int> items = {1, 2, 2, 3, 4};
+  // repeated 2 is skipped like push(item, true) does
+  queue.push_batch(items.begin(), items.end(), true);
+
+  std::vector<int> batch;
+  EXPECT_EQ(queue.pop_batch(batch, 3), 3);
+  EXPECT_EQ(batch, std::vector<int>({1, 2, 3}));
+  queue.task_done(3);
+  EXPECT_EQ(queue.pop_batch(batch, 3), 1);
+  EXPECT_EQ(batch, std::vector<int>({4}));
+  queue.task_done(1);
+  queue.wait_until_done();
+}
+
+TEST(SessionTest, Test_Owner_And_Read_Schedule) {
+  Session session(7);
+  EXPECT_EQ(session.get_owner(), NONE);
+  EXPECT_EQ(session.claim_owner(2), 2);
+  // owner is kept for the session lifetime
+  EXPECT_EQ(session.claim_owner(3), 2);
+
+  EXPECT_TRUE(session.schedule_read());
+  EXPECT_FALSE(session.schedule_read());
+  session.clear_read_scheduled();
+  EXPECT_TRUE(session.schedule_read());
+}
+
+TEST(TimerWheelTest, Test_Expiry_Across_Levels) {
+  TimerWheel<int> wheel(10);
+  // delays on every level of the wheel, first level covers 640 ms
+  std::vector<int> delays = {5, 10, 630, 640, 655, 40960, 41000, 3000000};
+  for (int delay : delays) wheel.schedule(delay, delay);
+  EXPECT_EQ(wheel.size(), delays.size());
+
+  std::vector<std::pair<int, uint64_t>> fired;
+  for (uint64_t now = 0; now <= 3000000; now += 10) {
+    wheel.advance(now, [&](int& delay) { fired.emplace_back(delay, now); });
+  }
+  ASSERT_EQ(fired.size(), delays.size());
+  for (auto& timer : fired) {
+    // never early, at most one tick late
+    EXPECT_GE(timer.second, uint64_t(timer.first));
+    EXPECT_LT(timer.second, uint64_t(timer.first) + 10 + 10);
+  }
+  EXPECT_EQ(wheel.size(), 0);
+}
+
+/**
+ * @brief Builds a 32 byte frame with the given MTI, payload is one repeated character.
+ */
+static std::string test_frame(const char *mti, char payload) {
+  return std::string("001") + mti + std::string(22, payload) + "002";
+}
+
+TEST(OutboxTest, Test_Budget_Policies) {
+  OutboxBudget budget;
+  budget.max_frames = 2;
+  std::string frames;
+  std::vector<int> waiters;
+  bool needs_flush = false;
+  int next_class = -1;
+  auto ignore_wait = [](PriorityClass, uint64_t) {};
+  std::string a = test_frame("0200", 'a'), b = test_frame("0200", 'b'),
+              c = test_frame("0200", 'c'), d = test_frame("0200", 'd');
+
+  Outbox newest;
+  EXPECT_EQ(newest.push(a.data(), 32, budget, NONE, needs_flush),
+            PushResult::QUEUED);
+  EXPECT_TRUE(needs_flush);
+  EXPECT_EQ(newest.push(b.data(), 32, budget, NONE, needs_flush),
+            PushResult::QUEUED);
+  // one flush request per batch of pending frames
+  EXPECT_FALSE(needs_flush);
+  EXPECT_EQ(newest.push(c.data(), 32, budget, NONE, needs_flush),
+            PushResult::DROPPED_NEWEST);
+  EXPECT_EQ(newest.take(frames, waiters, budget, next_class, ignore_wait), 2);
+  EXPECT_EQ(frames, a + b);
+  EXPECT_EQ(next_class, -1);
+  EXPECT_EQ(newest.get_dropped(), 1);
+
+  budget.policy = SlowConsumerPolicy::DROP_OLDEST;
+  Outbox oldest;
+  for (auto *frame : {&a, &b, &c}) {
+    oldest.push(frame->data(), 32, budget, NONE, needs_flush);
+  }
+  EXPECT_EQ(oldest.take(frames, waiters, budget, next_class, ignore_wait), 2);
+  EXPECT_EQ(frames, b + c);
+  // unsent tail goes out before newer frames, new frames wait for writability
+  EXPECT_EQ(oldest.put_back(frames.data() + 40, 24, 32), 1);
+  oldest.push(d.data(), 32, budget, NONE, needs_flush);
+  EXPECT_FALSE(needs_flush);
+  EXPECT_EQ(oldest.pending_class(), int(PriorityClass::FINANCIAL));
+  EXPECT_EQ(oldest.take(frames, waiters, budget, next_class, ignore_wait), 2);
+  EXPECT_EQ(frames, c.substr(8) + d);
+
+  budget.policy = SlowConsumerPolicy::BACKPRESSURE;
+  Outbox backpressure;
+  for (auto *frame : {&a, &b}) {
+    backpressure.push(frame->data(), 32, budget, 5, needs_flush);
+  }
+  EXPECT_EQ(backpressure.push(c.data(), 32, budget, 5, needs_flush),
+            PushResult::OVER_BUDGET);
+  EXPECT_FALSE(backpressure.below_low_watermark(budget));
+  EXPECT_EQ(
+      backpressure.take(frames, waiters, budget, next_class, ignore_wait), 3);
+  EXPECT_EQ(waiters, std::vector<int>({5}));
+  EXPECT_TRUE(backpressure.below_low_watermark(budget));
+}
+
+TEST(OutboxTest, Test_Priority_Lanes) {
+  EXPECT_EQ(Message::get_priority_class(test_frame("0800", 'x').data()),
+            PriorityClass::NETWORK_MANAGEMENT);
+  EXPECT_EQ(Message::get_priority_class(test_frame("0420", 'x').data()),
+            PriorityClass::REVERSAL);
+  EXPECT_EQ(Message::get_priority_class(test_frame("0200", 'x').data()),
+            PriorityClass::FINANCIAL);
+
+  OutboxBudget budget;
+  budget.priority = WritePriority::STRICT;
+  std::string bulk = test_frame("0200", 'b'), reversal = test_frame("0400", 'r'),
+              echo = test_frame("0800", 'e');
+  std::string frames;
+  std::vector<int> waiters;
+  bool needs_flush = false;
+  int next_class = -1;
+  int waits[PRIORITY_CLASSES] = {};
+  auto count_wait = [&waits](PriorityClass frame_class, uint64_t) {
+    waits[int(frame_class)]++;
+  };
+
+  Outbox strict;
+  strict.push(bulk.data(), 32, budget, NONE, needs_flush);
+  EXPECT_TRUE(needs_flush);
+  strict.push(reversal.data(), 32, budget, NONE, needs_flush);
+  // higher class overtakes the queued flush request
+  EXPECT_TRUE(needs_flush);
+  strict.push(bulk.data(), 32, budget, NONE, needs_flush);
+  EXPECT_FALSE(needs_flush);
+  strict.push(echo.data(), 32, budget, NONE, needs_flush);
+  EXPECT_TRUE(needs_flush);
+  EXPECT_EQ(strict.get_depth(PriorityClass::FINANCIAL), 2);
+  EXPECT_EQ(strict.take(frames, waiters, budget, next_class, count_wait), 4);
+  EXPECT_EQ(frames, echo + reversal + bulk + bulk);
+  EXPECT_EQ(waits[0] + waits[1] + waits[2], 4);
+  EXPECT_EQ(waits[int(PriorityClass::FINANCIAL)], 2);
+
+  // drop-oldest evicts bulk traffic for a reversal, never a reversal for bulk
+  budget.max_frames = 2;
+  budget.policy = SlowConsumerPolicy::DROP_OLDEST;
+  Outbox full;
+  full.push(reversal.data(), 32, budget, NONE, needs_flush);
+  full.push(bulk.data(), 32, budget, NONE, needs_flush);
+  EXPECT_EQ(full.push(reversal.data(), 32, budget, NONE, needs_flush),
+            PushResult::DROPPED_OLDEST);
+  EXPECT_EQ(full.push(bulk.data(), 32, budget, NONE, needs_flush),
+            PushResult::DROPPED_NEWEST);
+  full.take(frames, waiters, budget, next_class, count_wait);
+  EXPECT_EQ(frames, reversal + reversal);
+
+  // a flush is limited, the highest class left is reported for the next one
+  budget.max_frames = 0;
+  budget.priority = WritePriority::WEIGHTED;
+  budget.lane_weights[0] = 2;
+  budget.lane_weights[2] = 1;
+  Outbox weighted;
+  size_t bulk_count = FLUSH_MAX_BYTES / DATA_MESSAGE_SIZE;
+  for (size_t i = 0; i < bulk_count; i++) {
+    weighted.push(bulk.data(), 32, budget, NONE, needs_flush);
+  }
+  for (int i = 0; i < 4; i++) {
+    weighted.push(echo.data(), 32, budget, NONE, needs_flush);
+  }
+  EXPECT_EQ(weighted.take(frames, waiters, budget, next_class, count_wait),
+            bulk_count);
+  // classes take turns by their weights
+  EXPECT_EQ(frames.substr(0, 5 * 32), echo + echo + bulk + echo + echo);
+  EXPECT_EQ(next_class, int(PriorityClass::FINANCIAL));
+  EXPECT_EQ(weighted.take(frames, waiters, budget, next_class, count_wait), 4);
+  EXPECT_EQ(next_class, -1);
+}
+
+TEST(OutboxTest, Test_Compact_Encoding) {
+  std::string bulk = test_frame("0200", '5'), echo = test_frame("0800", '7');
+  char packed[COMPACT_MESSAGE_SIZE];
+  char unpacked[DATA_MESSAGE_SIZE];
+  ASSERT_TRUE(FrameCodec::pack(bulk.data(), packed));
+  // digit 2i in the high nibble
+  EXPECT_EQ(packed[0], '\x00');
+  EXPECT_EQ(packed[1], '\x10');
+  EXPECT_EQ(packed[2], '\x20');
+  EXPECT_EQ(packed[15], '\x02');
+  FrameCodec::unpack(packed, unpacked);
+  EXPECT_EQ(std::string(unpacked, DATA_MESSAGE_SIZE), bulk);
+  EXPECT_FALSE(FrameCodec::pack(test_frame("0200", 'x').data(), packed));
+  EXPECT_FALSE(FrameCodec::pack(test_frame("0200", '/').data(), packed));
+
+  // pending frames follow the marker packed, whatever their class
+  OutboxBudget budget;
+  budget.priority = WritePriority::STRICT;
+  std::string frames;
+  std::vector<int> waiters;
+  bool needs_flush = false;
+  int next_class = -1;
+  auto ignore_wait = [](PriorityClass, uint64_t) {};
+  Outbox outbox;
+  outbox.push(bulk.data(), 32, budget, NONE, needs_flush);
+  std::string marker = Message::build_encoding_frame(2, FrameEncoding::PACKED_BCD);
+  outbox.switch_encoding(marker.data(), marker.size(), FrameEncoding::PACKED_BCD,
+                         needs_flush);
+  EXPECT_TRUE(needs_flush);
+  outbox.push(echo.data(), 32, budget, NONE, needs_flush);
+  EXPECT_EQ(outbox.push(test_frame("0200", 'x').data(), 32, budget, NONE,
+                        needs_flush),
+            PushResult::NOT_ENCODABLE);
+  EXPECT_EQ(outbox.take(frames, waiters, budget, next_class, ignore_wait), 3);
+  ASSERT_EQ(frames.size(), 32 + 2 * COMPACT_MESSAGE_SIZE);
+  EXPECT_EQ(frames.substr(0, 32), marker);
+  FrameCodec::unpack(frames.data() + 32, unpacked);
+  EXPECT_EQ(std::string(unpacked, DATA_MESSAGE_SIZE), echo);
+  FrameCodec::unpack(frames.data() + 48, unpacked);
+  EXPECT_EQ(std::string(unpacked, DATA_MESSAGE_SIZE), bulk);
+}
+
+TEST(SignalingQueueTest, Test_Lanes) {
+  SignalingQueue<int> strict;
+  strict.set_lanes(3);
+  strict.push(20, false, 2);
+  strict.push(10, false, 1);
+  strict.push(0, false, 0);
+  strict.push(21, false, 7);
+  std::vector<int> batch;
+  strict.pop_batch(batch, 10);
+  EXPECT_EQ(batch, std::vector<int>({0, 10, 20, 21}));
+
+  SignalingQueue<int> weighted;
+  weighted.set_lanes(2, {2, 1});
+  for (int i = 0; i < 4; i++) {
+    weighted.push(i, false, 0);
+    weighted.push(10 + i, false, 1);
+  }
+  weighted.pop_batch(batch, 10);
+  EXPECT_EQ(batch, std::vector<int>({0, 1, 10, 2, 3, 11, 12, 13}));
+}
+
+TEST(LatencyHistogramTest, Test_Percentiles) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.percentile(50), 0);
+  for (uint64_t value = 1; value <= 1000; value++) histogram.record(value);
+  EXPECT_EQ(histogram.count(), 1000);
+  EXPECT_EQ(histogram.max(), 1000);
+  // buckets are within 1/16 of the value
+  EXPECT_NEAR(double(histogram.percentile(50)), 500, 500 / 16.0);
+  EXPECT_NEAR(double(histogram.percentile(99)), 990, 990 / 16.0);
+  EXPECT_EQ(histogram.percentile(100), 1000);
+  for (uint64_t value : {0ull, 15ull, 16ull, 100ull, 1ull << 40}) {
+    int bucket = LatencyHistogram::bucket_of(value);
+    EXPECT_GE(LatencyHistogram::upper_bound(bucket), value);
+    EXPECT_LE(LatencyHistogram::upper_bound(bucket) - value, value / 16);
+  }
+  histogram.reset();
+  EXPECT_EQ(histogram.count(), 0);
+}
+
+TEST(ShmRingTest, Test_Wrap_And_Wait_Flags) {
+  const size_t capacity = 128;
+  std::vector<char> region(ShmRing::region_size(capacity) + 64);
+  // header is cache line aligned like a mapping
+  void *aligned = reinterpret_cast<void *>(
+      (reinterpret_cast<uintptr_t>(region.data()) + 63) & ~uintptr_t(63));
+  ShmRing producer(aligned, capacity, true);
+  ShmRing consumer(aligned, capacity, false);
+
+  // only whole units are written, an ID message then frames
+  EXPECT_EQ(producer.write("001", 3, 3), 3);
+  std::string frames(5 * 32, 'a');
+  EXPECT_EQ(producer.write(frames.data(), frames.size(), 32), 96);
+  EXPECT_EQ(producer.write(frames.data(), 32, 32), 0);
+  EXPECT_TRUE(producer.prepare_space_wait(32));
+
+  char buffer[128];
+  EXPECT_EQ(consumer.read(buffer, 3), 3);
+  EXPECT_EQ(std::string(buffer, 3), "001");
+  EXPECT_EQ(consumer.read(buffer, 64), 64);
+  EXPECT_TRUE(consumer.take_producer_waiting());
+  EXPECT_FALSE(consumer.take_producer_waiting());
+
+  // frame written across the end of the ring comes back in one piece
+  std::string frame = "00122001234561111111111111111002";
+  EXPECT_EQ(producer.write(frame.data(), 32, 32), 32);
+  EXPECT_EQ(consumer.read(buffer, 32), 32);
+  EXPECT_EQ(consumer.read(buffer, 32), 32);
+  EXPECT_EQ(std::string(buffer, 32), frame);
+
+  // consumer going to sleep is woken by the next write only
+  EXPECT_TRUE(consumer.prepare_wait());
+  EXPECT_EQ(producer.write(frame.data(), 32, 32), 32);
+  EXPECT_TRUE(producer.take_consumer_waiting());
+  EXPECT_FALSE(producer.take_consumer_waiting());
+  EXPECT_FALSE(consumer.prepare_wait());
+
+  consumer.close();
+  EXPECT_TRUE(producer.is_closed());
+}
+
+/**
+ * Reads frames of a fake socket until it fails, like the read task of a session.
+ */
+template <class Source>
+static SessionTask read_frames(Source source, std::vector<std::string> &frames) {
+  FrameReader reader(source);
+  char frame[DATA_MESSAGE_SIZE];
+  int bytes_read;
+  while (true) {
+    do {
+      bytes_read = co_await reader.read(frame, DATA_MESSAGE_SIZE);
+    } while (bytes_read == READ_PENDING);
+    if (bytes_read < 0) co_return;
+    frames.emplace_back(frame, DATA_MESSAGE_SIZE);
+  }
+}
+
+TEST(SessionTaskTest, Test_Frame_Split_Across_Reads) {
+  // socket buffer refilled between resumptions, empty reads suspend the task
+  std::string wire;
+  bool closed = false;
+  auto source = [&](char *buffer, int len) {
+    if (wire.empty()) return closed ? -1 : 0;
+    int count = std::min<int>(len, wire.size());
+    memcpy(buffer, wire.data(), count);
+    wire.erase(0, count);
+    return count;
+  };
+  std::vector<std::string> frames;
+  size_t frames_in_use = FramePool::in_use();
+  {
+    SessionTask task = read_frames(source, frames);
+    EXPECT_EQ(FramePool::in_use(), frames_in_use + 1);
+
+    std::string frame = "00122000000421111111111111111002";
+    wire = frame.substr(0, 10);
+    task.resume();
+    EXPECT_TRUE(frames.empty());
+    wire = frame.substr(10) + frame.substr(0, 5);
+    task.resume();
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0], frame);
+    wire = frame.substr(5);
+    task.resume();
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[1], frame);
+
+    closed = true;
+    task.resume();
+    EXPECT_TRUE(task.done());
+  }
+  // frame goes back to the pool with the task
+  EXPECT_EQ(FramePool::in_use(), frames_in_use);
+}
+
+/**
+ * Sends a wire to a fake socket taking a few bytes per call, awaiting the
+ * socket being writable when it took only part of them, like the write task.
+ */
+template <class Sink, class Arm>
+static SessionTask write_frames(Sink sink, Arm arm, std::string &wire) {
+  while (!wire.empty()) {
+    int count = sink(wire.data(), wire.size());
+    wire.erase(0, count);
+    if (!wire.empty()) co_await Writable(arm);
+  }
+}
+
+TEST(SessionTaskTest, Test_Frame_Released_On_Other_Thread) {
+  // sessions are removed on any thread, blocks stay in the pool
+  size_t frames_in_use = FramePool::in_use();
+  void *frame = nullptr;
+  std::thread starter([&]() { frame = FramePool::allocate(TASK_FRAME_SIZE); });
+  starter.join();
+  ASSERT_NE(frame, nullptr);
+  EXPECT_EQ(FramePool::in_use(), frames_in_use + 1);
+  std::thread remover([&]() { FramePool::release(frame, TASK_FRAME_SIZE); });
+  remover.join();
+  EXPECT_EQ(FramePool::in_use(), frames_in_use);
+  // cache of the exited remover went to the shared list
+  void *reused = FramePool::allocate(TASK_FRAME_SIZE);
+  EXPECT_NE(reused, nullptr);
+  FramePool::release(reused, TASK_FRAME_SIZE);
+  EXPECT_EQ(FramePool::in_use(), frames_in_use);
+}
+
+TEST(SessionTaskTest, Test_Await_Writable) {
+  std::string wire = "00122000000421111111111111111002";
+  std::string sent;
+  int capacity = 0;
+  int armed = 0;
+  auto sink = [&](const char *buffer, int len) {
+    int count = std::min(len, capacity);
+    sent.append(buffer, count);
+    capacity -= count;
+    return count;
+  };
+  SessionTask task = write_frames(sink, [&]() { ++armed; }, wire);
+
+  // socket buffer full, the wait is registered once per suspension
+  task.resume();
+  EXPECT_EQ(armed, 1);
+  EXPECT_TRUE(sent.empty());
+  capacity = 20;
+  task.resume();
+  EXPECT_EQ(armed, 2);
+  EXPECT_EQ(sent.size(), 20u);
+  capacity = 20;
+  task.resume();
+  EXPECT_EQ(armed, 2);
+  EXPECT_EQ(sent, "00122000000421111111111111111002");
+  EXPECT_TRUE(task.done());
+}
+
+TEST(RouterCoreTest, Test_Submit_And_Detach) {
+  RouterCore core;
+  std::vector<int> membership;
+  core.set_listener([&](int node_id, bool attached) {
+    membership.push_back(attached ? node_id : -node_id);
+  });
+  std::vector<std::string> delivered;
+  auto delivery = [&](const std::shared_ptr<Session> &dst, const char *frame,
+                      int src) {
+    delivered.push_back(std::to_string(dst->get_id()) + ":" +
+                        std::string(frame, DATA_MESSAGE_SIZE));
+    return src != 7;
+  };
+
+  int first = core.attach(2, delivery);
+  int second = core.attach(2, delivery);
+  EXPECT_LE(first, LOCAL_HANDLE_BASE);
+  EXPECT_NE(first, second);
+  EXPECT_EQ(core.attach(MAX_CLIENTS_COUNT, delivery), NONE);
+  EXPECT_EQ(core.endpoints(2), 2);
+
+  std::string frame = test_frame("0200", 'a');
+  EXPECT_EQ(core.submit(frame.c_str()), SubmitResult::DELIVERED);
+  ASSERT_EQ(delivered.size(), 1);
+  EXPECT_EQ(delivered[0], "2:" + frame);
+  // delivery asks the producer to stop
+  EXPECT_EQ(core.submit(frame.c_str(), DATA_MESSAGE_SIZE, 7),
+            SubmitResult::REJECTED);
+
+  // resolver overrides the dst field
+  int dst_id = NONE;
+  core.set_resolver([](const char *, int) { return 5; });
+  EXPECT_EQ(core.submit(frame.c_str(), DATA_MESSAGE_SIZE, NONE, &dst_id),
+            SubmitResult::NOT_FOUND);
+  EXPECT_EQ(dst_id, 5);
+  core.set_resolver(nullptr);
+
+  EXPECT_TRUE(core.detach(first));
+  EXPECT_FALSE(core.detach(first));
+  EXPECT_EQ(core.submit(frame.c_str()), SubmitResult::DELIVERED);
+  EXPECT_TRUE(core.detach(second));
+  EXPECT_EQ(core.submit(frame.c_str()), SubmitResult::NOT_FOUND);
+  EXPECT_EQ(membership, (std::vector<int>{2, -2}));
+}
+
+#ifndef _WIN32
+/**
+ * @brief Checks if two descriptors refer to the same socket, passed descriptors get new numbers.
+ */
+static bool same_socket(int a, int b) {
+  struct stat first, second;
+  if (fstat(a, &first) != 0 || fstat(b, &second) != 0) return false;
+  return first.st_dev == second.st_dev && first.st_ino == second.st_ino;
+}
+
+/// node_id of a handoff record of node 7, reads packed frames and gets ASCII.
+static const int32_t HANDOFF_TEST_NODE =
+    7 | static_cast<int32_t>(FrameEncoding::PACKED_BCD)
+            << HANDOFF_READ_ENCODING_SHIFT |
+    static_cast<int32_t>(FrameEncoding::ASCII) << HANDOFF_WRITE_ENCODING_SHIFT;
+
+TEST(HandoffTest, Test_Records_Over_Socketpair) {
+  int channel[2], listener[2], node[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, channel), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, listener), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, node), 0);
+
+  EXPECT_TRUE(Handoff::send_record(channel[0], listener[0],
+                                   HandoffRecord{HANDOFF_LISTENER, NONE}));
+  EXPECT_TRUE(Handoff::send_record(channel[0], node[0],
+                                   HandoffRecord{HANDOFF_SESSION, HANDOFF_TEST_NODE}));
+  EXPECT_TRUE(Handoff::send_record(channel[0], -1, HandoffRecord{HANDOFF_END, NONE}));
+
+  HandoffRecord record;
+  int fd = Handoff::recv_record(channel[1], record);
+  EXPECT_EQ(record.kind, HANDOFF_LISTENER);
+  EXPECT_EQ(record.node_id, NONE);
+  EXPECT_TRUE(same_socket(fd, listener[0]));
+  close(fd);
+
+  fd = Handoff::recv_record(channel[1], record);
+  EXPECT_EQ(record.kind, HANDOFF_SESSION);
+  EXPECT_EQ(record.node_id & HANDOFF_NODE_ID_MASK, 7);
+  EXPECT_EQ((record.node_id >> HANDOFF_READ_ENCODING_SHIFT) & 0xFF,
+            static_cast<int>(FrameEncoding::PACKED_BCD));
+  EXPECT_TRUE(same_socket(fd, node[0]));
+  close(fd);
+
+  // END carries no descriptor
+  EXPECT_EQ(Handoff::recv_record(channel[1], record), -1);
+  EXPECT_EQ(record.kind, HANDOFF_END);
+
+  // closed channel reads as an interrupted handoff
+  close(channel[0]);
+  EXPECT_EQ(Handoff::recv_record(channel[1], record), -1);
+  EXPECT_EQ(record.kind, 0);
+  for (int socket : {channel[1], listener[0], listener[1], node[0], node[1]}) {
+    close(socket);
+  }
+}
+
+TEST(HandoffTest, Test_Take_Over) {
+  RouterCore core;
+  Sessions::init_sessions(
+      16, &core, [](const std::shared_ptr<Session> &, const char *, int) {
+        return true;
+      });
+  // the old router passes a listener, node 7, a session without handshake
+  // and a peer link
+  int listener[2], node[2], pending[2], peer[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, listener), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, node), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pending), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, peer), 0);
+
+  std::string path = "/tmp/isc_handoff_test_" + std::to_string(getpid());
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  int handoff_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  ASSERT_EQ(bind(handoff_socket, (sockaddr *)&addr, sizeof(addr)), 0);
+  ASSERT_EQ(listen(handoff_socket, 1), 0);
+  std::thread old_router([&]() {
+    int requester = accept(handoff_socket, nullptr, nullptr);
+    HandoffRecord records[] = {{HANDOFF_LISTENER, NONE},
+                               {HANDOFF_SESSION, HANDOFF_TEST_NODE},
+                               {HANDOFF_SESSION, NONE},
+                               {HANDOFF_SESSION, ROUTER_NODE_ID},
+                               {HANDOFF_END, NONE}};
+    int fds[] = {listener[0], node[0], pending[0], peer[0], -1};
+    for (int i = 0; i < 5; i++) {
+      Handoff::send_record(requester, fds[i], records[i]);
+    }
+    close(requester);
+  });
+  int server_socket = Handoff::take_over(path);
+  old_router.join();
+  close(handoff_socket);
+  unlink(path.c_str());
+
+  EXPECT_TRUE(same_socket(server_socket, listener[0]));
+  auto sessions = Sessions::get_sessions();
+  EXPECT_EQ(sessions.size(), 3u);
+  int found = 0;
+  for (auto &session : sessions) {
+    int socket = session->get_socket();
+    if (same_socket(socket, node[0])) {
+      EXPECT_EQ(session->get_id(), 7);
+      EXPECT_EQ(session->get_read_encoding(), FrameEncoding::PACKED_BCD);
+      EXPECT_EQ(session->get_outbox().get_encoding(), FrameEncoding::ASCII);
+      found++;
+    } else if (same_socket(socket, pending[0])) {
+      EXPECT_EQ(session->get_id(), NONE);
+      found++;
+    } else if (same_socket(socket, peer[0])) {
+      EXPECT_EQ(session->get_id(), ROUTER_NODE_ID);
+      found++;
+    }
+  }
+  EXPECT_EQ(found, 3);
+  EXPECT_EQ(core.endpoints(7), 1u);
+
+  for (auto &session : sessions) {
+    // peer links close their own socket
+    if (session->get_id() == ROUTER_NODE_ID) close(session->get_socket());
+    Sessions::removeSession(session->get_socket());
+  }
+  close(server_socket);
+  for (int *pair : {listener, node, pending, peer}) {
+    close(pair[0]);
+    close(pair[1]);
+  }
+}
+
+TEST(HandoffTest, Test_Flush_Partial_Tail) {
+  RouterCore core;
+  Sessions::init_sessions(
+      16, &core, [](const std::shared_ptr<Session> &, const char *, int) {
+        return true;
+      });
+  int pair[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+  // router sockets are non-blocking
+  fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+  Sessions::accept_client(pair[0]);
+  auto session = Sessions::find_session_by_socket(pair[0]);
+  ASSERT_NE(session, nullptr);
+  Outbox &outbox = session->get_outbox();
+  OutboxBudget budget;
+  bool needs_flush = false;
+  std::string frame = test_frame("0200", '5');
+  for (int i = 0; i < 3; i++) {
+    outbox.push(frame.c_str(), DATA_MESSAGE_SIZE, budget, NONE, needs_flush);
+  }
+  // the last flush sent 20 bytes of a frame, its tail goes out first
+  outbox.put_back(frame.data() + 20, DATA_MESSAGE_SIZE - 20, DATA_MESSAGE_SIZE);
+
+  EXPECT_TRUE(Handoff::flush_outboxes(budget, 1000));
+  std::string expected = frame.substr(20) + frame + frame + frame;
+  std::string received(expected.size(), '\0');
+  EXPECT_EQ(recv(pair[1], received.data(), received.size(), MSG_WAITALL),
+            static_cast<ssize_t>(expected.size()));
+  EXPECT_EQ(received, expected);
+  EXPECT_EQ(outbox.pending_class(), -1);
+
+  // node doesnt read, the handoff is refused and the rest waits in the outbox
+  std::string backlog(1 << 20, '5');
+  outbox.put_back(backlog.data(), backlog.size(), DATA_MESSAGE_SIZE);
+  EXPECT_FALSE(Handoff::flush_outboxes(budget, 20));
+  EXPECT_TRUE(outbox.waiting_writable());
+  EXPECT_NE(outbox.pending_class(), -1);
+
+  session.reset();
+  Sessions::removeSession(pair[0]);
+  close(pair[1]);
+}
+
+/// Drives reads of the router on socketpairs, no event loop or workers run.
+class RouterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Sessions::init_sessions(
+        16, &Router::core_,
+        [](const std::shared_ptr<Session> &dst_session, const char *frame,
+           int src_socket) {
+          return Router::forward(dst_session, frame, src_socket);
+        });
+  }
+
+  void TearDown() override {
+    // flushes of sessions removed by the test find no session
+    do_queued_writes();
+    // senders removed by the test are forgotten
+    Router::sweep_paused_senders();
+    Router::outbox_budget_ = OutboxBudget();
+  }
+
+  static void set_budget(const OutboxBudget &budget) {
+    Router::outbox_budget_ = budget;
+  }
+
+  /**
+   * @brief Reads a ready socket as a read worker does.
+   */
+  static void do_reads(int socket) { Router::do_reads(socket); }
+
+  /**
+   * @brief Runs the flushes queued for write workers, as a write worker does.
+   */
+  static void do_queued_writes() {
+    while (!Router::ready_write_sockets_queue_.idle()) {
+      Router::do_writes(Router::ready_write_sockets_queue_.pop());
+      Router::ready_write_sockets_queue_.task_done();
+    }
+  }
+
+  /**
+   * @brief Registers the router end of a socketpair as a node session.
+   */
+  static std::shared_ptr<Session> add_node(int socket, int node_id) {
+    fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) | O_NONBLOCK);
+    Sessions::accept_client(socket);
+    Sessions::add_node(socket, node_id);
+    return Sessions::find_session_by_socket(socket);
+  }
+};
+
+TEST_F(RouterTest, Test_Paused_Sender_Ready_Again) {
+  OutboxBudget budget;
+  budget.max_frames = 4;
+  budget.policy = SlowConsumerPolicy::BACKPRESSURE;
+  set_budget(budget);
+  int sender[2], receiver[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sender), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, receiver), 0);
+  auto src = add_node(sender[0], 3);
+  auto dst = add_node(receiver[0], 5);
+  ASSERT_NE(src, nullptr);
+  ASSERT_NE(dst, nullptr);
+
+  // the receiver reads nothing, the sender has far more than the budget
+  std::string frames;
+  for (int i = 0; i < 32; i++) frames += "00302001234561111111111111111005";
+  ASSERT_EQ(send(sender[1], frames.data(), frames.size(), 0),
+            static_cast<ssize_t>(frames.size()));
+
+  // the frame over the budget is kept and pauses the sender
+  do_reads(sender[0]);
+  int pending = dst->get_outstanding();
+  EXPECT_EQ(pending, static_cast<int>(budget.max_frames) + 1);
+
+  // the event loop queued the socket again before it got paused
+  for (int i = 0; i < 16; i++) do_reads(sender[0]);
+  EXPECT_EQ(dst->get_outstanding(), pending);
+
+  src.reset();
+  dst.reset();
+  Sessions::removeSession(sender[0]);
+  Sessions::removeSession(receiver[0]);
+  close(sender[1]);
+  close(receiver[1]);
+}
+
+TEST_F(RouterTest, Test_Steady_State_Forwarding_Allocations) {
+  // the hook counts, otherwise a bound below proves nothing
+  AllocCounts before = AllocStats::thread_counts();
+  // stored through volatile, the compiler may drop an unused allocation
+  static int *volatile sink;
+  sink = new int(1);
+  delete sink;
+  EXPECT_EQ(AllocStats::thread_counts().allocations, before.allocations + 1);
+
+  int sender[2], receiver[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sender), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, receiver), 0);
+  ASSERT_NE(add_node(sender[0], 3), nullptr);
+  ASSERT_NE(add_node(receiver[0], 5), nullptr);
+
+  // node 3 sends 16 frames to node 5 per round. the read worker looks the
+  // destination up in Sessions and forwards to its outbox, the flush goes
+  // through the write queue to the write task, node 5 reads them all
+  std::string frames;
+  for (int i = 0; i < 16; i++) frames += "00302001234561111111111111111005";
+  char received[16 * DATA_MESSAGE_SIZE];
+  auto forward = [&](int rounds) {
+    for (int i = 0; i < rounds; i++) {
+      send(sender[1], frames.data(), frames.size(), 0);
+      do_reads(sender[0]);
+      do_queued_writes();
+      ASSERT_EQ(recv(receiver[1], received, sizeof(received), MSG_WAITALL),
+                static_cast<ssize_t>(sizeof(received)));
+    }
+  };
+  // tasks, buffers and queues grow to their steady size first
+  forward(64);
+  before = AllocStats::thread_counts();
+  const int rounds = 4096;
+  forward(rounds);
+  uint64_t allocations = AllocStats::thread_counts().allocations - before.allocations;
+  // the deque of the write queue takes a block every 128 flushes, a flush
+  // carries 16 frames
+  EXPECT_LE(allocations, static_cast<uint64_t>(rounds / 128 + 1));
+
+  Sessions::removeSession(sender[0]);
+  Sessions::removeSession(receiver[0]);
+  close(sender[1]);
+  close(receiver[1]);
+}
+
+TEST(MeshTest, Test_Link_Budget) {
+  OutboxBudget budget;
+  budget.max_frames = 2;
+  budget.policy = SlowConsumerPolicy::DROP_OLDEST;
+  std::string frame = test_frame("0200", '5');
+  char buffer[DATA_MESSAGE_SIZE * 3];
+
+  // data frames over the budget are dropped, the oldest ones are kept
+  int pair[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+  auto session = std::make_shared<Session>(pair[0]);
+  session->close_on_destroy();
+  auto link = std::make_shared<PeerLink>(session, true, budget);
+  session.reset();
+  for (int i = 0; i < 3; i++) link->enqueue(frame.c_str(), frame.size());
+  PeerLink::start(link);
+  EXPECT_EQ(recv(pair[1], buffer, DATA_MESSAGE_SIZE * 2, MSG_WAITALL),
+            DATA_MESSAGE_SIZE * 2);
+  link->close();
+  link->wait_closed();
+  close(pair[1]);
+
+  // an announcement is never dropped, the link is closed instead
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+  session = std::make_shared<Session>(pair[0]);
+  session->close_on_destroy();
+  link = std::make_shared<PeerLink>(session, true, budget);
+  session.reset();
+  for (int node_id = 1; node_id <= 3; node_id++) {
+    std::string control = Message::build_control_frame(CONTROL_ATTACH, node_id);
+    link->enqueue(control.c_str(), control.size());
+  }
+  PeerLink::start(link);
+  link->wait_closed();
+  EXPECT_EQ(recv(pair[1], buffer, sizeof(buffer), 0), 0);
+  // writer released the session, its last reference closed the socket
+  struct stat status;
+  EXPECT_EQ(fstat(pair[0], &status), -1);
+  close(pair[1]);
+}
+
+TEST(MeshTest, Test_Link_Budget_Peer_Not_Reading) {
+  OutboxBudget budget;
+  budget.max_frames = 64;
+  int pair[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+  fcntl(pair[0], F_SETFL, fcntl(pair[0], F_GETFL) | O_NONBLOCK);
+  auto session = std::make_shared<Session>(pair[0]);
+  session->close_on_destroy();
+  auto link = std::make_shared<PeerLink>(session, true, budget);
+  session.reset();
+  PeerLink::start(link);
+
+  // pair[1] is never read, its buffer is full before the writer sends
+  char filler[4096] = {};
+  while (send(pair[0], filler, sizeof(filler), MSG_NOSIGNAL) > 0) {
+  }
+  std::string control = Message::build_control_frame(CONTROL_ATTACH, 1);
+  link->enqueue(control.c_str(), control.size());
+  // the writer is waiting for the socket when announcements go over the budget
+  usleep(50 * 1000);
+  auto closed = std::async(std::launch::async, [&]() { link->wait_closed(); });
+  for (size_t i = 0; i < budget.max_frames + 1; i++) {
+    link->enqueue(control.c_str(), control.size());
+  }
+  bool done = closed.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+  // a stuck writer is released by the failing send, so the test ends anyway
+  close(pair[1]);
+  closed.wait();
+  EXPECT_TRUE(done);
+}
+
+#ifdef ISC_ROUTER_BINARY
+/// Listening port of the first router of the mesh test, the second one listens on the next port.
+#define MESH_TEST_PORT 47620
+
+/**
+ * @brief Starts the router binary linked with a peer router.
+ */
+static pid_t spawn_router(int port, const std::string &peer_ip, int peer_port) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    freopen("/dev/null", "w", stdout);
+    freopen("/dev/null", "w", stderr);
+    std::string port_arg = std::to_string(port);
+    std::string peer_arg = peer_ip + ":" + std::to_string(peer_port);
+    execl(ISC_ROUTER_BINARY, ISC_ROUTER_BINARY, port_arg.c_str(), "--peer",
+          peer_arg.c_str(), (char *)nullptr);
+    _exit(127);
+  }
+  return pid;
+}
+
+/**
+ * @brief Connects a node to a router and handshakes, reads wait at most 100 ms.
+ * @return The socket, -1 if the router doesnt accept connections yet.
+ */
+static int connect_node(int port, int node_id) {
+  int socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (connect(socket_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    close(socket_fd);
+    return -1;
+  }
+  timeval timeout{0, 100 * 1000};
+  setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  char id_message[ID_MESSAGE_SIZE + 1];
+  snprintf(id_message, sizeof(id_message), "%03d", node_id);
+  send(socket_fd, id_message, ID_MESSAGE_SIZE, MSG_NOSIGNAL);
+  return socket_fd;
+}
+
+TEST(MeshTest, Test_Two_Routers_On_Loopback) {
+  // both routers peer each other, they keep one of the two links
+  pid_t first = spawn_router(MESH_TEST_PORT, "127.0.0.1", MESH_TEST_PORT + 1);
+  pid_t second = spawn_router(MESH_TEST_PORT + 1, "127.0.0.1", MESH_TEST_PORT);
+  int sender = -1, receiver = -1;
+  for (int i = 0; i < 50 && (sender == -1 || receiver == -1); i++) {
+    usleep(100 * 1000);
+    if (sender == -1) sender = connect_node(MESH_TEST_PORT, 3);
+    if (receiver == -1) receiver = connect_node(MESH_TEST_PORT + 1, 5);
+  }
+
+  // frames are dropped until the routers linked and announced their nodes
+  std::string frame = "00302001234561111111111111111005";
+  std::string received;
+  for (int i = 0; i < 50 && sender != -1 && receiver != -1 &&
+                  received.size() < DATA_MESSAGE_SIZE;
+       i++) {
+    send(sender, frame.data(), frame.size(), MSG_NOSIGNAL);
+    char buffer[DATA_MESSAGE_SIZE];
+    ssize_t count;
+    while (received.size() < DATA_MESSAGE_SIZE &&
+           (count = recv(receiver, buffer,
+                         DATA_MESSAGE_SIZE - received.size(), 0)) > 0) {
+      received.append(buffer, count);
+    }
+  }
+
+  for (int socket_fd : {sender, receiver}) {
+    if (socket_fd != -1) close(socket_fd);
+  }
+  for (pid_t pid : {first, second}) {
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+  }
+  EXPECT_NE(sender, -1);
+  EXPECT_NE(receiver, -1);
+  EXPECT_EQ(received, frame);
+}
+
+TEST(MeshTest, Test_Router_Handshake_From_Unknown_Address) {
+  // the only peer is on another loopback address, connections of the test
+  // come from 127.0.0.1
+  pid_t router = spawn_router(MESH_TEST_PORT + 2, "127.0.0.2", MESH_TEST_PORT + 3);
+  int intruder = -1;
+  for (int i = 0; i < 50 && intruder == -1; i++) {
+    usleep(100 * 1000);
+    intruder = connect_node(MESH_TEST_PORT + 2, ROUTER_NODE_ID);
+  }
+  // refused link is closed, reads end instead of timing out
+  ssize_t count = -1;
+  char buffer[DATA_MESSAGE_SIZE];
+  for (int i = 0; i < 20 && intruder != -1 && count == -1; i++) {
+    count = recv(intruder, buffer, sizeof(buffer), 0);
+  }
+
+  if (intruder != -1) close(intruder);
+  kill(router, SIGTERM);
+  waitpid(router, nullptr, 0);
+  EXPECT_NE(intruder, -1);
+  EXPECT_EQ(count, 0);
+}
+
+TEST(MeshTest, Test_Router_Hello_From_Unknown_Port) {
+  // connections of the test come from the peer IP, only the port in their
+  // hello tells the listed peer from any other local process
+  pid_t router = spawn_router(MESH_TEST_PORT + 4, "127.0.0.1", MESH_TEST_PORT + 5);
+  auto link_as = [](int listen_port) {
+    int link = -1;
+    for (int i = 0; i < 50 && link == -1; i++) {
+      link = connect_node(MESH_TEST_PORT + 4, ROUTER_NODE_ID);
+      if (link == -1) usleep(100 * 1000);
+    }
+    if (link == -1) return link;
+    std::string hello = Message::build_hello_frame(1, listen_port);
+    send(link, hello.data(), hello.size(), MSG_NOSIGNAL);
+    return link;
+  };
+  // reads the hello and announcements of the router, then the end of a
+  // refused link or the timeout of a kept one
+  auto read_until_quiet = [](int link) {
+    char buffer[DATA_MESSAGE_SIZE];
+    ssize_t count;
+    while ((count = recv(link, buffer, sizeof(buffer), 0)) > 0) {
+    }
+    return count;
+  };
+
+  int intruder = link_as(MESH_TEST_PORT + 6);
+  int peer = link_as(MESH_TEST_PORT + 5);
+  ssize_t intruder_count = -1;
+  for (int i = 0; i < 20 && intruder != -1 && intruder_count == -1; i++) {
+    intruder_count = read_until_quiet(intruder);
+  }
+  ssize_t peer_count = peer != -1 ? read_until_quiet(peer) : 0;
+
+  for (int link : {intruder, peer}) {
+    if (link != -1) close(link);
+  }
+  kill(router, SIGTERM);
+  waitpid(router, nullptr, 0);
+  EXPECT_NE(intruder, -1);
+  EXPECT_NE(peer, -1);
+  EXPECT_EQ(intruder_count, 0);
+  EXPECT_EQ(peer_count, -1);
+}
+#endif
+#endif
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  // router components log to the console and file loggers, tests discard it
+  for (const char *name : {"console", "file"}) {
+    spdlog::register_logger(std::make_shared<spdlog::logger>(
+        name, std::make_shared<spdlog::sinks::null_sink_mt>()));
+  }
+  return RUN_ALL_TESTS();
+}